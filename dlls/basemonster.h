@@ -98,6 +98,8 @@ public:
 	float m_flDistTooFar; // if enemy farther away than this, bits_COND_ENEMY_TOOFAR set in CheckEnemy
 	float m_flDistLook;	  // distance monster sees (Default 2048)
 
+	float m_flLastSenseTime; // last time the perception manager let this monster Look and Listen while it was low priority.
+
 	int m_iTriggerCondition;	 // for scripted AI, this is the condition that will cause the activation of the monster's TriggerTarget
 	string_t m_iszTriggerTarget; // name of target that should be fired.
 
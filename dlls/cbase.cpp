@@ -444,6 +444,9 @@ void DispatchObjectCollsionBox(edict_t* pent)
 	}
 	else
 		SetObjectCollisionBox(&pent->v);
+
+	// The engine calls this whenever the entity is relinked, so it moved or changed size.
+	UTIL_UpdateEntityGrid(pent);
 }
 
 
@@ -37,6 +37,8 @@
 #include "spectator.h"
 #include "client.h"
 #include "soundent.h"
+#include "perception.h"
+#include "profiler.h"
 #include "gamerules.h"
 #include "game.h"
 #include "customentity.h"
@@ -57,6 +59,9 @@ extern DLL_GLOBAL bool g_fGameOver;
 extern DLL_GLOBAL int g_iSkillLevel;
 DLL_GLOBAL unsigned int g_ulFrameCount;
 
+// Bumped whenever entities may have changed since the last client update was built, see PackEntity
+static unsigned int g_ulPackFrame = 1;
+
 extern void CopyToBodyQue(entvars_t* pev);
 
 void LinkUserMessages();
@@ -525,6 +530,9 @@ void ClientCommand(edict_t* pEntity)
 	if (!pEntity->pvPrivateData)
 		return;
 
+	// Commands run while the game is paused too, when there are no frames.
+	g_ulPackFrame++;
+
 	entvars_t* pev = &pEntity->v;
 
 	auto player = GetClassPtr<CBasePlayer>(reinterpret_cast<CBasePlayer*>(&pEntity->v));
@@ -786,6 +794,8 @@ void ServerDeactivate()
 
 	// Peform any shutdown operations here...
 	//
+	UTIL_ResetEntityGrid();
+	g_PerceptionManager.Reset();
 }
 
 void ServerActivate(edict_t* pEdictList, int edictCount, int clientMax)
@@ -973,6 +983,15 @@ static bool g_LastAllowBunnyHoppingState = false;
 //
 void StartFrame()
 {
+	g_FrameProfiler.BeginFrame(sv_profile.value != 0);
+
+	PROFILE_SCOPE("StartFrame");
+
+	g_ulPackFrame++;
+
+	UTIL_RebuildEntityGrid();
+	g_PerceptionManager.StartFrame();
+
 	if (g_pGameRules)
 		g_pGameRules->Think();
 
@@ -1298,87 +1317,73 @@ void SetupVisibility(edict_t* pViewEntity, edict_t* pClient, unsigned char** pvs
 #include "entity_state.h"
 
 /*
-AddToFullPack
-
-Return 1 if the entity state has been filled in for the ent and the entity will be propagated to the client, 0 otherwise
+PackEntity
 
-state is the server maintained copy of the state info that is transmitted to the client
-a MOD could alter values copied into state to send the "host" a different look for a particular entity update, etc.
-e and ent are the entity that is being added to the update, if 1 is returned
-host is the player's edict of the player whom we are sending the update to
-player is 1 if the ent/e is a player and 0 otherwise
-pSet is either the PAS or PVS that we previous set up.  We can use it to ask the engine to filter the entity against the PAS or PVS.
-we could also use the pas/ pvs that we set in SetupVisibility, if we wanted to.  Caching the value is valid in that case, but still only for the current frame
+AddToFullPack is called for every entity for every client. Everything about an entity that doesn't
+depend on the client is worked out by the first call for it each frame, and kept for the other clients.
+The engine builds every client's update after the frame's physics, so nothing changes in between.
 */
-int AddToFullPack(struct entity_state_s* state, int e, edict_t* ent, edict_t* host, int hostflags, int player, unsigned char* pSet)
+enum
 {
-	// Entities with an index greater than this will corrupt the client's heap because 
-	// the index is sent with only 11 bits of precision (2^11 == 2048).
-	// So we don't send them, just like having too many entities would result
-	// in the entity not being sent.
-	if (e >= MAX_EDICTS)
+	PACK_NOMODEL = 1 << 0,		 // never sent
+	PACK_NODRAW = 1 << 1,		 // only sent to itself
+	PACK_SPECTATOR = 1 << 2,	 // only sent to itself
+	PACK_SKIPLOCALHOST = 1 << 3, // not sent to its owner if the owner predicts it
+};
+
+struct PackedEntity
+{
+	unsigned int frame; // g_ulPackFrame it was packed in
+	int flags;
+	int groupinfo;
+	edict_t* owner;
+};
+
+static std::vector<PackedEntity> g_PackedEntities;
+static std::vector<entity_state_t> g_PackedStates;
+
+static const PackedEntity& PackEntity(int e, edict_t* ent, int player)
+{
+	if (static_cast<std::size_t>(e) >= g_PackedEntities.size())
 	{
-		return 0;
+		const int size = std::min(MAX_EDICTS, std::max(e + 1, gpGlobals->maxEntities));
+
+		g_PackedEntities.resize(size);
+		g_PackedStates.resize(size);
 	}
 
-	int i;
+	PackedEntity& packed = g_PackedEntities[e];
 
-	auto entity = reinterpret_cast<CBaseEntity*>(GET_PRIVATE(ent));
+	if (packed.frame == g_ulPackFrame)
+		return packed;
 
-	// don't send if flagged for NODRAW and it's not the host getting the message
-	if ((ent->v.effects & EF_NODRAW) != 0 &&
-		(ent != host))
-		return 0;
+	packed.frame = g_ulPackFrame;
+	packed.flags = 0;
 
 	// Ignore ents without valid / visible models
 	if (0 == ent->v.modelindex || !STRING(ent->v.model))
-		return 0;
-
-	// Don't send spectators to other players
-	if ((ent->v.flags & FL_SPECTATOR) != 0 && (ent != host))
 	{
-		return 0;
+		packed.flags = PACK_NOMODEL;
+		return packed;
 	}
 
-	// Ignore if not the host and not touching a PVS/PAS leaf
-	// If pSet is NULL, then the test will always succeed and the entity will be added to the update
-	if (ent != host)
-	{
-		if (!ENGINE_CHECK_VISIBILITY((const struct edict_s*)ent, pSet))
-		{
-			return 0;
-		}
-	}
+	if ((ent->v.effects & EF_NODRAW) != 0)
+		packed.flags |= PACK_NODRAW;
 
+	if ((ent->v.flags & FL_SPECTATOR) != 0)
+		packed.flags |= PACK_SPECTATOR;
 
-	// Don't send entity to local client if the client says it's predicting the entity itself.
 	if ((ent->v.flags & FL_SKIPLOCALHOST) != 0)
-	{
-		if ((hostflags & 1) != 0 && (ent->v.owner == host))
-			return 0;
-	}
+		packed.flags |= PACK_SKIPLOCALHOST;
 
-	if (0 != host->v.groupinfo)
-	{
-		UTIL_SetGroupTrace(host->v.groupinfo, GROUP_OP_AND);
+	packed.groupinfo = ent->v.groupinfo;
+	packed.owner = ent->v.owner;
 
-		// Should always be set, of course
-		if (0 != ent->v.groupinfo)
-		{
-			if (g_groupop == GROUP_OP_AND)
-			{
-				if ((ent->v.groupinfo & host->v.groupinfo) == 0)
-					return 0;
-			}
-			else if (g_groupop == GROUP_OP_NAND)
-			{
-				if ((ent->v.groupinfo & host->v.groupinfo) != 0)
-					return 0;
-			}
-		}
+	int i;
 
-		UTIL_UnsetGroupTrace();
-	}
+	auto entity = reinterpret_cast<CBaseEntity*>(GET_PRIVATE(ent));
+
+	entity_state_t* state = &g_PackedStates[e];
 
 	memset(state, 0, sizeof(*state));
 
@@ -1418,12 +1423,6 @@ int AddToFullPack(struct entity_state_s* state, int e, edict_t* ent, edict_t* ho
 	state->skin = ent->v.skin;
 	state->effects = ent->v.effects;
 
-	//Remove the night vision illumination effect so other players don't see it
-	if (0 != player && host != ent)
-	{
-		state->effects &= ~EF_BRIGHTLIGHT;
-	}
-
 	// This non-player entity is being moved by the game .dll and not the physics simulation system
 	//  make sure that we interpolate it's position on the client if it moves
 	/*
@@ -1516,12 +1515,97 @@ int AddToFullPack(struct entity_state_s* state, int e, edict_t* ent, edict_t* ho
 		state->health = ent->v.health;
 	}
 
-	CBaseEntity* pEntity = static_cast<CBaseEntity*>(GET_PRIVATE(ent));
-	if (pEntity && pEntity->Classify() != CLASS_NONE && pEntity->Classify() != CLASS_MACHINE)
+	if (entity && entity->Classify() != CLASS_NONE && entity->Classify() != CLASS_MACHINE)
 		state->eflags |= EFLAG_FLESH_SOUND;
 	else
 		state->eflags &= ~EFLAG_FLESH_SOUND;
 
+	return packed;
+}
+
+/*
+AddToFullPack
+
+Return 1 if the entity state has been filled in for the ent and the entity will be propagated to the client, 0 otherwise
+
+state is the server maintained copy of the state info that is transmitted to the client
+a MOD could alter values copied into state to send the "host" a different look for a particular entity update, etc.
+e and ent are the entity that is being added to the update, if 1 is returned
+host is the player's edict of the player whom we are sending the update to
+player is 1 if the ent/e is a player and 0 otherwise
+pSet is either the PAS or PVS that we previous set up.  We can use it to ask the engine to filter the entity against the PAS or PVS.
+we could also use the pas/ pvs that we set in SetupVisibility, if we wanted to.  Caching the value is valid in that case, but still only for the current frame
+*/
+int AddToFullPack(struct entity_state_s* state, int e, edict_t* ent, edict_t* host, int hostflags, int player, unsigned char* pSet)
+{
+	PROFILE_SCOPE("AddToFullPack");
+
+	// Entities with an index greater than this will corrupt the client's heap because 
+	// the index is sent with only 11 bits of precision (2^11 == 2048).
+	// So we don't send them, just like having too many entities would result
+	// in the entity not being sent.
+	if (e >= MAX_EDICTS)
+	{
+		return 0;
+	}
+
+	const PackedEntity& packed = PackEntity(e, ent, player);
+
+	if ((packed.flags & PACK_NOMODEL) != 0)
+		return 0;
+
+	if (ent != host)
+	{
+		// don't send if flagged for NODRAW and it's not the host getting the message
+		// Don't send spectators to other players
+		if ((packed.flags & (PACK_NODRAW | PACK_SPECTATOR)) != 0)
+			return 0;
+
+		// Ignore if not touching a PVS/PAS leaf
+		// If pSet is NULL, then the test will always succeed and the entity will be added to the update
+		if (!ENGINE_CHECK_VISIBILITY((const struct edict_s*)ent, pSet))
+		{
+			return 0;
+		}
+	}
+
+	// Don't send entity to local client if the client says it's predicting the entity itself.
+	if ((packed.flags & PACK_SKIPLOCALHOST) != 0)
+	{
+		if ((hostflags & 1) != 0 && (packed.owner == host))
+			return 0;
+	}
+
+	if (0 != host->v.groupinfo)
+	{
+		UTIL_SetGroupTrace(host->v.groupinfo, GROUP_OP_AND);
+
+		// Should always be set, of course
+		if (0 != packed.groupinfo)
+		{
+			if (g_groupop == GROUP_OP_AND)
+			{
+				if ((packed.groupinfo & host->v.groupinfo) == 0)
+					return 0;
+			}
+			else if (g_groupop == GROUP_OP_NAND)
+			{
+				if ((packed.groupinfo & host->v.groupinfo) != 0)
+					return 0;
+			}
+		}
+
+		UTIL_UnsetGroupTrace();
+	}
+
+	*state = g_PackedStates[e];
+
+	//Remove the night vision illumination effect so other players don't see it
+	if (0 != player && host != ent)
+	{
+		state->effects &= ~EF_BRIGHTLIGHT;
+	}
+
 	return 1;
 }
 
@@ -1601,6 +1685,29 @@ static entity_field_alias_t entity_field_alias[] =
 		{"angles[2]", 0},
 };
 
+// What delta.lst scales origins and angles by before sending them. Keep these in sync with it.
+constexpr float ENTITY_ORIGIN_SCALE = 8.0f;
+constexpr float PLAYER_ORIGIN_SCALE = 32.0f;
+constexpr float ANGLE_SCALE = 65536.0f / 360.0f; // DT_ANGLE, 16 bits
+constexpr int ANGLE_MASK = 0xFFFF;
+
+/*
+==================
+UnsetQuantizedFields
+
+The engine sends a field whenever its value changes, even if the client gets the same value
+once it's been scaled and cut to the field's bits. Don't send those.
+==================
+*/
+static void UnsetQuantizedFields(struct delta_s* pFields, const entity_field_alias_t* alias, const float* from, const float* to, float scale, int mask)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if (((int)(from[i] * scale) & mask) == ((int)(to[i] * scale) & mask))
+			DELTA_UNSETBYINDEX(pFields, alias[i].field);
+	}
+}
+
 void Entity_FieldInit(struct delta_s* pFields)
 {
 	entity_field_alias[FIELD_ORIGIN0].field = DELTA_FINDFIELD(pFields, entity_field_alias[FIELD_ORIGIN0].name);
@@ -1633,6 +1740,12 @@ void Entity_Encode(struct delta_s* pFields, const unsigned char* from, const uns
 	f = (entity_state_t*)from;
 	t = (entity_state_t*)to;
 
+	if (sv_delta_quantize.value != 0)
+	{
+		UnsetQuantizedFields(pFields, &entity_field_alias[FIELD_ORIGIN0], f->origin, t->origin, ENTITY_ORIGIN_SCALE, -1);
+		UnsetQuantizedFields(pFields, &entity_field_alias[FIELD_ANGLES0], f->angles, t->angles, ANGLE_SCALE, ANGLE_MASK);
+	}
+
 	// Never send origin to local player, it's sent with more resolution in clientdata_t structure
 	const bool localplayer = (t->number - 1) == ENGINE_CURRENT_PLAYER();
 	if (localplayer)
@@ -1673,6 +1786,9 @@ static entity_field_alias_t player_field_alias[] =
 		{"origin[0]", 0},
 		{"origin[1]", 0},
 		{"origin[2]", 0},
+		{"angles[0]", 0},
+		{"angles[1]", 0},
+		{"angles[2]", 0},
 };
 
 void Player_FieldInit(struct delta_s* pFields)
@@ -1680,6 +1796,9 @@ void Player_FieldInit(struct delta_s* pFields)
 	player_field_alias[FIELD_ORIGIN0].field = DELTA_FINDFIELD(pFields, player_field_alias[FIELD_ORIGIN0].name);
 	player_field_alias[FIELD_ORIGIN1].field = DELTA_FINDFIELD(pFields, player_field_alias[FIELD_ORIGIN1].name);
 	player_field_alias[FIELD_ORIGIN2].field = DELTA_FINDFIELD(pFields, player_field_alias[FIELD_ORIGIN2].name);
+	player_field_alias[FIELD_ANGLES0].field = DELTA_FINDFIELD(pFields, player_field_alias[FIELD_ANGLES0].name);
+	player_field_alias[FIELD_ANGLES1].field = DELTA_FINDFIELD(pFields, player_field_alias[FIELD_ANGLES1].name);
+	player_field_alias[FIELD_ANGLES2].field = DELTA_FINDFIELD(pFields, player_field_alias[FIELD_ANGLES2].name);
 }
 
 /*
@@ -1703,6 +1822,12 @@ void Player_Encode(struct delta_s* pFields, const unsigned char* from, const uns
 	f = (entity_state_t*)from;
 	t = (entity_state_t*)to;
 
+	if (sv_delta_quantize.value != 0)
+	{
+		UnsetQuantizedFields(pFields, &player_field_alias[FIELD_ORIGIN0], f->origin, t->origin, PLAYER_ORIGIN_SCALE, -1);
+		UnsetQuantizedFields(pFields, &player_field_alias[FIELD_ANGLES0], f->angles, t->angles, ANGLE_SCALE, ANGLE_MASK);
+	}
+
 	// Never send origin to local player, it's sent with more resolution in clientdata_t structure
 	const bool localplayer = (t->number - 1) == ENGINE_CURRENT_PLAYER();
 	if (localplayer)
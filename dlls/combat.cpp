@@ -29,6 +29,7 @@
 #include "animation.h"
 #include "weapons.h"
 #include "func_break.h"
+#include "perception.h"
 
 extern Vector VecBModelOrigin(entvars_t* pevBModel);
 
@@ -1247,7 +1248,6 @@ bool CBaseMonster::FInViewCone(Vector* pOrigin)
 //=========================================================
 bool CBaseEntity::FVisible(CBaseEntity* pEntity)
 {
-	TraceResult tr;
 	Vector vecLookerOrigin;
 	Vector vecTargetOrigin;
 
@@ -1261,16 +1261,8 @@ bool CBaseEntity::FVisible(CBaseEntity* pEntity)
 	vecLookerOrigin = pev->origin + pev->view_ofs; //look through the caller's 'eyes'
 	vecTargetOrigin = pEntity->EyePosition();
 
-	UTIL_TraceLine(vecLookerOrigin, vecTargetOrigin, ignore_monsters, ignore_glass, ENT(pev) /*pentIgnore*/, &tr);
-
-	if (tr.flFraction != 1.0)
-	{
-		return false; // Line of sight is not established
-	}
-	else
-	{
-		return true; // line of sight is valid.
-	}
+	// Monsters looking at each other in the same frame share one trace.
+	return g_PerceptionManager.LineOfSight(this, vecLookerOrigin, pEntity, vecTargetOrigin);
 }
 
 //=========================================================
@@ -18,6 +18,7 @@
 #include "client.h"
 #include "game.h"
 #include "filesystem_utils.h"
+#include "profiler.h"
 
 cvar_t displaysoundlist = {"displaysoundlist", "0"};
 
@@ -575,6 +576,16 @@ cvar_t sk_player_leg3 = {"sk_player_leg3", "1"};
 
 cvar_t sv_pushable_fixed_tick_fudge = {"sv_pushable_fixed_tick_fudge", "15"};
 
+// Number of threads used to build node graph routing tables, 0 to use all cores.
+cvar_t sv_nodegraph_threads = {"sv_nodegraph_threads", "0"};
+
+// Monster perception scheduling, see perception.h. Both 0 to let every monster sense every think.
+cvar_t sv_ai_perception_budget = {"sv_ai_perception_budget", "0"};		// idle or faraway monsters allowed to sense per frame.
+cvar_t sv_ai_perception_interval = {"sv_ai_perception_interval", "0"};	// seconds between senses for idle or faraway monsters.
+cvar_t sv_ai_perception_near_dist = {"sv_ai_perception_near_dist", "1024"}; // monsters closer than this to a player aren't faraway.
+cvar_t sv_profile = {"sv_profile", "0"}; // record profiler zones each frame, see sv_profile_dump.
+cvar_t sv_delta_quantize = {"sv_delta_quantize", "0"}; // don't send origins and angles that only change below the precision in delta.lst.
+
 // BEGIN Opposing Force variables
 
 cvar_t ctfplay = {"mp_ctfplay", "0", FCVAR_SERVER};
@@ -1175,6 +1186,12 @@ void GameDLLInit()
 	// END REGISTER CVARS FOR SKILL LEVEL STUFF
 
 	CVAR_REGISTER(&sv_pushable_fixed_tick_fudge);
+	CVAR_REGISTER(&sv_nodegraph_threads);
+	CVAR_REGISTER(&sv_ai_perception_budget);
+	CVAR_REGISTER(&sv_ai_perception_interval);
+	CVAR_REGISTER(&sv_ai_perception_near_dist);
+	CVAR_REGISTER(&sv_profile);
+	CVAR_REGISTER(&sv_delta_quantize);
 
 	// BEGIN REGISTER CVARS FOR OPPOSING FORCE
 
@@ -1196,6 +1213,7 @@ void GameDLLInit()
 	// END REGISTER CVARS FOR OPPOSING FORCE
 
 	InitMapLoadingUtils();
+	Profiler_RegisterCommands();
 
 	SERVER_COMMAND("exec skill.cfg\n");
 	SERVER_COMMAND("exec skillopfor.cfg\n");
@@ -42,6 +42,12 @@ extern cvar_t allow_spectators;
 extern cvar_t mp_chattime;
 
 extern cvar_t sv_allowbunnyhopping;
+extern cvar_t sv_nodegraph_threads;
+extern cvar_t sv_ai_perception_budget;
+extern cvar_t sv_ai_perception_interval;
+extern cvar_t sv_ai_perception_near_dist;
+extern cvar_t sv_profile;
+extern cvar_t sv_delta_quantize;
 
 extern cvar_t ctf_capture;
 extern cvar_t oldweapons;
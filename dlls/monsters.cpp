@@ -33,6 +33,7 @@
 #include "decals.h"
 #include "soundent.h"
 #include "gamerules.h"
+#include "profiler.h"
 
 #define MONSTER_CUT_CORNER_DIST 8 // 8 means the monster's bounding box is contained without the box of the node in WC
 
@@ -191,7 +192,6 @@ void CBaseMonster::BarnacleVictimReleased()
 //=========================================================
 void CBaseMonster::Listen()
 {
-	int iSound;
 	int iMySounds;
 	float hearingSensitivity;
 	CSound* pCurrentSound;
@@ -209,19 +209,23 @@ void CBaseMonster::Listen()
 		iMySounds &= m_pSchedule->iSoundMask;
 	}
 
-	iSound = CSoundEnt::ActiveList();
-
 	// UNDONE: Clear these here?
 	ClearConditions(bits_COND_HEAR_SOUND | bits_COND_SMELL_FOOD | bits_COND_SMELL);
 	hearingSensitivity = HearingSensitivity();
 
-	while (iSound != SOUNDLIST_EMPTY)
+	const Vector vecEarPosition = EarPosition();
+
+	// Only the sounds in grid cells close enough to be heard, in active list order.
+	for (int iSound : CSoundEnt::SoundsNear(vecEarPosition, hearingSensitivity))
 	{
 		pCurrentSound = CSoundEnt::SoundPointerForIndex(iSound);
 
+		const float flHearingDistance = pCurrentSound ? pCurrentSound->m_iVolume * hearingSensitivity : 0;
+
 		if (nullptr != pCurrentSound &&
 			(pCurrentSound->m_iType & iMySounds) != 0 &&
-			(pCurrentSound->m_vecOrigin - EarPosition()).Length() <= pCurrentSound->m_iVolume * hearingSensitivity)
+			flHearingDistance >= 0 &&
+			(pCurrentSound->m_vecOrigin - vecEarPosition).LengthSquared() <= flHearingDistance * flHearingDistance)
 
 		//if ( ( g_pSoundEnt->m_SoundPool[ iSound ].m_iType & iMySounds ) && ( g_pSoundEnt->m_SoundPool[ iSound ].m_vecOrigin - EarPosition()).Length () <= g_pSoundEnt->m_SoundPool[ iSound ].m_iVolume * hearingSensitivity )
 		{
@@ -257,9 +261,6 @@ void CBaseMonster::Listen()
 
 			m_iAudibleList = iSound;
 		}
-
-		//		iSound = g_pSoundEnt->m_SoundPool[ iSound ].m_iNext;
-		iSound = pCurrentSound->m_iNext;
 	}
 }
 
@@ -410,7 +411,7 @@ CSound* CBaseMonster::PBestSound()
 {
 	int iThisSound;
 	int iBestSound = -1;
-	float flBestDist = 8192; // so first nearby sound will become best so far.
+	float flBestDist = 8192 * 8192; // so first nearby sound will become best so far. (squared)
 	float flDist;
 	CSound* pSound;
 
@@ -431,7 +432,7 @@ CSound* CBaseMonster::PBestSound()
 
 		if (pSound && pSound->FIsSound())
 		{
-			flDist = (pSound->m_vecOrigin - EarPosition()).Length();
+			flDist = (pSound->m_vecOrigin - EarPosition()).LengthSquared();
 
 			if (flDist < flBestDist)
 			{
@@ -461,7 +462,7 @@ CSound* CBaseMonster::PBestScent()
 {
 	int iThisScent;
 	int iBestScent = -1;
-	float flBestDist = 8192; // so first nearby smell will become best so far.
+	float flBestDist = 8192 * 8192; // so first nearby smell will become best so far. (squared)
 	float flDist;
 	CSound* pSound;
 
@@ -482,7 +483,7 @@ CSound* CBaseMonster::PBestScent()
 
 		if (pSound->FIsScent())
 		{
-			flDist = (pSound->m_vecOrigin - pev->origin).Length();
+			flDist = (pSound->m_vecOrigin - pev->origin).LengthSquared();
 
 			if (flDist < flBestDist)
 			{
@@ -513,6 +514,8 @@ CSound* CBaseMonster::PBestScent()
 //=========================================================
 void CBaseMonster::MonsterThink()
 {
+	PROFILE_SCOPE("CBaseMonster::MonsterThink");
+
 	pev->nextthink = gpGlobals->time + 0.1; // keep monster thinking.
 
 
@@ -2018,6 +2021,7 @@ void CBaseMonster::MonsterInit()
 	m_IdealActivity = ACT_IDLE;
 
 	SetBits(pev->flags, FL_MONSTER);
+	UTIL_UpdateEntityGrid(edict());
 	if ((pev->spawnflags & SF_MONSTER_HITMONSTERCLIP) != 0)
 		pev->flags |= FL_MONSTERCLIP;
 
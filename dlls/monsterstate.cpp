@@ -24,6 +24,7 @@
 #include "animation.h"
 #include "saverestore.h"
 #include "soundent.h"
+#include "perception.h"
 
 //=========================================================
 // SetState
@@ -79,7 +80,8 @@ void CBaseMonster::RunAI()
 		// things will happen before the player gets there!
 		// UPDATE: We now let COMBAT state monsters think and act fully outside of player PVS. This allows the player to leave
 		// an area where monsters are fighting, and the fight will continue.
-		if (!FNullEnt(FIND_CLIENT_IN_PVS(edict())) || (m_MonsterState == MONSTERSTATE_COMBAT))
+		// The perception manager spreads idle and faraway monsters out over several frames.
+		if ((!FNullEnt(FIND_CLIENT_IN_PVS(edict())) || (m_MonsterState == MONSTERSTATE_COMBAT)) && g_PerceptionManager.ShouldSense(this))
 		{
 			Look(m_flDistLook);
 			Listen(); // check for audible sounds.
@@ -16,9 +16,14 @@
 // nodes.cpp - AI node tree stuff.
 //=========================================================
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <functional>
 #include <limits>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "extdll.h"
 #include "util.h"
@@ -28,6 +33,8 @@
 #include "animation.h"
 #include "doors.h"
 #include "filesystem_utils.h"
+#include "game.h"
+#include "profiler.h"
 
 #define HULL_STEP_SIZE 16 // how far the test hull moves on each step
 #define NODE_HEIGHT 8	  // how high to lift nodes off the ground after we drop them all (make stair/ramp mapping easier)
@@ -74,14 +81,17 @@ void CGraph::InitGraph()
 		m_pNodes = NULL;
 	}
 
-	if (m_di)
+	// Free the routing info. If the graph was mapped, the route info
+	// and hash links belong to the mapping.
+	//
+	if (m_pGraphFile)
 	{
-		free(m_di);
-		m_di = NULL;
+		delete m_pGraphFile;
+		m_pGraphFile = NULL;
+		m_pRouteInfo = NULL;
+		m_pHashLinks = NULL;
 	}
 
-	// Free the routing info.
-	//
 	if (m_pRouteInfo)
 	{
 		free(m_pRouteInfo);
@@ -94,6 +104,9 @@ void CGraph::InitGraph()
 		m_pHashLinks = NULL;
 	}
 
+	FreeNodeGrid();
+	FreeNodeClusters();
+
 	// Zero node and link counts
 	//
 	m_cNodes = 0;
@@ -577,6 +590,8 @@ int CGraph::NextNodeInRoute(int iCurrentNode, int iDest, int iHull, int iCap)
 //=========================================================
 int CGraph::FindShortestPath(int* piPath, int iStart, int iDest, int iHull, int afCapMask)
 {
+	PROFILE_SCOPE("CGraph::FindShortestPath");
+
 	int iVisitNode;
 	int iCurrentNode;
 	int iNumPathNodes;
@@ -636,6 +651,28 @@ int CGraph::FindShortestPath(int* piPath, int iStart, int iDest, int iHull, int
 		//ALERT( at_aiconsole, "SVD: Path with %d nodes.\n", iNumPathNodes);
 	}
 	else
+	{
+		// Long searches go through the cluster entrances, this falls back to searching
+		// every node if the clusters aren't built or their portal costs are out of date.
+		//
+		iNumPathNodes = -1;
+
+		// Graphs loaded with routing tables never get here, so the clusters are only
+		// built on the first search that needs them.
+		//
+		if (0 == m_fClustersBuilt)
+		{
+			BuildNodeClusters();
+			m_fClustersBuilt = 1;
+		}
+
+		if (m_pClusters && m_pNodeCluster[iStart] != m_pNodeCluster[iDest])
+		{
+			iNumPathNodes = FindClusterPath(piPath, iStart, iDest, iHull, afCapMask);
+		}
+	}
+
+	if (0 == m_fRoutingComplete && iNumPathNodes < 0)
 	{
 		CQueuePriority queue;
 
@@ -774,84 +811,273 @@ int CGraph::FindShortestPath(int* piPath, int iStart, int iDest, int iHull, int
 	return iNumPathNodes;
 }
 
-inline unsigned int Hash(void* p, int len)
+//=========================================================
+// Open list entry for the cluster searches.
+//=========================================================
+typedef struct
+{
+	float flEstimate; // distance so far plus the straight line distance left.
+	float flDistance;
+	int iNode;
+} NODE_SEARCH_ENTRY;
+
+static bool operator<(const NODE_SEARCH_ENTRY& lhs, const NODE_SEARCH_ENTRY& rhs)
 {
-	CRC32_t ulCrc;
-	CRC32_INIT(&ulCrc);
-	CRC32_PROCESS_BUFFER(&ulCrc, p, len);
-	return CRC32_FINAL(ulCrc);
+	// std::push_heap keeps the largest entry on top, we want the smallest.
+	return lhs.flEstimate > rhs.flEstimate;
 }
 
-void inline CalcBounds(int& Lower, int& Upper, int Goal, int Best)
+// Only used on the game thread, kept around so searches don't allocate.
+static std::vector<NODE_SEARCH_ENTRY> g_NodeSearchHeap;
+static std::vector<int> g_NodeSearchPath;
+
+static int NodeHullLinkMask(int iHull)
 {
-	int Temp = 2 * Goal - Best;
-	if (Best > Goal)
-	{
-		Lower = V_max(0, Temp);
-		Upper = Best;
-	}
-	else
+	switch (iHull)
 	{
-		Upper = V_min(255, Temp);
-		Lower = Best;
+	case NODE_SMALL_HULL:
+		return bits_LINK_SMALL_HULL;
+	case NODE_HUMAN_HULL:
+		return bits_LINK_HUMAN_HULL;
+	case NODE_LARGE_HULL:
+		return bits_LINK_LARGE_HULL;
+	case NODE_FLY_HULL:
+	default:
+		return bits_LINK_FLY_HULL;
 	}
 }
 
-// Convert from [-8192,8192] to [0, 255]
+//=========================================================
+// CGraph - FindClusterPath - A* over the cluster
+// abstraction. Nodes in the start and destination clusters
+// are expanded through their links, nodes in any other
+// cluster (which are always entrances) through their links
+// out of the cluster and the precomputed portal costs to the
+// cluster's other entrances. The portal hops are then
+// refined into nodes with a search inside the cluster.
 //
-inline int CALC_RANGE(int x, int lower, int upper)
+// Returns the number of nodes copied into piPath (at most
+// MAX_PATH_SIZE), 0 if there is no path, or -1 if the
+// portal costs don't match the graph anymore.
+//=========================================================
+int CGraph::FindClusterPath(int* piPath, int iStart, int iDest, int iHull, int afCapMask)
 {
-	return NUM_RANGES * (x - lower) / ((upper - lower + 1));
-}
+	const int iHullMask = NodeHullLinkMask(iHull);
+	const int iCap = CapIndex(afCapMask);
+	const int iStartCluster = m_pNodeCluster[iStart];
+	const int iDestCluster = m_pNodeCluster[iDest];
+	const Vector2D vecDest = m_pNodes[iDest].m_vecOrigin.Make2D();
 
+	// Link weights are 2D lengths, so the 2D distance never overestimates.
+	const auto estimate = [&](int iNode)
+	{ return (vecDest - m_pNodes[iNode].m_vecOrigin.Make2D()).Length(); };
 
-void inline UpdateRange(int& minValue, int& maxValue, int Goal, int Best)
-{
-	int Lower, Upper;
-	CalcBounds(Lower, Upper, Goal, Best);
-	if (Upper < maxValue)
-		maxValue = Upper;
-	if (minValue < Lower)
-		minValue = Lower;
+	int i;
+	for (i = 0; i < m_cNodes; i++)
+	{
+		m_pNodes[i].m_flClosestSoFar = -1.0;
+	}
+
+	auto& heap = g_NodeSearchHeap;
+	heap.clear();
+
+	const auto visit = [&](int iNode, int iPrevious, float flDistance)
+	{
+		CNode& node = m_pNodes[iNode];
+
+		if (node.m_flClosestSoFar < -0.5 || flDistance < node.m_flClosestSoFar - 0.001)
+		{
+			node.m_flClosestSoFar = flDistance;
+			node.m_iPreviousNode = iPrevious;
+
+			heap.push_back({flDistance + estimate(iNode), flDistance, iNode});
+			std::push_heap(heap.begin(), heap.end());
+		}
+	};
+
+	visit(iStart, iStart, 0.0);
+
+	while (!heap.empty())
+	{
+		std::pop_heap(heap.begin(), heap.end());
+		const NODE_SEARCH_ENTRY current = heap.back();
+		heap.pop_back();
+
+		if (current.flDistance > m_pNodes[current.iNode].m_flClosestSoFar)
+			continue; // stale entry, this node was reached by a shorter path since.
+
+		if (current.iNode == iDest)
+			break;
+
+		const CNode& node = m_pNodes[current.iNode];
+		const int iCluster = m_pNodeCluster[current.iNode];
+		const bool fExpandLinks = iCluster == iStartCluster || iCluster == iDestCluster;
+
+		for (i = 0; i < node.m_cNumLinks; i++)
+		{
+			const CLink& link = m_pLinkPool[node.m_iFirstLink + i];
+
+			if (!fExpandLinks && m_pNodeCluster[link.m_iDestNode] == iCluster)
+				continue; // covered by the portal costs below.
+
+			if ((link.m_afLinkInfo & iHullMask) != iHullMask)
+				continue;
+
+			if (link.m_pLinkEnt != NULL && !HandleLinkEnt(current.iNode, link.m_pLinkEnt, afCapMask, NODEGRAPH_STATIC))
+				continue;
+
+			visit(link.m_iDestNode, current.iNode, current.flDistance + link.m_flWeight);
+		}
+
+		if (!fExpandLinks)
+		{
+			const NODE_CLUSTER& cluster = m_pClusters[iCluster];
+			const int iEntrance = m_pNodeEntrance[current.iNode];
+			const float* pCosts = m_pClusterCosts + cluster.iFirstCost + ((iHull * 2 + iCap) * cluster.cEntrances + iEntrance) * cluster.cEntrances;
+
+			for (i = 0; i < cluster.cEntrances; i++)
+			{
+				if (i != iEntrance && pCosts[i] >= 0)
+				{
+					visit(m_pClusterEntrances[cluster.iFirstEntrance + i], current.iNode, current.flDistance + pCosts[i]);
+				}
+			}
+		}
+	}
+
+	if (m_pNodes[iDest].m_flClosestSoFar < -0.5)
+	{ // Destination is unreachable, no path found.
+		return 0;
+	}
+
+	// Walk back to the start. This path still has portal hops in it.
+	//
+	auto& path = g_NodeSearchPath;
+	path.clear();
+
+	int iCurrentNode;
+	for (iCurrentNode = iDest; iCurrentNode != iStart; iCurrentNode = m_pNodes[iCurrentNode].m_iPreviousNode)
+	{
+		path.push_back(iCurrentNode);
+	}
+
+	path.push_back(iStart);
+	std::reverse(path.begin(), path.end());
+
+	int iNumPathNodes = 0;
+	piPath[iNumPathNodes++] = iStart;
+
+	for (size_t iHop = 1; iHop < path.size() && iNumPathNodes < MAX_PATH_SIZE; iHop++)
+	{
+		const int iFrom = path[iHop - 1];
+		const int iTo = path[iHop];
+		const int iCluster = m_pNodeCluster[iFrom];
+
+		if (iCluster != m_pNodeCluster[iTo] || iCluster == iStartCluster || iCluster == iDestCluster)
+		{ // a real link
+			piPath[iNumPathNodes++] = iTo;
+			continue;
+		}
+
+		// Portal hop, find the nodes in between. This overwrites the search state
+		// of this cluster's nodes, which is fine now that the path is copied out.
+		//
+		if (!SearchCluster(iCluster, iFrom, iTo, iHullMask, afCapMask))
+		{
+			return -1;
+		}
+
+		int cHopNodes = 0;
+		for (iCurrentNode = iTo; iCurrentNode != iFrom; iCurrentNode = m_pNodes[iCurrentNode].m_iPreviousNode)
+		{
+			cHopNodes++;
+		}
+
+		// Only as much of the hop as fits.
+		//
+		const int cSkip = V_max(0, cHopNodes - (MAX_PATH_SIZE - iNumPathNodes));
+
+		iCurrentNode = iTo;
+		for (i = 0; i < cSkip; i++)
+		{
+			iCurrentNode = m_pNodes[iCurrentNode].m_iPreviousNode;
+		}
+
+		iNumPathNodes += cHopNodes - cSkip;
+
+		for (i = iNumPathNodes - 1; iCurrentNode != iFrom; i--)
+		{
+			piPath[i] = iCurrentNode;
+			iCurrentNode = m_pNodes[iCurrentNode].m_iPreviousNode;
+		}
+	}
+
+	return iNumPathNodes;
 }
 
-void CGraph::CheckNode(Vector vecOrigin, int iNode)
+//=========================================================
+// CGraph - SearchCluster - shortest paths from iStart to the
+// other nodes of its cluster, using only links inside the
+// cluster. Leaves m_flClosestSoFar and m_iPreviousNode set
+// on the cluster's nodes. If iDest is not NO_NODE the search
+// stops as soon as it is reached, and returns whether it was.
+//=========================================================
+bool CGraph::SearchCluster(int iCluster, int iStart, int iDest, int iHullMask, int afCapMask)
 {
-	// Have we already seen this point before?.
-	//
-	if (m_di[iNode].m_CheckedEvent == m_CheckedCounter)
-		return;
-	m_di[iNode].m_CheckedEvent = m_CheckedCounter;
+	const NODE_CLUSTER& cluster = m_pClusters[iCluster];
+
+	int i;
+	for (i = 0; i < cluster.cNodes; i++)
+	{
+		m_pNodes[m_pClusterNodes[cluster.iFirstNode + i]].m_flClosestSoFar = -1.0;
+	}
+
+	auto& heap = g_NodeSearchHeap;
+	heap.clear();
 
-	float flDist = (vecOrigin - m_pNodes[iNode].m_vecOriginPeek).Length();
+	m_pNodes[iStart].m_flClosestSoFar = 0.0;
+	m_pNodes[iStart].m_iPreviousNode = iStart;
+	heap.push_back({0.0, 0.0, iStart});
 
-	if (flDist < m_flShortest)
+	while (!heap.empty())
 	{
-		TraceResult tr;
+		std::pop_heap(heap.begin(), heap.end());
+		const NODE_SEARCH_ENTRY current = heap.back();
+		heap.pop_back();
 
-		// make sure that vecOrigin can trace to this node!
-		UTIL_TraceLine(vecOrigin, m_pNodes[iNode].m_vecOriginPeek, ignore_monsters, 0, &tr);
+		if (current.flDistance > m_pNodes[current.iNode].m_flClosestSoFar)
+			continue;
+
+		if (current.iNode == iDest)
+			return true;
 
-		if (tr.flFraction == 1.0)
+		const CNode& node = m_pNodes[current.iNode];
+
+		for (i = 0; i < node.m_cNumLinks; i++)
 		{
-			m_iNearest = iNode;
-			m_flShortest = flDist;
+			const CLink& link = m_pLinkPool[node.m_iFirstLink + i];
+
+			if (m_pNodeCluster[link.m_iDestNode] != iCluster || (link.m_afLinkInfo & iHullMask) != iHullMask)
+				continue;
+
+			if (link.m_pLinkEnt != NULL && !HandleLinkEnt(current.iNode, link.m_pLinkEnt, afCapMask, NODEGRAPH_STATIC))
+				continue;
 
-			UpdateRange(m_minX, m_maxX, CALC_RANGE(vecOrigin.x, m_RegionMin[0], m_RegionMax[0]), m_pNodes[iNode].m_Region[0]);
-			UpdateRange(m_minY, m_maxY, CALC_RANGE(vecOrigin.y, m_RegionMin[1], m_RegionMax[1]), m_pNodes[iNode].m_Region[1]);
-			UpdateRange(m_minZ, m_maxZ, CALC_RANGE(vecOrigin.z, m_RegionMin[2], m_RegionMax[2]), m_pNodes[iNode].m_Region[2]);
+			CNode& visitNode = m_pNodes[link.m_iDestNode];
+			const float flOurDistance = current.flDistance + link.m_flWeight;
 
-			// From maxCircle, calculate maximum bounds box. All points must be
-			// simultaneously inside all bounds of the box.
-			//
-			m_minBoxX = CALC_RANGE(vecOrigin.x - flDist, m_RegionMin[0], m_RegionMax[0]);
-			m_maxBoxX = CALC_RANGE(vecOrigin.x + flDist, m_RegionMin[0], m_RegionMax[0]);
-			m_minBoxY = CALC_RANGE(vecOrigin.y - flDist, m_RegionMin[1], m_RegionMax[1]);
-			m_maxBoxY = CALC_RANGE(vecOrigin.y + flDist, m_RegionMin[1], m_RegionMax[1]);
-			m_minBoxZ = CALC_RANGE(vecOrigin.z - flDist, m_RegionMin[2], m_RegionMax[2]);
-			m_maxBoxZ = CALC_RANGE(vecOrigin.z + flDist, m_RegionMin[2], m_RegionMax[2]);
+			if (visitNode.m_flClosestSoFar < -0.5 || flOurDistance < visitNode.m_flClosestSoFar - 0.001)
+			{
+				visitNode.m_flClosestSoFar = flOurDistance;
+				visitNode.m_iPreviousNode = current.iNode;
+
+				heap.push_back({flOurDistance, flOurDistance, link.m_iDestNode});
+				std::push_heap(heap.begin(), heap.end());
+			}
 		}
 	}
+
+	return iDest == NO_NODE;
 }
 
 //=========================================================
@@ -866,202 +1092,99 @@ int CGraph::FindNearestNode(const Vector& vecOrigin, CBaseEntity* pEntity)
 
 int CGraph::FindNearestNode(const Vector& vecOrigin, int afNodeTypes)
 {
-	int i;
 	TraceResult tr;
 
-	if (0 == m_fGraphPresent || 0 == m_fGraphPointersSet)
+	if (0 == m_fGraphPresent || 0 == m_fGraphPointersSet || !m_pGridEntries)
 	{ // protect us in the case that the node graph isn't available
 		ALERT(at_aiconsole, "Graph not ready!\n");
 		return -1;
 	}
 
-	// Check with the cache
-	//
-	unsigned int iHash = (CACHE_SIZE - 1) & Hash((void*)(const float*)vecOrigin, sizeof(vecOrigin));
-	if (m_Cache[iHash].v == vecOrigin)
-	{
-		//ALERT(at_aiconsole, "Cache Hit.\n");
-		return m_Cache[iHash].n;
-	}
-	else
-	{
-		//ALERT(at_aiconsole, "Cache Miss.\n");
-	}
-
-	// Mark all points as unchecked.
-	//
-	m_CheckedCounter++;
-	if (m_CheckedCounter == 0)
-	{
-		for (int i = 0; i < m_cNodes; i++)
-		{
-			m_di[i].m_CheckedEvent = 0;
-		}
-		m_CheckedCounter++;
-	}
-
-	m_iNearest = -1;
-	m_flShortest = 999999.0; // just a big number.
-
-	// If we can find a visible point, then let CalcBounds set the limits, but if
-	// we have no visible point at all to start with, then don't restrict the limits.
-	//
-#if 1
-	m_minX = 0;
-	m_maxX = 255;
-	m_minY = 0;
-	m_maxY = 255;
-	m_minZ = 0;
-	m_maxZ = 255;
-	m_minBoxX = 0;
-	m_maxBoxX = 255;
-	m_minBoxY = 0;
-	m_maxBoxY = 255;
-	m_minBoxZ = 0;
-	m_maxBoxZ = 255;
-#else
-	m_minBoxX = CALC_RANGE(vecOrigin.x - flDist, m_RegionMin[0], m_RegionMax[0]);
-	m_maxBoxX = CALC_RANGE(vecOrigin.x + flDist, m_RegionMin[0], m_RegionMax[0]);
-	m_minBoxY = CALC_RANGE(vecOrigin.y - flDist, m_RegionMin[1], m_RegionMax[1]);
-	m_maxBoxY = CALC_RANGE(vecOrigin.y + flDist, m_RegionMin[1], m_RegionMax[1]);
-	m_minBoxZ = CALC_RANGE(vecOrigin.z - flDist, m_RegionMin[2], m_RegionMax[2]);
-	m_maxBoxZ = CALC_RANGE(vecOrigin.z + flDist, m_RegionMin[2], m_RegionMax[2])
-		CalcBounds(m_minX, m_maxX, CALC_RANGE(vecOrigin.x, m_RegionMin[0], m_RegionMax[0]), m_pNodes[m_iNearest].m_Region[0]);
-	CalcBounds(m_minY, m_maxY, CALC_RANGE(vecOrigin.y, m_RegionMin[1], m_RegionMax[1]), m_pNodes[m_iNearest].m_Region[1]);
-	CalcBounds(m_minZ, m_maxZ, CALC_RANGE(vecOrigin.z, m_RegionMin[2], m_RegionMax[2]), m_pNodes[m_iNearest].m_Region[2]);
-#endif
+	const int iCellX = std::clamp(static_cast<int>((vecOrigin.x - m_GridMins[0]) / m_flGridCellSize), 0, m_cGridCellsX - 1);
+	const int iCellY = std::clamp(static_cast<int>((vecOrigin.y - m_GridMins[1]) / m_flGridCellSize), 0, m_cGridCellsY - 1);
 
-	int halfX = (m_minX + m_maxX) / 2;
-	int halfY = (m_minY + m_maxY) / 2;
-	int halfZ = (m_minZ + m_maxZ) / 2;
+	const int iMaxRing = V_max(V_max(iCellX, m_cGridCellsX - 1 - iCellX), V_max(iCellY, m_cGridCellsY - 1 - iCellY));
 
-	int j;
+	int iNearest = -1;
+	float flShortestSq = 999999.0 * 999999.0; // just a big number.
 
-	for (i = halfX; i >= m_minX; i--)
+	for (int iRing = 0; iRing <= iMaxRing; iRing++)
 	{
-		for (j = m_RangeStart[0][i]; j <= m_RangeEnd[0][i]; j++)
+		// Every cell in this ring is at least iRing - 1 whole cells away from the cell that
+		// contains vecOrigin. Once that is further than the best node, we're done.
+		//
+		if (iRing > 1)
 		{
-			if ((m_pNodes[m_di[j].m_SortedBy[0]].m_afNodeInfo & afNodeTypes) == 0)
-				continue;
-
-			int rgY = m_pNodes[m_di[j].m_SortedBy[0]].m_Region[1];
-			if (rgY > m_maxBoxY)
+			const float flRingDist = (iRing - 1) * m_flGridCellSize;
+			if (flRingDist * flRingDist >= flShortestSq)
 				break;
-			if (rgY < m_minBoxY)
-				continue;
-
-			int rgZ = m_pNodes[m_di[j].m_SortedBy[0]].m_Region[2];
-			if (rgZ < m_minBoxZ)
-				continue;
-			if (rgZ > m_maxBoxZ)
-				continue;
-			CheckNode(vecOrigin, m_di[j].m_SortedBy[0]);
 		}
-	}
 
-	for (i = V_max(m_minY, halfY + 1); i <= m_maxY; i++)
-	{
-		for (j = m_RangeStart[1][i]; j <= m_RangeEnd[1][i]; j++)
-		{
-			if ((m_pNodes[m_di[j].m_SortedBy[1]].m_afNodeInfo & afNodeTypes) == 0)
-				continue;
+		// Gather the nodes in this ring that could beat the current best.
+		//
+		int cCandidates = 0;
 
-			int rgZ = m_pNodes[m_di[j].m_SortedBy[1]].m_Region[2];
-			if (rgZ > m_maxBoxZ)
-				break;
-			if (rgZ < m_minBoxZ)
-				continue;
-			int rgX = m_pNodes[m_di[j].m_SortedBy[1]].m_Region[0];
-			if (rgX < m_minBoxX)
-				continue;
-			if (rgX > m_maxBoxX)
-				continue;
-			CheckNode(vecOrigin, m_di[j].m_SortedBy[1]);
-		}
-	}
+		const int yMin = V_max(0, iCellY - iRing);
+		const int yMax = V_min(m_cGridCellsY - 1, iCellY + iRing);
 
-	for (i = V_min(m_maxZ, halfZ); i >= m_minZ; i--)
-	{
-		for (j = m_RangeStart[2][i]; j <= m_RangeEnd[2][i]; j++)
+		for (int y = yMin; y <= yMax; y++)
 		{
-			if ((m_pNodes[m_di[j].m_SortedBy[2]].m_afNodeInfo & afNodeTypes) == 0)
-				continue;
+			// Rows in the middle of the ring only have a cell on each end.
+			//
+			const bool fFullRow = y == iCellY - iRing || y == iCellY + iRing;
+			const int xStep = fFullRow ? 1 : V_max(1, 2 * iRing);
 
-			int rgX = m_pNodes[m_di[j].m_SortedBy[2]].m_Region[0];
-			if (rgX > m_maxBoxX)
-				break;
-			if (rgX < m_minBoxX)
-				continue;
-			int rgY = m_pNodes[m_di[j].m_SortedBy[2]].m_Region[1];
-			if (rgY < m_minBoxY)
-				continue;
-			if (rgY > m_maxBoxY)
-				continue;
-			CheckNode(vecOrigin, m_di[j].m_SortedBy[2]);
-		}
-	}
+			for (int x = iCellX - iRing; x <= iCellX + iRing; x += xStep)
+			{
+				if (x < 0 || x >= m_cGridCellsX)
+					continue;
 
-	for (i = V_max(m_minX, halfX + 1); i <= m_maxX; i++)
-	{
-		for (j = m_RangeStart[0][i]; j <= m_RangeEnd[0][i]; j++)
-		{
-			if ((m_pNodes[m_di[j].m_SortedBy[0]].m_afNodeInfo & afNodeTypes) == 0)
-				continue;
+				const int iCell = y * m_cGridCellsX + x;
 
-			int rgY = m_pNodes[m_di[j].m_SortedBy[0]].m_Region[1];
-			if (rgY > m_maxBoxY)
-				break;
-			if (rgY < m_minBoxY)
-				continue;
+				if ((m_pGridCellTypes[iCell] & afNodeTypes) == 0)
+					continue;
 
-			int rgZ = m_pNodes[m_di[j].m_SortedBy[0]].m_Region[2];
-			if (rgZ < m_minBoxZ)
-				continue;
-			if (rgZ > m_maxBoxZ)
-				continue;
-			CheckNode(vecOrigin, m_di[j].m_SortedBy[0]);
-		}
-	}
+				for (int i = m_pGridCellStart[iCell]; i < m_pGridCellStart[iCell + 1]; i++)
+				{
+					const NODE_GRID_ENTRY& entry = m_pGridEntries[i];
 
-	for (i = V_min(m_maxY, halfY); i >= m_minY; i--)
-	{
-		for (j = m_RangeStart[1][i]; j <= m_RangeEnd[1][i]; j++)
-		{
-			if ((m_pNodes[m_di[j].m_SortedBy[1]].m_afNodeInfo & afNodeTypes) == 0)
-				continue;
+					if ((entry.afNodeTypes & afNodeTypes) == 0)
+						continue;
 
-			int rgZ = m_pNodes[m_di[j].m_SortedBy[1]].m_Region[2];
-			if (rgZ > m_maxBoxZ)
-				break;
-			if (rgZ < m_minBoxZ)
-				continue;
-			int rgX = m_pNodes[m_di[j].m_SortedBy[1]].m_Region[0];
-			if (rgX < m_minBoxX)
-				continue;
-			if (rgX > m_maxBoxX)
-				continue;
-			CheckNode(vecOrigin, m_di[j].m_SortedBy[1]);
+					const float flDistSq = (vecOrigin - entry.vecOrigin).LengthSquared();
+
+					if (flDistSq < flShortestSq)
+					{
+						m_pGridCandidates[cCandidates].flDistSq = flDistSq;
+						m_pGridCandidates[cCandidates].iNode = entry.iNode;
+						cCandidates++;
+					}
+				}
+			}
 		}
-	}
 
-	for (i = V_max(m_minZ, halfZ + 1); i <= m_maxZ; i++)
-	{
-		for (j = m_RangeStart[2][i]; j <= m_RangeEnd[2][i]; j++)
+		// Trace to the candidates nearest-first. The first one that's visible is the
+		// best this ring has to offer, everything after it is further away.
+		//
+		std::sort(m_pGridCandidates, m_pGridCandidates + cCandidates, [](const NODE_GRID_CANDIDATE& lhs, const NODE_GRID_CANDIDATE& rhs)
+			{ return lhs.flDistSq < rhs.flDistSq; });
+
+		for (int i = 0; i < cCandidates; i++)
 		{
-			if ((m_pNodes[m_di[j].m_SortedBy[2]].m_afNodeInfo & afNodeTypes) == 0)
-				continue;
+			if (m_pGridCandidates[i].flDistSq >= flShortestSq)
+				break;
+
+			const int iNode = m_pGridCandidates[i].iNode;
 
-			int rgX = m_pNodes[m_di[j].m_SortedBy[2]].m_Region[0];
-			if (rgX > m_maxBoxX)
+			// make sure that vecOrigin can trace to this node!
+			UTIL_TraceLine(vecOrigin, m_pNodes[iNode].m_vecOriginPeek, ignore_monsters, 0, &tr);
+
+			if (tr.flFraction == 1.0)
+			{
+				iNearest = iNode;
+				flShortestSq = m_pGridCandidates[i].flDistSq;
 				break;
-			if (rgX < m_minBoxX)
-				continue;
-			int rgY = m_pNodes[m_di[j].m_SortedBy[2]].m_Region[1];
-			if (rgY < m_minBoxY)
-				continue;
-			if (rgY > m_maxBoxY)
-				continue;
-			CheckNode(vecOrigin, m_di[j].m_SortedBy[2]);
+			}
 		}
 	}
 
@@ -1069,13 +1192,16 @@ int CGraph::FindNearestNode(const Vector& vecOrigin, int afNodeTypes)
 	// Verify our answers.
 	//
 	int iNearestCheck = -1;
-	m_flShortest = 8192;// find nodes within this radius
+	float flShortest = 8192;// find nodes within this radius
 
-	for ( i = 0 ; i < m_cNodes ; i++ )
+	for ( int i = 0 ; i < m_cNodes ; i++ )
 	{
+		if ( ( m_pNodes[ i ].m_afNodeInfo & afNodeTypes ) == 0 )
+			continue;
+
 		float flDist = ( vecOrigin - m_pNodes[ i ].m_vecOriginPeek ).Length();
 
-		if ( flDist < m_flShortest )
+		if ( flDist < flShortest )
 		{
 			// make sure that vecOrigin can trace to this node!
 			UTIL_TraceLine ( vecOrigin, m_pNodes[ i ].m_vecOriginPeek, ignore_monsters, 0, &tr );
@@ -1083,31 +1209,29 @@ int CGraph::FindNearestNode(const Vector& vecOrigin, int afNodeTypes)
 			if ( tr.flFraction == 1.0 )
 			{
 				iNearestCheck = i;
-				m_flShortest = flDist;
+				flShortest = flDist;
 			}
 		}
 	}
 
-	if (iNearestCheck != m_iNearest)
+	if (iNearestCheck != iNearest)
 	{
 		ALERT( at_aiconsole, "NOT closest %d(%f,%f,%f) %d(%f,%f,%f).\n",
 			iNearestCheck,
 			m_pNodes[iNearestCheck].m_vecOriginPeek.x,
 			m_pNodes[iNearestCheck].m_vecOriginPeek.y,
 			m_pNodes[iNearestCheck].m_vecOriginPeek.z,
-			m_iNearest,
-			(m_iNearest == -1?0.0:m_pNodes[m_iNearest].m_vecOriginPeek.x),
-			(m_iNearest == -1?0.0:m_pNodes[m_iNearest].m_vecOriginPeek.y),
-			(m_iNearest == -1?0.0:m_pNodes[m_iNearest].m_vecOriginPeek.z));
+			iNearest,
+			(iNearest == -1?0.0:m_pNodes[iNearest].m_vecOriginPeek.x),
+			(iNearest == -1?0.0:m_pNodes[iNearest].m_vecOriginPeek.y),
+			(iNearest == -1?0.0:m_pNodes[iNearest].m_vecOriginPeek.z));
 	}
-	if (m_iNearest == -1)
+	if (iNearest == -1)
 	{
 		ALERT(at_aiconsole, "All that work for nothing.\n");
 	}
 #endif
-	m_Cache[iHash].v = vecOrigin;
-	m_Cache[iHash].n = m_iNearest;
-	return m_iNearest;
+	return iNearest;
 }
 
 //=========================================================
@@ -2029,7 +2153,7 @@ void CTestHull::BuildNodeGraph()
 
 	// This is used for FindNearestNode
 	//
-	WorldGraph.BuildRegionTables();
+	WorldGraph.BuildNodeGrid();
 
 
 	// Push all of the LAND nodes down to the ground now. Leave the water and air nodes alone.
@@ -2056,6 +2180,8 @@ void CTestHull::BuildNodeGraph()
 	WorldGraph.m_fGraphPointersSet = 1; // since the graph was generated, the pointers are ready
 	WorldGraph.m_fRoutingComplete = 0;	// Optimal routes aren't computed, yet.
 
+	WorldGraph.FreeNodeClusters(); // Rebuilt if FindShortestPath needs them.
+
 	// Compute and compress the routing information.
 	//
 	WorldGraph.ComputeStaticRoutingTables();
@@ -2312,11 +2438,86 @@ void CQueuePriority::Heap_SiftUp()
 	}
 }
 
+//=========================================================
+// .nod file layout. After the header everything is stored in
+// lumps of fixed-width little-endian records, so the file does
+// not depend on the in-memory layout of CGraph, CNode or CLink
+// and the routing tables can be used straight out of a
+// read-only mapping of the file.
+//=========================================================
+#define GRAPH_FILE_IDENT (('2' << 24) + ('D' << 16) + ('O' << 8) + 'N') // little-endian "NOD2"
+
+enum
+{
+	GRAPH_LUMP_NODES = 0,
+	GRAPH_LUMP_LINKS,
+	GRAPH_LUMP_HASHLINKS,
+	GRAPH_LUMP_ROUTEINFO,
+	GRAPH_LUMP_COUNT
+};
+
+typedef struct
+{
+	int fileofs;
+	int filelen;
+} GRAPH_FILE_LUMP;
+
+typedef struct
+{
+	int version; // GRAPH_VERSION. This comes first so that builds that don't know this layout reject the file.
+	int ident;
+	int cNodes;
+	int cLinks;
+	int nRouteInfo;
+	int nHashLinks;
+	int HashPrimes[16];
+	GRAPH_FILE_LUMP lumps[GRAPH_LUMP_COUNT];
+} GRAPH_FILE_HEADER;
+
+typedef struct
+{
+	float origin[3];
+	float originPeek[3];
+	int afNodeInfo;
+	int cNumLinks;
+	int iFirstLink;
+	int nextBestNode[MAX_NODE_HULLS][2];
+	short sHintType;
+	short sHintActivity;
+	float flHintYaw;
+} GRAPH_FILE_NODE;
+
+typedef struct
+{
+	int iSrcNode;
+	int iDestNode;
+	char szLinkEntModelname[4];
+	int afLinkInfo;
+	float flWeight;
+	int fLinkEnt; // non-zero if the link was blocked by an entity when the graph was saved.
+} GRAPH_FILE_LINK;
+
+static_assert(sizeof(GRAPH_FILE_HEADER) == 120, "GRAPH_FILE_HEADER must have the same layout on all platforms");
+static_assert(sizeof(GRAPH_FILE_NODE) == 76, "GRAPH_FILE_NODE must have the same layout on all platforms");
+static_assert(sizeof(GRAPH_FILE_LINK) == 24, "GRAPH_FILE_LINK must have the same layout on all platforms");
+
+// Lumps are aligned so the hash links can be used in place.
+#define GRAPH_LUMP_ALIGN 4
+
+static bool GraphLumpValid(const GRAPH_FILE_LUMP& lump, std::size_t fileSize, std::size_t expectedSize)
+{
+	return lump.fileofs >= 0 && lump.filelen >= 0 && (lump.fileofs % GRAPH_LUMP_ALIGN) == 0 && static_cast<std::size_t>(lump.filelen) == expectedSize && static_cast<std::size_t>(lump.fileofs) + lump.filelen <= fileSize;
+}
+
 //=========================================================
 // CGraph - FLoadGraph - attempts to load a node graph from disk.
 // if the current level is maps/snar.bsp, maps/graphs/snar.nod
 // will be loaded. If file cannot be loaded, the node tree
 // will be created and saved to disk.
+//
+// The file is mapped if possible, in which case the routing
+// tables and hash links are used in place and shared with
+// every other server on this machine that loads the same map.
 //=========================================================
 bool CGraph::FLoadGraph(const char* szMapName)
 {
@@ -2327,157 +2528,155 @@ bool CGraph::FLoadGraph(const char* szMapName)
 
 	//Note: Allow loading graphs only from the mod directory itself.
 	//Do not allow loading from other games since they may have a different graph format.
-	const auto buffer = FileSystem_LoadFileIntoBuffer(fileName.c_str(), FileContentFormat::Binary, "GAMECONFIG");
+	FSMappedFile* pGraphFile = new FSMappedFile();
+	std::vector<std::byte> buffer;
 
-	if (buffer.empty())
+	const byte* pFileData;
+	std::size_t fileSize;
+
+	if (pGraphFile->Open(fileName.c_str()))
 	{
-		return false;
+		pFileData = reinterpret_cast<const byte*>(pGraphFile->Data());
+		fileSize = pGraphFile->Size();
 	}
+	else
+	{
+		delete pGraphFile;
+		pGraphFile = NULL;
 
-	auto pMemFile = reinterpret_cast<const byte*>(buffer.data());
+		buffer = FileSystem_LoadFileIntoBuffer(fileName.c_str(), FileContentFormat::Binary, "GAMECONFIG");
+
+		pFileData = reinterpret_cast<const byte*>(buffer.data());
+		fileSize = buffer.size();
+	}
 
-	assert(buffer.size() <= static_cast<std::size_t>(std::numeric_limits<int>::max()));
-	int length = static_cast<int>(buffer.size());
+	assert(fileSize <= static_cast<std::size_t>(std::numeric_limits<int>::max()));
 
-	// Read the graph version number
+	// Read and validate the header before touching anything.
 	//
-	length -= sizeof(int);
-	if (length < 0)
+	GRAPH_FILE_HEADER header;
+
+	if (fileSize < sizeof(int))
+	{
+		delete pGraphFile;
 		return false;
+	}
 
-	int iVersion;
-	memcpy(&iVersion, pMemFile, sizeof(int));
-	pMemFile += sizeof(int);
+	memcpy(&header.version, pFileData, sizeof(int));
 
-	if (iVersion != GRAPH_VERSION)
+	if (header.version != GRAPH_VERSION)
 	{
 		// This file was written by a different build of the dll!
 		//
-		ALERT(at_aiconsole, "**ERROR** Graph version is %d, expected %d\n", iVersion, GRAPH_VERSION);
+		ALERT(at_aiconsole, "**ERROR** Graph version is %d, expected %d\n", header.version, GRAPH_VERSION);
+		delete pGraphFile;
 		return false;
 	}
 
-	// Read the graph class
-	//
-	length -= sizeof(CGraph);
-	if (length < 0)
+	if (fileSize < sizeof(header))
+	{
+		ALERT(at_aiconsole, "**ERROR** Graph file is truncated\n");
+		delete pGraphFile;
 		return false;
-	memcpy(this, pMemFile, sizeof(CGraph));
-	pMemFile += sizeof(CGraph);
-
-	// Set the pointers to zero, just in case we run out of memory.
-	//
-	m_pNodes = NULL;
-	m_pLinkPool = NULL;
-	m_di = NULL;
-	m_pRouteInfo = NULL;
-	m_pHashLinks = NULL;
-
+	}
 
-	// Malloc for the nodes
-	//
-	m_pNodes = (CNode*)calloc(sizeof(CNode), m_cNodes);
+	memcpy(&header, pFileData, sizeof(header));
 
-	if (!m_pNodes)
+	if (header.ident != GRAPH_FILE_IDENT || header.cNodes <= 0 || header.cNodes > MAX_NODES || header.cLinks < 0 || header.nRouteInfo < 0 || header.nHashLinks < 0 || !GraphLumpValid(header.lumps[GRAPH_LUMP_NODES], fileSize, sizeof(GRAPH_FILE_NODE) * header.cNodes) || !GraphLumpValid(header.lumps[GRAPH_LUMP_LINKS], fileSize, sizeof(GRAPH_FILE_LINK) * header.cLinks) || !GraphLumpValid(header.lumps[GRAPH_LUMP_HASHLINKS], fileSize, sizeof(short) * header.nHashLinks) || !GraphLumpValid(header.lumps[GRAPH_LUMP_ROUTEINFO], fileSize, sizeof(char) * header.nRouteInfo))
 	{
-		ALERT(at_aiconsole, "**ERROR**\nCouldn't malloc %d nodes!\n", m_cNodes);
+		ALERT(at_aiconsole, "**ERROR** Graph file is corrupt\n");
+		delete pGraphFile;
 		return false;
 	}
 
-	// Read in all the nodes
+	// Nodes and links hold per-search state and entity pointers, so those are always copied.
 	//
-	length -= sizeof(CNode) * m_cNodes;
-	if (length < 0)
-		return false;
-	memcpy(m_pNodes, pMemFile, sizeof(CNode) * m_cNodes);
-	pMemFile += sizeof(CNode) * m_cNodes;
+	m_cNodes = header.cNodes;
+	m_cLinks = header.cLinks;
+	m_nRouteInfo = header.nRouteInfo;
+	m_nHashLinks = header.nHashLinks;
+	memcpy(m_HashPrimes, header.HashPrimes, sizeof(m_HashPrimes));
 
+	m_pNodes = (CNode*)calloc(sizeof(CNode), m_cNodes);
+	m_pLinkPool = (CLink*)calloc(sizeof(CLink), V_max(1, m_cLinks));
 
-	// Malloc for the link pool
-	//
-	m_pLinkPool = (CLink*)calloc(sizeof(CLink), m_cLinks);
-
-	if (!m_pLinkPool)
+	if (!m_pNodes || !m_pLinkPool)
 	{
-		ALERT(at_aiconsole, "**ERROR**\nCouldn't malloc %d link!\n", m_cLinks);
+		ALERT(at_aiconsole, "**ERROR**\nCouldn't malloc %d nodes and %d links!\n", m_cNodes, m_cLinks);
+		delete pGraphFile;
+		InitGraph();
 		return false;
 	}
 
-	// Read in all the links
-	//
-	length -= sizeof(CLink) * m_cLinks;
-	if (length < 0)
-		return false;
-	memcpy(m_pLinkPool, pMemFile, sizeof(CLink) * m_cLinks);
-	pMemFile += sizeof(CLink) * m_cLinks;
+	const GRAPH_FILE_NODE* pFileNodes = reinterpret_cast<const GRAPH_FILE_NODE*>(pFileData + header.lumps[GRAPH_LUMP_NODES].fileofs);
 
-	// Malloc for the sorting info.
-	//
-	m_di = (DIST_INFO*)calloc(sizeof(DIST_INFO), m_cNodes);
-	if (!m_di)
+	int i;
+	for (i = 0; i < m_cNodes; i++)
 	{
-		ALERT(at_aiconsole, "***ERROR**\nCouldn't malloc %d entries sorting nodes!\n", m_cNodes);
-		return false;
+		const GRAPH_FILE_NODE& fileNode = pFileNodes[i];
+		CNode& node = m_pNodes[i];
+
+		node.m_vecOrigin = Vector(fileNode.origin[0], fileNode.origin[1], fileNode.origin[2]);
+		node.m_vecOriginPeek = Vector(fileNode.originPeek[0], fileNode.originPeek[1], fileNode.originPeek[2]);
+		node.m_afNodeInfo = fileNode.afNodeInfo;
+		node.m_cNumLinks = fileNode.cNumLinks;
+		node.m_iFirstLink = fileNode.iFirstLink;
+		memcpy(node.m_pNextBestNode, fileNode.nextBestNode, sizeof(node.m_pNextBestNode));
+		node.m_sHintType = fileNode.sHintType;
+		node.m_sHintActivity = fileNode.sHintActivity;
+		node.m_flHintYaw = fileNode.flHintYaw;
 	}
 
-	// Read it in.
-	//
-	length -= sizeof(DIST_INFO) * m_cNodes;
-	if (length < 0)
-		return false;
-	memcpy(m_di, pMemFile, sizeof(DIST_INFO) * m_cNodes);
-	pMemFile += sizeof(DIST_INFO) * m_cNodes;
+	const GRAPH_FILE_LINK* pFileLinks = reinterpret_cast<const GRAPH_FILE_LINK*>(pFileData + header.lumps[GRAPH_LUMP_LINKS].fileofs);
 
-	// Malloc for the routing info.
-	//
-	m_fRoutingComplete = 0;
-	m_pRouteInfo = (char*)calloc(sizeof(char), m_nRouteInfo);
-	if (!m_pRouteInfo)
+	for (i = 0; i < m_cLinks; i++)
 	{
-		ALERT(at_aiconsole, "***ERROR**\nCounldn't malloc %d route bytes!\n", m_nRouteInfo);
-		return false;
+		const GRAPH_FILE_LINK& fileLink = pFileLinks[i];
+		CLink& link = m_pLinkPool[i];
+
+		link.m_iSrcNode = fileLink.iSrcNode;
+		link.m_iDestNode = fileLink.iDestNode;
+		memcpy(link.m_szLinkEntModelname, fileLink.szLinkEntModelname, sizeof(link.m_szLinkEntModelname));
+		link.m_afLinkInfo = fileLink.afLinkInfo;
+		link.m_flWeight = fileLink.flWeight;
+
+		// FSetGraphPointers resolves this to the real entity using the model name.
+		link.m_pLinkEnt = 0 != fileLink.fLinkEnt ? reinterpret_cast<entvars_t*>(1) : NULL;
 	}
-	m_CheckedCounter = 0;
-	for (int i = 0; i < m_cNodes; i++)
+
+	// The routing tables and hash links are never written to once the graph is loaded,
+	// so use them in place if the file is mapped.
+	//
+	if (pGraphFile)
 	{
-		m_di[i].m_CheckedEvent = 0;
+		m_pGraphFile = pGraphFile;
+		m_pRouteInfo = const_cast<char*>(reinterpret_cast<const char*>(pFileData + header.lumps[GRAPH_LUMP_ROUTEINFO].fileofs));
+		m_pHashLinks = const_cast<short*>(reinterpret_cast<const short*>(pFileData + header.lumps[GRAPH_LUMP_HASHLINKS].fileofs));
 	}
+	else
+	{
+		m_pRouteInfo = (char*)calloc(sizeof(char), V_max(1, m_nRouteInfo));
+		m_pHashLinks = (short*)calloc(sizeof(short), V_max(1, m_nHashLinks));
 
-	// Read in the route information.
-	//
-	length -= sizeof(char) * m_nRouteInfo;
-	if (length < 0)
-		return false;
-	memcpy(m_pRouteInfo, pMemFile, sizeof(char) * m_nRouteInfo);
-	pMemFile += sizeof(char) * m_nRouteInfo;
-	m_fRoutingComplete = 1;
+		if (!m_pRouteInfo || !m_pHashLinks)
+		{
+			ALERT(at_aiconsole, "***ERROR**\nCounldn't malloc %d route bytes and %d hash links!\n", m_nRouteInfo, m_nHashLinks);
+			InitGraph();
+			return false;
+		}
 
-	// malloc for the hash links
-	//
-	m_pHashLinks = (short*)calloc(sizeof(short), m_nHashLinks);
-	if (!m_pHashLinks)
-	{
-		ALERT(at_aiconsole, "***ERROR**\nCounldn't malloc %d hash link bytes!\n", m_nHashLinks);
-		return false;
+		memcpy(m_pRouteInfo, pFileData + header.lumps[GRAPH_LUMP_ROUTEINFO].fileofs, sizeof(char) * m_nRouteInfo);
+		memcpy(m_pHashLinks, pFileData + header.lumps[GRAPH_LUMP_HASHLINKS].fileofs, sizeof(short) * m_nHashLinks);
 	}
 
-	// Read in the hash link information
-	//
-	length -= sizeof(short) * m_nHashLinks;
-	if (length < 0)
-		return false;
-	memcpy(m_pHashLinks, pMemFile, sizeof(short) * m_nHashLinks);
-	pMemFile += sizeof(short) * m_nHashLinks;
+	m_fRoutingComplete = 1;
 
 	// Set the graph present flag, clear the pointers set flag
 	//
 	m_fGraphPresent = 1;
 	m_fGraphPointersSet = 0;
 
-	if (length != 0)
-	{
-		ALERT(at_aiconsole, "***WARNING***:Node graph was longer than expected by %d bytes.!\n", length);
-	}
+	ALERT(at_aiconsole, "Loaded %s (%s)\n", fileName.c_str(), m_pGraphFile ? "mapped" : "copied");
 
 	return true;
 }
@@ -2485,6 +2684,10 @@ bool CGraph::FLoadGraph(const char* szMapName)
 //=========================================================
 // CGraph - FSaveGraph - It's not rocket science.
 // this WILL overwrite existing files.
+//
+// The graph is written to a temporary file first and then
+// renamed over the old one, so servers that have the old
+// file mapped keep a valid copy of it.
 //=========================================================
 bool CGraph::FSaveGraph(const char* szMapName)
 {
@@ -2498,43 +2701,111 @@ bool CGraph::FSaveGraph(const char* szMapName)
 	g_pFileSystem->CreateDirHierarchy("maps/graphs", "GAMECONFIG");
 
 	const std::string fileName{std::string{"maps/graphs/"} + szMapName + ".nod"};
+	const std::string tempFileName{fileName + ".tmp"};
 
-	FSFile file{fileName.c_str(), "wb", "GAMECONFIG"};
+	GRAPH_FILE_HEADER header;
+	memset(&header, 0, sizeof(header));
 
-	ALERT(at_aiconsole, "Created: %s\n", fileName.c_str());
+	header.version = GRAPH_VERSION;
+	header.ident = GRAPH_FILE_IDENT;
+	header.cNodes = m_cNodes;
+	header.cLinks = m_cLinks;
+	header.nRouteInfo = m_pRouteInfo ? m_nRouteInfo : 0;
+	header.nHashLinks = m_pHashLinks ? m_nHashLinks : 0;
+	memcpy(header.HashPrimes, m_HashPrimes, sizeof(header.HashPrimes));
 
-	if (!file)
-	{ // couldn't create
-		ALERT(at_aiconsole, "Couldn't Create: %s\n", fileName.c_str());
-		return false;
+	// Lay out the lumps back to back after the header.
+	//
+	const int lumpSizes[GRAPH_LUMP_COUNT] =
+		{
+			static_cast<int>(sizeof(GRAPH_FILE_NODE)) * header.cNodes,
+			static_cast<int>(sizeof(GRAPH_FILE_LINK)) * header.cLinks,
+			static_cast<int>(sizeof(short)) * header.nHashLinks,
+			static_cast<int>(sizeof(char)) * header.nRouteInfo};
+
+	int fileofs = sizeof(header);
+
+	int i;
+	for (i = 0; i < GRAPH_LUMP_COUNT; i++)
+	{
+		fileofs = (fileofs + GRAPH_LUMP_ALIGN - 1) & ~(GRAPH_LUMP_ALIGN - 1);
+		header.lumps[i].fileofs = fileofs;
+		header.lumps[i].filelen = lumpSizes[i];
+		fileofs += lumpSizes[i];
 	}
 
-	// write the version
-	const int iVersion = GRAPH_VERSION;
-	file.Write(&iVersion, sizeof(int));
+	std::vector<byte> data(fileofs, 0);
+
+	memcpy(data.data(), &header, sizeof(header));
+
+	GRAPH_FILE_NODE* pFileNodes = reinterpret_cast<GRAPH_FILE_NODE*>(data.data() + header.lumps[GRAPH_LUMP_NODES].fileofs);
+
+	for (i = 0; i < m_cNodes; i++)
+	{
+		const CNode& node = m_pNodes[i];
+		GRAPH_FILE_NODE& fileNode = pFileNodes[i];
 
-	// write the CGraph class
-	file.Write(this, sizeof(CGraph));
+		node.m_vecOrigin.CopyToArray(fileNode.origin);
+		node.m_vecOriginPeek.CopyToArray(fileNode.originPeek);
+		fileNode.afNodeInfo = node.m_afNodeInfo;
+		fileNode.cNumLinks = node.m_cNumLinks;
+		fileNode.iFirstLink = node.m_iFirstLink;
+		memcpy(fileNode.nextBestNode, node.m_pNextBestNode, sizeof(fileNode.nextBestNode));
+		fileNode.sHintType = node.m_sHintType;
+		fileNode.sHintActivity = node.m_sHintActivity;
+		fileNode.flHintYaw = node.m_flHintYaw;
+	}
 
-	// write the nodes
-	file.Write(m_pNodes, sizeof(CNode) * m_cNodes);
+	GRAPH_FILE_LINK* pFileLinks = reinterpret_cast<GRAPH_FILE_LINK*>(data.data() + header.lumps[GRAPH_LUMP_LINKS].fileofs);
 
-	// write the links
-	file.Write(m_pLinkPool, sizeof(CLink) * m_cLinks);
+	for (i = 0; i < m_cLinks; i++)
+	{
+		const CLink& link = m_pLinkPool[i];
+		GRAPH_FILE_LINK& fileLink = pFileLinks[i];
 
-	file.Write(m_di, sizeof(DIST_INFO) * m_cNodes);
+		fileLink.iSrcNode = link.m_iSrcNode;
+		fileLink.iDestNode = link.m_iDestNode;
+		memcpy(fileLink.szLinkEntModelname, link.m_szLinkEntModelname, sizeof(fileLink.szLinkEntModelname));
+		fileLink.afLinkInfo = link.m_afLinkInfo;
+		fileLink.flWeight = link.m_flWeight;
+		fileLink.fLinkEnt = link.m_pLinkEnt != NULL ? 1 : 0;
+	}
+
+	if (0 != header.nHashLinks)
+	{
+		memcpy(data.data() + header.lumps[GRAPH_LUMP_HASHLINKS].fileofs, m_pHashLinks, sizeof(short) * header.nHashLinks);
+	}
 
 	// Write the route info.
 	//
-	if (m_pRouteInfo && 0 != m_nRouteInfo)
+	if (0 != header.nRouteInfo)
+	{
+		memcpy(data.data() + header.lumps[GRAPH_LUMP_ROUTEINFO].fileofs, m_pRouteInfo, sizeof(char) * header.nRouteInfo);
+	}
+
 	{
-		file.Write(m_pRouteInfo, sizeof(char) * m_nRouteInfo);
+		FSFile file{tempFileName.c_str(), "wb", "GAMECONFIG"};
+
+		if (!file)
+		{ // couldn't create
+			ALERT(at_aiconsole, "Couldn't Create: %s\n", tempFileName.c_str());
+			return false;
+		}
+
+		if (file.Write(data.data(), data.size()) != static_cast<int>(data.size()))
+		{
+			ALERT(at_aiconsole, "Couldn't Write: %s\n", tempFileName.c_str());
+			return false;
+		}
 	}
 
-	if (m_pHashLinks && 0 != m_nHashLinks)
+	if (!FileSystem_ReplaceFile(tempFileName.c_str(), fileName.c_str()))
 	{
-		file.Write(m_pHashLinks, sizeof(short) * m_nHashLinks);
+		return false;
 	}
+
+	ALERT(at_aiconsole, "Created: %s\n", fileName.c_str());
+
 	return true;
 }
 
@@ -2584,8 +2855,18 @@ bool CGraph::FSetGraphPointers()
 		}
 	}
 
+	// This is used for FindNearestNode
+	//
+	BuildNodeGrid();
+
 	// the pointers are now set.
 	m_fGraphPointersSet = 1;
+
+	// The clusters check the link entities, so any built for the old pointers are stale.
+	// FindShortestPath builds them again if it runs without routing tables.
+	//
+	FreeNodeClusters();
+
 	return true;
 }
 
@@ -2868,454 +3149,702 @@ void CGraph::BuildLinkLookups()
 #endif
 }
 
-void CGraph::BuildRegionTables()
+//=========================================================
+// CGraph - BuildNodeGrid - buckets the nodes into the uniform
+// grid that FindNearestNode searches.
+//=========================================================
+bool CGraph::BuildNodeGrid()
 {
-	if (m_di)
-		free(m_di);
+	FreeNodeGrid();
 
-	// Go ahead and setup for range searching the nodes for FindNearestNodes
-	//
-	m_di = (DIST_INFO*)calloc(sizeof(DIST_INFO), m_cNodes);
-	if (!m_di)
+	if (m_cNodes <= 0)
 	{
-		ALERT(at_aiconsole, "Couldn't allocated node ordering array.\n");
-		return;
+		return false;
 	}
 
-	// Calculate regions for all the nodes.
+	float mins[2] = {999999999.0, 999999999.0};	  // just a big number out there;
+	float maxs[2] = {-999999999.0, -999999999.0}; // just a big number out there;
+
+	int i;
+	for (i = 0; i < m_cNodes; i++)
+	{
+		const Vector& vecOrigin = m_pNodes[i].m_vecOriginPeek;
+
+		mins[0] = V_min(mins[0], vecOrigin.x);
+		mins[1] = V_min(mins[1], vecOrigin.y);
+		maxs[0] = V_max(maxs[0], vecOrigin.x);
+		maxs[1] = V_max(maxs[1], vecOrigin.y);
+	}
+
+	// Size the cells so the grid never gets bigger than NODE_GRID_MAX_CELLS along either axis.
 	//
+	const float flExtent = V_max(maxs[0] - mins[0], maxs[1] - mins[1]);
+
+	m_flGridCellSize = V_max(static_cast<float>(NODE_GRID_MIN_CELL_SIZE), flExtent / NODE_GRID_MAX_CELLS);
+	m_GridMins[0] = mins[0];
+	m_GridMins[1] = mins[1];
+	m_cGridCellsX = V_min(NODE_GRID_MAX_CELLS, static_cast<int>((maxs[0] - mins[0]) / m_flGridCellSize) + 1);
+	m_cGridCellsY = V_min(NODE_GRID_MAX_CELLS, static_cast<int>((maxs[1] - mins[1]) / m_flGridCellSize) + 1);
+
+	const int cCells = m_cGridCellsX * m_cGridCellsY;
+
+	m_pGridEntries = (NODE_GRID_ENTRY*)calloc(sizeof(NODE_GRID_ENTRY), m_cNodes);
+	m_pGridCellStart = (int*)calloc(sizeof(int), cCells + 1);
+	m_pGridCellTypes = (byte*)calloc(sizeof(byte), cCells);
+	m_pGridCandidates = (NODE_GRID_CANDIDATE*)calloc(sizeof(NODE_GRID_CANDIDATE), m_cNodes);
+	int* piNodeCell = (int*)calloc(sizeof(int), m_cNodes);
+
+	if (!m_pGridEntries || !m_pGridCellStart || !m_pGridCellTypes || !m_pGridCandidates || !piNodeCell)
+	{
+		ALERT(at_aiconsole, "Couldn't allocate node grid.\n");
+		free(piNodeCell);
+		FreeNodeGrid();
+		return false;
+	}
+
+	// Count the nodes in each cell, then turn the counts into start offsets.
 	//
-	int i;
-	for (i = 0; i < 3; i++)
+	for (i = 0; i < m_cNodes; i++)
 	{
-		m_RegionMin[i] = 999999999.0;  // just a big number out there;
-		m_RegionMax[i] = -999999999.0; // just a big number out there;
+		const Vector& vecOrigin = m_pNodes[i].m_vecOriginPeek;
+
+		const int x = std::clamp(static_cast<int>((vecOrigin.x - m_GridMins[0]) / m_flGridCellSize), 0, m_cGridCellsX - 1);
+		const int y = std::clamp(static_cast<int>((vecOrigin.y - m_GridMins[1]) / m_flGridCellSize), 0, m_cGridCellsY - 1);
+
+		piNodeCell[i] = y * m_cGridCellsX + x;
+		m_pGridCellStart[piNodeCell[i] + 1]++;
+		m_pGridCellTypes[piNodeCell[i]] |= m_pNodes[i].m_afNodeInfo & bits_NODE_GROUP_REALM;
+	}
+
+	for (i = 0; i < cCells; i++)
+	{
+		m_pGridCellStart[i + 1] += m_pGridCellStart[i];
 	}
+
+	// Fill in the cells. The start offsets are used as insertion cursors and restored afterwards.
+	//
 	for (i = 0; i < m_cNodes; i++)
 	{
-		if (m_pNodes[i].m_vecOrigin.x < m_RegionMin[0])
-			m_RegionMin[0] = m_pNodes[i].m_vecOrigin.x;
-		if (m_pNodes[i].m_vecOrigin.y < m_RegionMin[1])
-			m_RegionMin[1] = m_pNodes[i].m_vecOrigin.y;
-		if (m_pNodes[i].m_vecOrigin.z < m_RegionMin[2])
-			m_RegionMin[2] = m_pNodes[i].m_vecOrigin.z;
+		NODE_GRID_ENTRY& entry = m_pGridEntries[m_pGridCellStart[piNodeCell[i]]++];
+
+		entry.vecOrigin = m_pNodes[i].m_vecOriginPeek;
+		entry.iNode = i;
+		entry.afNodeTypes = m_pNodes[i].m_afNodeInfo & bits_NODE_GROUP_REALM;
+	}
+
+	for (i = cCells; i > 0; i--)
+	{
+		m_pGridCellStart[i] = m_pGridCellStart[i - 1];
+	}
+	m_pGridCellStart[0] = 0;
+
+	free(piNodeCell);
+
+	ALERT(at_aiconsole, "Node grid: %d x %d cells of %.0f units\n", m_cGridCellsX, m_cGridCellsY, m_flGridCellSize);
+
+	return true;
+}
+
+void CGraph::FreeNodeGrid()
+{
+	if (m_pGridEntries)
+	{
+		free(m_pGridEntries);
+		m_pGridEntries = NULL;
+	}
+
+	if (m_pGridCellStart)
+	{
+		free(m_pGridCellStart);
+		m_pGridCellStart = NULL;
+	}
+
+	if (m_pGridCellTypes)
+	{
+		free(m_pGridCellTypes);
+		m_pGridCellTypes = NULL;
+	}
+
+	if (m_pGridCandidates)
+	{
+		free(m_pGridCandidates);
+		m_pGridCandidates = NULL;
+	}
+
+	m_cGridCellsX = m_cGridCellsY = 0;
+}
+
+//=========================================================
+// CGraph - BuildNodeClusters - groups the nodes into
+// clusters and computes the portal costs between each
+// cluster's entrances. Needs the link entity pointers to be
+// set, since doors are checked the same way FindShortestPath
+// checks them.
+//=========================================================
+bool CGraph::BuildNodeClusters()
+{
+	FreeNodeClusters();
+
+	if (m_cNodes <= 0)
+	{
+		return false;
+	}
+
+	m_pNodeCluster = (short*)malloc(sizeof(short) * m_cNodes);
+	m_pNodeEntrance = (short*)malloc(sizeof(short) * m_cNodes);
+	m_pClusterNodes = (short*)malloc(sizeof(short) * m_cNodes);
+	m_pClusters = (NODE_CLUSTER*)calloc(sizeof(NODE_CLUSTER), m_cNodes);
 
-		if (m_pNodes[i].m_vecOrigin.x > m_RegionMax[0])
-			m_RegionMax[0] = m_pNodes[i].m_vecOrigin.x;
-		if (m_pNodes[i].m_vecOrigin.y > m_RegionMax[1])
-			m_RegionMax[1] = m_pNodes[i].m_vecOrigin.y;
-		if (m_pNodes[i].m_vecOrigin.z > m_RegionMax[2])
-			m_RegionMax[2] = m_pNodes[i].m_vecOrigin.z;
+	if (!m_pNodeCluster || !m_pNodeEntrance || !m_pClusterNodes || !m_pClusters)
+	{
+		ALERT(at_aiconsole, "Couldn't malloc node clusters!\n");
+		FreeNodeClusters();
+		return false;
 	}
+
+	int i, j;
 	for (i = 0; i < m_cNodes; i++)
 	{
-		m_pNodes[i].m_Region[0] = CALC_RANGE(m_pNodes[i].m_vecOrigin.x, m_RegionMin[0], m_RegionMax[0]);
-		m_pNodes[i].m_Region[1] = CALC_RANGE(m_pNodes[i].m_vecOrigin.y, m_RegionMin[1], m_RegionMax[1]);
-		m_pNodes[i].m_Region[2] = CALC_RANGE(m_pNodes[i].m_vecOrigin.z, m_RegionMin[2], m_RegionMax[2]);
+		m_pNodeCluster[i] = -1;
+		m_pNodeEntrance[i] = -1;
 	}
 
-	for (i = 0; i < 3; i++)
+	// Grow each cluster breadth first from the lowest unassigned node, which keeps
+	// clusters connected and roughly round. Nodes are added to m_pClusterNodes in
+	// the order they are reached, so each cluster's nodes end up next to each other.
+	//
+	int cAssigned = 0;
+	for (i = 0; i < m_cNodes; i++)
 	{
-		int j;
-		for (j = 0; j < NUM_RANGES; j++)
+		if (m_pNodeCluster[i] != -1)
+			continue;
+
+		NODE_CLUSTER& cluster = m_pClusters[m_cClusters];
+		cluster.iFirstNode = cAssigned;
+
+		m_pNodeCluster[i] = m_cClusters;
+		m_pClusterNodes[cAssigned++] = i;
+
+		for (int iQueue = cluster.iFirstNode; iQueue < cAssigned && cAssigned - cluster.iFirstNode < NODE_CLUSTER_MAX_NODES; iQueue++)
 		{
-			m_RangeStart[i][j] = 255;
-			m_RangeEnd[i][j] = 0;
+			const CNode& node = m_pNodes[m_pClusterNodes[iQueue]];
+
+			for (j = 0; j < node.m_cNumLinks && cAssigned - cluster.iFirstNode < NODE_CLUSTER_MAX_NODES; j++)
+			{
+				const int iDestNode = m_pLinkPool[node.m_iFirstLink + j].m_iDestNode;
+
+				if (m_pNodeCluster[iDestNode] == -1)
+				{
+					m_pNodeCluster[iDestNode] = m_cClusters;
+					m_pClusterNodes[cAssigned++] = iDestNode;
+				}
+			}
 		}
-		for (j = 0; j < m_cNodes; j++)
+
+		cluster.cNodes = cAssigned - cluster.iFirstNode;
+		m_cClusters++;
+	}
+
+	// Any node with a link into or out of its cluster is an entrance.
+	//
+	for (i = 0; i < m_cLinks; i++)
+	{
+		const CLink& link = m_pLinkPool[i];
+
+		if (m_pNodeCluster[link.m_iSrcNode] != m_pNodeCluster[link.m_iDestNode])
 		{
-			m_di[j].m_SortedBy[i] = j;
+			m_pNodeEntrance[link.m_iSrcNode] = 0;
+			m_pNodeEntrance[link.m_iDestNode] = 0;
 		}
+	}
+
+	int cEntrances = 0;
+	int cCosts = 0;
+	for (i = 0; i < m_cClusters; i++)
+	{
+		NODE_CLUSTER& cluster = m_pClusters[i];
+		cluster.iFirstEntrance = cEntrances;
+		cluster.iFirstCost = cCosts;
 
-		for (j = 0; j < m_cNodes - 1; j++)
+		for (j = 0; j < cluster.cNodes; j++)
 		{
-			int jNode = m_di[j].m_SortedBy[i];
-			int jCodeX = m_pNodes[jNode].m_Region[0];
-			int jCodeY = m_pNodes[jNode].m_Region[1];
-			int jCodeZ = m_pNodes[jNode].m_Region[2];
-			int jCode;
-			switch (i)
+			const int iNode = m_pClusterNodes[cluster.iFirstNode + j];
+
+			if (m_pNodeEntrance[iNode] != -1)
 			{
-			case 0:
-				jCode = (jCodeX << 16) + (jCodeY << 8) + jCodeZ;
-				break;
-			case 1:
-				jCode = (jCodeY << 16) + (jCodeZ << 8) + jCodeX;
-				break;
-			case 2:
-				jCode = (jCodeZ << 16) + (jCodeX << 8) + jCodeY;
-				break;
+				m_pNodeEntrance[iNode] = cluster.cEntrances++;
 			}
+		}
+
+		cEntrances += cluster.cEntrances;
+		cCosts += MAX_NODE_HULLS * 2 * cluster.cEntrances * cluster.cEntrances;
+	}
+
+	m_pClusterEntrances = (short*)malloc(sizeof(short) * V_max(1, cEntrances));
+	m_pClusterCosts = (float*)malloc(sizeof(float) * V_max(1, cCosts));
+
+	if (!m_pClusterEntrances || !m_pClusterCosts)
+	{
+		ALERT(at_aiconsole, "Couldn't malloc %d node cluster portal costs!\n", cCosts);
+		FreeNodeClusters();
+		return false;
+	}
+
+	for (i = 0; i < m_cNodes; i++)
+	{
+		if (m_pNodeEntrance[i] != -1)
+		{
+			m_pClusterEntrances[m_pClusters[m_pNodeCluster[i]].iFirstEntrance + m_pNodeEntrance[i]] = i;
+		}
+	}
+
+	// Portal costs, for each hull and capability index like the routing tables.
+	//
+	for (i = 0; i < m_cClusters; i++)
+	{
+		const NODE_CLUSTER& cluster = m_pClusters[i];
 
-			for (int k = j + 1; k < m_cNodes; k++)
+		for (int iHull = 0; iHull < MAX_NODE_HULLS; iHull++)
+		{
+			for (int iCap = 0; iCap < 2; iCap++)
 			{
-				int kNode = m_di[k].m_SortedBy[i];
-				int kCodeX = m_pNodes[kNode].m_Region[0];
-				int kCodeY = m_pNodes[kNode].m_Region[1];
-				int kCodeZ = m_pNodes[kNode].m_Region[2];
-				int kCode;
-				switch (i)
-				{
-				case 0:
-					kCode = (kCodeX << 16) + (kCodeY << 8) + kCodeZ;
-					break;
-				case 1:
-					kCode = (kCodeY << 16) + (kCodeZ << 8) + kCodeX;
-					break;
-				case 2:
-					kCode = (kCodeZ << 16) + (kCodeX << 8) + kCodeY;
-					break;
-				}
+				const int afCapMask = iCap == 0 ? 0 : (bits_CAP_OPEN_DOORS | bits_CAP_AUTO_DOORS | bits_CAP_USE);
 
-				if (kCode < jCode)
+				for (j = 0; j < cluster.cEntrances; j++)
 				{
-					// Swap j and k entries.
-					//
-					int Tmp = m_di[j].m_SortedBy[i];
-					m_di[j].m_SortedBy[i] = m_di[k].m_SortedBy[i];
-					m_di[k].m_SortedBy[i] = Tmp;
+					SearchCluster(i, m_pClusterEntrances[cluster.iFirstEntrance + j], NO_NODE, NodeHullLinkMask(iHull), afCapMask);
+
+					float* pCosts = m_pClusterCosts + cluster.iFirstCost + ((iHull * 2 + iCap) * cluster.cEntrances + j) * cluster.cEntrances;
+
+					for (int k = 0; k < cluster.cEntrances; k++)
+					{
+						pCosts[k] = V_max(-1.0f, m_pNodes[m_pClusterEntrances[cluster.iFirstEntrance + k]].m_flClosestSoFar);
+					}
 				}
 			}
 		}
 	}
 
-	// Generate lookup tables.
+	ALERT(at_aiconsole, "%d node clusters, %d entrances\n", m_cClusters, cEntrances);
+
+	return true;
+}
+
+void CGraph::FreeNodeClusters()
+{
+	if (m_pNodeCluster)
+	{
+		free(m_pNodeCluster);
+		m_pNodeCluster = NULL;
+	}
+
+	if (m_pNodeEntrance)
+	{
+		free(m_pNodeEntrance);
+		m_pNodeEntrance = NULL;
+	}
+
+	if (m_pClusterNodes)
+	{
+		free(m_pClusterNodes);
+		m_pClusterNodes = NULL;
+	}
+
+	if (m_pClusterEntrances)
+	{
+		free(m_pClusterEntrances);
+		m_pClusterEntrances = NULL;
+	}
+
+	if (m_pClusterCosts)
+	{
+		free(m_pClusterCosts);
+		m_pClusterCosts = NULL;
+	}
+
+	if (m_pClusters)
+	{
+		free(m_pClusters);
+		m_pClusters = NULL;
+	}
+
+	m_cClusters = 0;
+	m_fClustersBuilt = 0;
+}
+
+//=========================================================
+// CompressRouteTable - run-length encodes one node's row of
+// the routing table (the next node to take from iFrom to
+// every other node) into pRoute, which must have room for
+// 2 * cNodes bytes. Returns the number of bytes written.
+//
+// Called from the routing table builder's worker threads,
+// so it must not call into the engine.
+//=========================================================
+static int CompressRouteTable(const unsigned short* BestNextNodes, int iFrom, int cNodes, char* pRoute, bool& fNeedsSorting)
+{
+	// Compress this node's routing table.
 	//
-	for (i = 0; i < m_cNodes; i++)
+	int iLastNode = 9999999; // just really big.
+	int cSequence = 0;
+	int cRepeats = 0;
+	char* p = pRoute;
+	for (int i = 0; i < cNodes; i++)
 	{
-		int CodeX = m_pNodes[m_di[i].m_SortedBy[0]].m_Region[0];
-		int CodeY = m_pNodes[m_di[i].m_SortedBy[1]].m_Region[1];
-		int CodeZ = m_pNodes[m_di[i].m_SortedBy[2]].m_Region[2];
+		bool CanRepeat = ((BestNextNodes[i] == iLastNode) && cRepeats < 127);
+		bool CanSequence = (BestNextNodes[i] == i && cSequence < 128);
 
-		if (i < m_RangeStart[0][CodeX])
+		if (0 != cRepeats)
 		{
-			m_RangeStart[0][CodeX] = i;
+			if (CanRepeat)
+			{
+				cRepeats++;
+			}
+			else
+			{
+				// Emit the repeat phrase.
+				//
+				*p++ = cRepeats - 1;
+				int a = iLastNode - iFrom;
+				int b = iLastNode - iFrom + cNodes;
+				int c = iLastNode - iFrom - cNodes;
+				if (-128 <= a && a <= 127)
+				{
+					*p++ = a;
+				}
+				else if (-128 <= b && b <= 127)
+				{
+					*p++ = b;
+				}
+				else if (-128 <= c && c <= 127)
+				{
+					*p++ = c;
+				}
+				else
+				{
+					fNeedsSorting = true;
+				}
+				cRepeats = 0;
+
+				if (CanSequence)
+				{
+					// Start a sequence.
+					//
+					cSequence++;
+				}
+				else
+				{
+					// Start another repeat.
+					//
+					cRepeats++;
+				}
+			}
+		}
+		else if (0 != cSequence)
+		{
+			if (CanSequence)
+			{
+				cSequence++;
+			}
+			else
+			{
+				// It may be advantageous to combine
+				// a single-entry sequence phrase with the
+				// next repeat phrase.
+				//
+				if (cSequence == 1 && CanRepeat)
+				{
+					// Combine with repeat phrase.
+					//
+					cRepeats = 2;
+					cSequence = 0;
+				}
+				else
+				{
+					// Emit the sequence phrase.
+					//
+					*p++ = -cSequence;
+					cSequence = 0;
+
+					// Start a repeat sequence.
+					//
+					cRepeats++;
+				}
+			}
 		}
-		if (i < m_RangeStart[1][CodeY])
+		else
 		{
-			m_RangeStart[1][CodeY] = i;
+			if (CanSequence)
+			{
+				// Start a sequence phrase.
+				//
+				cSequence++;
+			}
+			else
+			{
+				// Start a repeat sequence.
+				//
+				cRepeats++;
+			}
 		}
-		if (i < m_RangeStart[2][CodeZ])
+		iLastNode = BestNextNodes[i];
+	}
+	if (0 != cRepeats)
+	{
+		// Emit the repeat phrase.
+		//
+		*p++ = cRepeats - 1;
+#if 0
+		iLastNode = iFrom + *pRoute;
+		if (iLastNode >= cNodes) iLastNode -= cNodes;
+		else if (iLastNode < 0) iLastNode += cNodes;
+#endif
+		int a = iLastNode - iFrom;
+		int b = iLastNode - iFrom + cNodes;
+		int c = iLastNode - iFrom - cNodes;
+		if (-128 <= a && a <= 127)
 		{
-			m_RangeStart[2][CodeZ] = i;
+			*p++ = a;
 		}
-		if (m_RangeEnd[0][CodeX] < i)
+		else if (-128 <= b && b <= 127)
 		{
-			m_RangeEnd[0][CodeX] = i;
+			*p++ = b;
 		}
-		if (m_RangeEnd[1][CodeY] < i)
+		else if (-128 <= c && c <= 127)
 		{
-			m_RangeEnd[1][CodeY] = i;
+			*p++ = c;
 		}
-		if (m_RangeEnd[2][CodeZ] < i)
+		else
 		{
-			m_RangeEnd[2][CodeZ] = i;
+			fNeedsSorting = true;
 		}
 	}
+	if (0 != cSequence)
+	{
+		// Emit the Sequence phrase.
+		//
+		*p++ = -cSequence;
+	}
 
-	// Initialize the cache.
-	//
-	memset(m_Cache, 0, sizeof(m_Cache));
+	return p - pRoute;
 }
 
-void CGraph::ComputeStaticRoutingTables()
+//=========================================================
+// Routing table builder. Every (hull, capability, source
+// node) combination is an independent single-source search
+// over the graph, so they are handed out to a pool of worker
+// threads. Workers only read the graph and write to their own
+// scratch and result slots; everything that has to look at
+// entities is resolved on the game thread beforehand.
+//=========================================================
+typedef struct
 {
-	int nRoutes = m_cNodes * m_cNodes;
-#define FROM_TO(x, y) ((x)*m_cNodes + (y))
-	short* Routes = new short[nRoutes];
+	float flDistance;
+	int iNode;
+} ROUTE_HEAP_ENTRY;
 
-	int* pMyPath = new int[m_cNodes];
-	unsigned short* BestNextNodes = new unsigned short[m_cNodes];
-	char* pRoute = new char[m_cNodes * 2];
+struct CRouteBuildJobs
+{
+	const CGraph* pGraph;
+	const byte* pLinkUsable; // m_cLinks * 2, whether each link can be used with each capability index.
+	std::vector<char>* pResults;
+	std::atomic<int> iNextJob;
+	std::atomic<bool> fNeedsSorting;
+	int cJobs;
+};
+
+static void RouteBuildWorker(CRouteBuildJobs& jobs)
+{
+	const CGraph& graph = *jobs.pGraph;
+	const int cNodes = graph.m_cNodes;
 
+	// CQueuePriority only holds MAX_STACK_NODES entries, which isn't enough
+	// for a search that visits the whole graph, so use a heap of our own.
+	std::vector<float> distances(cNodes);
+	std::vector<unsigned short> BestNextNodes(cNodes);
+	std::vector<ROUTE_HEAP_ENTRY> heap;
+	std::vector<char> route(cNodes * 2);
 
-	if (Routes && pMyPath && BestNextNodes && pRoute)
+	heap.reserve(cNodes);
+
+	const auto heapCompare = [](const ROUTE_HEAP_ENTRY& lhs, const ROUTE_HEAP_ENTRY& rhs)
+	{ return lhs.flDistance > rhs.flDistance; };
+
+	for (int iJob = jobs.iNextJob++; iJob < jobs.cJobs; iJob = jobs.iNextJob++)
 	{
-		int nTotalCompressedSize = 0;
-		for (int iHull = 0; iHull < MAX_NODE_HULLS; iHull++)
+		const int iFrom = iJob % cNodes;
+		const int iCap = (iJob / cNodes) % 2;
+		const int iHull = iJob / (cNodes * 2);
+
+		const int iHullMask = NodeHullLinkMask(iHull);
+
+		// Unreachable nodes (and the source itself) route to the source.
+		//
+		int i;
+		for (i = 0; i < cNodes; i++)
 		{
-			for (int iCap = 0; iCap < 2; iCap++)
+			distances[i] = -1.0;
+			BestNextNodes[i] = iFrom;
+		}
+
+		distances[iFrom] = 0.0;
+		heap.clear();
+		heap.push_back({0.0, iFrom});
+
+		while (!heap.empty())
+		{
+			std::pop_heap(heap.begin(), heap.end(), heapCompare);
+			const ROUTE_HEAP_ENTRY current = heap.back();
+			heap.pop_back();
+
+			// Stale entry, this node has been reached by a shorter path since.
+			if (current.flDistance > distances[current.iNode])
+				continue;
+
+			const CNode& node = graph.m_pNodes[current.iNode];
+
+			for (i = 0; i < node.m_cNumLinks; i++)
 			{
-				int iCapMask;
-				switch (iCap)
-				{
-				case 0:
-					iCapMask = 0;
-					break;
+				const int iLink = node.m_iFirstLink + i;
+				const CLink& link = graph.m_pLinkPool[iLink];
 
-				case 1:
-					iCapMask = bits_CAP_OPEN_DOORS | bits_CAP_AUTO_DOORS | bits_CAP_USE;
-					break;
-				}
+				if ((link.m_afLinkInfo & iHullMask) != iHullMask || 0 == jobs.pLinkUsable[iLink * 2 + iCap])
+					continue;
 
+				const int iVisitNode = link.m_iDestNode;
+				const float flOurDistance = current.flDistance + link.m_flWeight;
 
-				// Initialize Routing table to uncalculated.
-				//
-				int iFrom;
-				for (iFrom = 0; iFrom < m_cNodes; iFrom++)
+				// Same relaxation rule as FindShortestPath.
+				if (distances[iVisitNode] < -0.5 || flOurDistance < distances[iVisitNode] - 0.001)
 				{
-					for (int iTo = 0; iTo < m_cNodes; iTo++)
-					{
-						Routes[FROM_TO(iFrom, iTo)] = -1;
-					}
+					distances[iVisitNode] = flOurDistance;
+
+					// The first step is the same for every node down this branch of the search.
+					BestNextNodes[iVisitNode] = current.iNode == iFrom ? iVisitNode : BestNextNodes[current.iNode];
+
+					heap.push_back({flOurDistance, iVisitNode});
+					std::push_heap(heap.begin(), heap.end(), heapCompare);
 				}
+			}
+		}
 
-				for (iFrom = 0; iFrom < m_cNodes; iFrom++)
-				{
-					for (int iTo = m_cNodes - 1; iTo >= 0; iTo--)
-					{
-						if (Routes[FROM_TO(iFrom, iTo)] != -1)
-							continue;
+		bool fNeedsSorting = false;
+		const int nRoute = CompressRouteTable(BestNextNodes.data(), iFrom, cNodes, route.data(), fNeedsSorting);
 
-						int cPathSize = FindShortestPath(pMyPath, iFrom, iTo, iHull, iCapMask);
+		jobs.pResults[iJob].assign(route.data(), route.data() + nRoute);
 
-						// Use the computed path to update the routing table.
-						//
-						if (cPathSize > 1)
-						{
-							for (int iNode = 0; iNode < cPathSize - 1; iNode++)
-							{
-								int iStart = pMyPath[iNode];
-								int iNext = pMyPath[iNode + 1];
-								for (int iNode1 = iNode + 1; iNode1 < cPathSize; iNode1++)
-								{
-									int iEnd = pMyPath[iNode1];
-									Routes[FROM_TO(iStart, iEnd)] = iNext;
-								}
-							}
-#if 0
-							// Well, at first glance, this should work, but actually it's safer
-							// to be told explictly that you can take a series of node in a
-							// particular direction. Some links don't appear to have links in
-							// the opposite direction.
-							//
-							for (iNode = cPathSize-1; iNode >= 1; iNode--)
-							{
-								int iStart = pMyPath[iNode];
-								int iNext  = pMyPath[iNode-1];
-								for (int iNode1 = iNode-1; iNode1 >= 0; iNode1--)
-								{
-									int iEnd = pMyPath[iNode1];
-									Routes[FROM_TO(iStart, iEnd)] = iNext;
-								}
-							}
-#endif
-						}
-						else
-						{
-							Routes[FROM_TO(iFrom, iTo)] = iFrom;
-							Routes[FROM_TO(iTo, iFrom)] = iTo;
-						}
-					}
-				}
+		if (fNeedsSorting)
+		{
+			jobs.fNeedsSorting = true;
+		}
+	}
+}
 
-				for (iFrom = 0; iFrom < m_cNodes; iFrom++)
-				{
-					for (int iTo = 0; iTo < m_cNodes; iTo++)
-					{
-						BestNextNodes[iTo] = Routes[FROM_TO(iFrom, iTo)];
-					}
+void CGraph::ComputeStaticRoutingTables()
+{
+	if (m_cNodes <= 0)
+	{
+		return;
+	}
 
-					// Compress this node's routing table.
-					//
-					int iLastNode = 9999999; // just really big.
-					int cSequence = 0;
-					int cRepeats = 0;
-					int CompressedSize = 0;
-					char* p = pRoute;
-					for (int i = 0; i < m_cNodes; i++)
-					{
-						bool CanRepeat = ((BestNextNodes[i] == iLastNode) && cRepeats < 127);
-						bool CanSequence = (BestNextNodes[i] == i && cSequence < 128);
+	// HandleLinkEnt looks at entities, so work out which links can be used with
+	// each capability here instead of in the workers.
+	//
+	std::vector<byte> linkUsable(m_cLinks * 2, 1);
 
-						if (0 != cRepeats)
-						{
-							if (CanRepeat)
-							{
-								cRepeats++;
-							}
-							else
-							{
-								// Emit the repeat phrase.
-								//
-								CompressedSize += 2; // (count-1, iLastNode-i)
-								*p++ = cRepeats - 1;
-								int a = iLastNode - iFrom;
-								int b = iLastNode - iFrom + m_cNodes;
-								int c = iLastNode - iFrom - m_cNodes;
-								if (-128 <= a && a <= 127)
-								{
-									*p++ = a;
-								}
-								else if (-128 <= b && b <= 127)
-								{
-									*p++ = b;
-								}
-								else if (-128 <= c && c <= 127)
-								{
-									*p++ = c;
-								}
-								else
-								{
-									ALERT(at_aiconsole, "Nodes need sorting (%d,%d)!\n", iLastNode, iFrom);
-								}
-								cRepeats = 0;
+	int i;
+	for (i = 0; i < m_cLinks; i++)
+	{
+		if (m_pLinkPool[i].m_pLinkEnt != NULL)
+		{
+			linkUsable[i * 2 + 0] = HandleLinkEnt(m_pLinkPool[i].m_iSrcNode, m_pLinkPool[i].m_pLinkEnt, 0, NODEGRAPH_STATIC) ? 1 : 0;
+			linkUsable[i * 2 + 1] = HandleLinkEnt(m_pLinkPool[i].m_iSrcNode, m_pLinkPool[i].m_pLinkEnt,
+									  bits_CAP_OPEN_DOORS | bits_CAP_AUTO_DOORS | bits_CAP_USE, NODEGRAPH_STATIC)
+										? 1
+										: 0;
+		}
+	}
 
-								if (CanSequence)
-								{
-									// Start a sequence.
-									//
-									cSequence++;
-								}
-								else
-								{
-									// Start another repeat.
-									//
-									cRepeats++;
-								}
-							}
-						}
-						else if (0 != cSequence)
-						{
-							if (CanSequence)
-							{
-								cSequence++;
-							}
-							else
-							{
-								// It may be advantageous to combine
-								// a single-entry sequence phrase with the
-								// next repeat phrase.
-								//
-								if (cSequence == 1 && CanRepeat)
-								{
-									// Combine with repeat phrase.
-									//
-									cRepeats = 2;
-									cSequence = 0;
-								}
-								else
-								{
-									// Emit the sequence phrase.
-									//
-									CompressedSize += 1; // (-count)
-									*p++ = -cSequence;
-									cSequence = 0;
-
-									// Start a repeat sequence.
-									//
-									cRepeats++;
-								}
-							}
-						}
-						else
-						{
-							if (CanSequence)
-							{
-								// Start a sequence phrase.
-								//
-								cSequence++;
-							}
-							else
-							{
-								// Start a repeat sequence.
-								//
-								cRepeats++;
-							}
-						}
-						iLastNode = BestNextNodes[i];
-					}
-					if (0 != cRepeats)
-					{
-						// Emit the repeat phrase.
-						//
-						CompressedSize += 2;
-						*p++ = cRepeats - 1;
-#if 0
-						iLastNode = iFrom + *pRoute;
-						if (iLastNode >= m_cNodes) iLastNode -= m_cNodes;
-						else if (iLastNode < 0) iLastNode += m_cNodes;
-#endif
-						int a = iLastNode - iFrom;
-						int b = iLastNode - iFrom + m_cNodes;
-						int c = iLastNode - iFrom - m_cNodes;
-						if (-128 <= a && a <= 127)
-						{
-							*p++ = a;
-						}
-						else if (-128 <= b && b <= 127)
-						{
-							*p++ = b;
-						}
-						else if (-128 <= c && c <= 127)
-						{
-							*p++ = c;
-						}
-						else
-						{
-							ALERT(at_aiconsole, "Nodes need sorting (%d,%d)!\n", iLastNode, iFrom);
-						}
-					}
-					if (0 != cSequence)
-					{
-						// Emit the Sequence phrase.
-						//
-						CompressedSize += 1;
-						*p++ = -cSequence;
-					}
+	CRouteBuildJobs jobs;
+	jobs.pGraph = this;
+	jobs.pLinkUsable = linkUsable.data();
+	jobs.cJobs = MAX_NODE_HULLS * 2 * m_cNodes;
+	jobs.iNextJob = 0;
+	jobs.fNeedsSorting = false;
 
-					// Go find a place to store this thing and point to it.
-					//
-					int nRoute = p - pRoute;
-					if (m_pRouteInfo)
-					{
-						int i;
-						for (i = 0; i < m_nRouteInfo - nRoute; i++)
-						{
-							if (memcmp(m_pRouteInfo + i, pRoute, nRoute) == 0)
-							{
-								break;
-							}
-						}
-						if (i < m_nRouteInfo - nRoute)
-						{
-							m_pNodes[iFrom].m_pNextBestNode[iHull][iCap] = i;
-						}
-						else
-						{
-							char* Tmp = (char*)calloc(sizeof(char), (m_nRouteInfo + nRoute));
-							memcpy(Tmp, m_pRouteInfo, m_nRouteInfo);
-							free(m_pRouteInfo);
-							m_pRouteInfo = Tmp;
-							memcpy(m_pRouteInfo + m_nRouteInfo, pRoute, nRoute);
-							m_pNodes[iFrom].m_pNextBestNode[iHull][iCap] = m_nRouteInfo;
-							m_nRouteInfo += nRoute;
-							nTotalCompressedSize += CompressedSize;
-						}
-					}
-					else
-					{
-						m_nRouteInfo = nRoute;
-						m_pRouteInfo = (char*)calloc(sizeof(char), nRoute);
-						memcpy(m_pRouteInfo, pRoute, nRoute);
-						m_pNodes[iFrom].m_pNextBestNode[iHull][iCap] = 0;
-						nTotalCompressedSize += CompressedSize;
-					}
-				}
-			}
+	std::vector<std::vector<char>> results(jobs.cJobs);
+	jobs.pResults = results.data();
+
+	int cThreads = static_cast<int>(sv_nodegraph_threads.value);
+
+	if (cThreads <= 0)
+	{
+		cThreads = static_cast<int>(std::thread::hardware_concurrency());
+	}
+
+	cThreads = std::clamp(cThreads, 1, jobs.cJobs);
+
+	ALERT(at_aiconsole, "Computing routing tables for %d nodes on %d threads\n", m_cNodes, cThreads);
+
+	// The game thread does its share of the work too.
+	//
+	std::vector<std::thread> threads;
+	threads.reserve(cThreads - 1);
+
+	for (i = 1; i < cThreads; i++)
+	{
+		threads.emplace_back(RouteBuildWorker, std::ref(jobs));
+	}
+
+	RouteBuildWorker(jobs);
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	if (jobs.fNeedsSorting)
+	{
+		ALERT(at_aiconsole, "Nodes need sorting!\n");
+	}
+
+	// Merge the compressed rows in a fixed order so the output doesn't depend on the
+	// thread count. Rows that already appear somewhere in the route info are shared.
+	//
+	std::vector<char> routeInfo;
+
+	for (int iJob = 0; iJob < jobs.cJobs; iJob++)
+	{
+		const int iFrom = iJob % m_cNodes;
+		const int iCap = (iJob / m_cNodes) % 2;
+		const int iHull = iJob / (m_cNodes * 2);
+
+		const std::vector<char>& route = results[iJob];
+
+		const auto it = std::search(routeInfo.begin(), routeInfo.end(),
+			std::boyer_moore_horspool_searcher(route.begin(), route.end()));
+
+		if (it != routeInfo.end() || route.empty())
+		{
+			m_pNodes[iFrom].m_pNextBestNode[iHull][iCap] = it - routeInfo.begin();
+		}
+		else
+		{
+			m_pNodes[iFrom].m_pNextBestNode[iHull][iCap] = routeInfo.size();
+			routeInfo.insert(routeInfo.end(), route.begin(), route.end());
 		}
-		ALERT(at_aiconsole, "Size of Routes = %d\n", nTotalCompressedSize);
 	}
 
-	delete[] Routes;
-	delete[] BestNextNodes;
-	delete[] pRoute;
-	delete[] pMyPath;
+	if (m_pRouteInfo)
+	{
+		free(m_pRouteInfo);
+	}
 
-	Routes = 0;
-	BestNextNodes = 0;
-	pRoute = 0;
-	pMyPath = 0;
+	m_nRouteInfo = routeInfo.size();
+	m_pRouteInfo = (char*)calloc(sizeof(char), V_max(1, m_nRouteInfo));
+	memcpy(m_pRouteInfo, routeInfo.data(), m_nRouteInfo);
+
+	ALERT(at_aiconsole, "Size of Routes = %d\n", m_nRouteInfo);
 
 #if 0
 	TestRoutingTables();
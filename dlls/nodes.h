@@ -19,6 +19,7 @@
 #pragma once
 
 class FSFile;
+class FSMappedFile;
 
 //=========================================================
 // DEFINE
@@ -40,7 +41,6 @@ class CNode
 public:
 	Vector m_vecOrigin;		// location of this node in space
 	Vector m_vecOriginPeek; // location of this node (LAND nodes are NODE_HEIGHT higher).
-	byte m_Region[3];		// Which of 256 regions do each of the coordinate belong?
 	int m_afNodeInfo;		// bits that tell us more about this location
 
 	int m_cNumLinks;  // how many links this node has
@@ -95,20 +95,30 @@ public:
 
 typedef struct
 {
-	int m_SortedBy[3];
-	int m_CheckedEvent;
-} DIST_INFO;
+	Vector vecOrigin; // copy of the node's m_vecOriginPeek, so a cell can be scanned without touching CNode.
+	short iNode;
+	short afNodeTypes; // the node's bits_NODE_GROUP_REALM bits.
+} NODE_GRID_ENTRY;
 
 typedef struct
 {
-	Vector v;
-	short n; // Nearest node or -1 if no node found.
-} CACHE_ENTRY;
+	float flDistSq;
+	short iNode;
+} NODE_GRID_CANDIDATE;
+
+typedef struct
+{
+	int iFirstNode;		// first node of this cluster in m_pClusterNodes.
+	int cNodes;
+	int iFirstEntrance; // first entrance of this cluster in m_pClusterEntrances.
+	int cEntrances;
+	int iFirstCost; // first portal cost of this cluster in m_pClusterCosts.
+} NODE_CLUSTER;
 
 //=========================================================
 // CGraph
 //=========================================================
-#define GRAPH_VERSION (int)16 // !!!increment this whever graph/node/link classes change, to obsolesce older disk files.
+#define GRAPH_VERSION (int)18 // !!!increment this whever graph/node/link classes change, to obsolesce older disk files.
 class CGraph
 {
 public:
@@ -121,31 +131,45 @@ public:
 	CLink* m_pLinkPool; // big list of all node connections
 	char* m_pRouteInfo; // compressed routing information the nodes use.
 
+	FSMappedFile* m_pGraphFile; // if the graph was loaded from a mapped .nod file, m_pRouteInfo and m_pHashLinks point into it.
+
 	int m_cNodes;	  // total number of nodes
 	int m_cLinks;	  // total number of links
 	int m_nRouteInfo; // size of m_pRouteInfo in bytes.
 
-	// Tables for making nearest node lookup faster. SortedBy provided nodes in a
-	// order of a particular coordinate. Instead of doing a binary search, RangeStart
-	// and RangeEnd let you get to the part of SortedBy that you are interested in.
+	// Uniform 2D grid over the node origins for FindNearestNode. Cells are visited in
+	// rings of increasing distance around the query point, and the search stops as soon
+	// as no cell in the next ring can hold a node closer than the best visible one.
+	// This is rebuilt from the nodes whenever the graph is built or loaded, it is not
+	// stored in the .nod file.
 	//
-	// Once you have a point of interest, the only way you'll find a closer point is
-	// if at least one of the coordinates is closer than the ones you have now. So we
-	// search each range. After the search is exhausted, we know we have the closest
-	// node.
+#define NODE_GRID_MAX_CELLS 64		 // maximum number of cells along each axis.
+#define NODE_GRID_MIN_CELL_SIZE 128 // smallest cell size, in units.
+	NODE_GRID_ENTRY* m_pGridEntries;	   // m_cNodes long, grouped by cell.
+	int* m_pGridCellStart;				   // first entry of each cell. Has one extra entry so that m_pGridCellStart[i + 1] ends cell i.
+	byte* m_pGridCellTypes;				   // bits_NODE_GROUP_REALM bits of all nodes in each cell.
+	NODE_GRID_CANDIDATE* m_pGridCandidates; // m_cNodes long, scratch space for FindNearestNode.
+	int m_cGridCellsX, m_cGridCellsY;
+	float m_flGridCellSize;
+	float m_GridMins[2];
+
+	// The nodes are also grouped into small connected clusters for FindShortestPath
+	// when there are no routing tables. A node with a link to or from another cluster
+	// is an entrance, and the shortest distance between every pair of entrances of a
+	// cluster is stored for each hull and capability index. Long searches only walk
+	// the start and destination clusters node by node, and hop from entrance to
+	// entrance everywhere else. Like the grid this is rebuilt, not saved. Graphs with
+	// routing tables never search this way, so the clusters are built on first use.
 	//
-#define CACHE_SIZE 128
-#define NUM_RANGES 256
-	DIST_INFO* m_di; // This is m_cNodes long, but the entries don't correspond to CNode entries.
-	int m_RangeStart[3][NUM_RANGES];
-	int m_RangeEnd[3][NUM_RANGES];
-	float m_flShortest;
-	int m_iNearest;
-	int m_minX, m_minY, m_minZ, m_maxX, m_maxY, m_maxZ;
-	int m_minBoxX, m_minBoxY, m_minBoxZ, m_maxBoxX, m_maxBoxY, m_maxBoxZ;
-	int m_CheckedCounter;
-	float m_RegionMin[3], m_RegionMax[3]; // The range of nodes.
-	CACHE_ENTRY m_Cache[CACHE_SIZE];
+#define NODE_CLUSTER_MAX_NODES 32 // maximum number of nodes in a cluster.
+	short* m_pNodeCluster;		   // m_cNodes long, cluster of each node.
+	short* m_pNodeEntrance;		   // m_cNodes long, index of each node in its cluster's entrances, or -1.
+	short* m_pClusterNodes;		   // m_cNodes long, grouped by cluster.
+	short* m_pClusterEntrances;	   // entrance nodes, grouped by cluster.
+	float* m_pClusterCosts;		   // MAX_NODE_HULLS * 2 * cEntrances * cEntrances per cluster, -1 if unreachable.
+	NODE_CLUSTER* m_pClusters;
+	int m_cClusters;
+	qboolean m_fClustersBuilt; // has BuildNodeClusters run for the current graph and link entities?
 
 
 	int m_HashPrimes[16];
@@ -165,6 +189,8 @@ public:
 	int LinkVisibleNodes(CLink* pLinkPool, FSFile& file, int* piBadNode);
 	int RejectInlineLinks(CLink* pLinkPool, FSFile& file);
 	int FindShortestPath(int* piPath, int iStart, int iDest, int iHull, int afCapMask);
+	int FindClusterPath(int* piPath, int iStart, int iDest, int iHull, int afCapMask);
+	bool SearchCluster(int iCluster, int iStart, int iDest, int iHullMask, int afCapMask);
 	int FindNearestNode(const Vector& vecOrigin, CBaseEntity* pEntity);
 	int FindNearestNode(const Vector& vecOrigin, int afNodeTypes);
 	//int		FindNearestLink ( const Vector &vecTestPoint, int *piNearestLink, bool *pfAlongLine );
@@ -188,9 +214,11 @@ public:
 	bool FLoadGraph(const char* szMapName);
 	bool FSaveGraph(const char* szMapName);
 	bool FSetGraphPointers();
-	void CheckNode(Vector vecOrigin, int iNode);
 
-	void BuildRegionTables();
+	bool BuildNodeGrid();
+	void FreeNodeGrid();
+	bool BuildNodeClusters();
+	void FreeNodeClusters();
 	void ComputeStaticRoutingTables();
 	void TestRoutingTables();
 
@@ -0,0 +1,157 @@
+/***
+*
+*	Copyright (c) 1996-2001, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+#include <utility>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "monsters.h"
+#include "game.h"
+#include "perception.h"
+
+//=========================================================
+// Reset - forgets everything, used when the level changes.
+//=========================================================
+void CPerceptionManager::Reset()
+{
+	memset(m_SightCache, 0, sizeof(m_SightCache));
+	m_iFrame = 1;
+	m_cLowPrioritySenses = 0;
+}
+
+//=========================================================
+// StartFrame - called once per server frame before any
+// monster thinks.
+//=========================================================
+void CPerceptionManager::StartFrame()
+{
+	// Frame 0 is never used so zeroed entries are never valid.
+	if (++m_iFrame == 0)
+	{
+		Reset();
+	}
+
+	m_cLowPrioritySenses = 0;
+}
+
+//=========================================================
+// IsHighPriority - monsters that are doing something near
+// a player always get to sense.
+//=========================================================
+bool CPerceptionManager::IsHighPriority(CBaseMonster* pMonster)
+{
+	if (pMonster->m_MonsterState == MONSTERSTATE_IDLE)
+	{
+		return false;
+	}
+
+	const float flNearDistSquared = sv_ai_perception_near_dist.value * sv_ai_perception_near_dist.value;
+
+	for (int i = 1; i <= gpGlobals->maxClients; i++)
+	{
+		CBaseEntity* pPlayer = UTIL_PlayerByIndex(i);
+
+		if (pPlayer && (pPlayer->pev->origin - pMonster->pev->origin).LengthSquared() <= flNearDistSquared)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//=========================================================
+// ShouldSense
+//=========================================================
+bool CPerceptionManager::ShouldSense(CBaseMonster* pMonster)
+{
+	const float flInterval = sv_ai_perception_interval.value;
+	const int iBudget = static_cast<int>(sv_ai_perception_budget.value);
+
+	if ((flInterval <= 0 && iBudget <= 0) || IsHighPriority(pMonster))
+	{
+		return true;
+	}
+
+	// Staggering keeps the monsters that sensed recently from using up the budget,
+	// so the others get their turn.
+	if (flInterval > 0 && gpGlobals->time - pMonster->m_flLastSenseTime < flInterval && gpGlobals->time >= pMonster->m_flLastSenseTime)
+	{
+		return false;
+	}
+
+	if (iBudget > 0 && m_cLowPrioritySenses >= iBudget)
+	{
+		return false;
+	}
+
+	m_cLowPrioritySenses++;
+	pMonster->m_flLastSenseTime = gpGlobals->time;
+
+	return true;
+}
+
+//=========================================================
+// LineOfSight
+//=========================================================
+bool CPerceptionManager::LineOfSight(CBaseEntity* pLooker, const Vector& vecLookerEye, CBaseEntity* pTarget, const Vector& vecTargetEye)
+{
+	// The trace ignores monsters, so it's only the same both ways if neither end is a
+	// brush entity that the other direction would hit.
+	const bool fCacheable = (pLooker->pev->flags & (FL_CLIENT | FL_MONSTER)) != 0 &&
+							(pTarget->pev->flags & (FL_CLIENT | FL_MONSTER)) != 0 &&
+							pLooker->pev->solid != SOLID_BSP &&
+							pTarget->pev->solid != SOLID_BSP;
+
+	int iEntityA = pLooker->entindex();
+	int iEntityB = pTarget->entindex();
+	Vector vecEyeA = vecLookerEye;
+	Vector vecEyeB = vecTargetEye;
+
+	if (iEntityA > iEntityB)
+	{
+		std::swap(iEntityA, iEntityB);
+		std::swap(vecEyeA, vecEyeB);
+	}
+
+	PERCEPTION_SIGHT_ENTRY& entry = m_SightCache[(static_cast<unsigned int>(iEntityA) * 2654435761u ^ static_cast<unsigned int>(iEntityB)) & (PERCEPTION_CACHE_SIZE - 1)];
+
+	if (fCacheable &&
+		entry.iFrame == m_iFrame &&
+		entry.iEntityA == iEntityA &&
+		entry.iEntityB == iEntityB &&
+		entry.vecEyeA == vecEyeA &&
+		entry.vecEyeB == vecEyeB)
+	{
+		return entry.fVisible;
+	}
+
+	TraceResult tr;
+	UTIL_TraceLine(vecLookerEye, vecTargetEye, ignore_monsters, ignore_glass, pLooker->edict(), &tr);
+
+	const bool fVisible = tr.flFraction == 1.0;
+
+	if (fCacheable)
+	{
+		entry.iFrame = m_iFrame;
+		entry.iEntityA = iEntityA;
+		entry.iEntityB = iEntityB;
+		entry.vecEyeA = vecEyeA;
+		entry.vecEyeB = vecEyeB;
+		entry.fVisible = fVisible;
+	}
+
+	return fVisible;
+}
@@ -0,0 +1,72 @@
+/***
+*
+*	Copyright (c) 1996-2001, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+
+#pragma once
+
+class CBaseMonster;
+
+//=========================================================
+// perception.h - schedules monster sensing (Look/Listen)
+// across server frames and caches line of sight checks
+// for the current frame.
+//=========================================================
+
+#define PERCEPTION_CACHE_SIZE 4096 // number of line of sight results remembered per frame. Must be a power of 2.
+
+//=========================================================
+// A line of sight trace between the eyes of two entities.
+// The pair is stored with the lower edict index first so
+// A looking at B and B looking at A share an entry.
+//=========================================================
+typedef struct
+{
+	unsigned int iFrame; // frame the entry was stored in, entries from other frames are unused.
+	int iEntityA;
+	int iEntityB;
+	Vector vecEyeA;
+	Vector vecEyeB;
+	bool fVisible;
+} PERCEPTION_SIGHT_ENTRY;
+
+//=========================================================
+// CPerceptionManager - a single instance handles every
+// monster. Monsters that are idle or far away from every
+// player only sense every sv_ai_perception_interval
+// seconds, and no more than sv_ai_perception_budget of them
+// sense in any one frame. Monsters that are busy near a
+// player always sense.
+//=========================================================
+class CPerceptionManager
+{
+public:
+	void Reset();
+	void StartFrame();
+
+	// Returns whether this monster should run Look and Listen this frame.
+	bool ShouldSense(CBaseMonster* pMonster);
+
+	// Traces from vecLookerEye to vecTargetEye, or reuses the result of a trace
+	// between the same two eye positions made earlier in this frame.
+	bool LineOfSight(CBaseEntity* pLooker, const Vector& vecLookerEye, CBaseEntity* pTarget, const Vector& vecTargetEye);
+
+private:
+	bool IsHighPriority(CBaseMonster* pMonster);
+
+	PERCEPTION_SIGHT_ENTRY m_SightCache[PERCEPTION_CACHE_SIZE];
+	unsigned int m_iFrame = 1;
+	int m_cLowPrioritySenses = 0; // low priority monsters that have sensed this frame.
+};
+
+inline CPerceptionManager g_PerceptionManager;
@@ -0,0 +1,99 @@
+/***
+*
+*	Copyright (c) 1996-2001, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+
+#include <string>
+
+#include "extdll.h"
+#include "util.h"
+#include "filesystem_utils.h"
+#include "profiler.h"
+
+//=========================================================
+// Writes the contents of the profiler's buffers as a
+// Chrome trace. Times are in microseconds relative to the
+// start of the oldest frame.
+//=========================================================
+static bool Profiler_WriteChromeTrace(const char* fileName)
+{
+	std::string json;
+	json.reserve(1 << 20);
+	json += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	bool fFirstEvent = true;
+	bool fHaveBaseTime = false;
+	std::uint64_t baseTime = 0;
+	int cFrames = 0;
+	int cZones = 0;
+	char szEvent[256];
+
+	auto addEvent = [&](const char* name, int tid, std::uint64_t startTime, std::uint64_t endTime)
+	{
+		if (!fHaveBaseTime)
+		{
+			baseTime = startTime;
+			fHaveBaseTime = true;
+		}
+
+		// Clamp rather than wrap if a zone started before the oldest frame.
+		const std::uint64_t start = startTime > baseTime ? startTime - baseTime : 0;
+		const std::uint64_t duration = endTime > startTime ? endTime - startTime : 0;
+
+		snprintf(szEvent, sizeof(szEvent), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			fFirstEvent ? "" : ",\n", name, tid, start / 1000.0, duration / 1000.0);
+
+		json += szEvent;
+		fFirstEvent = false;
+	};
+
+	g_FrameProfiler.ForEachFrame(
+		[&](const ProfilerFrame& frame, std::uint64_t endTime)
+		{
+			char szName[64];
+			snprintf(szName, sizeof(szName), "Frame %u", frame.Number);
+			addEvent(szName, 0, frame.StartTime, endTime);
+			++cFrames;
+		},
+		[&](const ProfilerZone& zone)
+		{
+			addEvent(zone.Name, 1, zone.StartTime, zone.EndTime);
+			++cZones;
+		});
+
+	json += "\n]}\n";
+
+	if (!FileSystem_WriteTextToFile(fileName, json.c_str()))
+	{
+		return false;
+	}
+
+	ALERT(at_console, "Wrote %d frames, %d zones to \"%s\"\n", cFrames, cZones, fileName);
+
+	return true;
+}
+
+//=========================================================
+// sv_profile_dump [filename]
+//=========================================================
+static void Profiler_Dump()
+{
+	const char* fileName = CMD_ARGC() >= 2 ? CMD_ARGV(1) : "profile.json";
+
+	Profiler_WriteChromeTrace(fileName);
+}
+
+void Profiler_RegisterCommands()
+{
+	g_engfuncs.pfnAddServerCommand("sv_profile_dump", &Profiler_Dump);
+}
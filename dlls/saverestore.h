@@ -16,7 +16,12 @@
 
 #pragma once
 
+#include <string>
+#include <unordered_map>
+
 class CBaseEntity;
+struct SaveRestorePlan;
+struct SaveRestorePlanField;
 
 class CSaveRestoreBuffer
 {
@@ -35,6 +40,7 @@ public:
 	edict_t* EntityFromIndex(int entityIndex);
 
 	unsigned short TokenHash(const char* pszToken);
+	unsigned short TokenHash(const char* pszToken, unsigned int hash, unsigned short& cachedToken);
 
 	const SAVERESTOREDATA& GetData() const { return m_data; }
 
@@ -56,7 +62,12 @@ public:
 protected:
 	SAVERESTOREDATA& m_data;
 	void BufferRewind(int size);
-	unsigned int HashString(const char* pszToken);
+
+public:
+	static unsigned int HashString(const char* pszToken);
+
+private:
+	unsigned short FindToken(const char* pszToken, unsigned int hash);
 };
 
 
@@ -86,6 +97,8 @@ private:
 	void BufferString(char* pdata, int len);
 	void BufferData(const char* pdata, int size);
 	void BufferHeader(const char* pname, int size);
+
+	SaveRestorePlanField* m_pPlanField = nullptr; // Field being written by WriteFields, whose token can be reused
 };
 
 typedef struct
@@ -120,6 +133,9 @@ private:
 
 	void BufferReadHeader(HEADER* pheader);
 
+	int ReadField(const SaveRestorePlan& plan, void* pBaseData, TYPEDESCRIPTION* pFields, int fieldCount, int startField, int size, char* pName, void* pData);
+	int FindField(const SaveRestorePlan& plan, TYPEDESCRIPTION* pFields, int fieldCount, int startField, const char* pName);
+
 	bool m_global = false; // Restoring a global entity?
 	bool m_precache = true;
 };
@@ -184,6 +200,7 @@ private:
 	globalentity_t* Find(string_t globalname);
 	globalentity_t* m_pList;
 	int m_listCount;
+	std::unordered_map<std::string, globalentity_t*> m_index; // Entries of m_pList by name
 };
 
 extern CGlobalState gGlobalState;
@@ -25,6 +25,7 @@
 #include "nodes.h"
 #include "defaultai.h"
 #include "soundent.h"
+#include "profiler.h"
 
 //=========================================================
 // FHaveSchedule - Returns true if monster's m_pSchedule
@@ -318,6 +319,8 @@ void CBaseMonster::MaintainSchedule()
 //=========================================================
 void CBaseMonster::RunTask(Task_t* pTask)
 {
+	PROFILE_SCOPE("CBaseMonster::RunTask");
+
 	switch (pTask->iTask)
 	{
 	case TASK_TURN_RIGHT:
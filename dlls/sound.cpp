@@ -26,6 +26,7 @@
 #include "pm_defs.h"
 #include "pm_materials.h"
 #include "pm_shared.h"
+#include "string_index.h"
 
 static char* memfgets(byte* pMemFile, int fileSize, int& filePos, char* pBuffer, int bufferSize);
 
@@ -1012,6 +1013,8 @@ typedef struct sentenceg
 
 SENTENCEG rgsentenceg[CSENTENCEG_MAX];
 bool fSentencesInit = false;
+static CaseInsensitiveStringIndex g_SentenceGroupIndex;
+static CaseInsensitiveStringIndex g_SentenceIndex;
 
 char gszallsentencenames[CVOXFILESENTENCEMAX][CBSENTENCENAME_MAX];
 int gcallsentences = 0;
@@ -1149,22 +1152,10 @@ int USENTENCEG_Pick(int isentenceg, char* szfound)
 
 int SENTENCEG_GetIndex(const char* szgroupname)
 {
-	int i;
-
 	if (!fSentencesInit || !szgroupname)
 		return -1;
 
-	// search rgsentenceg for match on szgroupname
-
-	i = 0;
-	while (0 != rgsentenceg[i].count)
-	{
-		if (0 == strcmp(szgroupname, rgsentenceg[i].szgroupname))
-			return i;
-		i++;
-	}
-
-	return -1;
+	return g_SentenceGroupIndex.Find(szgroupname);
 }
 
 // given sentence group index, play random sentence for given entity.
@@ -1284,6 +1275,9 @@ void SENTENCEG_Init()
 	memset(rgsentenceg, 0, CSENTENCEG_MAX * sizeof(SENTENCEG));
 	isentencegs = -1;
 
+	g_SentenceGroupIndex.Clear();
+	g_SentenceIndex.Clear();
+
 
 	int filePos = 0, fileSize;
 	byte* pMemFile = g_engfuncs.pfnLoadFileForMe("sound/sentences.txt", &fileSize);
@@ -1379,11 +1373,17 @@ void SENTENCEG_Init()
 
 	i = 0;
 
-	while (0 != rgsentenceg[i].count && i < CSENTENCEG_MAX)
+	while (i < CSENTENCEG_MAX && 0 != rgsentenceg[i].count)
 	{
 		USENTENCEG_InitLRU(&(rgsentenceg[i].rgblru[0]), rgsentenceg[i].count);
+		g_SentenceGroupIndex.Add(rgsentenceg[i].szgroupname, i);
 		i++;
 	}
+
+	for (i = 0; i < gcallsentences; i++)
+	{
+		g_SentenceIndex.Add(gszallsentencenames[i], i);
+	}
 }
 
 // convert sentence (sample) name to !sentencenum, return !sentencenum
@@ -1392,20 +1392,20 @@ int SENTENCEG_Lookup(const char* sample, char* sentencenum)
 {
 	char sznum[32];
 
-	int i;
 	// this is a sentence name; lookup sentence number
 	// and give to engine as string.
-	for (i = 0; i < gcallsentences; i++)
-		if (!stricmp(gszallsentencenames[i], sample + 1))
+	const int i = g_SentenceIndex.Find(sample + 1);
+
+	if (i != -1)
+	{
+		if (sentencenum)
 		{
-			if (sentencenum)
-			{
-				strcpy(sentencenum, "!");
-				sprintf(sznum, "%d", i);
-				strcat(sentencenum, sznum);
-			}
-			return i;
+			strcpy(sentencenum, "!");
+			sprintf(sznum, "%d", i);
+			strcat(sentencenum, sznum);
 		}
+		return i;
+	}
 	// sentence name not found!
 	return -1;
 }
@@ -1495,6 +1495,7 @@ bool fTextureTypeInit = false;
 int gcTextures = 0;
 char grgszTextureName[CTEXTURESMAX][CBTEXTURENAMEMAX]; // texture names
 char grgchTextureType[CTEXTURESMAX];				   // parallel array of texture types
+static CaseInsensitiveStringIndex g_TextureTypeIndex{CBTEXTURENAMEMAX - 1}; // maps texture names to indices in the arrays above
 
 // open materials.txt,  get size, alloc space,
 // save in array.  Only works first time called,
@@ -1563,6 +1564,7 @@ void TEXTURETYPE_Init()
 	memset(grgchTextureType, 0, CTEXTURESMAX);
 
 	gcTextures = 0;
+	g_TextureTypeIndex.Clear();
 	memset(buffer, 0, 512);
 
 	pMemFile = g_engfuncs.pfnLoadFileForMe("sound/materials.txt", &fileSize);
@@ -1610,6 +1612,11 @@ void TEXTURETYPE_Init()
 
 	g_engfuncs.pfnFreeFile(pMemFile);
 
+	for (i = 0; i < gcTextures; i++)
+	{
+		g_TextureTypeIndex.Add(grgszTextureName[i], i);
+	}
+
 	fTextureTypeInit = true;
 }
 
@@ -1621,13 +1628,10 @@ void TEXTURETYPE_Init()
 
 char TEXTURETYPE_Find(char* name)
 {
-	// CONSIDER: pre-sort texture names and perform faster binary search here
+	const int i = g_TextureTypeIndex.Find(name);
 
-	for (int i = 0; i < gcTextures; i++)
-	{
-		if (!strnicmp(name, &(grgszTextureName[i][0]), CBTEXTURENAMEMAX - 1))
-			return (grgchTextureType[i]);
-	}
+	if (i != -1)
+		return grgchTextureType[i];
 
 	return CHAR_TEX_CONCRETE;
 }
@@ -12,6 +12,9 @@
 *   without written permission from Valve LLC.
 *
 ****/
+#include <algorithm>
+#include <cmath>
+
 #include "extdll.h"
 #include "util.h"
 #include "cbase.h"
@@ -32,6 +35,10 @@ void CSound::Clear()
 	m_flExpireTime = 0;
 	m_iNext = SOUNDLIST_EMPTY;
 	m_iNextAudible = 0;
+	m_iSerial = 0;
+	m_iBucket = -1;
+	m_iNextInBucket = SOUNDLIST_EMPTY;
+	m_iPrevInBucket = SOUNDLIST_EMPTY;
 }
 
 //=========================================================
@@ -98,11 +105,14 @@ void CSoundEnt::Think()
 	iPreviousSound = SOUNDLIST_EMPTY;
 	iSound = m_iActiveSound;
 
+	// The loudest sound may be expiring, so work this out again.
+	m_iMaxVolume = 0;
+
 	while (iSound != SOUNDLIST_EMPTY)
 	{
-		if (m_SoundPool[iSound].m_flExpireTime <= gpGlobals->time && m_SoundPool[iSound].m_flExpireTime != SOUND_NEVER_EXPIRE)
+		if (Sound(iSound).m_flExpireTime <= gpGlobals->time && Sound(iSound).m_flExpireTime != SOUND_NEVER_EXPIRE)
 		{
-			int iNext = m_SoundPool[iSound].m_iNext;
+			int iNext = Sound(iSound).m_iNext;
 
 			// move this sound back into the free list
 			FreeSound(iSound, iPreviousSound);
@@ -111,8 +121,13 @@ void CSoundEnt::Think()
 		}
 		else
 		{
+			if (Sound(iSound).m_iBucket != -1)
+			{
+				m_iMaxVolume = std::max(m_iMaxVolume, Sound(iSound).m_iVolume);
+			}
+
 			iPreviousSound = iSound;
-			iSound = m_SoundPool[iSound].m_iNext;
+			iSound = Sound(iSound).m_iNext;
 		}
 	}
 
@@ -143,21 +158,23 @@ void CSoundEnt::FreeSound(int iSound, int iPrevious)
 		return;
 	}
 
+	pSoundEnt->UnlinkFromGrid(iSound);
+
 	if (iPrevious != SOUNDLIST_EMPTY)
 	{
 		// iSound is not the head of the active list, so
 		// must fix the index for the Previous sound
 		//		pSoundEnt->m_SoundPool[ iPrevious ].m_iNext = m_SoundPool[ iSound ].m_iNext;
-		pSoundEnt->m_SoundPool[iPrevious].m_iNext = pSoundEnt->m_SoundPool[iSound].m_iNext;
+		pSoundEnt->Sound(iPrevious).m_iNext = pSoundEnt->Sound(iSound).m_iNext;
 	}
 	else
 	{
 		// the sound we're freeing IS the head of the active list.
-		pSoundEnt->m_iActiveSound = pSoundEnt->m_SoundPool[iSound].m_iNext;
+		pSoundEnt->m_iActiveSound = pSoundEnt->Sound(iSound).m_iNext;
 	}
 
 	// make iSound the head of the Free list.
-	pSoundEnt->m_SoundPool[iSound].m_iNext = pSoundEnt->m_iFreeSound;
+	pSoundEnt->Sound(iSound).m_iNext = pSoundEnt->m_iFreeSound;
 	pSoundEnt->m_iFreeSound = iSound;
 }
 
@@ -169,7 +186,7 @@ int CSoundEnt::IAllocSound()
 {
 	int iNewSound;
 
-	if (m_iFreeSound == SOUNDLIST_EMPTY)
+	if (m_iFreeSound == SOUNDLIST_EMPTY && !GrowPool())
 	{
 		// no free sound!
 		ALERT(at_console, "Free Sound List is full!\n");
@@ -181,15 +198,106 @@ int CSoundEnt::IAllocSound()
 
 	iNewSound = m_iFreeSound; // copy the index of the next free sound
 
-	m_iFreeSound = m_SoundPool[m_iFreeSound].m_iNext; // move the index down into the free list.
+	m_iFreeSound = Sound(m_iFreeSound).m_iNext; // move the index down into the free list.
 
-	m_SoundPool[iNewSound].m_iNext = m_iActiveSound; // point the new sound at the top of the active list.
+	Sound(iNewSound).m_iNext = m_iActiveSound; // point the new sound at the top of the active list.
 
 	m_iActiveSound = iNewSound; // now make the new sound the top of the active list. You're done.
 
+	Sound(iNewSound).m_iSerial = m_iNextSerial++;
+
 	return iNewSound;
 }
 
+//=========================================================
+// GrowPool - adds another block of sounds to the free list.
+// Returns false if the pool is already at MAX_WORLD_SOUNDS.
+//=========================================================
+bool CSoundEnt::GrowPool()
+{
+	if (m_cSounds + SOUND_POOL_BLOCK_SIZE > MAX_WORLD_SOUNDS)
+	{
+		return false;
+	}
+
+	m_SoundBlocks.push_back(std::make_unique<CSound[]>(SOUND_POOL_BLOCK_SIZE));
+
+	const int iFirst = m_cSounds;
+	m_cSounds += SOUND_POOL_BLOCK_SIZE;
+
+	for (int i = iFirst; i < m_cSounds; i++)
+	{ // clear all sounds, and link them into the free sound list.
+		Sound(i).Clear();
+		Sound(i).m_iNext = i + 1;
+	}
+
+	Sound(m_cSounds - 1).m_iNext = m_iFreeSound;
+	m_iFreeSound = iFirst;
+
+	return true;
+}
+
+static int SoundGridCoord(float value)
+{
+	return static_cast<int>(std::floor(value / SOUND_GRID_CELL_SIZE));
+}
+
+static int SoundGridBucket(int x, int y)
+{
+	return ((static_cast<unsigned int>(x) * 73856093u) ^ (static_cast<unsigned int>(y) * 19349663u)) & (SOUND_GRID_BUCKETS - 1);
+}
+
+//=========================================================
+// LinkToGrid - puts an active sound into the grid bucket
+// for its origin.
+//=========================================================
+void CSoundEnt::LinkToGrid(int iSound)
+{
+	CSound& sound = Sound(iSound);
+
+	UnlinkFromGrid(iSound);
+
+	sound.m_iBucket = SoundGridBucket(SoundGridCoord(sound.m_vecOrigin.x), SoundGridCoord(sound.m_vecOrigin.y));
+	sound.m_iPrevInBucket = SOUNDLIST_EMPTY;
+	sound.m_iNextInBucket = m_BucketHead[sound.m_iBucket];
+
+	if (sound.m_iNextInBucket != SOUNDLIST_EMPTY)
+	{
+		Sound(sound.m_iNextInBucket).m_iPrevInBucket = iSound;
+	}
+
+	m_BucketHead[sound.m_iBucket] = iSound;
+
+	m_iMaxVolume = std::max(m_iMaxVolume, sound.m_iVolume);
+}
+
+void CSoundEnt::UnlinkFromGrid(int iSound)
+{
+	CSound& sound = Sound(iSound);
+
+	if (sound.m_iBucket == -1)
+	{
+		return;
+	}
+
+	if (sound.m_iPrevInBucket != SOUNDLIST_EMPTY)
+	{
+		Sound(sound.m_iPrevInBucket).m_iNextInBucket = sound.m_iNextInBucket;
+	}
+	else
+	{
+		m_BucketHead[sound.m_iBucket] = sound.m_iNextInBucket;
+	}
+
+	if (sound.m_iNextInBucket != SOUNDLIST_EMPTY)
+	{
+		Sound(sound.m_iNextInBucket).m_iPrevInBucket = sound.m_iPrevInBucket;
+	}
+
+	sound.m_iBucket = -1;
+	sound.m_iNextInBucket = sound.m_iPrevInBucket = SOUNDLIST_EMPTY;
+}
+
 //=========================================================
 // InsertSound - Allocates a free sound and fills it with
 // sound info.
@@ -212,10 +320,12 @@ void CSoundEnt::InsertSound(int iType, const Vector& vecOrigin, int iVolume, flo
 		return;
 	}
 
-	pSoundEnt->m_SoundPool[iThisSound].m_vecOrigin = vecOrigin;
-	pSoundEnt->m_SoundPool[iThisSound].m_iType = iType;
-	pSoundEnt->m_SoundPool[iThisSound].m_iVolume = iVolume;
-	pSoundEnt->m_SoundPool[iThisSound].m_flExpireTime = gpGlobals->time + flDuration;
+	pSoundEnt->Sound(iThisSound).m_vecOrigin = vecOrigin;
+	pSoundEnt->Sound(iThisSound).m_iType = iType;
+	pSoundEnt->Sound(iThisSound).m_iVolume = iVolume;
+	pSoundEnt->Sound(iThisSound).m_flExpireTime = gpGlobals->time + flDuration;
+
+	pSoundEnt->LinkToGrid(iThisSound);
 }
 
 //=========================================================
@@ -228,16 +338,21 @@ void CSoundEnt::Initialize()
 	int iSound;
 
 	m_cLastActiveSounds;
-	m_iFreeSound = 0;
+	m_iFreeSound = SOUNDLIST_EMPTY;
 	m_iActiveSound = SOUNDLIST_EMPTY;
+	m_iNextSerial = 0;
+	m_iMaxVolume = 0;
 
-	for (i = 0; i < MAX_WORLD_SOUNDS; i++)
-	{ // clear all sounds, and link them into the free sound list.
-		m_SoundPool[i].Clear();
-		m_SoundPool[i].m_iNext = i + 1;
+	for (i = 0; i < SOUND_GRID_BUCKETS; i++)
+	{
+		m_BucketHead[i] = SOUNDLIST_EMPTY;
 	}
 
-	m_SoundPool[i - 1].m_iNext = SOUNDLIST_EMPTY; // terminate the list here.
+	// Start with one block, more are added as needed. The client reserved sounds
+	// below have to come first so they are at indices 0 to maxClients - 1.
+	m_SoundBlocks.clear();
+	m_cSounds = 0;
+	GrowPool();
 
 
 	// now reserve enough sounds for each client
@@ -251,7 +366,7 @@ void CSoundEnt::Initialize()
 			return;
 		}
 
-		pSoundEnt->m_SoundPool[iSound].m_flExpireTime = SOUND_NEVER_EXPIRE;
+		pSoundEnt->Sound(iSound).m_flExpireTime = SOUND_NEVER_EXPIRE;
 	}
 
 	if (CVAR_GET_FLOAT("displaysoundlist") == 1)
@@ -288,7 +403,7 @@ int CSoundEnt::ISoundsInList(int iListType)
 	{
 		i++;
 
-		iThisSound = m_SoundPool[iThisSound].m_iNext;
+		iThisSound = Sound(iThisSound).m_iNext;
 	}
 
 	return i;
@@ -331,7 +446,7 @@ CSound* CSoundEnt::SoundPointerForIndex(int iIndex)
 		return NULL;
 	}
 
-	if (iIndex > (MAX_WORLD_SOUNDS - 1))
+	if (iIndex >= pSoundEnt->m_cSounds)
 	{
 		ALERT(at_console, "SoundPointerForIndex() - Index too large!\n");
 		return NULL;
@@ -343,7 +458,7 @@ CSound* CSoundEnt::SoundPointerForIndex(int iIndex)
 		return NULL;
 	}
 
-	return &pSoundEnt->m_SoundPool[iIndex];
+	return &pSoundEnt->Sound(iIndex);
 }
 
 //=========================================================
@@ -365,3 +480,68 @@ int CSoundEnt::ClientSoundIndex(edict_t* pClient)
 
 	return iReturn;
 }
+
+//=========================================================
+// SoundsNear - the client reserved sounds move with their
+// clients, so they are always included. Everything else
+// comes from the grid cells within the loudest sound's
+// range of vecOrigin.
+//=========================================================
+const std::vector<int>& CSoundEnt::SoundsNear(const Vector& vecOrigin, float flHearingSensitivity)
+{
+	static const std::vector<int> noSounds;
+
+	if (!pSoundEnt)
+	{
+		return noSounds;
+	}
+
+	std::vector<int>& sounds = pSoundEnt->m_NearbySounds;
+	sounds.clear();
+
+	int i;
+	for (i = 0; i < gpGlobals->maxClients && i < pSoundEnt->m_cSounds; i++)
+	{
+		sounds.push_back(i);
+	}
+
+	const float flRange = pSoundEnt->m_iMaxVolume * flHearingSensitivity;
+
+	const int minX = SoundGridCoord(vecOrigin.x - flRange);
+	const int minY = SoundGridCoord(vecOrigin.y - flRange);
+	const int maxX = SoundGridCoord(vecOrigin.x + flRange);
+	const int maxY = SoundGridCoord(vecOrigin.y + flRange);
+
+	const auto addBucket = [&](int iBucket)
+	{
+		for (int iSound = pSoundEnt->m_BucketHead[iBucket]; iSound != SOUNDLIST_EMPTY; iSound = pSoundEnt->Sound(iSound).m_iNextInBucket)
+		{
+			sounds.push_back(iSound);
+		}
+	};
+
+	if (static_cast<long long>(maxX - minX + 1) * (maxY - minY + 1) >= SOUND_GRID_BUCKETS)
+	{
+		for (i = 0; i < SOUND_GRID_BUCKETS; i++)
+		{
+			addBucket(i);
+		}
+	}
+	else
+	{
+		for (int x = minX; x <= maxX; x++)
+		{
+			for (int y = minY; y <= maxY; y++)
+			{
+				addBucket(SoundGridBucket(x, y));
+			}
+		}
+	}
+
+	// Cells can share a bucket, and callers expect the active list's newest first order.
+	std::sort(sounds.begin(), sounds.end(), [](int lhs, int rhs)
+		{ return pSoundEnt->Sound(lhs).m_iSerial > pSoundEnt->Sound(rhs).m_iSerial; });
+	sounds.erase(std::unique(sounds.begin(), sounds.end()), sounds.end());
+
+	return sounds;
+}
@@ -15,13 +15,22 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
+
 //=========================================================
 // Soundent.h - the entity that spawns when the world
 // spawns, and handles the world's active and free sound
 // lists.
 //=========================================================
 
-#define MAX_WORLD_SOUNDS 64 // maximum number of sounds handled by the world at one time.
+#define SOUND_POOL_BLOCK_SIZE 64 // sounds are allocated this many at a time. Blocks never move, so CSound pointers stay valid.
+#define MAX_WORLD_SOUNDS 1024	 // maximum number of sounds handled by the world at one time.
+
+// Active sounds other than the client reserved ones are hashed into a coarse grid by origin,
+// so monsters only look at sounds that are close enough to possibly be heard.
+#define SOUND_GRID_CELL_SIZE 512.0f
+#define SOUND_GRID_BUCKETS 256 // must be a power of 2.
 
 #define bits_SOUND_NONE 0
 #define bits_SOUND_COMBAT (1 << 0)	// gunshots, explosions
@@ -56,6 +65,10 @@ public:
 	float m_flExpireTime; // when the sound should be purged from the list
 	int m_iNext;		  // index of next sound in this list ( Active or Free )
 	int m_iNextAudible;	  // temporary link that monsters use to build a list of audible sounds
+	int m_iSerial;		  // increases with each allocation, sorting by this gives the active list order.
+	int m_iBucket;		  // grid bucket this sound is in, or -1
+	int m_iNextInBucket;
+	int m_iPrevInBucket;
 
 	bool FIsSound();
 	bool FIsScent();
@@ -81,6 +94,9 @@ public:
 	static CSound* SoundPointerForIndex(int iIndex); // return a pointer for this index in the sound list
 	static int ClientSoundIndex(edict_t* pClient);
 
+	// Returns the active sounds that may be audible at vecOrigin, in active list order.
+	static const std::vector<int>& SoundsNear(const Vector& vecOrigin, float flHearingSensitivity);
+
 	bool IsEmpty() { return m_iActiveSound == SOUNDLIST_EMPTY; }
 	int ISoundsInList(int iListType);
 	int IAllocSound();
@@ -92,7 +108,19 @@ public:
 	bool m_fShowReport;		 // if true, dump information about free/active sounds.
 
 private:
-	CSound m_SoundPool[MAX_WORLD_SOUNDS];
+	CSound& Sound(int iIndex) { return m_SoundBlocks[iIndex / SOUND_POOL_BLOCK_SIZE][iIndex % SOUND_POOL_BLOCK_SIZE]; }
+	bool GrowPool();
+	void LinkToGrid(int iSound);
+	void UnlinkFromGrid(int iSound);
+
+	std::vector<std::unique_ptr<CSound[]>> m_SoundBlocks;
+	int m_cSounds; // number of sounds in all blocks.
+	int m_iNextSerial;
+
+	int m_BucketHead[SOUND_GRID_BUCKETS];
+	int m_iMaxVolume; // loudest sound in the grid, bounds how far away a sound can be heard.
+
+	std::vector<int> m_NearbySounds; // scratch for SoundsNear.
 };
 
 inline CSoundEnt* pSoundEnt;
@@ -32,6 +32,8 @@
 #include "ctf/CTFGoalFlag.h"
 #include "UserMessages.h"
 
+#include <vector>
+
 #define SF_TRIGGER_PUSH_START_OFF 2		   //spawnflag that makes trigger_push spawn turned OFF
 #define SF_TRIGGER_HURT_TARGETONCE 1	   // Only fire hurt target once
 #define SF_TRIGGER_HURT_START_OFF 2		   //spawnflag that makes trigger_push spawn turned OFF
@@ -1359,6 +1361,8 @@ public:
 	static int ChangeList(LEVELLIST* pLevelList, int maxList);
 	static bool AddTransitionToList(LEVELLIST* pLevelList, int listCount, const char* pMapName, const char* pLandmarkName, edict_t* pentLandmark);
 	static bool InTransitionVolume(CBaseEntity* pEntity, char* pVolumeName);
+	static void FindTransitionVolumes(const char* pVolumeName, std::vector<CBaseEntity*>& volumes);
+	static bool InTransitionVolume(CBaseEntity* pEntity, const std::vector<CBaseEntity*>& volumes);
 
 	bool Save(CSave& save) override;
 	bool Restore(CRestore& restore) override;
@@ -1588,10 +1592,37 @@ int BuildChangeList(LEVELLIST* pLevelList, int maxList)
 
 
 bool CChangeLevel::InTransitionVolume(CBaseEntity* pEntity, char* pVolumeName)
+{
+	std::vector<CBaseEntity*> volumes;
+
+	FindTransitionVolumes(pVolumeName, volumes);
+
+	return InTransitionVolume(pEntity, volumes);
+}
+
+
+// Find the trigger_transition entities for a landmark, so many entities can be tested against them
+void CChangeLevel::FindTransitionVolumes(const char* pVolumeName, std::vector<CBaseEntity*>& volumes)
 {
 	edict_t* pentVolume;
 
+	volumes.clear();
+
+	pentVolume = FIND_ENTITY_BY_TARGETNAME(NULL, pVolumeName);
+	while (!FNullEnt(pentVolume))
+	{
+		CBaseEntity* pVolume = CBaseEntity::Instance(pentVolume);
+
+		if (pVolume && FClassnameIs(pVolume->pev, "trigger_transition"))
+			volumes.push_back(pVolume);
+
+		pentVolume = FIND_ENTITY_BY_TARGETNAME(pentVolume, pVolumeName);
+	}
+}
+
 
+bool CChangeLevel::InTransitionVolume(CBaseEntity* pEntity, const std::vector<CBaseEntity*>& volumes)
+{
 	if ((pEntity->ObjectCaps() & FCAP_FORCE_TRANSITION) != 0)
 		return true;
 
@@ -1602,24 +1633,18 @@ bool CChangeLevel::InTransitionVolume(CBaseEntity* pEntity, char* pVolumeName)
 			pEntity = CBaseEntity::Instance(pEntity->pev->aiment);
 	}
 
-	bool inVolume = true; // Unless we find a trigger_transition, everything is in the volume
+	// Unless we find a trigger_transition, everything is in the volume
+	if (volumes.empty())
+		return true;
 
-	pentVolume = FIND_ENTITY_BY_TARGETNAME(NULL, pVolumeName);
-	while (!FNullEnt(pentVolume))
+	for (CBaseEntity* pVolume : volumes)
 	{
-		CBaseEntity* pVolume = CBaseEntity::Instance(pentVolume);
-
-		if (pVolume && FClassnameIs(pVolume->pev, "trigger_transition"))
-		{
-			if (pVolume->Intersects(pEntity)) // It touches one, it's in the volume
-				return true;
-			else
-				inVolume = false; // Found a trigger_transition, but I don't intersect it -- if I don't find another, don't go!
-		}
-		pentVolume = FIND_ENTITY_BY_TARGETNAME(pentVolume, pVolumeName);
+		if (pVolume->Intersects(pEntity)) // It touches one, it's in the volume
+			return true;
 	}
 
-	return inVolume;
+	// Found a trigger_transition, but I don't intersect it
+	return false;
 }
 
 
@@ -1669,6 +1694,7 @@ int CChangeLevel::ChangeList(LEVELLIST* pLevelList, int maxList)
 		nullptr != pSaveData && pSaveData->pTable)
 	{
 		CSave saveHelper(*pSaveData);
+		std::vector<CBaseEntity*> volumes;
 
 		for (i = 0; i < count; i++)
 		{
@@ -1713,10 +1739,13 @@ int CChangeLevel::ChangeList(LEVELLIST* pLevelList, int maxList)
 				pent = pent->v.chain;
 			}
 
+			// Look up the landmark's trigger_transitions once, not once per entity
+			FindTransitionVolumes(pLevelList[i].landmarkName, volumes);
+
 			for (j = 0; j < entityCount; j++)
 			{
 				// Check to make sure the entity isn't screened out by a trigger_transition
-				if (0 != entityFlags[j] && InTransitionVolume(pEntList[j], pLevelList[i].landmarkName))
+				if (0 != entityFlags[j] && InTransitionVolume(pEntList[j], volumes))
 				{
 					// Mark entity table with 1<<i
 					int index = saveHelper.EntityIndex(pEntList[j]);
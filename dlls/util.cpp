@@ -25,6 +25,12 @@
 #include "cbase.h"
 #include "saverestore.h"
 #include <time.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include "shake.h"
 #include "decals.h"
 #include "player.h"
@@ -32,6 +38,7 @@
 #include "gamerules.h"
 #include "game.h"
 #include "UserMessages.h"
+#include "string_index.h"
 
 float UTIL_WeaponTimeBase()
 {
@@ -423,6 +430,241 @@ void UTIL_MoveToOrigin(edict_t* pent, const Vector& vecGoal, float flDist, int i
 }
 
 
+//=========================================================
+// CEntityGrid - spatial hash of the clients and monsters,
+// so UTIL_EntitiesInBox and UTIL_MonstersInSphere don't
+// have to look at every edict. Entities are hashed by the
+// 2D center of their absolute box, and queries are grown by
+// the largest distance from any entity's center to its box
+// or origin so nothing is missed.
+//
+// The grid is rebuilt from the edicts every frame, and kept
+// current during the frame by UTIL_UpdateEntityGrid, which
+// the engine ends up calling whenever an entity is relinked.
+// Queries still check each candidate's current state, so
+// stale entries for freed edicts are harmless.
+//=========================================================
+#define ENTITY_GRID_FLAGS (FL_CLIENT | FL_MONSTER)
+#define ENTITY_GRID_CELL_SIZE 256.0f
+#define ENTITY_GRID_BUCKETS 1024 // must be a power of 2.
+
+class CEntityGrid
+{
+public:
+	bool IsBuilt() const { return m_fBuilt; }
+
+	void Reset()
+	{
+		m_BucketHead.clear();
+		m_Next.clear();
+		m_Prev.clear();
+		m_Bucket.clear();
+		m_QueryStamp.clear();
+		m_flMaxExtent = 0;
+		m_fBuilt = false;
+	}
+
+	void Rebuild()
+	{
+		edict_t* pEdictList = UTIL_GetEntityList();
+
+		if (!pEdictList)
+		{
+			Reset();
+			return;
+		}
+
+		const int maxEntities = gpGlobals->maxEntities;
+
+		m_BucketHead.assign(ENTITY_GRID_BUCKETS, -1);
+		m_Next.assign(maxEntities, -1);
+		m_Prev.assign(maxEntities, -1);
+		m_Bucket.assign(maxEntities, -1);
+
+		if (static_cast<int>(m_QueryStamp.size()) != maxEntities)
+		{
+			m_QueryStamp.assign(maxEntities, 0);
+			m_iQueryStamp = 0;
+		}
+
+		m_flMaxExtent = 0;
+		m_fBuilt = true;
+
+		// Ignore world.
+		for (int i = 1; i < maxEntities; i++)
+		{
+			edict_t* pEdict = pEdictList + i;
+
+			if (0 == pEdict->free && (pEdict->v.flags & ENTITY_GRID_FLAGS) != 0)
+			{
+				Insert(i, pEdict);
+			}
+		}
+	}
+
+	void Update(edict_t* pEdict)
+	{
+		if (!m_fBuilt)
+		{
+			return;
+		}
+
+		const int i = pEdict - UTIL_GetEntityList();
+
+		if (i <= 0 || i >= static_cast<int>(m_Bucket.size()))
+		{
+			return;
+		}
+
+		Remove(i);
+
+		if (0 == pEdict->free && (pEdict->v.flags & ENTITY_GRID_FLAGS) != 0)
+		{
+			Insert(i, pEdict);
+		}
+	}
+
+	// Fills indices with the edicts that may be within the given 2D bounds.
+	void Query(float minsX, float minsY, float maxsX, float maxsY, std::vector<int>& indices)
+	{
+		indices.clear();
+
+		const int minCellX = CellCoord(minsX - m_flMaxExtent);
+		const int minCellY = CellCoord(minsY - m_flMaxExtent);
+		const int maxCellX = CellCoord(maxsX + m_flMaxExtent);
+		const int maxCellY = CellCoord(maxsY + m_flMaxExtent);
+
+		// Several cells can share a bucket, so make sure each edict is only returned once.
+		if (++m_iQueryStamp == 0)
+		{
+			std::fill(m_QueryStamp.begin(), m_QueryStamp.end(), 0);
+			m_iQueryStamp = 1;
+		}
+
+		if (static_cast<long long>(maxCellX - minCellX + 1) * (maxCellY - minCellY + 1) >= ENTITY_GRID_BUCKETS)
+		{
+			// Covers most of the world, just look at everything in the grid.
+			for (int iBucket = 0; iBucket < ENTITY_GRID_BUCKETS; iBucket++)
+			{
+				AddBucket(iBucket, indices);
+			}
+		}
+		else
+		{
+			for (int x = minCellX; x <= maxCellX; x++)
+			{
+				for (int y = minCellY; y <= maxCellY; y++)
+				{
+					AddBucket(BucketForCell(x, y), indices);
+				}
+			}
+		}
+
+		// Return them in edict order, like a scan of the whole list would.
+		std::sort(indices.begin(), indices.end());
+	}
+
+private:
+	static int CellCoord(float value)
+	{
+		return static_cast<int>(std::floor(value / ENTITY_GRID_CELL_SIZE));
+	}
+
+	static int BucketForCell(int x, int y)
+	{
+		return ((static_cast<unsigned int>(x) * 73856093u) ^ (static_cast<unsigned int>(y) * 19349663u)) & (ENTITY_GRID_BUCKETS - 1);
+	}
+
+	void AddBucket(int iBucket, std::vector<int>& indices)
+	{
+		for (int i = m_BucketHead[iBucket]; i != -1; i = m_Next[i])
+		{
+			if (m_QueryStamp[i] != m_iQueryStamp)
+			{
+				m_QueryStamp[i] = m_iQueryStamp;
+				indices.push_back(i);
+			}
+		}
+	}
+
+	void Insert(int i, edict_t* pEdict)
+	{
+		const entvars_t& vars = pEdict->v;
+		const float centerX = (vars.absmin.x + vars.absmax.x) * 0.5f;
+		const float centerY = (vars.absmin.y + vars.absmax.y) * 0.5f;
+
+		// UTIL_MonstersInSphere tests against the origin, so that has to be covered too.
+		const float flExtent = std::max({vars.absmax.x - centerX, vars.absmax.y - centerY,
+			std::fabs(vars.origin.x - centerX), std::fabs(vars.origin.y - centerY)});
+
+		m_flMaxExtent = std::max(m_flMaxExtent, flExtent);
+
+		const int iBucket = BucketForCell(CellCoord(centerX), CellCoord(centerY));
+
+		m_Bucket[i] = iBucket;
+		m_Prev[i] = -1;
+		m_Next[i] = m_BucketHead[iBucket];
+
+		if (m_Next[i] != -1)
+		{
+			m_Prev[m_Next[i]] = i;
+		}
+
+		m_BucketHead[iBucket] = i;
+	}
+
+	void Remove(int i)
+	{
+		if (m_Bucket[i] == -1)
+		{
+			return;
+		}
+
+		if (m_Prev[i] != -1)
+		{
+			m_Next[m_Prev[i]] = m_Next[i];
+		}
+		else
+		{
+			m_BucketHead[m_Bucket[i]] = m_Next[i];
+		}
+
+		if (m_Next[i] != -1)
+		{
+			m_Prev[m_Next[i]] = m_Prev[i];
+		}
+
+		m_Bucket[i] = m_Prev[i] = m_Next[i] = -1;
+	}
+
+	std::vector<int> m_BucketHead;
+	std::vector<int> m_Next;	   // per edict, next edict in the same bucket.
+	std::vector<int> m_Prev;	   // per edict, previous edict in the same bucket.
+	std::vector<int> m_Bucket;	   // per edict, bucket it's in or -1.
+	std::vector<int> m_QueryStamp; // per edict, last query that returned it.
+	int m_iQueryStamp = 0;
+	float m_flMaxExtent = 0;
+	bool m_fBuilt = false;
+};
+
+static CEntityGrid g_EntityGrid;
+static std::vector<int> g_EntityGridResults;
+
+void UTIL_ResetEntityGrid()
+{
+	g_EntityGrid.Reset();
+}
+
+void UTIL_RebuildEntityGrid()
+{
+	g_EntityGrid.Rebuild();
+}
+
+void UTIL_UpdateEntityGrid(edict_t* pEdict)
+{
+	g_EntityGrid.Update(pEdict);
+}
+
 int UTIL_EntitiesInBox(CBaseEntity** pList, int listMax, const Vector& mins, const Vector& maxs, int flagMask)
 {
 	edict_t* pEdict = UTIL_GetEntityList();
@@ -434,6 +676,40 @@ int UTIL_EntitiesInBox(CBaseEntity** pList, int listMax, const Vector& mins, con
 	if (!pEdict)
 		return count;
 
+	// Only clients and monsters are in the grid, anything else needs a full scan.
+	if (g_EntityGrid.IsBuilt() && 0 != flagMask && (flagMask & ~ENTITY_GRID_FLAGS) == 0)
+	{
+		g_EntityGrid.Query(mins.x, mins.y, maxs.x, maxs.y, g_EntityGridResults);
+
+		for (int i : g_EntityGridResults)
+		{
+			edict_t* pCandidate = pEdict + i;
+
+			if (0 != pCandidate->free || (pCandidate->v.flags & flagMask) == 0)
+				continue;
+
+			if (mins.x > pCandidate->v.absmax.x ||
+				mins.y > pCandidate->v.absmax.y ||
+				mins.z > pCandidate->v.absmax.z ||
+				maxs.x < pCandidate->v.absmin.x ||
+				maxs.y < pCandidate->v.absmin.y ||
+				maxs.z < pCandidate->v.absmin.z)
+				continue;
+
+			pEntity = CBaseEntity::Instance(pCandidate);
+			if (!pEntity)
+				continue;
+
+			pList[count] = pEntity;
+			count++;
+
+			if (count >= listMax)
+				return count;
+		}
+
+		return count;
+	}
+
 	// Ignore world.
 	++pEdict;
 
@@ -468,12 +744,49 @@ int UTIL_EntitiesInBox(CBaseEntity** pList, int listMax, const Vector& mins, con
 }
 
 
+static bool UTIL_IsMonsterInSphere(edict_t* pEdict, const Vector& center, float radiusSquared)
+{
+	float distance, delta;
+
+	if (0 != pEdict->free) // Not in use
+		return false;
+
+	if ((pEdict->v.flags & (FL_CLIENT | FL_MONSTER)) == 0) // Not a client/monster ?
+		return false;
+
+	// Use origin for X & Y since they are centered for all monsters
+	// Now X
+	delta = center.x - pEdict->v.origin.x; //(pEdict->v.absmin.x + pEdict->v.absmax.x)*0.5;
+	delta *= delta;
+
+	if (delta > radiusSquared)
+		return false;
+	distance = delta;
+
+	// Now Y
+	delta = center.y - pEdict->v.origin.y; //(pEdict->v.absmin.y + pEdict->v.absmax.y)*0.5;
+	delta *= delta;
+
+	distance += delta;
+	if (distance > radiusSquared)
+		return false;
+
+	// Now Z
+	delta = center.z - (pEdict->v.absmin.z + pEdict->v.absmax.z) * 0.5;
+	delta *= delta;
+
+	distance += delta;
+	if (distance > radiusSquared)
+		return false;
+
+	return true;
+}
+
 int UTIL_MonstersInSphere(CBaseEntity** pList, int listMax, const Vector& center, float radius)
 {
 	edict_t* pEdict = UTIL_GetEntityList();
 	CBaseEntity* pEntity;
 	int count;
-	float distance, delta;
 
 	count = 0;
 	float radiusSquared = radius * radius;
@@ -481,40 +794,35 @@ int UTIL_MonstersInSphere(CBaseEntity** pList, int listMax, const Vector& center
 	if (!pEdict)
 		return count;
 
-	// Ignore world.
-	++pEdict;
-
-	for (int i = 1; i < gpGlobals->maxEntities; i++, pEdict++)
+	if (g_EntityGrid.IsBuilt())
 	{
-		if (0 != pEdict->free) // Not in use
-			continue;
+		g_EntityGrid.Query(center.x - radius, center.y - radius, center.x + radius, center.y + radius, g_EntityGridResults);
 
-		if ((pEdict->v.flags & (FL_CLIENT | FL_MONSTER)) == 0) // Not a client/monster ?
-			continue;
+		for (int i : g_EntityGridResults)
+		{
+			if (!UTIL_IsMonsterInSphere(pEdict + i, center, radiusSquared))
+				continue;
 
-		// Use origin for X & Y since they are centered for all monsters
-		// Now X
-		delta = center.x - pEdict->v.origin.x; //(pEdict->v.absmin.x + pEdict->v.absmax.x)*0.5;
-		delta *= delta;
+			pEntity = CBaseEntity::Instance(pEdict + i);
+			if (!pEntity)
+				continue;
 
-		if (delta > radiusSquared)
-			continue;
-		distance = delta;
+			pList[count] = pEntity;
+			count++;
 
-		// Now Y
-		delta = center.y - pEdict->v.origin.y; //(pEdict->v.absmin.y + pEdict->v.absmax.y)*0.5;
-		delta *= delta;
+			if (count >= listMax)
+				return count;
+		}
 
-		distance += delta;
-		if (distance > radiusSquared)
-			continue;
+		return count;
+	}
 
-		// Now Z
-		delta = center.z - (pEdict->v.absmin.z + pEdict->v.absmax.z) * 0.5;
-		delta *= delta;
+	// Ignore world.
+	++pEdict;
 
-		distance += delta;
-		if (distance > radiusSquared)
+	for (int i = 1; i < gpGlobals->maxEntities; i++, pEdict++)
+	{
+		if (!UTIL_IsMonsterInSphere(pEdict, center, radiusSquared))
 			continue;
 
 		pEntity = CBaseEntity::Instance(pEdict);
@@ -1697,6 +2005,136 @@ static int gSizes[FIELD_TYPECOUNT] =
 		sizeof(std::uint64_t), //FIELD_INT64
 };
 
+/**
+*	@brief What WriteFields and ReadFields need to know about one field, computed once per table.
+*/
+struct SaveRestorePlanField
+{
+	const char* Name;
+	int Offset;
+	int Bytes;				//!< Size of the field in memory
+	unsigned int NameHash;	//!< CSaveRestoreBuffer::HashString of the name
+	unsigned short Token;	//!< Token index the name was given by the last save, only used if the token table still holds the name there
+	bool IsPlainData;		//!< Restored by copying the saved bytes as they are
+	bool IsGlobal;
+};
+
+/**
+*	@brief Everything about a TYPEDESCRIPTION table that does not depend on the object being saved or restored.
+*	Built the first time the table is used and kept until the dll is unloaded, so tables must not move (they are all static arrays).
+*/
+struct SaveRestorePlan
+{
+	struct Range
+	{
+		int Offset;
+		int Bytes;
+	};
+
+	std::vector<SaveRestorePlanField> Fields;
+	std::vector<Range> ClearRanges;		  //!< Memory of all fields, merged where fields touch, cleared before restoring
+	std::vector<Range> LocalClearRanges;  //!< The same without FTYPEDESC_GLOBAL fields, for restoring global entities
+	CaseInsensitiveStringIndex FieldIndex; //!< Field number by name
+	bool HasDuplicateNames = false;		   //!< If so, names are searched for in table order like they used to be
+
+	static SaveRestorePlan& Get(TYPEDESCRIPTION* pFields, int fieldCount);
+
+private:
+	static void MergeRanges(std::vector<Range>& ranges);
+};
+
+SaveRestorePlan& SaveRestorePlan::Get(TYPEDESCRIPTION* pFields, int fieldCount)
+{
+	static std::unordered_map<const TYPEDESCRIPTION*, std::unique_ptr<SaveRestorePlan>> plans;
+
+	auto& plan = plans[pFields];
+
+	if (plan && plan->Fields.size() == static_cast<std::size_t>(fieldCount))
+	{
+		return *plan;
+	}
+
+	plan = std::make_unique<SaveRestorePlan>();
+
+	plan->Fields.reserve(fieldCount);
+
+	for (int i = 0; i < fieldCount; ++i)
+	{
+		const TYPEDESCRIPTION& description = pFields[i];
+
+		SaveRestorePlanField field;
+		field.Name = description.fieldName;
+		field.Offset = description.fieldOffset;
+		field.Bytes = description.fieldSize * gSizes[description.fieldType];
+		field.NameHash = description.fieldName ? CSaveRestoreBuffer::HashString(description.fieldName) : 0;
+		field.Token = 0;
+		field.IsGlobal = (description.flags & FTYPEDESC_GLOBAL) != 0;
+
+		switch (description.fieldType)
+		{
+		case FIELD_FLOAT:
+		case FIELD_VECTOR:
+		case FIELD_INTEGER:
+		case FIELD_INT64:
+		case FIELD_SHORT:
+		case FIELD_CHARACTER:
+			field.IsPlainData = true;
+			break;
+
+		default:
+			field.IsPlainData = false;
+			break;
+		}
+
+		plan->Fields.push_back(field);
+
+		plan->ClearRanges.push_back({field.Offset, field.Bytes});
+
+		if (!field.IsGlobal)
+		{
+			plan->LocalClearRanges.push_back({field.Offset, field.Bytes});
+		}
+
+		if (description.fieldName)
+		{
+			if (plan->FieldIndex.Find(description.fieldName) != -1)
+			{
+				plan->HasDuplicateNames = true;
+			}
+
+			plan->FieldIndex.Add(description.fieldName, i);
+		}
+	}
+
+	MergeRanges(plan->ClearRanges);
+	MergeRanges(plan->LocalClearRanges);
+
+	return *plan;
+}
+
+void SaveRestorePlan::MergeRanges(std::vector<Range>& ranges)
+{
+	std::sort(ranges.begin(), ranges.end(), [](const Range& lhs, const Range& rhs)
+		{ return lhs.Offset < rhs.Offset; });
+
+	std::size_t count = 0;
+
+	for (const auto& range : ranges)
+	{
+		if (count > 0 && range.Offset <= ranges[count - 1].Offset + ranges[count - 1].Bytes)
+		{
+			Range& last = ranges[count - 1];
+			last.Bytes = std::max(last.Bytes, range.Offset + range.Bytes - last.Offset);
+		}
+		else
+		{
+			ranges[count++] = range;
+		}
+	}
+
+	ranges.resize(count);
+}
+
 
 // Base class includes common SAVERESTOREDATA pointer, and manages the entity table
 CSaveRestoreBuffer::CSaveRestoreBuffer(SAVERESTOREDATA& data)
@@ -1820,6 +2258,24 @@ unsigned int CSaveRestoreBuffer::HashString(const char* pszToken)
 }
 
 unsigned short CSaveRestoreBuffer::TokenHash(const char* pszToken)
+{
+	return FindToken(pszToken, HashString(pszToken));
+}
+
+unsigned short CSaveRestoreBuffer::TokenHash(const char* pszToken, unsigned int hash, unsigned short& cachedToken)
+{
+	// Tokens are never removed from the table, so if the slot still holds this string it is the slot a search would find
+	if (cachedToken < m_data.tokenCount && nullptr != m_data.pTokens && m_data.pTokens[cachedToken] == pszToken)
+	{
+		return cachedToken;
+	}
+
+	cachedToken = FindToken(pszToken, hash);
+
+	return cachedToken;
+}
+
+unsigned short CSaveRestoreBuffer::FindToken(const char* pszToken, unsigned int hash)
 {
 #if _DEBUG
 	static int tokensparsed = 0;
@@ -1832,7 +2288,7 @@ unsigned short CSaveRestoreBuffer::TokenHash(const char* pszToken)
 		return 0;
 	}
 
-	const unsigned short hash = (unsigned short)(HashString(pszToken) % (unsigned)m_data.tokenCount);
+	const unsigned short start = (unsigned short)(hash % (unsigned)m_data.tokenCount);
 
 	for (int i = 0; i < m_data.tokenCount; i++)
 	{
@@ -1845,7 +2301,7 @@ unsigned short CSaveRestoreBuffer::TokenHash(const char* pszToken)
 		}
 #endif
 
-		int index = hash + i;
+		int index = start + i;
 		if (index >= m_data.tokenCount)
 			index -= m_data.tokenCount;
 
@@ -2061,35 +2517,35 @@ bool CSave::WriteEntVars(const char* pname, entvars_t* pev)
 
 bool CSave::WriteFields(const char* pname, void* pBaseData, TYPEDESCRIPTION* pFields, int fieldCount)
 {
-	int i, j, actualCount, emptyCount;
+	int i, j;
 	TYPEDESCRIPTION* pTest;
 	int entityArray[MAX_ENTITYARRAY];
 	byte boolArray[MAX_ENTITYARRAY];
 
-	// Precalculate the number of empty fields
-	emptyCount = 0;
-	for (i = 0; i < fieldCount; i++)
-	{
-		void* pOutputData;
-		pOutputData = ((char*)pBaseData + pFields[i].fieldOffset);
-		if (DataEmpty((const char*)pOutputData, pFields[i].fieldSize * gSizes[pFields[i].fieldType]))
-			emptyCount++;
-	}
+	SaveRestorePlan& plan = SaveRestorePlan::Get(pFields, fieldCount);
 
-	// Empty fields will not be written, write out the actual number of fields to be written
-	actualCount = fieldCount - emptyCount;
+	// Empty fields will not be written. Write the number of fields that are once we know it,
+	// so each field is only checked once.
+	int actualCount = 0;
+	const int sizeBefore = m_data.size;
 	WriteInt(pname, &actualCount, 1);
 
+	char* pCount = m_data.pCurrentData - sizeof(int);
+	const bool countWritten = m_data.size == sizeBefore + (int)(2 * sizeof(short) + sizeof(int));
+
 	for (i = 0; i < fieldCount; i++)
 	{
 		void* pOutputData;
 		pTest = &pFields[i];
 		pOutputData = ((char*)pBaseData + pTest->fieldOffset);
 
-		// UNDONE: Must we do this twice?
-		if (DataEmpty((const char*)pOutputData, pTest->fieldSize * gSizes[pTest->fieldType]))
+		if (DataEmpty((const char*)pOutputData, plan.Fields[i].Bytes))
 			continue;
 
+		++actualCount;
+
+		m_pPlanField = &plan.Fields[i];
+
 		switch (pTest->fieldType)
 		{
 		case FIELD_FLOAT:
@@ -2180,8 +2636,13 @@ bool CSave::WriteFields(const char* pname, void* pBaseData, TYPEDESCRIPTION* pFi
 		default:
 			ALERT(at_error, "Bad field type\n");
 		}
+
+		m_pPlanField = nullptr;
 	}
 
+	if (countWritten)
+		memcpy(pCount, &actualCount, sizeof(int));
+
 	return true;
 }
 
@@ -2197,7 +2658,19 @@ void CSave::BufferString(char* pdata, int len)
 
 bool CSave::DataEmpty(const char* pdata, int size)
 {
-	for (int i = 0; i < size; i++)
+	int i = 0;
+
+	// Test 8 bytes at a time, then whatever is left
+	for (; i + (int)sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t))
+	{
+		std::uint64_t value;
+		memcpy(&value, pdata + i, sizeof(value));
+
+		if (0 != value)
+			return false;
+	}
+
+	for (; i < size; i++)
 	{
 		if (0 != pdata[i])
 			return false;
@@ -2215,7 +2688,12 @@ void CSave::BufferField(const char* pname, int size, const char* pdata)
 
 void CSave::BufferHeader(const char* pname, int size)
 {
-	short hashvalue = TokenHash(pname);
+	short hashvalue;
+
+	if (m_pPlanField && m_pPlanField->Name == pname)
+		hashvalue = TokenHash(pname, m_pPlanField->NameHash, m_pPlanField->Token);
+	else
+		hashvalue = TokenHash(pname);
 	if (size > 1 << (sizeof(short) * 8))
 		ALERT(at_error, "CSave :: BufferHeader() size parameter exceeds 'short'!\n");
 	BufferData((const char*)&size, sizeof(short));
@@ -2247,7 +2725,39 @@ void CSave::BufferData(const char* pdata, int size)
 
 int CRestore::ReadField(void* pBaseData, TYPEDESCRIPTION* pFields, int fieldCount, int startField, int size, char* pName, void* pData)
 {
-	int i, j, stringCount, fieldNumber, entityIndex;
+	return ReadField(SaveRestorePlan::Get(pFields, fieldCount), pBaseData, pFields, fieldCount, startField, size, pName, pData);
+}
+
+
+int CRestore::FindField(const SaveRestorePlan& plan, TYPEDESCRIPTION* pFields, int fieldCount, int startField, const char* pName)
+{
+	if (fieldCount <= 0)
+		return -1;
+
+	// Most data is read in the same order it was written, so try the next field first
+	const int nextField = startField % fieldCount;
+
+	if (pFields[nextField].fieldName && !stricmp(pFields[nextField].fieldName, pName))
+		return nextField;
+
+	if (!plan.HasDuplicateNames)
+		return plan.FieldIndex.Find(pName);
+
+	for (int i = 1; i < fieldCount; i++)
+	{
+		const int fieldNumber = (i + startField) % fieldCount;
+
+		if (pFields[fieldNumber].fieldName && !stricmp(pFields[fieldNumber].fieldName, pName))
+			return fieldNumber;
+	}
+
+	return -1;
+}
+
+
+int CRestore::ReadField(const SaveRestorePlan& plan, void* pBaseData, TYPEDESCRIPTION* pFields, int fieldCount, int startField, int size, char* pName, void* pData)
+{
+	int j, stringCount, fieldNumber, entityIndex;
 	TYPEDESCRIPTION* pTest;
 	float timeData;
 	Vector position;
@@ -2259,163 +2769,169 @@ int CRestore::ReadField(void* pBaseData, TYPEDESCRIPTION* pFields, int fieldCoun
 	if (0 != m_data.fUseLandmark)
 		position = m_data.vecLandmarkOffset;
 
-	for (i = 0; i < fieldCount; i++)
+	fieldNumber = FindField(plan, pFields, fieldCount, startField, pName);
+
+	if (fieldNumber == -1)
+		return -1;
+
+	pTest = &pFields[fieldNumber];
+
+	// Don't overwrite global fields when restoring a global entity
+	if (m_global && (pTest->flags & FTYPEDESC_GLOBAL) != 0)
 	{
-		fieldNumber = (i + startField) % fieldCount;
-		pTest = &pFields[fieldNumber];
-		if (pTest->fieldName && !stricmp(pTest->fieldName, pName))
+#if 0
+		ALERT( at_console, "Skipping global field %s\n", pName );
+#endif
+		return fieldNumber;
+	}
+
+	// Saved exactly as it is in memory, so copy the whole field at once.
+	// Never copy more than was saved, the rest has already been cleared by ReadFields.
+	if (plan.Fields[fieldNumber].IsPlainData)
+	{
+		memcpy((char*)pBaseData + pTest->fieldOffset, pData, std::min(size, plan.Fields[fieldNumber].Bytes));
+		return fieldNumber;
+	}
+
+	for (j = 0; j < pTest->fieldSize; j++)
+	{
+		void* pOutputData = ((char*)pBaseData + pTest->fieldOffset + (j * gSizes[pTest->fieldType]));
+		void* pInputData = (char*)pData + j * gSizes[pTest->fieldType];
+
+		switch (pTest->fieldType)
 		{
-			if (!m_global || (pTest->flags & FTYPEDESC_GLOBAL) == 0)
+		case FIELD_TIME:
+			timeData = *(float*)pInputData;
+			// Re-base time variables
+			timeData += m_data.time;
+			*((float*)pOutputData) = timeData;
+			break;
+		case FIELD_FLOAT:
+			*((float*)pOutputData) = *(float*)pInputData;
+			break;
+		case FIELD_MODELNAME:
+		case FIELD_SOUNDNAME:
+		case FIELD_STRING:
+			// Skip over j strings
+			pString = (char*)pData;
+			for (stringCount = 0; stringCount < j; stringCount++)
 			{
-				for (j = 0; j < pTest->fieldSize; j++)
-				{
-					void* pOutputData = ((char*)pBaseData + pTest->fieldOffset + (j * gSizes[pTest->fieldType]));
-					void* pInputData = (char*)pData + j * gSizes[pTest->fieldType];
-
-					switch (pTest->fieldType)
-					{
-					case FIELD_TIME:
-						timeData = *(float*)pInputData;
-						// Re-base time variables
-						timeData += m_data.time;
-						*((float*)pOutputData) = timeData;
-						break;
-					case FIELD_FLOAT:
-						*((float*)pOutputData) = *(float*)pInputData;
-						break;
-					case FIELD_MODELNAME:
-					case FIELD_SOUNDNAME:
-					case FIELD_STRING:
-						// Skip over j strings
-						pString = (char*)pData;
-						for (stringCount = 0; stringCount < j; stringCount++)
-						{
-							while ('\0' != *pString)
-								pString++;
-							pString++;
-						}
-						pInputData = pString;
-						if (strlen((char*)pInputData) == 0)
-							*((int*)pOutputData) = 0;
-						else
-						{
-							int string;
-
-							string = ALLOC_STRING((char*)pInputData);
-
-							*((int*)pOutputData) = string;
-
-							if (!FStringNull(string) && m_precache)
-							{
-								if (pTest->fieldType == FIELD_MODELNAME)
-									PRECACHE_MODEL((char*)STRING(string));
-								else if (pTest->fieldType == FIELD_SOUNDNAME)
-									PRECACHE_SOUND((char*)STRING(string));
-							}
-						}
-						break;
-					case FIELD_EVARS:
-						entityIndex = *(int*)pInputData;
-						pent = EntityFromIndex(entityIndex);
-						if (pent)
-							*((entvars_t**)pOutputData) = VARS(pent);
-						else
-							*((entvars_t**)pOutputData) = NULL;
-						break;
-					case FIELD_CLASSPTR:
-						entityIndex = *(int*)pInputData;
-						pent = EntityFromIndex(entityIndex);
-						if (pent)
-							*((CBaseEntity**)pOutputData) = CBaseEntity::Instance(pent);
-						else
-							*((CBaseEntity**)pOutputData) = NULL;
-						break;
-					case FIELD_EDICT:
-						entityIndex = *(int*)pInputData;
-						pent = EntityFromIndex(entityIndex);
-						*((edict_t**)pOutputData) = pent;
-						break;
-					case FIELD_EHANDLE:
-						// Input and Output sizes are different!
-						pInputData = (char*)pData + j * sizeof(int);
-						entityIndex = *(int*)pInputData;
-						pent = EntityFromIndex(entityIndex);
-						if (pent)
-							*((EHANDLE*)pOutputData) = CBaseEntity::Instance(pent);
-						else
-							*((EHANDLE*)pOutputData) = NULL;
-						break;
-					case FIELD_ENTITY:
-						entityIndex = *(int*)pInputData;
-						pent = EntityFromIndex(entityIndex);
-						if (pent)
-							*((EOFFSET*)pOutputData) = OFFSET(pent);
-						else
-							*((EOFFSET*)pOutputData) = 0;
-						break;
-					case FIELD_VECTOR:
-						((float*)pOutputData)[0] = ((float*)pInputData)[0];
-						((float*)pOutputData)[1] = ((float*)pInputData)[1];
-						((float*)pOutputData)[2] = ((float*)pInputData)[2];
-						break;
-					case FIELD_POSITION_VECTOR:
-						((float*)pOutputData)[0] = ((float*)pInputData)[0] + position.x;
-						((float*)pOutputData)[1] = ((float*)pInputData)[1] + position.y;
-						((float*)pOutputData)[2] = ((float*)pInputData)[2] + position.z;
-						break;
-
-					case FIELD_BOOLEAN:
-					{
-						// Input and Output sizes are different!
-						pOutputData = (char*)pOutputData + j * (sizeof(bool) - gSizes[pTest->fieldType]);
-						const bool value = *((byte*)pInputData) != 0;
-
-						*((bool*)pOutputData) = value;
-					}
-					break;
-
-					case FIELD_INTEGER:
-						*((int*)pOutputData) = *(int*)pInputData;
-						break;
-
-					case FIELD_INT64:
-						*((std::uint64_t*)pOutputData) = *(std::uint64_t*)pInputData;
-						break;
-
-					case FIELD_SHORT:
-						*((short*)pOutputData) = *(short*)pInputData;
-						break;
-
-					case FIELD_CHARACTER:
-						*((char*)pOutputData) = *(char*)pInputData;
-						break;
-
-					case FIELD_POINTER:
-						*((int*)pOutputData) = *(int*)pInputData;
-						break;
-					case FIELD_FUNCTION:
-						if (strlen((char*)pInputData) == 0)
-							*((int*)pOutputData) = 0;
-						else
-							*((int*)pOutputData) = FUNCTION_FROM_NAME((char*)pInputData);
-						break;
-
-					default:
-						ALERT(at_error, "Bad field type\n");
-					}
-				}
+				while ('\0' != *pString)
+					pString++;
+				pString++;
 			}
-#if 0
+			pInputData = pString;
+			if (strlen((char*)pInputData) == 0)
+				*((int*)pOutputData) = 0;
 			else
 			{
-				ALERT( at_console, "Skipping global field %s\n", pName );
+				int string;
+
+				string = ALLOC_STRING((char*)pInputData);
+
+				*((int*)pOutputData) = string;
+
+				if (!FStringNull(string) && m_precache)
+				{
+					if (pTest->fieldType == FIELD_MODELNAME)
+						PRECACHE_MODEL((char*)STRING(string));
+					else if (pTest->fieldType == FIELD_SOUNDNAME)
+						PRECACHE_SOUND((char*)STRING(string));
+				}
 			}
-#endif
-			return fieldNumber;
+			break;
+		case FIELD_EVARS:
+			entityIndex = *(int*)pInputData;
+			pent = EntityFromIndex(entityIndex);
+			if (pent)
+				*((entvars_t**)pOutputData) = VARS(pent);
+			else
+				*((entvars_t**)pOutputData) = NULL;
+			break;
+		case FIELD_CLASSPTR:
+			entityIndex = *(int*)pInputData;
+			pent = EntityFromIndex(entityIndex);
+			if (pent)
+				*((CBaseEntity**)pOutputData) = CBaseEntity::Instance(pent);
+			else
+				*((CBaseEntity**)pOutputData) = NULL;
+			break;
+		case FIELD_EDICT:
+			entityIndex = *(int*)pInputData;
+			pent = EntityFromIndex(entityIndex);
+			*((edict_t**)pOutputData) = pent;
+			break;
+		case FIELD_EHANDLE:
+			// Input and Output sizes are different!
+			pInputData = (char*)pData + j * sizeof(int);
+			entityIndex = *(int*)pInputData;
+			pent = EntityFromIndex(entityIndex);
+			if (pent)
+				*((EHANDLE*)pOutputData) = CBaseEntity::Instance(pent);
+			else
+				*((EHANDLE*)pOutputData) = NULL;
+			break;
+		case FIELD_ENTITY:
+			entityIndex = *(int*)pInputData;
+			pent = EntityFromIndex(entityIndex);
+			if (pent)
+				*((EOFFSET*)pOutputData) = OFFSET(pent);
+			else
+				*((EOFFSET*)pOutputData) = 0;
+			break;
+		case FIELD_VECTOR:
+			((float*)pOutputData)[0] = ((float*)pInputData)[0];
+			((float*)pOutputData)[1] = ((float*)pInputData)[1];
+			((float*)pOutputData)[2] = ((float*)pInputData)[2];
+			break;
+		case FIELD_POSITION_VECTOR:
+			((float*)pOutputData)[0] = ((float*)pInputData)[0] + position.x;
+			((float*)pOutputData)[1] = ((float*)pInputData)[1] + position.y;
+			((float*)pOutputData)[2] = ((float*)pInputData)[2] + position.z;
+			break;
+
+		case FIELD_BOOLEAN:
+		{
+			// Input and Output sizes are different!
+			pOutputData = (char*)pOutputData + j * (sizeof(bool) - gSizes[pTest->fieldType]);
+			const bool value = *((byte*)pInputData) != 0;
+
+			*((bool*)pOutputData) = value;
+		}
+		break;
+
+		case FIELD_INTEGER:
+			*((int*)pOutputData) = *(int*)pInputData;
+			break;
+
+		case FIELD_INT64:
+			*((std::uint64_t*)pOutputData) = *(std::uint64_t*)pInputData;
+			break;
+
+		case FIELD_SHORT:
+			*((short*)pOutputData) = *(short*)pInputData;
+			break;
+
+		case FIELD_CHARACTER:
+			*((char*)pOutputData) = *(char*)pInputData;
+			break;
+
+		case FIELD_POINTER:
+			*((int*)pOutputData) = *(int*)pInputData;
+			break;
+		case FIELD_FUNCTION:
+			if (strlen((char*)pInputData) == 0)
+				*((int*)pOutputData) = 0;
+			else
+				*((int*)pOutputData) = FUNCTION_FROM_NAME((char*)pInputData);
+			break;
+
+		default:
+			ALERT(at_error, "Bad field type\n");
 		}
 	}
 
-	return -1;
+	return fieldNumber;
 }
 
 
@@ -2449,18 +2965,16 @@ bool CRestore::ReadFields(const char* pname, void* pBaseData, TYPEDESCRIPTION* p
 
 	lastField = 0; // Make searches faster, most data is read/written in the same order
 
-	// Clear out base data
-	for (i = 0; i < fieldCount; i++)
-	{
-		// Don't clear global fields
-		if (!m_global || (pFields[i].flags & FTYPEDESC_GLOBAL) == 0)
-			memset(((char*)pBaseData + pFields[i].fieldOffset), 0, pFields[i].fieldSize * gSizes[pFields[i].fieldType]);
-	}
+	const SaveRestorePlan& plan = SaveRestorePlan::Get(pFields, fieldCount);
+
+	// Clear out base data. Don't clear global fields
+	for (const auto& range : m_global ? plan.LocalClearRanges : plan.ClearRanges)
+		memset(((char*)pBaseData + range.Offset), 0, range.Bytes);
 
 	for (i = 0; i < fileCount; i++)
 	{
 		BufferReadHeader(&header);
-		lastField = ReadField(pBaseData, pFields, fieldCount, lastField, header.size, m_data.pTokens[header.token], header.pData);
+		lastField = ReadField(plan, pBaseData, pFields, fieldCount, lastField, header.size, m_data.pTokens[header.token], header.pData);
 		lastField++;
 	}
 
@@ -243,6 +243,12 @@ extern void UTIL_MakeVectors(const Vector& vecAngles);
 extern int UTIL_MonstersInSphere(CBaseEntity** pList, int listMax, const Vector& center, float radius);
 extern int UTIL_EntitiesInBox(CBaseEntity** pList, int listMax, const Vector& mins, const Vector& maxs, int flagMask);
 
+// Spatial hash of clients and monsters that answers the two queries above.
+// Rebuilt every frame, and updated whenever the engine relinks an entity.
+extern void UTIL_ResetEntityGrid();
+extern void UTIL_RebuildEntityGrid();
+extern void UTIL_UpdateEntityGrid(edict_t* pEdict);
+
 inline void UTIL_MakeVectorsPrivate(const Vector& vecAngles, float* p_vForward, float* p_vRight, float* p_vUp)
 {
 	g_engfuncs.pfnAngleVectors(vecAngles, p_vForward, p_vRight, p_vUp);
@@ -278,6 +278,7 @@ void CGlobalState::Reset()
 {
 	m_pList = NULL;
 	m_listCount = 0;
+	m_index.clear();
 }
 
 globalentity_t* CGlobalState::Find(string_t globalname)
@@ -285,20 +286,9 @@ globalentity_t* CGlobalState::Find(string_t globalname)
 	if (FStringNull(globalname))
 		return NULL;
 
-	globalentity_t* pTest;
-	const char* pEntityName = STRING(globalname);
-
-
-	pTest = m_pList;
-	while (pTest)
-	{
-		if (FStrEq(pEntityName, pTest->name))
-			break;
+	auto it = m_index.find(STRING(globalname));
 
-		pTest = pTest->pNext;
-	}
-
-	return pTest;
+	return it != m_index.end() ? it->second : NULL;
 }
 
 
@@ -332,6 +322,9 @@ void CGlobalState::EntityAdd(string_t globalname, string_t mapName, GLOBALESTATE
 	strcpy(pNewEntity->levelName, STRING(mapName));
 	pNewEntity->state = state;
 	m_listCount++;
+
+	// Newest entry wins, like the list walk this replaced
+	m_index[pNewEntity->name] = pNewEntity;
 }
 
 
@@ -20,6 +20,8 @@
 #include "player.h"
 #include "client.h"
 #include "perf_counter.h"
+#include "profiler.h"
+#include "nav_danger.h"						// before bot_manager.h, whose min/max macros break the STL headers
 
 #include "bot.h"
 #include "bot_manager.h"
@@ -103,6 +105,11 @@ void CBotManager::RestartRound( void )
  */
 void CBotManager::StartFrame( void )
 {
+	PROFILE_SCOPE( "CBotManager::StartFrame" );
+
+	// spread the danger from last frame's events, so the paths computed this frame can avoid it
+	TheNavDangerMap.Update();
+
 	// debug smoke grenade visualization
 	if (cv_bot_debug.value == 5)
 	{
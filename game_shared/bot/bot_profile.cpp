@@ -115,12 +115,45 @@ bool BotProfile::IsValidForTeam( BotProfileTeamType team ) const
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+static std::vector< BotProfileDatabase * > loadedDatabases;	///< every database parsed by this process - never freed
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the key a name is indexed by, which ignores case
+ */
+static std::string MakeKey( const char *name )
+{
+	std::string key( name );
+	for( unsigned int i=0; i<key.size(); ++i )
+		key[i] = tolower( key[i] );
+
+	return key;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Order profiles by name without case, for GetProfile()
+ */
+static bool IsNameLess( const BotProfile *a, const BotProfile *b )
+{
+	return stricmp( a->GetName(), b->GetName() ) < 0;
+}
+
+static bool IsNameLessThan( const BotProfile *profile, const char *name )
+{
+	return stricmp( profile->GetName(), name ) < 0;
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Constructor
  */
-BotProfileManager::BotProfileManager( void )
+BotProfileDatabase::BotProfileDatabase( const char *filename, unsigned int checksum ) : m_filename( filename )
 {
+	m_checksum = checksum;
+
 	m_nextSkin = 0;
 	for (int i=0; i<NumCustomSkins; ++i)
 	{
@@ -132,37 +165,81 @@ BotProfileManager::BotProfileManager( void )
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Load the bot profile database
+ * Return the database of the given bot profile file. The file is only parsed the first time this process
+ * loads it, or if it has changed since. 'voiceBanks' are the banks that must have the first indices, in order.
  */
-void BotProfileManager::Init( const char *filename, unsigned int *checksum )
+BotProfileDatabase *BotProfileDatabase::Load( const char *filename, unsigned int *checksum, const std::vector<char *> &voiceBanks )
 {
 	int dataLength;
 	char *dataPointer = (char *)LOAD_FILE_FOR_ME( const_cast<char *>( filename ), &dataLength );
-	const char *dataFile = dataPointer;
 
-	if (dataFile == NULL)
+	if (dataPointer == NULL)
 	{
 		if ( UTIL_IsGame( "czero" ) )
 		{
 			CONSOLE_ECHO( "WARNING: Cannot access bot profile database '%s'\n", filename );
 		}
-		return;
+		return NULL;
 	}
 
-	// compute simple checksum
+	// compute simple checksum - it also tells us if the file has changed since we parsed it
+	unsigned int fileChecksum = ComputeSimpleChecksum( (const unsigned char *)dataPointer, dataLength );
+
 	if (checksum)
 	{
-		*checksum = ComputeSimpleChecksum( (const unsigned char *)dataPointer, dataLength );
+		*checksum = fileChecksum;
+	}
+
+	BotProfileDatabase *database = NULL;
+
+	for( unsigned int d=0; d<loadedDatabases.size() && database == NULL; ++d )
+	{
+		BotProfileDatabase *loaded = loadedDatabases[d];
+
+		if (stricmp( loaded->m_filename.c_str(), filename ) || loaded->m_checksum != fileChecksum)
+			continue;
+
+		// the profiles refer to voice banks by index, so the banks must be in the same order
+		bool isSameVoiceBanks = (loaded->m_voiceBanks.size() >= voiceBanks.size());
+		for( unsigned int v=0; v<voiceBanks.size() && isSameVoiceBanks; ++v )
+			if (stricmp( loaded->m_voiceBanks[v], voiceBanks[v] ))
+				isSameVoiceBanks = false;
+
+		if (isSameVoiceBanks)
+			database = loaded;
 	}
 
+	if (database == NULL)
+	{
+		database = new BotProfileDatabase( filename, fileChecksum );
+
+		for( unsigned int v=0; v<voiceBanks.size(); ++v )
+			database->FindVoiceBankIndex( voiceBanks[v] );
+
+		database->Parse( dataPointer );
+		database->BuildIndex();
+
+		loadedDatabases.push_back( database );
+	}
+
+	FREE_FILE( dataPointer );
+
+	return database;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Parse the BotProfile.db into BotProfile instances
+ */
+void BotProfileDatabase::Parse( const char *dataFile )
+{
+	const char *filename = m_filename.c_str();
+
 	// keep list of templates used for inheritance
 	BotProfileList templateList;
 
 	BotProfile defaultProfile;
 
-	//
-	// Parse the BotProfile.db into BotProfile instances
-	//
 	while( true )
 	{
 		dataFile = SharedParse( dataFile );
@@ -185,7 +262,6 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected skin name\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 			token = SharedGetToken();
@@ -196,14 +272,12 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected 'Model'\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 			token = SharedGetToken();
 			if (stricmp( "Model", token ))
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected 'Model'\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 
@@ -212,14 +286,12 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected '='\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 			token = SharedGetToken();
 			if (strcmp( "=", token ))
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected '='\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 
@@ -228,7 +300,6 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected attribute value\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 			token = SharedGetToken();
@@ -239,6 +310,7 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			{
 				// decorate the name
 				m_skins[ m_nextSkin ] = CloneString( decoratedName );
+				m_skinIndex[ MakeKey( decoratedName ) ] = FirstCustomSkin + m_nextSkin;
 
 				// construct the model filename
 				m_skinModelnames[ m_nextSkin ] = CloneString( token );
@@ -252,22 +324,21 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected 'End'\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 			token = SharedGetToken();
 			if (strcmp( "End", token ))
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected 'End'\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 
 			continue; // it's just a custom skin - no need to do inheritance on a bot profile, etc.
 		}
 
-		// encountered a new profile
+		// encountered a new profile - templates live until the end of the parse, profiles are copied into the database
 		BotProfile *profile;
+		BotProfile newProfile;
 
 		if (isDefault)
 		{
@@ -275,7 +346,7 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 		}
 		else
 		{
-			profile = new BotProfile;
+			profile = (isTemplate) ? new BotProfile : &newProfile;
 
 			// always inherit from Default
 			*profile = defaultProfile;
@@ -306,7 +377,6 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 				if (inherit == NULL)
 				{
 					CONSOLE_ECHO( "Error parsing '%s' - invalid template reference '%s'\n", filename, token );
-					FREE_FILE( dataPointer );
 					return;
 				}
 
@@ -328,7 +398,6 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing '%s' - expected name\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 			profile->m_name = CloneString( SharedGetToken() );
@@ -353,7 +422,6 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected 'End'\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 			token = SharedGetToken();
@@ -372,7 +440,6 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected '='\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 
@@ -380,7 +447,6 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (strcmp( "=", token ))
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected '='\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 
@@ -389,7 +455,6 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			if (!dataFile)
 			{
 				CONSOLE_ECHO( "Error parsing %s - expected attribute value\n", filename );
-				FREE_FILE( dataPointer );
 				return;
 			}
 			token = SharedGetToken();
@@ -409,7 +474,7 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 				if ( profile->m_skin == 0 )
 				{
 					// atoi() failed - try to look up a custom skin by name
-					profile->m_skin = GetCustomSkinIndex( token, filename );
+					profile->m_skin = GetCustomSkinIndex( GetDecoratedSkinName( token, filename ) );
 				}
 			}
 			else if (!stricmp( "Teamwork", attributeName ))
@@ -516,61 +581,140 @@ void BotProfileManager::Init( const char *filename, unsigned int *checksum )
 			}
 			else
 			{
-				// add profile to the master list
-				m_profileList.push_back( profile );
+				// add profile to the database, moving its name into the block of names
+				m_nameOffset.push_back( m_names.size() );
+				m_names.insert( m_names.end(), profile->m_name, profile->m_name + strlen( profile->m_name ) + 1 );
+
+				delete [] profile->m_name;
+				profile->m_name = NULL;
+
+				m_profile.push_back( *profile );
 			}
 		}
 	}
 
-	FREE_FILE( dataPointer );
-
 	// free the templates
 	for( BotProfileList::iterator iter = templateList.begin(); iter != templateList.end(); ++iter )
 		delete *iter;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Point the parsed profiles at their names, and index them by difficulty, team and name
+ */
+void BotProfileDatabase::BuildIndex( void )
+{
+	m_profileList.clear();
+	for( unsigned int i=0; i<m_profile.size(); ++i )
+	{
+		m_profile[i].m_name = &m_names[ m_nameOffset[i] ];
+		m_profileList.push_back( &m_profile[i] );
+	}
+
+	for( int d=0; d<NUM_DIFFICULTY_LEVELS; ++d )
+	{
+		for( int t=0; t<=BOT_TEAM_ANY; ++t )
+		{
+			BotProfileList *bucket = &m_profileIndex[d][t];
+			bucket->clear();
+
+			for( BotProfileList::iterator iter = m_profileList.begin(); iter != m_profileList.end(); ++iter )
+				if ((*iter)->IsDifficulty( (BotDifficultyType)d ) && (*iter)->IsValidForTeam( (BotProfileTeamType)t ))
+					bucket->push_back( *iter );
+		}
+	}
+
+	// a stable sort keeps profiles with the same name in file order, so the first one is still found first
+	m_profileByName = m_profileList;
+	std::stable_sort( m_profileByName.begin(), m_profileByName.end(), IsNameLess );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Given a name, return the first profile with it that is valid for the team
+ */
+const BotProfile *BotProfileDatabase::GetProfile( const char *name, BotProfileTeamType team ) const
+{
+	BotProfileList::const_iterator iter = std::lower_bound( m_profileByName.begin(), m_profileByName.end(), name, IsNameLessThan );
+
+	for( ; iter != m_profileByName.end() && !stricmp( (*iter)->GetName(), name ); ++iter )
+		if ((*iter)->IsValidForTeam( team ))
+			return *iter;
+
+	return NULL;
+}
+
+//--------------------------------------------------------------------------------------------------------
+/**
+ * Looks up a custom skin index by filename-decorated name
+ */
+int BotProfileDatabase::GetCustomSkinIndex( const char *skinName ) const
+{
+	std::map< std::string, int >::const_iterator iter = m_skinIndex.find( MakeKey( skinName ) );
+
+	return (iter != m_skinIndex.end()) ? iter->second : 0;
+}
+
+//--------------------------------------------------------------------------------------------------------
+/**
+ * return index of the (custom) bot phrase db, inserting it if needed
+ */
+int BotProfileDatabase::FindVoiceBankIndex( const char *filename )
+{
+	std::string key = MakeKey( filename );
+
+	std::map< std::string, int >::const_iterator iter = m_voiceBankIndex.find( key );
+	if (iter != m_voiceBankIndex.end())
+		return iter->second;
+
+	int index = m_voiceBanks.size();
+
+	m_voiceBanks.push_back( CloneString( filename ) );
+	m_voiceBankIndex[ key ] = index;
+
+	return index;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Constructor
+ */
+BotProfileManager::BotProfileManager( void )
+{
+	m_database = NULL;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the bot profile database. The file is parsed only the first time it is loaded,
+ * after which every manager shares the same profiles.
+ */
+void BotProfileManager::Init( const char *filename, unsigned int *checksum )
+{
+	m_database = BotProfileDatabase::Load( filename, checksum, m_initialVoiceBanks );
+}
+
 //--------------------------------------------------------------------------------------------------------------
 BotProfileManager::~BotProfileManager( void )
 {
 	Reset();
 
 	VoiceBankList::iterator it;
-	for ( it = m_voiceBanks.begin(); it != m_voiceBanks.end(); ++it )
+	for ( it = m_initialVoiceBanks.begin(); it != m_initialVoiceBanks.end(); ++it )
 	{
 		delete[] *it;
 	}
-	m_voiceBanks.clear();
+	m_initialVoiceBanks.clear();
 }
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Free all bot profiles
+ * Stop using the bot profiles. The database itself is kept for the next manager that loads it.
  */
 void BotProfileManager::Reset( void )
 {
-	for( BotProfileList::iterator iter = m_profileList.begin(); iter != m_profileList.end(); ++iter )
-		delete *iter;
-
-	m_profileList.clear();
-
-	for (int i=0; i<NumCustomSkins; ++i)
-	{
-		if ( m_skins[i] )
-		{
-			delete[] m_skins[i];
-			m_skins[i] = NULL;
-		}
-		if ( m_skinFilenames[i] )
-		{
-			delete[] m_skinFilenames[i];
-			m_skinFilenames[i] = NULL;
-		}
-		if ( m_skinModelnames[i] )
-		{
-			delete[] m_skinModelnames[i];
-			m_skinModelnames[i] = NULL;
-		}
-	}
+	m_database = NULL;
 }
 
 //--------------------------------------------------------------------------------------------------------
@@ -579,12 +723,12 @@ void BotProfileManager::Reset( void )
  */
 const char * BotProfileManager::GetCustomSkin( int index )
 {
-	if ( index < FirstCustomSkin || index > LastCustomSkin )
+	if ( m_database == NULL || index < FirstCustomSkin || index > LastCustomSkin )
 	{
 		return NULL;
 	}
 
-	return m_skins[ index - FirstCustomSkin ];
+	return m_database->GetCustomSkin( index - FirstCustomSkin );
 }
 
 //--------------------------------------------------------------------------------------------------------
@@ -593,12 +737,12 @@ const char * BotProfileManager::GetCustomSkin( int index )
  */
 const char * BotProfileManager::GetCustomSkinFname( int index )
 {
-	if ( index < FirstCustomSkin || index > LastCustomSkin )
+	if ( m_database == NULL || index < FirstCustomSkin || index > LastCustomSkin )
 	{
 		return NULL;
 	}
 
-	return m_skinFilenames[ index - FirstCustomSkin ];
+	return m_database->GetCustomSkinFname( index - FirstCustomSkin );
 }
 
 //--------------------------------------------------------------------------------------------------------
@@ -607,12 +751,12 @@ const char * BotProfileManager::GetCustomSkinFname( int index )
  */
 const char * BotProfileManager::GetCustomSkinModelname( int index )
 {
-	if ( index < FirstCustomSkin || index > LastCustomSkin )
+	if ( m_database == NULL || index < FirstCustomSkin || index > LastCustomSkin )
 	{
 		return NULL;
 	}
 
-	return m_skinModelnames[ index - FirstCustomSkin ];
+	return m_database->GetCustomSkinModelname( index - FirstCustomSkin );
 }
 
 //--------------------------------------------------------------------------------------------------------
@@ -621,23 +765,18 @@ const char * BotProfileManager::GetCustomSkinModelname( int index )
  */
 int BotProfileManager::GetCustomSkinIndex( const char *name, const char *filename )
 {
+	if ( m_database == NULL )
+	{
+		return 0;
+	}
+
 	const char * skinName = name;
 	if ( filename )
 	{
 		skinName = GetDecoratedSkinName( name, filename );
 	}
 
-	for (int i=0; i<NumCustomSkins; ++i)
-	{
-		if ( m_skins[i] )
-		{
-			if ( !stricmp( skinName, m_skins[i] ) )
-			{
-				return FirstCustomSkin + i;
-			}
-		}
-	}
-	return 0;
+	return m_database->GetCustomSkinIndex( skinName );
 }
 
 
@@ -647,10 +786,16 @@ int BotProfileManager::GetCustomSkinIndex( const char *name, const char *filenam
  */
 int BotProfileManager::FindVoiceBankIndex( const char *filename )
 {
+	if ( m_database )
+	{
+		return m_database->FindVoiceBankIndex( filename );
+	}
+
+	// not loaded yet - remember the bank, so it has the same index in the database
 	int index = 0;
 
 	VoiceBankList::const_iterator it;
-	for ( it = m_voiceBanks.begin(); it != m_voiceBanks.end(); ++it, ++index )
+	for ( it = m_initialVoiceBanks.begin(); it != m_initialVoiceBanks.end(); ++it, ++index )
 	{
 		if ( !stricmp( filename, *it ) )
 		{
@@ -658,7 +803,7 @@ int BotProfileManager::FindVoiceBankIndex( const char *filename )
 		}
 	}
 
-	m_voiceBanks.push_back( CloneString( filename ) );
+	m_initialVoiceBanks.push_back( CloneString( filename ) );
 	return index;
 }
 
@@ -672,15 +817,18 @@ const BotProfile *BotProfileManager::GetRandomProfile( BotDifficultyType difficu
 #ifndef RANDOM_LONG
 	return NULL;	// we don't need random profiles when we're not in the game dll
 #else
+	if (m_database == NULL)
+		return NULL;
+
+	// only the profiles indexed under this difficulty and team are candidates
+	const BotProfileList *profileList = m_database->GetProfileList( difficulty, team );
 	BotProfileList::const_iterator iter;
 
 	// count up valid profiles
 	int validCount = 0;
-	for( iter = m_profileList.begin(); iter != m_profileList.end(); ++iter )
+	for( iter = profileList->begin(); iter != profileList->end(); ++iter )
 	{
-		const BotProfile *profile = *iter;
-
-		if (profile->IsDifficulty( difficulty ) && !UTIL_IsNameTaken( profile->GetName() ) && profile->IsValidForTeam( team ))
+		if (!UTIL_IsNameTaken( (*iter)->GetName() ))
 			++validCount;
 	}
 
@@ -689,11 +837,11 @@ const BotProfile *BotProfileManager::GetRandomProfile( BotDifficultyType difficu
 
 	// select one at random
 	int which = RANDOM_LONG( 0, validCount-1 );
-	for( iter = m_profileList.begin(); iter != m_profileList.end(); ++iter )
+	for( iter = profileList->begin(); iter != profileList->end(); ++iter )
 	{
 		const BotProfile *profile = *iter;
 
-		if (profile->IsDifficulty( difficulty ) && !UTIL_IsNameTaken( profile->GetName() ) && profile->IsValidForTeam( team ))
+		if (!UTIL_IsNameTaken( profile->GetName() ))
 			if (which-- == 0)
 				return profile;
 	}
@@ -20,6 +20,9 @@
 #undef max
 #include <list>
 #include <vector>
+#include <algorithm>
+#include <map>
+#include <string>
 #include "bot_constants.h"
 
 enum
@@ -85,6 +88,7 @@ public:
 	bool PrefersSilencer() const							{ return m_prefersSilencer; }
 private:	
 	friend class BotProfileManager;			///< for loading profiles
+	friend class BotProfileDatabase;
 
 	void Inherit( const BotProfile *parent, const BotProfile *baseline );	///< copy values from parent if they differ from baseline
 
@@ -109,7 +113,7 @@ private:
 
 	int m_voiceBank;										///< Index of the BotChatter.db voice bank this profile uses (0 is the default)
 };
-typedef std::list<BotProfile *> BotProfileList;
+typedef std::vector<BotProfile *> BotProfileList;
 
 
 inline bool BotProfile::IsDifficulty( BotDifficultyType diff ) const
@@ -166,6 +170,57 @@ inline void BotProfile::Inherit( const BotProfile *parent, const BotProfile *bas
 
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Everything parsed from one bot profile database file - the profiles, custom skins and voice banks -
+ * with indices for the lookups made as bots join.
+ * Each file is parsed once per process. Every BotProfileManager that loads it afterwards, such as the one
+ * created for each map, shares the same database, which is not freed and is not changed again except
+ * by adding voice banks. The file is re-parsed only if its checksum changes.
+ */
+class BotProfileDatabase
+{
+public:
+	static BotProfileDatabase *Load( const char *filename, unsigned int *checksum, const std::vector<char *> &voiceBanks );	///< return the database of the file, parsing it if needed - NULL if it can't be read
+
+	const BotProfileList *GetProfileList( void ) const		{ return &m_profileList; }		///< all profiles, in file order
+	const BotProfileList *GetProfileList( BotDifficultyType difficulty, BotProfileTeamType team ) const	{ return &m_profileIndex[ difficulty ][ team ]; }	///< profiles valid for the difficulty and team, in file order
+	const BotProfile *GetProfile( const char *name, BotProfileTeamType team ) const;
+
+	const char *GetCustomSkin( int index ) const			{ return m_skins[ index ]; }
+	const char *GetCustomSkinModelname( int index ) const	{ return m_skinModelnames[ index ]; }
+	const char *GetCustomSkinFname( int index ) const		{ return m_skinFilenames[ index ]; }
+	int GetCustomSkinIndex( const char *skinName ) const;	///< return the index of a decorated skin name, or 0
+
+	const std::vector<char *> *GetVoiceBanks( void ) const	{ return &m_voiceBanks; }
+	int FindVoiceBankIndex( const char *filename );			///< return index of the (custom) bot phrase db, inserting it if needed
+
+private:
+	BotProfileDatabase( const char *filename, unsigned int checksum );
+
+	void Parse( const char *dataFile );
+	void BuildIndex( void );
+
+	std::string m_filename;
+	unsigned int m_checksum;
+
+	std::vector< BotProfile > m_profile;					///< all profiles, in one block
+	std::vector< char > m_names;							///< all profile names, in one block
+	std::vector< unsigned int > m_nameOffset;				///< where each profile's name starts in m_names
+	BotProfileList m_profileList;							///< points into m_profile, in file order
+	BotProfileList m_profileIndex[ NUM_DIFFICULTY_LEVELS ][ BOT_TEAM_ANY+1 ];
+	BotProfileList m_profileByName;							///< sorted by name without case, and in file order for the same name
+
+	char *m_skins[ NumCustomSkins ];						///< Custom skin names
+	char *m_skinModelnames[ NumCustomSkins ];				///< Custom skin modelnames
+	char *m_skinFilenames[ NumCustomSkins ];				///< Custom skin filenames
+	int m_nextSkin;											///< Next custom skin to allocate
+	std::map< std::string, int > m_skinIndex;				///< custom skin index by lowercase decorated name
+
+	std::vector<char *> m_voiceBanks;
+	std::map< std::string, int > m_voiceBankIndex;			///< voice bank index by lowercase filename
+};
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * The BotProfileManager defines the interface to accessing BotProfiles
@@ -182,14 +237,10 @@ public:
 	/// given a name, return a profile
 	const BotProfile *GetProfile( const char *name, BotProfileTeamType team ) const
 	{
-		for( BotProfileList::const_iterator iter = m_profileList.begin(); iter != m_profileList.end(); ++iter )
-			if ( !stricmp( name, (*iter)->GetName() ) && (*iter)->IsValidForTeam( team ) )
-				return *iter;
-
-		return NULL;
+		return (m_database) ? m_database->GetProfile( name, team ) : NULL;
 	}
 
-	const BotProfileList *GetProfileList( void ) const		{ return &m_profileList; }		///< return list of all profiles
+	const BotProfileList *GetProfileList( void ) const		{ return (m_database) ? m_database->GetProfileList() : &m_emptyList; }		///< return list of all profiles
 
 	const BotProfile *GetRandomProfile( BotDifficultyType difficulty, BotProfileTeamType team ) const;			///< return random unused profile that matches the given difficulty level
 
@@ -199,18 +250,14 @@ public:
 	int GetCustomSkinIndex( const char *name, const char *filename = NULL );	///< Looks up a custom skin index by name
 
 	typedef std::vector<char *> VoiceBankList;
-	const VoiceBankList* GetVoiceBanks() const { return &m_voiceBanks; }
+	const VoiceBankList* GetVoiceBanks() const { return (m_database) ? m_database->GetVoiceBanks() : &m_initialVoiceBanks; }
 	int FindVoiceBankIndex( const char *filename );		///< return index of the (custom) bot phrase db, inserting it if needed
 
 protected:
-	BotProfileList m_profileList;							///< the list of all bot profiles
-
-	VoiceBankList m_voiceBanks;
+	BotProfileDatabase *m_database;							///< shared with every other manager that loaded the same file
 
-	char *m_skins[ NumCustomSkins ];						///< Custom skin names
-	char *m_skinModelnames[ NumCustomSkins ];				///< Custom skin modelnames
-	char *m_skinFilenames[ NumCustomSkins ];				///< Custom skin filenames
-	int m_nextSkin;											///< Next custom skin to allocate
+	BotProfileList m_emptyList;
+	VoiceBankList m_initialVoiceBanks;						///< voice banks found before Init(), which come first in every database
 };
 
 /// the global singleton for accessing BotProfiles
@@ -7,6 +7,11 @@
 
 // Author: Michael S. Booth (mike@turtlerockstudios.com), 2003
 
+#if defined( __SSE__ ) || defined( _M_X64 ) || (defined( _M_IX86_FP ) && _M_IX86_FP >= 1)
+#define PLAYER_SNAPSHOT_SSE
+#include <xmmintrin.h>
+#endif
+
 #include "extdll.h"
 #include "util.h"
 #include "cbase.h"
@@ -439,33 +444,339 @@ void UTIL_ConstructBotNetName(char *name, int nameLength, const BotProfile *prof
  */
 bool UTIL_IsVisibleToTeam( const Vector &spot, int team, float maxRange )
 {
-	for( int i = 1; i <= gpGlobals->maxClients; ++i )
+	CPlayerSnapshot players;
+	players.Update();
+
+	return players.IsVisibleToTeams( spot, 1 << team, maxRange );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Gather the living players, and pad the last group of four so every group can be loaded whole
+ */
+void CPlayerSnapshot::Update( void )
+{
+	m_count = 0;
+
+	for( int i = 1; i <= gpGlobals->maxClients && m_count < MAX_PLAYERS; ++i )
 	{
 		CBasePlayer *player = static_cast<CBasePlayer *>( UTIL_PlayerByIndex( i ) );
 
-		if (player == NULL)
+		if (!IsEntityValid( player ))
 			continue;
 
-		if (FNullEnt( player->pev ))
+		if (!player->IsAlive())
 			continue;
 
-		if (FStrEq( STRING( player->pev->netname ), "" ))
-			continue;
+		int n = m_count++;
+
+		m_player[n] = player;
+		m_team[n] = player->m_iTeam;
+
+		const Vector &origin = player->pev->origin;
+		m_originX[n] = origin.x;
+		m_originY[n] = origin.y;
+		m_originZ[n] = origin.z;
+
+		Vector center = player->Center();
+		m_centerX[n] = center.x;
+		m_centerY[n] = center.y;
+		m_centerZ[n] = center.z;
+
+		Vector eye = player->EyePosition();
+		m_eyeX[n] = eye.x;
+		m_eyeY[n] = eye.y;
+		m_eyeZ[n] = eye.z;
+
+		// compute player's unit aiming vector 
+		UTIL_MakeVectors( player->pev->v_angle + player->pev->punchangle );
+		m_forwardX[n] = gpGlobals->v_forward.x;
+		m_forwardY[n] = gpGlobals->v_forward.y;
+		m_forwardZ[n] = gpGlobals->v_forward.z;
+
+		// computed just as IsCrossingLineOfFire() always has, so the line of fire test gives the same answer
+		const float longRange = 5000.0f;
+		Vector target = origin + longRange * gpGlobals->v_forward;
+		m_targetX[n] = target.x;
+		m_targetY[n] = target.y;
+	}
 
-		if (!player->IsAlive())
-			continue;
+	for( int n = m_count; n & 3; ++n )
+	{
+		m_originX[n] = m_originY[n] = m_originZ[n] = 0.0f;
+		m_centerX[n] = m_centerY[n] = m_centerZ[n] = 0.0f;
+		m_eyeX[n] = m_eyeY[n] = m_eyeZ[n] = 0.0f;
+		m_forwardX[n] = m_forwardY[n] = m_forwardZ[n] = 0.0f;
+		m_targetX[n] = m_targetY[n] = 0.0f;
+		m_team[n] = 0;
+		m_player[n] = NULL;
+	}
+}
 
-		if (player->m_iTeam != team)
-			continue;
+//--------------------------------------------------------------------------------------------------------------
+inline int CPlayerSnapshot::GetGroupMask( int first ) const
+{
+	int left = m_count - first;
+	return (left >= 4) ? 0xF : (1 << left) - 1;
+}
 
-		if (maxRange > 0.0f && (spot - player->Center()).IsLengthGreaterThan( maxRange ))
-			continue;
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return a bit for each player of the group whose position is within range of the spot
+ */
+inline int CPlayerSnapshot::CullByRange( int first, const float *x, const float *y, const float *z, const Vector &spot, float rangeSq ) const
+{
+#ifdef PLAYER_SNAPSHOT_SSE
+	__m128 dx = _mm_sub_ps( _mm_loadu_ps( x + first ), _mm_set1_ps( spot.x ) );
+	__m128 dy = _mm_sub_ps( _mm_loadu_ps( y + first ), _mm_set1_ps( spot.y ) );
+	__m128 dz = _mm_sub_ps( _mm_loadu_ps( z + first ), _mm_set1_ps( spot.z ) );
 
-		TraceResult result;
-		UTIL_TraceLine( player->EyePosition(), spot, ignore_monsters, ignore_glass, ENT( player->pev ), &result );
+	__m128 distSq = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ), _mm_mul_ps( dz, dz ) );
 
-		if (result.flFraction == 1.0f)
-			return true;
+	return _mm_movemask_ps( _mm_cmple_ps( distSq, _mm_set1_ps( rangeSq ) ) );
+#else
+	int mask = 0;
+	for( int i=0; i<4; ++i )
+	{
+		float dx = x[first+i] - spot.x;
+		float dy = y[first+i] - spot.y;
+		float dz = z[first+i] - spot.z;
+
+		if (dx*dx + dy*dy + dz*dz <= rangeSq)
+			mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return a bit for each player of the group whose aim is within the view cone of the spot.
+ * The cosine test is done on squares, to avoid normalizing the direction to the spot.
+ */
+inline int CPlayerSnapshot::CullByViewCone( int first, const Vector &spot, float viewConeCos ) const
+{
+	float cosSq = viewConeCos * viewConeCos;
+
+#ifdef PLAYER_SNAPSHOT_SSE
+	__m128 dx = _mm_sub_ps( _mm_set1_ps( spot.x ), _mm_loadu_ps( m_eyeX + first ) );
+	__m128 dy = _mm_sub_ps( _mm_set1_ps( spot.y ), _mm_loadu_ps( m_eyeY + first ) );
+	__m128 dz = _mm_sub_ps( _mm_set1_ps( spot.z ), _mm_loadu_ps( m_eyeZ + first ) );
+
+	__m128 dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, _mm_loadu_ps( m_forwardX + first ) ),
+										 _mm_mul_ps( dy, _mm_loadu_ps( m_forwardY + first ) ) ),
+										 _mm_mul_ps( dz, _mm_loadu_ps( m_forwardZ + first ) ) );
+	__m128 lengthSq = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ), _mm_mul_ps( dz, dz ) );
+
+	__m128 inFront = _mm_cmpge_ps( dot, _mm_setzero_ps() );
+	__m128 dotSq = _mm_mul_ps( dot, dot );
+	__m128 limit = _mm_mul_ps( _mm_set1_ps( cosSq ), lengthSq );
+
+	if (viewConeCos >= 0.0f)
+		return _mm_movemask_ps( _mm_and_ps( inFront, _mm_cmpge_ps( dotSq, limit ) ) );
+
+	return _mm_movemask_ps( _mm_or_ps( inFront, _mm_cmple_ps( dotSq, limit ) ) );
+#else
+	int mask = 0;
+	for( int i=0; i<4; ++i )
+	{
+		float dx = spot.x - m_eyeX[first+i];
+		float dy = spot.y - m_eyeY[first+i];
+		float dz = spot.z - m_eyeZ[first+i];
+
+		float dot = dx * m_forwardX[first+i] + dy * m_forwardY[first+i] + dz * m_forwardZ[first+i];
+		float limit = cosSq * (dx*dx + dy*dy + dz*dz);
+
+		bool inCone;
+		if (viewConeCos >= 0.0f)
+			inCone = (dot >= 0.0f && dot * dot >= limit);
+		else
+			inCone = (dot >= 0.0f || dot * dot <= limit);
+
+		if (inCone)
+			mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return a bit for each player of the group whose line of fire crosses the 2D path from start to finish.
+ * This is the same arithmetic as IsIntersecting2D(), four players at a time.
+ */
+inline int CPlayerSnapshot::CullByLineOfFire( int first, const Vector &start, const Vector &finish ) const
+{
+	float pathX = finish.x - start.x;
+	float pathY = finish.y - start.y;
+
+#ifdef PLAYER_SNAPSHOT_SSE
+	__m128 originX = _mm_loadu_ps( m_originX + first );
+	__m128 originY = _mm_loadu_ps( m_originY + first );
+	__m128 fireX = _mm_sub_ps( _mm_loadu_ps( m_targetX + first ), originX );
+	__m128 fireY = _mm_sub_ps( _mm_loadu_ps( m_targetY + first ), originY );
+	__m128 toStartX = _mm_sub_ps( _mm_set1_ps( start.x ), originX );
+	__m128 toStartY = _mm_sub_ps( _mm_set1_ps( start.y ), originY );
+
+	__m128 denom = _mm_sub_ps( _mm_mul_ps( _mm_set1_ps( pathX ), fireY ), _mm_mul_ps( _mm_set1_ps( pathY ), fireX ) );
+	__m128 numS = _mm_sub_ps( _mm_mul_ps( toStartY, fireX ), _mm_mul_ps( toStartX, fireY ) );
+	__m128 numT = _mm_sub_ps( _mm_mul_ps( toStartY, _mm_set1_ps( pathX ) ), _mm_mul_ps( toStartX, _mm_set1_ps( pathY ) ) );
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps( 1.0f );
+	__m128 s = _mm_div_ps( numS, denom );
+	__m128 t = _mm_div_ps( numT, denom );
+
+	__m128 coincident = _mm_cmpeq_ps( numS, zero );
+	__m128 within = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( s, zero ), _mm_cmple_ps( s, one ) ),
+								_mm_and_ps( _mm_cmpge_ps( t, zero ), _mm_cmple_ps( t, one ) ) );
+
+	__m128 hit = _mm_and_ps( _mm_cmpneq_ps( denom, zero ), _mm_or_ps( coincident, within ) );
+
+	return _mm_movemask_ps( hit );
+#else
+	int mask = 0;
+	for( int i=0; i<4; ++i )
+	{
+		Vector origin( m_originX[first+i], m_originY[first+i], 0.0f );
+		Vector target( m_targetX[first+i], m_targetY[first+i], 0.0f );
+
+		if (IsIntersecting2D( start, finish, origin, target ))
+			mask |= 1 << i;
+	}
+	return mask;
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if anyone on the teams in 'teamMask' (bit 1 << team) can see the spot.
+ * Players are culled by range and view cone first, and only those left are traced from their eyes.
+ */
+bool CPlayerSnapshot::IsVisibleToTeams( const Vector &spot, unsigned int teamMask, float maxRange, float viewConeCos ) const
+{
+	for( int first = 0; first < m_count; first += 4 )
+	{
+		int mask = GetGroupMask( first );
+
+		for( int i=0; i<4; ++i )
+			if (!(teamMask & (1u << m_team[first+i])))
+				mask &= ~(1 << i);
+
+		if (mask && maxRange > 0.0f)
+			mask &= CullByRange( first, m_centerX, m_centerY, m_centerZ, spot, maxRange * maxRange );
+
+		if (mask && viewConeCos > -1.0f)
+			mask &= CullByViewCone( first, spot, viewConeCos );
+
+		for( int i=0; mask; ++i, mask >>= 1 )
+		{
+			if (!(mask & 1))
+				continue;
+
+			int n = first + i;
+			Vector eye( m_eyeX[n], m_eyeY[n], m_eyeZ[n] );
+
+			TraceResult result;
+			UTIL_TraceLine( eye, spot, ignore_monsters, ignore_glass, ENT( m_player[n]->pev ), &result );
+
+			if (result.flFraction == 1.0f)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if the closest player to the spot is within 'range' and isn't 'ignore'.
+ * Only players within range can be the closest one that matters, so only they are compared.
+ */
+bool CPlayerSnapshot::IsOccupied( const Vector &spot, float range, const CBaseEntity *ignore ) const
+{
+	float rangeSq = range * range;
+
+	int closest = -1;
+	float closeDistSq = rangeSq;
+
+	for( int first = 0; first < m_count; first += 4 )
+	{
+		int mask = GetGroupMask( first ) & CullByRange( first, m_originX, m_originY, m_originZ, spot, rangeSq );
+
+		for( int i=0; mask; ++i, mask >>= 1 )
+		{
+			if (!(mask & 1))
+				continue;
+
+			int n = first + i;
+			float distSq = (Vector( m_originX[n], m_originY[n], m_originZ[n] ) - spot).LengthSquared();
+
+			if (closest < 0 || distSq < closeDistSq)
+			{
+				closest = n;
+				closeDistSq = distSq;
+			}
+		}
+	}
+
+	if (closest < 0 || closeDistSq >= rangeSq)
+		return false;
+
+	return (m_player[ closest ] != ignore);
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if moving from "start" to "finish" will cross a player's line of fire.
+ * The path from "start" to "finish" is assumed to be a straight line.
+ * "start" and "finish" are assumed to be points on the ground.
+ */
+bool CPlayerSnapshot::IsCrossingLineOfFire( const Vector &start, const Vector &finish, const CBaseEntity *ignore, int ignoreTeam ) const
+{
+	// simple check to see if intersection lies in the Z range of the path
+	float loZ, hiZ;
+
+	if (start.z < finish.z)
+	{
+		loZ = start.z;
+		hiZ = finish.z;
+	}
+	else
+	{
+		loZ = finish.z;
+		hiZ = start.z;
+	}
+
+	for( int first = 0; first < m_count; first += 4 )
+	{
+		int mask = GetGroupMask( first ) & CullByLineOfFire( first, start, finish );
+
+		for( int i=0; mask; ++i, mask >>= 1 )
+		{
+			if (!(mask & 1))
+				continue;
+
+			int n = first + i;
+
+			if (m_player[n] == ignore)
+				continue;
+
+			if (ignoreTeam && m_team[n] == ignoreTeam)
+				continue;
+
+			Vector origin( m_originX[n], m_originY[n], m_originZ[n] );
+			Vector target( m_targetX[n], m_targetY[n], 0.0f );
+
+			Vector result;
+			if (IsIntersecting2D( start, finish, origin, target, &result ))
+			{
+				if (result.z >= loZ && result.z <= hiZ + HumanHeight)
+					return true;
+			}
+		}
 	}
 
 	return false;
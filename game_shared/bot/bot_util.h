@@ -99,7 +99,7 @@ extern CBasePlayer *UTIL_GetClosestPlayer( const Vector *pos, int team, float *d
 extern CBasePlayer *UTIL_GetLocalPlayer( void );
 extern bool UTIL_KickBotFromTeam( TeamName kickTeam ); ///< kick a bot from the given team. If no bot exists on the team, return false.
 
-extern bool UTIL_IsVisibleToTeam( const Vector &spot, int team, float maxRange = -1.0f ); ///< return true if anyone on the given team can see the given spot
+extern bool UTIL_IsVisibleToTeam( const Vector &spot, int team, float maxRange = -1.0f ); ///< return true if anyone on the given team can see the given spot - use CPlayerSnapshot for many spots
 
 extern const char * UTIL_GetBotPrefix(); ///< returns the bot prefix string.
 extern void UTIL_ConstructBotNetName(char *name, int nameLength, const BotProfile *bot);
@@ -310,6 +310,56 @@ bool ForEachPlayer( Functor &func )
 	return true;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The positions and aim of all living players, gathered into arrays so a spot can be tested against
+ * every player at once. Range, view cone, and line of fire tests are done four players at a time,
+ * and only the players that pass them are traced against.
+ * Take the snapshot once for a batch of queries - such as all of the candidates in a hiding spot search -
+ * and again whenever players may have moved.
+ */
+class CPlayerSnapshot
+{
+public:
+	CPlayerSnapshot( void )									{ m_count = 0; }
+
+	void Update( void );									///< gather the living players
+
+	int GetCount( void ) const								{ return m_count; }
+	CBasePlayer *GetPlayer( int i ) const					{ return m_player[i]; }
+
+	/**
+	 * Return true if anyone on the teams in 'teamMask' (bit 1 << team) can see the spot.
+	 * If 'viewConeCos' is given, only players facing within that cosine of the spot count.
+	 */
+	bool IsVisibleToTeams( const Vector &spot, unsigned int teamMask, float maxRange = -1.0f, float viewConeCos = -2.0f ) const;
+
+	/// return true if the closest player to the spot is within 'range' and isn't 'ignore'
+	bool IsOccupied( const Vector &spot, float range, const CBaseEntity *ignore = NULL ) const;
+
+	/// return true if moving from "start" to "finish" will cross a player's line of fire - see IsCrossingLineOfFire()
+	bool IsCrossingLineOfFire( const Vector &start, const Vector &finish, const CBaseEntity *ignore = NULL, int ignoreTeam = 0 ) const;
+
+private:
+	enum { MAX_PLAYERS = 32 };								///< a multiple of 4, so the last group can be padded
+
+	int GetGroupMask( int first ) const;					///< the lanes of the group starting at 'first' that hold players
+	int CullByRange( int first, const float *x, const float *y, const float *z, const Vector &spot, float rangeSq ) const;
+	int CullByViewCone( int first, const Vector &spot, float viewConeCos ) const;
+	int CullByLineOfFire( int first, const Vector &start, const Vector &finish ) const;
+
+	int m_count;
+
+	// one entry per player, in structure-of-arrays form
+	float m_originX[ MAX_PLAYERS ], m_originY[ MAX_PLAYERS ], m_originZ[ MAX_PLAYERS ];
+	float m_centerX[ MAX_PLAYERS ], m_centerY[ MAX_PLAYERS ], m_centerZ[ MAX_PLAYERS ];
+	float m_eyeX[ MAX_PLAYERS ], m_eyeY[ MAX_PLAYERS ], m_eyeZ[ MAX_PLAYERS ];
+	float m_forwardX[ MAX_PLAYERS ], m_forwardY[ MAX_PLAYERS ], m_forwardZ[ MAX_PLAYERS ];	///< aim, including punch angle
+	float m_targetX[ MAX_PLAYERS ], m_targetY[ MAX_PLAYERS ];	///< far end of the line of fire
+	int m_team[ MAX_PLAYERS ];
+	CBasePlayer *m_player[ MAX_PLAYERS ];
+};
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * For zombie game
@@ -0,0 +1,199 @@
+// nav_analyze.cpp
+// Offline analysis of a navigation mesh on a pool of worker threads
+
+#pragma warning( disable : 4530 )					// STL uses exceptions, but we are not compiling with them - ignore warning
+#pragma warning( disable : 4786 )					// long STL names get truncated in browse info.
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "bot_util.h"
+
+#include "nav.h"
+#include "nav_area.h"
+#include "nav_flat.h"
+#include "nav_trace.h"
+#include "nav_visibility.h"
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Invoke the functor on every area, spread over 'threadCount' threads including the game thread.
+ * Areas are handed out one at a time so a few expensive areas don't hold up one thread's whole share.
+ * The functor is given the area and its index, and must only write to that area or to that index of its results.
+ */
+template < typename Functor >
+static void RunAnalysisPass( const char *name, const std::vector< CNavArea * > &areas, int threadCount, Functor &func )
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::atomic< int > nextArea( 0 );
+	int areaCount = areas.size();
+
+	auto worker = [&]()
+	{
+		for( int i = nextArea++; i < areaCount; i = nextArea++ )
+			func( areas[i], i );
+	};
+
+	std::vector< std::thread > threads;
+	threads.reserve( threadCount - 1 );
+
+	for( int t=1; t<threadCount; ++t )
+		threads.emplace_back( worker );
+
+	// the game thread does its share too
+	worker();
+
+	for( unsigned int t=0; t<threads.size(); ++t )
+		threads[t].join();
+
+	std::chrono::duration< float > elapsed = std::chrono::steady_clock::now() - start;
+	CONSOLE_ECHO( "  %s: %.1f seconds\n", name, elapsed.count() );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Recompute the hiding spots, area visibility, sniper spots, spot encounters and approach areas of the loaded mesh
+ * on a pool of worker threads, and save the result to the map's .nav file.
+ * Traces go to a copy of the map's BSP instead of the engine, so workers never call into the engine.
+ * Results are kept per area and merged in area order, so the file is the same for any thread count.
+ * The game thread is blocked until the analysis is done.
+ */
+bool AnalyzeNavigationMap( int threadCount )
+{
+	if (TheNavAreaList.empty())
+	{
+		CONSOLE_ECHO( "No navigation mesh to analyze.\n" );
+		return false;
+	}
+
+	// areas are processed, and their results merged, in list order
+	std::vector< CNavArea * > areas( TheNavAreaList.begin(), TheNavAreaList.end() );
+	int areaCount = areas.size();
+
+	if (threadCount <= 0)
+		threadCount = std::thread::hardware_concurrency();
+
+	if (threadCount < 1)
+		threadCount = 1;
+	else if (threadCount > areaCount)
+		threadCount = areaCount;
+
+	if (!TheNavBspTracer.Load())
+		return false;
+
+	TheNavBspTracer.SetActive( true );
+
+	CONSOLE_ECHO( "Analyzing %d navigation areas on %d threads...\n", areaCount, threadCount );
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	//
+	// Find hiding spots. Workers only find them - spots are created here in area order, so they get the same IDs as a serial run.
+	//
+	DestroyHidingSpots();
+
+	std::vector< HidingSpotCandidate > candidate( areaCount * NUM_CORNERS );
+	std::vector< int > candidateCount( areaCount, 0 );
+
+	auto findHidingSpots = [&]( CNavArea *area, int i )
+	{
+		candidateCount[i] = area->FindHidingSpots( &candidate[ i * NUM_CORNERS ] );
+	};
+	RunAnalysisPass( "Hiding spots", areas, threadCount, findHidingSpots );
+
+	for( int i=0; i<areaCount; ++i )
+		areas[i]->AddHidingSpots( &candidate[ i * NUM_CORNERS ], candidateCount[i] );
+
+	//
+	// Compute which areas can see each other, from the hiding spots just found, so the later passes can skip
+	// traces between areas that can't
+	//
+	std::vector< CNavVisibility::Samples > visSamples( areaCount );
+	std::vector< std::vector< unsigned char > > visRow( areaCount );
+
+	auto computeVisSamples = [&]( CNavArea *area, int i )
+	{
+		CNavVisibility::ComputeSamples( area, &visSamples[i] );
+	};
+	RunAnalysisPass( "Visibility samples", areas, threadCount, computeVisSamples );
+
+	auto computeVisibility = [&]( CNavArea *area, int i )
+	{
+		CNavVisibility::ComputeRow( visSamples, i, &visRow[i] );
+	};
+	RunAnalysisPass( "Visibility", areas, threadCount, computeVisibility );
+
+	TheNavVisibility.Set( areas, visRow );
+
+	//
+	// Classify sniper spots. Each area only changes the flags of its own spots.
+	//
+	auto computeSniperSpots = [&]( CNavArea *area, int i )
+	{
+		area->ComputeSniperSpots();
+	};
+	RunAnalysisPass( "Sniper spots", areas, threadCount, computeSniperSpots );
+
+	//
+	// Compute spot encounters
+	//
+	auto computeSpotEncounters = [&]( CNavArea *area, int i )
+	{
+		area->ComputeSpotEncounters();
+	};
+	RunAnalysisPass( "Spot encounters", areas, threadCount, computeSpotEncounters );
+
+	//
+	// Compute approach areas. Each thread path-finds with its own CNavAreaSearch.
+	//
+	ApproachAreaAnalysisPrep();
+	TheNavFlatMesh.Build();
+
+	auto computeApproachAreas = [&]( CNavArea *area, int i )
+	{
+		area->ComputeApproachAreas();
+	};
+	RunAnalysisPass( "Approach areas", areas, threadCount, computeApproachAreas );
+
+	CleanupApproachAreaAnalysisPrep();
+
+	TheNavBspTracer.Reset();
+
+	std::chrono::duration< float > elapsed = std::chrono::steady_clock::now() - start;
+	CONSOLE_ECHO( "Analysis took %.1f seconds.\n", elapsed.count() );
+
+	//
+	// Save the results
+	//
+	char gameDir[256];
+	GET_GAME_DIR( gameDir );
+
+	char filename[256];
+	snprintf( filename, sizeof(filename), "%s\\maps\\%s.nav", gameDir, STRING( gpGlobals->mapname ) );
+
+	if (!SaveNavigationMap( filename ))
+	{
+		CONSOLE_ECHO( "ERROR: Unable to save navigation map '%s'.\n", filename );
+		return false;
+	}
+
+	CONSOLE_ECHO( "Navigation map '%s' saved.\n", filename );
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * "bot_nav_analyze [threads]" - analyze the loaded mesh, using all hardware threads if no count is given
+ */
+void NavAnalyzeCommand( void )
+{
+	int threadCount = (CMD_ARGC() > 1) ? atoi( CMD_ARGV( 1 ) ) : 0;
+
+	AnalyzeNavigationMap( threadCount );
+}
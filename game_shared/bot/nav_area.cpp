@@ -38,6 +38,9 @@
 #include "nav.h"
 #include "nav_node.h"
 #include "nav_area.h"
+#include "nav_trace.h"
+#include "nav_danger.h"
+#include "nav_visibility.h"
 
 #include "pm_shared.h" // for OBS_ROAMING
 
@@ -48,8 +51,7 @@ NavAreaList TheNavAreaList;
 
 NavLadderList TheNavLadderList;
 
-unsigned int CNavArea::m_masterMarker = 1;
-CNavArea *CNavArea::m_openList = NULL;
+thread_local CNavAreaSearch *CNavAreaSearch::m_current = NULL;
 
 bool CNavArea::m_isReset = false;
 static float lastDrawTimestamp = 0.0f;
@@ -86,6 +88,9 @@ unsigned int HidingSpot::m_masterMarker = 0;
 
 void DestroyHidingSpots( void )
 {
+	// the flat mesh holds pointers to the spots
+	TheNavFlatMesh.Reset();
+
 	// remove all hiding spot references from the nav areas
 	for( NavAreaList::iterator areaIter = TheNavAreaList.begin(); areaIter != TheNavAreaList.end(); ++areaIter )
 	{
@@ -127,6 +132,22 @@ HidingSpot::HidingSpot( const Vector *pos, unsigned char flags )
 	TheHidingSpotList.push_back( this );
 }
 
+/**
+ * For use when loading from a sectioned file, which stores spots as plain records
+ */
+HidingSpot::HidingSpot( const Vector *pos, unsigned char flags, unsigned int id )
+{
+	m_pos = *pos;
+	m_id = id;
+	m_flags = flags;
+
+	// update next ID to avoid ID collisions by later spots
+	if (m_id >= m_nextID)
+		m_nextID = m_id+1;
+
+	TheHidingSpotList.push_back( this );
+}
+
 void HidingSpot::Save( int fd, unsigned int version ) const
 {
 	_write( fd, &m_id, sizeof(unsigned int) );
@@ -168,17 +189,11 @@ HidingSpot *GetHidingSpotByID( unsigned int id )
  */
 void CNavArea::Initialize( void )
 {
-	m_marker = 0;
-	m_parent = NULL;
-	m_parentHow = GO_NORTH;
 	m_attributeFlags = 0;
 	m_place = 0;
 
 	for ( int i=0; i<MAX_AREA_TEAMS; ++i )
 	{
-		m_danger[i] = 0.0f;
-		m_dangerTimestamp[i] = 0.0f;
-
 		m_clearedTimestamp[i] = 0.0f;
 	}
 
@@ -298,6 +313,12 @@ CNavArea::~CNavArea()
 	if (m_isReset)
 		return;
 
+	// the mesh is changing
+	TheNavFlatMesh.Reset();
+
+	// the visibility set can't be patched, as the remaining areas may see through where we were
+	TheNavVisibility.Reset();
+
 	// tell the other areas we are going away
 	NavAreaList::iterator iter;
 	for( iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
@@ -355,6 +376,8 @@ void CNavArea::ConnectTo( CNavArea *area, NavDirType dir )
 	con.area = area;
 	m_connect[ dir ].push_back( con );
 
+	TheNavFlatMesh.Reset();
+
 	//static char *dirName[] = { "NORTH", "EAST", "SOUTH", "WEST" };
 	//CONSOLE_ECHO( "  Connected area #%d to #%d, %s\n", m_id, area->m_id, dirName[ dir ] );
 }
@@ -370,6 +393,8 @@ void CNavArea::Disconnect( CNavArea *area )
 
 	for( int dir = 0; dir<NUM_DIRECTIONS; dir++ )
 		m_connect[ dir ].remove( connect );
+
+	TheNavFlatMesh.Reset();
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -993,6 +1018,10 @@ void DestroyLadders( void )
  */
 void DestroyNavigationMap( void )
 {
+	TheNavFlatMesh.Reset();
+	TheNavDangerMap.Reset();
+	TheNavVisibility.Reset();
+
 	CNavArea::m_isReset = true;
 
 	// remove each element of the list and delete them
@@ -1644,6 +1673,9 @@ int BuildArea( CNavNode *node, int width, int height )
  */
 void BuildLadders( void )
 {
+	// the flat mesh holds pointers to the ladders
+	TheNavFlatMesh.Reset();
+
 	// remove any left-over ladders
 	DestroyLadders();
 
@@ -2627,113 +2659,190 @@ void CNavArea::DrawMarkedCorner( NavCornerType corner, byte red, byte green, byt
 	}
 }
 
+//--------------------------------------------------------------------------------------------------------------
+CNavAreaSearch::CNavAreaSearch( void )
+{
+	// zero is the marker of unused state
+	m_marker = 1;
+	m_openOrder = 0;
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Add to open list in decreasing value order
+ * Each thread gets its own search the first time it asks for one
  */
-void CNavArea::AddToOpenList( void )
+CNavAreaSearch *CNavAreaSearch::GetThreadSearch( void )
 {
-	// mark as being on open list for quick check
-	m_openMarker = m_masterMarker;
+	static thread_local CNavAreaSearch threadSearch;
 
-	// if list is empty, add and return
-	if (m_openList == NULL)
+	m_current = &threadSearch;
+	return m_current;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaSearch::MakeNewMarker( void )
+{
+	++m_marker;
+	if (m_marker == 0)
 	{
-		m_openList = this;
-		this->m_prevOpen = NULL;
-		this->m_nextOpen = NULL;
-		return;
+		// the marker wrapped around, so old state could look current again
+		m_state.clear();
+		m_marker = 1;
 	}
+}
 
-	// insert self in ascending cost order
-	CNavArea *area, *last = NULL;
-	for( area = m_openList; area; area = area->m_nextOpen )
-	{
-		if (this->GetTotalCost() < area->GetTotalCost())
-			break;
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaSearch::SetTotalCost( const CNavArea *area, float value )
+{
+	AreaState &state = State( area );
+	state.totalCost = value;
 
-		last = area;
+	// keep the open list ordered if the area is already on it
+	if (state.openIndex >= 0)
+	{
+		m_openList[ state.openIndex ].totalCost = value;
+		SiftUp( state.openIndex );
+		SiftDown( state.openIndex );
 	}
+}
 
-	if (area)
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Put an open list entry in the given heap slot and tell its area where it is
+ */
+void CNavAreaSearch::MoveOpenEntry( int to, const OpenEntry &entry )
+{
+	m_openList[ to ] = entry;
+	m_state[ entry.area->GetID() ].openIndex = to;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaSearch::SiftUp( int index )
+{
+	OpenEntry entry = m_openList[ index ];
+
+	while( index > 0 )
 	{
-		// insert before this area
-		this->m_prevOpen = area->m_prevOpen;
-		if (this->m_prevOpen)
-			this->m_prevOpen->m_nextOpen = this;
-		else
-			m_openList = this;
+		int parent = (index - 1) / 4;
+		if (!IsCheaper( entry, m_openList[ parent ] ))
+			break;
 
-		this->m_nextOpen = area;
-		area->m_prevOpen = this;
+		MoveOpenEntry( index, m_openList[ parent ] );
+		index = parent;
 	}
-	else
+
+	MoveOpenEntry( index, entry );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaSearch::SiftDown( int index )
+{
+	OpenEntry entry = m_openList[ index ];
+	int count = m_openList.size();
+
+	while( true )
 	{
-		// append to end of list
-		last->m_nextOpen = this;
+		int first = 4 * index + 1;
+		if (first >= count)
+			break;
 
-		this->m_prevOpen = last;
-		this->m_nextOpen = NULL;
+		// find the cheapest child
+		int cheapest = first;
+		int last = (first + 4 < count) ? first + 4 : count;
+		for( int child = first+1; child < last; ++child )
+			if (IsCheaper( m_openList[ child ], m_openList[ cheapest ] ))
+				cheapest = child;
+
+		if (!IsCheaper( m_openList[ cheapest ], entry ))
+			break;
+
+		MoveOpenEntry( index, m_openList[ cheapest ] );
+		index = cheapest;
 	}
+
+	MoveOpenEntry( index, entry );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Add to open list, ordered by total cost
+ */
+void CNavAreaSearch::AddToOpenList( CNavArea *area )
+{
+	AreaState &state = State( area );
+	if (state.openIndex >= 0)
+		return;
+
+	OpenEntry entry;
+	entry.totalCost = state.totalCost;
+	entry.order = m_openOrder++;
+	entry.area = area;
+
+	m_openList.push_back( entry );
+	SiftUp( m_openList.size() - 1 );
 }
 
 //--------------------------------------------------------------------------------------------------------------
 /**
  * A smaller value has been found, update this area on the open list
- * @todo "bubbling" does unnecessary work, since the order of all other nodes will be unchanged - only this node is altered
  */
-void CNavArea::UpdateOnOpenList( void )
+void CNavAreaSearch::UpdateOnOpenList( CNavArea *area )
 {
-	// since value can only decrease, bubble this area up from current spot
-	while( m_prevOpen && 
-				 this->GetTotalCost() < m_prevOpen->GetTotalCost() )
-	{
-		// swap position with predecessor
-		CNavArea *other = m_prevOpen;
-		CNavArea *before = other->m_prevOpen;
-		CNavArea *after  = this->m_nextOpen;
+	const AreaState *state = FindState( area );
+	if (state == NULL || state->openIndex < 0)
+		return;
 
-		this->m_nextOpen = other;
-		this->m_prevOpen = before;
+	// SetTotalCost() has already moved it, this just makes sure the entry is current
+	int index = state->openIndex;
+	m_openList[ index ].totalCost = state->totalCost;
+	SiftUp( index );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavAreaSearch::RemoveFromOpenList( CNavArea *area )
+{
+	AreaState &state = State( area );
+	if (state.openIndex < 0)
+		return;
 
-		other->m_prevOpen = this;
-		other->m_nextOpen = after;
+	int index = state.openIndex;
+	state.openIndex = -1;
 
-		if (before)
-			before->m_nextOpen = this;
-		else
-			m_openList = this;
+	OpenEntry last = m_openList.back();
+	m_openList.pop_back();
 
-		if (after)
-			after->m_prevOpen = other;
+	if (index < (int)m_openList.size())
+	{
+		// fill the hole with the last entry and restore the heap order
+		MoveOpenEntry( index, last );
+		SiftUp( index );
+		SiftDown( m_state[ last.area->GetID() ].openIndex );
 	}
 }
 
 //--------------------------------------------------------------------------------------------------------------
-void CNavArea::RemoveFromOpenList( void )
+CNavArea *CNavAreaSearch::PopOpenList( void )
 {
-	if (m_prevOpen)
-		m_prevOpen->m_nextOpen = m_nextOpen;
-	else
-		m_openList = m_nextOpen;
+	if (m_openList.empty())
+		return NULL;
 
-	if (m_nextOpen)
-		m_nextOpen->m_prevOpen = m_prevOpen;
+	CNavArea *area = m_openList.front().area;
+	RemoveFromOpenList( area );
 
-	// zero is an invalid marker
-	m_openMarker = 0;
+	return area;
 }
 
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Clears the open and closed lists for a new search
  */
-void CNavArea::ClearSearchLists( void )
+void CNavAreaSearch::ClearSearchLists( void )
 {
-	// effectively clears all open list pointers and closed flags
-	CNavArea::MakeNewMarker();
+	// effectively clears all open list indices and closed flags
+	MakeNewMarker();
 
-	m_openList = NULL;
+	m_openList.clear();
+	m_openOrder = 0;
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -2801,7 +2910,7 @@ bool IsHidingSpotInCover( const Vector *spot )
 
 	// if we are crouched underneath something, that counts as good cover
 	to = from + Vector( 0, 0, 20.0f );
-	UTIL_TraceLine( from, to, ignore_monsters, NULL, &result );
+	NavTraceLine( from, to, ignore_monsters, NULL, &result );
 	if (result.flFraction != 1.0f)
 		return true;
 
@@ -2812,7 +2921,7 @@ bool IsHidingSpotInCover( const Vector *spot )
 	{
 		to = from + Vector( coverRange * cos(angle), coverRange * sin(angle), HalfHumanHeight );
 
-		UTIL_TraceLine( from, to, ignore_monsters, NULL, &result );
+		NavTraceLine( from, to, ignore_monsters, NULL, &result );
 
 		// if traceline hit something, it hit "cover"
 		if (result.flFraction != 1.0f)
@@ -2832,6 +2941,19 @@ bool IsHidingSpotInCover( const Vector *spot )
  * Analyze local area neighborhood to find "hiding spots" for this area
  */
 void CNavArea::ComputeHidingSpots( void )
+{
+	HidingSpotCandidate spot[ NUM_CORNERS ];
+	int count = FindHidingSpots( spot );
+
+	AddHidingSpots( spot, count );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find the "hiding spots" for this area without creating them, and return how many were found.
+ * This does not modify anything, so it is safe to call from analysis worker threads.
+ */
+int CNavArea::FindHidingSpots( HidingSpotCandidate spot[ NUM_CORNERS ] ) const
 {
 	struct
 	{
@@ -2841,7 +2963,7 @@ void CNavArea::ComputeHidingSpots( void )
 
 	// "jump areas" cannot have hiding spots
 	if (GetAttributes() & NAV_JUMP)
-		return;
+		return 0;
 
 	int cornerCount[NUM_CORNERS];
 	for( int i=0; i<NUM_CORNERS; ++i )
@@ -2857,7 +2979,7 @@ void CNavArea::ComputeHidingSpots( void )
 
 		bool isHoriz = (d == NORTH || d == SOUTH) ? true : false;
 
-		for( NavConnectList::iterator iter = m_connect[d].begin(); iter != m_connect[d].end(); ++iter )
+		for( NavConnectList::const_iterator iter = m_connect[d].begin(); iter != m_connect[d].end(); ++iter )
 		{
 			NavConnect connect = *iter;
 
@@ -2926,41 +3048,78 @@ void CNavArea::ComputeHidingSpots( void )
 
 	// if a corner count is 2, then it really is a corner (walls on both sides)
 	float offset = 12.5f;
+	int count = 0;
+
+	// don't put a spot too close to an existing one, or to one we just found
+	auto isCollision = [&]( const Vector *pos )
+	{
+		if (IsHidingSpotCollision( pos ))
+			return true;
+
+		const float collisionRange = 30.0f;
+		for( int i=0; i<count; ++i )
+			if ((spot[i].pos - *pos).IsLengthLessThan( collisionRange ))
+				return true;
+
+		return false;
+	};
+
+	auto addSpot = [&]( const Vector *pos )
+	{
+		spot[ count ].pos = *pos;
+		spot[ count ].flags = (IsHidingSpotInCover( pos )) ? HidingSpot::IN_COVER : 0;
+		++count;
+	};
 
 	if (cornerCount[ NORTH_WEST ] == 2)
 	{
 		Vector pos = *GetCorner( NORTH_WEST ) + Vector(  offset,  offset, 0.0f );
-
-		m_hidingSpotList.push_back( new HidingSpot( &pos, (IsHidingSpotInCover( &pos )) ? HidingSpot::IN_COVER : 0 ) );
+		addSpot( &pos );
 	}
 
 	if (cornerCount[ NORTH_EAST ] == 2)
 	{
 		Vector pos = *GetCorner( NORTH_EAST ) + Vector( -offset,  offset, 0.0f );
-		if (!IsHidingSpotCollision( &pos ))
-			m_hidingSpotList.push_back( new HidingSpot( &pos, (IsHidingSpotInCover( &pos )) ? HidingSpot::IN_COVER : 0 ) );
+		if (!isCollision( &pos ))
+			addSpot( &pos );
 	}
 
 	if (cornerCount[ SOUTH_WEST ] == 2)
 	{
 		Vector pos = *GetCorner( SOUTH_WEST ) + Vector(  offset, -offset, 0.0f );
-		if (!IsHidingSpotCollision( &pos ))
-			m_hidingSpotList.push_back( new HidingSpot( &pos, (IsHidingSpotInCover( &pos )) ? HidingSpot::IN_COVER : 0 ) );
+		if (!isCollision( &pos ))
+			addSpot( &pos );
 	}
 
 	if (cornerCount[ SOUTH_EAST ] == 2)
 	{
 		Vector pos = *GetCorner( SOUTH_EAST ) + Vector( -offset, -offset, 0.0f );
-		if (!IsHidingSpotCollision( &pos ))
-			m_hidingSpotList.push_back( new HidingSpot( &pos, (IsHidingSpotInCover( &pos )) ? HidingSpot::IN_COVER : 0 ) );
+		if (!isCollision( &pos ))
+			addSpot( &pos );
 	}
+
+	return count;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Create hiding spots found by FindHidingSpots(). Spots get their IDs in the order they are added.
+ */
+void CNavArea::AddHidingSpots( const HidingSpotCandidate *spot, int count )
+{
+	// the hiding spot lists are changing
+	TheNavFlatMesh.Reset();
+
+	for( int i=0; i<count; ++i )
+		m_hidingSpotList.push_back( new HidingSpot( &spot[i].pos, spot[i].flags ) );
 }
 
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Determine how much walkable area we can see from the spot, and how far away we can see.
+ * Areas that the visibility set says can't be seen from the spot's area are not scanned.
  */
-void ClassifySniperSpot( HidingSpot *spot )
+void ClassifySniperSpot( HidingSpot *spot, const CNavArea *spotArea )
 {
 	Vector eye = *spot->GetPosition() + Vector( 0, 0, HalfHumanHeight );		// assume we are crouching
 	Vector walkable;
@@ -2971,10 +3130,16 @@ void ClassifySniperSpot( HidingSpot *spot )
 	const float minSniperRangeSq = 1000.0f * 1000.0f;
 	bool found = false;
 
+	std::vector< unsigned char > visibleRow;
+	bool hasVisibleRow = TheNavVisibility.GetRow( spotArea, &visibleRow );
+
 	for( NavAreaList::iterator iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
 	{
 		CNavArea *area = *iter;
 
+		if (hasVisibleRow && !TheNavVisibility.IsInRow( visibleRow, area ))
+			continue;
+
 		const Extent *extent = area->GetExtent();
 
 		// scan this area
@@ -2985,7 +3150,7 @@ void ClassifySniperSpot( HidingSpot *spot )
 				walkable.z = area->GetZ( &walkable ) + HalfHumanHeight;
 				
 				// check line of sight
-				UTIL_TraceLine( eye, walkable, ignore_monsters, ignore_glass, NULL, &result );
+				NavTraceLine( eye, walkable, ignore_monsters, ignore_glass, NULL, &result );
 
 				if (result.flFraction == 1.0f && !result.fStartSolid)
 				{
@@ -3055,7 +3220,7 @@ void CNavArea::ComputeSniperSpots( void )
 	{
 		HidingSpot *spot = *iter;
 
-		ClassifySniperSpot( spot );
+		ClassifySniperSpot( spot, this );
 	}
 }
 
@@ -3107,8 +3272,10 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 	Vector dir = e.path.to - e.path.from;
 	float length = dir.NormalizeInPlace();
 
-	// create unique marker to flag used spots
-	HidingSpot::ChangeMasterMarker();
+	// flag used spots by their position in TheHidingSpotList, rather than with the shared
+	// spot markers, so encounters for several areas can be computed at once
+	std::vector< bool > isEncountered( TheHidingSpotList.size(), false );
+	int spotIndex;
 
 	const float stepSize = 25.0f;		// 50
 	const float seeSpotRange = 2000.0f;	// 3000
@@ -3133,7 +3300,8 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 		eye = e.path.from + along * dir;
 
 		// check each hiding spot for visibility
-		for( HidingSpotList::iterator iter = TheHidingSpotList.begin(); iter != TheHidingSpotList.end(); ++iter )
+		spotIndex = 0;
+		for( HidingSpotList::iterator iter = TheHidingSpotList.begin(); iter != TheHidingSpotList.end(); ++iter, ++spotIndex )
 		{
 			spot = *iter;
 
@@ -3141,7 +3309,7 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 			if (!spot->HasGoodCover())
 				continue;
 
-			if (spot->IsMarked())
+			if (isEncountered[ spotIndex ])
 				continue;
 
 			const Vector *spotPos = spot->GetPosition();
@@ -3155,7 +3323,7 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 				continue;
 
 			// check if we have LOS
-			UTIL_TraceLine( eye, Vector( spotPos->x, spotPos->y, spotPos->z + HalfHumanHeight ), ignore_monsters, ignore_glass, NULL, &result );
+			NavTraceLine( eye, Vector( spotPos->x, spotPos->y, spotPos->z + HalfHumanHeight ), ignore_monsters, ignore_glass, NULL, &result );
 			if (result.flFraction != 1.0f)
 				continue;
 
@@ -3176,7 +3344,7 @@ void CNavArea::AddSpotEncounters( const CNavArea *from, NavDirType fromDir, cons
 			}
 
 			// mark spot as encountered
-			spot->Mark();
+			isEncountered[ spotIndex ] = true;
 		}
 	}
 
@@ -3221,97 +3389,35 @@ void CNavArea::ComputeSpotEncounters( void )
 	}
 }
 
-//--------------------------------------------------------------------------------------------------------------
-/**
- * Decay the danger values
- */
-void CNavArea::DecayDanger( void )
-{
-	// one kill == 1.0, which we will forget about in two minutes
-	const float decayRate = 1.0f / 120.0f;
-
-	for( int i=0; i<MAX_AREA_TEAMS; ++i )
-	{
-		float deltaT = gpGlobals->time - m_dangerTimestamp[i];
-		float decayAmount = decayRate * deltaT;
-
-		m_danger[i] -= decayAmount;
-		if (m_danger[i] < 0.0f)
-			m_danger[i] = 0.0f;
-
-		// update timestamp
-		m_dangerTimestamp[i] = gpGlobals->time;
-	}
-}
-
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Increase the danger of this area for the given team
  */
 void CNavArea::IncreaseDanger( int teamID, float amount )
 {
-	// before we add the new value, decay what's there
-	DecayDanger();
+	TheNavDangerMap.IncreaseDanger( m_id, teamID, amount );
 
-	m_danger[ teamID ] += amount;
-	m_dangerTimestamp[ teamID ] = gpGlobals->time;
+	// paths that avoid danger may go another way now
+	CNavPathCache::Invalidate();
 }
 
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Return the danger of this area (decays over time)
  */
-float CNavArea::GetDanger( int teamID )
+float CNavArea::GetDanger( int teamID ) const
 {
-	DecayDanger();
-	return m_danger[ teamID ];
+	return TheNavDangerMap.GetDanger( m_id, teamID );
 }
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Increase the danger of nav areas containing and near the given position
+ * Increase the danger of nav areas containing and near the given position.
+ * The danger is spread out at the start of the next frame, along with any other danger from this frame.
  */
 void IncreaseDangerNearby( int teamID, float amount, CNavArea *startArea, const Vector *pos, float maxRadius )
 {
-	if (startArea == NULL)
-		return;
-
-	CNavArea::MakeNewMarker();
-	CNavArea::ClearSearchLists();
-
-	startArea->AddToOpenList();
-	startArea->SetTotalCost( 0.0f );
-	startArea->Mark();
-	startArea->IncreaseDanger( teamID, amount );
-
-	while( !CNavArea::IsOpenListEmpty() )
-	{
-		// get next area to check
-		CNavArea *area = CNavArea::PopOpenList();
-		
-		// area has no hiding spots, explore adjacent areas
-		for( int dir=0; dir<NUM_DIRECTIONS; ++dir )
-		{
-			int count = area->GetAdjacentCount( (NavDirType)dir );
-			for( int i=0; i<count; ++i )
-			{
-				CNavArea *adjArea = area->GetAdjacentArea( (NavDirType)dir, i );
-
-				if (!adjArea->IsMarked())
-				{
-					// compute distance from danger source
-					float cost = (*adjArea->GetCenter() - *pos).Length();
-					if (cost <= maxRadius)
-					{
-						adjArea->AddToOpenList();
-						adjArea->SetTotalCost( cost );
-						adjArea->Mark();
-						adjArea->IncreaseDanger( teamID, amount * cost/maxRadius );
-					}
-				}
-			}
-		}
-	}
+	TheNavDangerMap.QueueNearby( teamID, amount, startArea, pos, maxRadius );
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -3354,22 +3460,30 @@ void DrawDanger( void )
  * If a player is at the given spot, return true
  */
 bool IsSpotOccupied( CBaseEntity *me, const Vector *pos )
+{
+	CPlayerSnapshot players;
+	players.Update();
+
+	return IsSpotOccupied( me, pos, players );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * If a player is at the given spot, return true.
+ * The players are taken from a snapshot, so a search can test many spots against one gathering of them.
+ */
+bool IsSpotOccupied( CBaseEntity *me, const Vector *pos, const CPlayerSnapshot &players )
 {
 	const float closeRange = 75.0f;		// 50
 
 	// is there a player in this spot
-	float range;
-	CBasePlayer *player = UTIL_GetClosestPlayer( pos, &range );
-
-	if (player != me)
-	{
-		if (player && range < closeRange)
-			return true;
-	}
+	if (players.IsOccupied( *pos, closeRange, me ))
+		return true;
 
 	// is there is a hostage in this spot
 	if (g_pHostages)
 	{
+		float range;
 		CHostage *hostage = g_pHostages->GetClosestHostage( *pos, &range );
 		if (hostage && hostage != me && range < closeRange)
 			return true;
@@ -3391,6 +3505,9 @@ public:
 		m_flags = flags;
 		m_place = place;
 		m_useCrouchAreas = useCrouchAreas;
+
+		// every candidate spot is checked against the players as they are now
+		m_players.Update();
 	}
 
 	enum { MAX_SPOTS = 256 };
@@ -3401,6 +3518,40 @@ public:
 		if (m_place != UNDEFINED_PLACE && area->GetPlace() != m_place)
 			return true;
 
+		// use the flat copy of the spots, which also knows whether each spot is in a crouch area
+		if (TheNavFlatMesh.IsBuilt())
+		{
+			int index = TheNavFlatMesh.GetIndexByID( area->GetID() );
+			int end = TheNavFlatMesh.GetSpotEnd( index );
+			for( int i = TheNavFlatMesh.GetSpotBegin( index ); i < end && m_count < MAX_SPOTS; ++i )
+			{
+				// only collect hiding spots with matching flags
+				if (!(m_flags & TheNavFlatMesh.GetSpotFlags( i )))
+					continue;
+
+				if (m_useCrouchAreas == false && TheNavFlatMesh.IsSpotInCrouchArea( i ))
+					continue;
+
+				// make sure hiding spot is in range
+				const Vector *pos = TheNavFlatMesh.GetSpotPosition( i );
+				if (m_range > 0.0f)
+					if ((*pos - *m_origin).IsLengthGreaterThan( m_range ))
+						continue;
+
+				// if a Player is using this hiding spot, don't consider it
+				if (IsSpotOccupied( m_me, pos, m_players ))
+					continue;
+
+				m_hidingSpot[ m_count++ ] = TheNavFlatMesh.GetSpot( i )->GetPosition();
+			}
+
+			// if we've filled up, stop searching
+			if (m_count == MAX_SPOTS)
+				return false;
+
+			return true;
+		}
+
 		// collect all the hiding spots in this area
 		const HidingSpotList *list = area->GetHidingSpotList();
 		
@@ -3421,7 +3572,7 @@ public:
 					continue;
 
 			// if a Player is using this hiding spot, don't consider it
-			if (IsSpotOccupied( m_me, spot->GetPosition() ))
+			if (IsSpotOccupied( m_me, spot->GetPosition(), m_players ))
 			{
 				// player is in hiding spot
 				/// @todo Check if player is moving or sitting still
@@ -3467,6 +3618,8 @@ public:
 	unsigned char m_flags;
 	Place m_place;
 	bool m_useCrouchAreas;
+
+	CPlayerSnapshot m_players;
 };
 
 /**
@@ -3590,51 +3743,10 @@ const Vector *FindRandomHidingSpot( CBaseEntity *me, Place place, bool isSniper
  */
 bool IsCrossingLineOfFire( const Vector &start, const Vector &finish, CBaseEntity *ignore, int ignoreTeam  )
 {
-	for ( int p=1; p <= gpGlobals->maxClients; ++p )
-	{
-		CBasePlayer *player = static_cast<CBasePlayer *>( UTIL_PlayerByIndex( p ) );
-
-		if (!IsEntityValid( player ))
-			continue;
-
-		if (player == ignore)
-			continue;
-
-		if (!player->IsAlive())
-			continue;
-
-		if (ignoreTeam && player->m_iTeam == ignoreTeam)
-			continue;
-
-		// compute player's unit aiming vector 
-		UTIL_MakeVectors( player->pev->v_angle + player->pev->punchangle );
-
-		const float longRange = 5000.0f;
-		Vector playerTarget = player->pev->origin + longRange * gpGlobals->v_forward;
-
-		Vector result;
-		if (IsIntersecting2D( start, finish, player->pev->origin, playerTarget, &result ))
-		{
-			// simple check to see if intersection lies in the Z range of the path
-			float loZ, hiZ;
-
-			if (start.z < finish.z)
-			{
-				loZ = start.z;
-				hiZ = finish.z;
-			}
-			else
-			{
-				loZ = finish.z;
-				hiZ = start.z;
-			}
-
-			if (result.z >= loZ && result.z <= hiZ + HumanHeight)
-				return true;
-		}
-	}
+	CPlayerSnapshot players;
+	players.Update();
 
-	return false;
+	return players.IsCrossingLineOfFire( start, finish, ignore, ignoreTeam );
 }
 
 //--------------------------------------------------------------------------------------------------------------------
@@ -3659,7 +3771,7 @@ const Vector *FindNearbyRetreatSpot( CBaseEntity *me, const Vector *start, CNavA
 	for( int i=0; i<collector.m_count; ++i )
 	{
 		// check if we would have to cross a line of fire to reach this hiding spot
-		if (IsCrossingLineOfFire( *start, *collector.m_hidingSpot[i], me ))
+		if (collector.m_players.IsCrossingLineOfFire( *start, *collector.m_hidingSpot[i], me ))
 		{
 			collector.RemoveSpot( i );
 
@@ -4661,7 +4773,7 @@ bool GetGroundHeight( const Vector *pos, float *height, Vector *normal )
 	{
 		from = *pos + Vector( 0, 0, offset );
 
-		UTIL_TraceLine( from, to, ignore_monsters, dont_ignore_glass, ignore, &result );
+		NavTraceLine( from, to, ignore_monsters, dont_ignore_glass, ignore, &result );
 
 		// if the trace came down thru a door, ignore the door and try again
 		// also ignore breakable floors
@@ -4745,8 +4857,8 @@ bool GetSimpleGroundHeight( const Vector *pos, float *height, Vector *normal )
 
 //--------------------------------------------------------------------------------------------------------------
 enum { MAX_BLOCKED_AREAS = 256 };
-static unsigned int BlockedID[ MAX_BLOCKED_AREAS ];
-static int BlockedIDCount = 0;
+static thread_local unsigned int BlockedID[ MAX_BLOCKED_AREAS ];		///< per thread, so approach areas can be computed in parallel
+static thread_local int BlockedIDCount = 0;
 
 /**
  * Shortest path cost, paying attention to "blocked" areas
@@ -4798,7 +4910,7 @@ inline bool IsAreaVisible( const Vector *pos, const CNavArea *area )
 		corner = *area->GetCorner( (NavCornerType)c );
 		corner.z += 0.75f * HumanHeight;
 
-		UTIL_TraceLine( *pos, corner, ignore_monsters, NULL, &result );
+		NavTraceLine( *pos, corner, ignore_monsters, NULL, &result );
 		if (result.flFraction == 1.0f)
 		{
 			// we can see this area
@@ -4845,10 +4957,14 @@ void CNavArea::ComputeApproachAreas( void )
 	{
 		CNavArea *farArea = *iter;
 
+		// cached paths may have gone around the areas blocked for the previous far area
+		if (BlockedIDCount)
+			CNavPathCache::Invalidate();
+
 		BlockedIDCount = 0;
 
 		// if we can see 'farArea', try again - the whole point is to go "around the bend", so to speak
-		if (IsAreaVisible( &eye, farArea ))
+		if (TheNavVisibility.IsPotentiallyVisible( this, farArea ) && IsAreaVisible( &eye, farArea ))
 			continue;
 	
 		// make first path to far away area
@@ -4881,7 +4997,7 @@ void CNavArea::ComputeApproachAreas( void )
 			for( i=1; i<count; ++i )
 			{
 				// if we see this area, continue on
-				if (IsAreaVisible( &eye, path[i] ))
+				if (TheNavVisibility.IsPotentiallyVisible( this, path[i] ) && IsAreaVisible( &eye, path[i] ))
 					continue;
 
 				// we can't see this area.
@@ -4897,6 +5013,7 @@ void CNavArea::ComputeApproachAreas( void )
 				int block = (path[i] == farArea) ? i-1 : i;
 
 				BlockedID[ BlockedIDCount++ ] = path[ block ]->GetID();
+				CNavPathCache::Invalidate();
 
 				if (block == 0)
 					break;
@@ -4994,6 +5111,23 @@ void CNavAreaGrid::Initialize( float minX, float maxX, float minY, float maxY )
 	m_grid = new NavAreaList[ m_gridSizeX * m_gridSizeY ];
 }
 
+/**
+ * Allocate the grid with the size it was saved with
+ */
+void CNavAreaGrid::InitializeCells( float minX, float minY, int sizeX, int sizeY )
+{
+	if (m_grid)
+		Reset();
+
+	m_minX = minX;
+	m_minY = minY;
+
+	m_gridSizeX = sizeX;
+	m_gridSizeY = sizeY;
+
+	m_grid = new NavAreaList[ m_gridSizeX * m_gridSizeY ];
+}
+
 /**
  * Add an area to the grid
  */
@@ -5011,6 +5145,14 @@ void CNavAreaGrid::AddNavArea( CNavArea *area )
 		for( int x = loX; x <= hiX; ++x )
 			m_grid[ x + y*m_gridSizeX ].push_back( const_cast<CNavArea *>( area ) );
 
+	AddNavAreaID( area );
+}
+
+/**
+ * Add an area to the hash table used to find areas by ID
+ */
+void CNavAreaGrid::AddNavAreaID( CNavArea *area )
+{
 	// add to hash table
 	int key = ComputeHashKey( area->GetID() );
 
@@ -6,8 +6,12 @@
 #define _NAV_AREA_H_
 
 #include <list>
+#include <vector>
+#include <type_traits>
 #include "nav.h"
 #include "steam_util.h"
+#include "nav_flat.h"
+#include "nav_path_cache.h"
 
 class CNavArea;
 
@@ -17,6 +21,9 @@ bool SaveNavigationMap( const char *filename );
 NavErrorType LoadNavigationMap( void );
 void DestroyNavigationMap( void );
 
+bool SaveNavigationMapSections( int fd, unsigned int bspSize );			///< write the mesh in the sectioned layout - for SaveNavigationMap()
+NavErrorType LoadNavigationMapSections( const unsigned char *data, unsigned int size, const char *filename );	///< create the mesh from a sectioned file in memory - for LoadNavigationMap()
+
 //-------------------------------------------------------------------------------------------------------------------
 /**
  * Used when building a path to determine the kind of path to build
@@ -115,6 +122,7 @@ class HidingSpot
 public:
 	HidingSpot( void );										///< for use when loading from a file
 	HidingSpot( const Vector *pos, unsigned char flags );	///< for use when generating - assigns unique ID
+	HidingSpot( const Vector *pos, unsigned char flags, unsigned int id );	///< for use when loading from a sectioned file
 
 	enum 
 	{ 
@@ -157,6 +165,15 @@ extern HidingSpotList TheHidingSpotList;
 
 extern HidingSpot *GetHidingSpotByID( unsigned int id );
 
+/**
+ * A hiding spot found by analysis, before it is created and given an ID
+ */
+struct HidingSpotCandidate
+{
+	Vector pos;
+	unsigned char flags;
+};
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Stores a pointer to an interesting "spot", and a parametric distance along a path
@@ -254,6 +271,8 @@ public:
 	//- hiding spots ------------------------------------------------------------------------------------
 	const HidingSpotList *GetHidingSpotList( void ) const	{ return &m_hidingSpotList; }
 	void ComputeHidingSpots( void );							///< analyze local area neighborhood to find "hiding spots" in this area - for map learning
+	int FindHidingSpots( HidingSpotCandidate spot[ NUM_CORNERS ] ) const;	///< find this area's hiding spots without creating them - thread safe
+	void AddHidingSpots( const HidingSpotCandidate *spot, int count );		///< create hiding spots returned by FindHidingSpots()
 	void ComputeSniperSpots( void );							///< analyze local area neighborhood to find "sniper spots" in this area - for map learning
 
 	SpotEncounter *GetSpotEncounter( const CNavArea *from, const CNavArea *to );	///< given the areas we are moving between, return the spots we will encounter
@@ -261,7 +280,7 @@ public:
 
 	//- "danger" ----------------------------------------------------------------------------------------
 	void IncreaseDanger( int teamID, float amount );			///< increase the danger of this area for the given team
-	float GetDanger( int teamID );								///< return the danger of this area (decays over time)
+	float GetDanger( int teamID ) const;						///< return the danger of this area (decays over time)
 
 	float GetSizeX( void ) const					{ return m_extent.hi.x - m_extent.lo.x; }
 	float GetSizeY( void ) const					{ return m_extent.hi.y - m_extent.lo.y; }
@@ -283,13 +302,14 @@ public:
 	void ComputeApproachAreas( void );							///< determine the set of "approach areas" - for map learning
 
 	//- A* pathfinding algorithm ------------------------------------------------------------------------
-	static void MakeNewMarker( void )					{ ++m_masterMarker; if (m_masterMarker == 0) m_masterMarker = 1; }
-	void Mark( void )													{ m_marker = m_masterMarker; }
-	BOOL IsMarked( void ) const								{ return (m_marker == m_masterMarker) ? true : false; }
+	// These operate on the calling thread's current search, see CNavAreaSearch
+	static void MakeNewMarker( void );
+	void Mark( void );
+	BOOL IsMarked( void ) const;
 	
-	void SetParent( CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES )	{ m_parent = parent; m_parentHow = how; }
-	CNavArea *GetParent( void ) const						{ return m_parent; }
-	NavTraverseType GetParentHow( void ) const	{ return m_parentHow; }
+	void SetParent( CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES );
+	CNavArea *GetParent( void ) const;
+	NavTraverseType GetParentHow( void ) const;
 
 	bool IsOpen( void ) const;								///< true if on "open list"
 	void AddToOpenList( void );								///< add to open list in decreasing value order
@@ -304,11 +324,11 @@ public:
 
 	static void ClearSearchLists( void );					///< clears the open and closed lists for a new search
 
-	void SetTotalCost( float value )							{ m_totalCost = value; }
-	float GetTotalCost( void ) const							{ return m_totalCost; }
+	void SetTotalCost( float value );
+	float GetTotalCost( void ) const;
 
-	void SetCostSoFar( float value )							{ m_costSoFar = value; }
-	float GetCostSoFar( void ) const							{ return m_costSoFar; }
+	void SetCostSoFar( float value );
+	float GetCostSoFar( void ) const;
 
 	//- editing -----------------------------------------------------------------------------------------
 	void Draw( byte red, byte green, byte blue, int duration = 50 );	///< draw area for debugging & editing
@@ -329,6 +349,8 @@ private:
 	friend void MarkJumpAreas( void );
 	friend bool SaveNavigationMap( const char *filename );
 	friend NavErrorType LoadNavigationMap( void );
+	friend bool SaveNavigationMapSections( int fd, unsigned int bspSize );
+	friend NavErrorType LoadNavigationMapSections( const unsigned char *data, unsigned int size, const char *filename );
 	friend void DestroyNavigationMap( void );
 	friend void DestroyHidingSpots( void );
 	friend void StripNavigationAreas( void );
@@ -354,17 +376,13 @@ private:
 	//- for hunting -------------------------------------------------------------------------------------
 	float m_clearedTimestamp[ MAX_AREA_TEAMS ];				///< time this area was last "cleared" of enemies
 
-	//- "danger" ----------------------------------------------------------------------------------------
-	float m_danger[ MAX_AREA_TEAMS ];						///< danger of this area, allowing bots to avoid areas where they died in the past - zero is no danger
-	float m_dangerTimestamp[ MAX_AREA_TEAMS ];				///< time when danger value was set - used for decaying
-	void DecayDanger( void );
-
 	//- hiding spots ------------------------------------------------------------------------------------
 	HidingSpotList m_hidingSpotList;
 	bool IsHidingSpotCollision( const Vector *pos ) const;	///< returns true if an existing hiding spot is too close to given position
 
 	//- encounter spots ---------------------------------------------------------------------------------
 	SpotEncounterList m_spotEncounterList;					///< list of possible ways to move thru this area, and the spots to look at as we do
+	void ComputeEncounterPath( SpotEncounter *e ) const;	///< compute the path segment of a loaded encounter from its areas
 	void AddSpotEncounters( const CNavArea *from, NavDirType fromDir, const CNavArea *to, NavDirType toDir );	///< add spot encounter data when moving from area to area
 
 	//- approach areas ----------------------------------------------------------------------------------
@@ -374,18 +392,6 @@ private:
 
 	void Strip( void );										///< remove "analyzed" data from nav area
 
-	//- A* pathfinding algorithm ------------------------------------------------------------------------
-	static unsigned int m_masterMarker;
-	unsigned int m_marker;									///< used to flag the area as visited
-	CNavArea *m_parent;										///< the area just prior to this on in the search path
-	NavTraverseType m_parentHow;							///< how we get from parent to us
-	float m_totalCost;										///< the distance so far plus an estimate of the distance left
-	float m_costSoFar;										///< distance travelled so far
-
-	static CNavArea *m_openList;
-	CNavArea *m_nextOpen, *m_prevOpen;						///< only valid if m_openMarker == m_masterMarker
-	unsigned int m_openMarker;								///< if this equals the current marker value, we are on the open list
-
 	//- connections to adjacent areas -------------------------------------------------------------------
 	NavConnectList m_connect[ NUM_DIRECTIONS ];				///< a list of adjacent areas for each direction
 	NavLadderList m_ladder[ NUM_LADDER_DIRECTIONS ];		///< list of ladders leading up and down from this area
@@ -410,6 +416,101 @@ typedef std::list<CNavArea *> NavAreaList;
 extern NavAreaList TheNavAreaList;
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The state of one search through the nav mesh: the open list, and each area's parent, costs and "visited" marker.
+ * Keeping this out of CNavArea lets searches run on several threads at once, as long as the mesh isn't changing.
+ * Each thread has a current search, which the CNavArea search methods and the search templates below use.
+ * The open list is an indexed 4-ary heap ordered by total cost, so decreasing an area's cost is O(log n).
+ */
+class CNavAreaSearch
+{
+public:
+	CNavAreaSearch( void );
+
+	void MakeNewMarker( void );								///< forget all state from previous searches
+	void Mark( const CNavArea *area )						{ State( area ).isMarked = true; }
+	bool IsMarked( const CNavArea *area ) const;
+
+	void SetParent( const CNavArea *area, CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES );
+	CNavArea *GetParent( const CNavArea *area ) const;
+	NavTraverseType GetParentHow( const CNavArea *area ) const;
+
+	void SetTotalCost( const CNavArea *area, float value );
+	float GetTotalCost( const CNavArea *area ) const;
+
+	void SetCostSoFar( const CNavArea *area, float value )	{ State( area ).costSoFar = value; }
+	float GetCostSoFar( const CNavArea *area ) const;
+
+	bool IsOpen( const CNavArea *area ) const;				///< true if on "open list"
+	void AddToOpenList( CNavArea *area );					///< add to open list, ordered by total cost
+	void UpdateOnOpenList( CNavArea *area );				///< a smaller value has been found, update this area on the open list
+	void RemoveFromOpenList( CNavArea *area );
+	bool IsOpenListEmpty( void ) const						{ return m_openList.empty(); }
+	CNavArea *PopOpenList( void );							///< remove and return the cheapest area on the open list
+
+	bool IsClosed( const CNavArea *area ) const				{ return IsMarked( area ) && !IsOpen( area ); }	///< true if on "closed list"
+	void AddToClosedList( CNavArea *area )					{ Mark( area ); }
+	void RemoveFromClosedList( CNavArea *area )				{ }	///< since "closed" is defined as visited (marked) and not on open list, do nothing
+
+	void ClearSearchLists( void );							///< clears the open and closed lists for a new search
+
+	CNavPathCache *GetPathCache( void )						{ return &m_pathCache; }	///< results of recent searches run on this search
+
+	static CNavAreaSearch *GetCurrent( void );				///< return the calling thread's current search
+
+	/**
+	 * Makes a search the calling thread's current search for as long as the scope object exists
+	 */
+	class Scope
+	{
+	public:
+		Scope( CNavAreaSearch *search )						{ m_prev = m_current; m_current = search; }
+		~Scope()											{ m_current = m_prev; }
+
+	private:
+		CNavAreaSearch *m_prev;
+	};
+
+private:
+	struct AreaState
+	{
+		unsigned int marker;								///< state is only valid if this equals the search's marker
+		bool isMarked;										///< used to flag the area as visited
+		int openIndex;										///< index in the open list heap, -1 if not on it
+		CNavArea *parent;									///< the area just prior to this on in the search path
+		NavTraverseType parentHow;							///< how we get from parent to us
+		float totalCost;									///< the distance so far plus an estimate of the distance left
+		float costSoFar;									///< distance travelled so far
+	};
+
+	struct OpenEntry
+	{
+		float totalCost;
+		unsigned int order;									///< areas with equal cost come off the list in the order they were added
+		CNavArea *area;
+	};
+
+	AreaState &State( const CNavArea *area );				///< get the area's state, resetting it if it is left over from an old search
+	const AreaState *FindState( const CNavArea *area ) const;	///< return NULL if the area hasn't been touched by this search
+
+	bool IsCheaper( const OpenEntry &a, const OpenEntry &b ) const;
+	void MoveOpenEntry( int to, const OpenEntry &entry );
+	void SiftUp( int index );
+	void SiftDown( int index );
+
+	std::vector< AreaState > m_state;						///< indexed by area ID
+	std::vector< OpenEntry > m_openList;
+	unsigned int m_marker;
+	unsigned int m_openOrder;
+
+	CNavPathCache m_pathCache;
+
+	static CNavAreaSearch *GetThreadSearch( void );
+	static thread_local CNavAreaSearch *m_current;
+};
+
+
 //
 // Inlines
 //
@@ -432,42 +533,160 @@ inline CNavArea *CNavArea::GetAdjacentArea( NavDirType dir, int i ) const
 	return NULL;
 }
 
+inline CNavAreaSearch *CNavAreaSearch::GetCurrent( void )
+{
+	return (m_current) ? m_current : GetThreadSearch();
+}
+
+inline CNavAreaSearch::AreaState &CNavAreaSearch::State( const CNavArea *area )
+{
+	unsigned int id = area->GetID();
+	if (id >= m_state.size())
+		m_state.resize( id + 1 );
+
+	AreaState &state = m_state[ id ];
+	if (state.marker != m_marker)
+	{
+		state.marker = m_marker;
+		state.isMarked = false;
+		state.openIndex = -1;
+		state.parent = NULL;
+		state.parentHow = GO_NORTH;
+		state.totalCost = 0.0f;
+		state.costSoFar = 0.0f;
+	}
+
+	return state;
+}
+
+inline const CNavAreaSearch::AreaState *CNavAreaSearch::FindState( const CNavArea *area ) const
+{
+	unsigned int id = area->GetID();
+	if (id >= m_state.size() || m_state[ id ].marker != m_marker)
+		return NULL;
+
+	return &m_state[ id ];
+}
+
+inline bool CNavAreaSearch::IsMarked( const CNavArea *area ) const
+{
+	const AreaState *state = FindState( area );
+	return (state && state->isMarked) ? true : false;
+}
+
+inline void CNavAreaSearch::SetParent( const CNavArea *area, CNavArea *parent, NavTraverseType how )
+{
+	AreaState &state = State( area );
+	state.parent = parent;
+	state.parentHow = how;
+}
+
+inline CNavArea *CNavAreaSearch::GetParent( const CNavArea *area ) const
+{
+	const AreaState *state = FindState( area );
+	return (state) ? state->parent : NULL;
+}
+
+inline NavTraverseType CNavAreaSearch::GetParentHow( const CNavArea *area ) const
+{
+	const AreaState *state = FindState( area );
+	return (state) ? state->parentHow : GO_NORTH;
+}
+
+inline float CNavAreaSearch::GetTotalCost( const CNavArea *area ) const
+{
+	const AreaState *state = FindState( area );
+	return (state) ? state->totalCost : 0.0f;
+}
+
+inline float CNavAreaSearch::GetCostSoFar( const CNavArea *area ) const
+{
+	const AreaState *state = FindState( area );
+	return (state) ? state->costSoFar : 0.0f;
+}
+
+inline bool CNavAreaSearch::IsOpen( const CNavArea *area ) const
+{
+	const AreaState *state = FindState( area );
+	return (state && state->openIndex >= 0) ? true : false;
+}
+
+inline bool CNavAreaSearch::IsCheaper( const OpenEntry &a, const OpenEntry &b ) const
+{
+	if (a.totalCost != b.totalCost)
+		return (a.totalCost < b.totalCost) ? true : false;
+
+	return (a.order < b.order) ? true : false;
+}
+
+inline void CNavArea::MakeNewMarker( void )
+{
+	CNavAreaSearch::GetCurrent()->MakeNewMarker();
+}
+
+inline void CNavArea::Mark( void )
+{
+	CNavAreaSearch::GetCurrent()->Mark( this );
+}
+
+inline BOOL CNavArea::IsMarked( void ) const
+{
+	return CNavAreaSearch::GetCurrent()->IsMarked( this );
+}
+
+inline void CNavArea::SetParent( CNavArea *parent, NavTraverseType how )
+{
+	CNavAreaSearch::GetCurrent()->SetParent( this, parent, how );
+}
+
+inline CNavArea *CNavArea::GetParent( void ) const
+{
+	return CNavAreaSearch::GetCurrent()->GetParent( this );
+}
+
+inline NavTraverseType CNavArea::GetParentHow( void ) const
+{
+	return CNavAreaSearch::GetCurrent()->GetParentHow( this );
+}
+
 inline bool CNavArea::IsOpen( void ) const
 {
-	return (m_openMarker == m_masterMarker) ? true : false;
+	return CNavAreaSearch::GetCurrent()->IsOpen( this );
 }
 
-inline bool CNavArea::IsOpenListEmpty( void )
+inline void CNavArea::AddToOpenList( void )
 {
-	return (m_openList) ? false : true;
+	CNavAreaSearch::GetCurrent()->AddToOpenList( this );
 }
 
-inline CNavArea *CNavArea::PopOpenList( void )
+inline void CNavArea::UpdateOnOpenList( void )
 {
-	if (m_openList)
-	{
-		CNavArea *area = m_openList;
-	
-		// disconnect from list
-		area->RemoveFromOpenList();
+	CNavAreaSearch::GetCurrent()->UpdateOnOpenList( this );
+}
 
-		return area;
-	}
+inline void CNavArea::RemoveFromOpenList( void )
+{
+	CNavAreaSearch::GetCurrent()->RemoveFromOpenList( this );
+}
 
-	return NULL;
+inline bool CNavArea::IsOpenListEmpty( void )
+{
+	return CNavAreaSearch::GetCurrent()->IsOpenListEmpty();
 }
 
-inline bool CNavArea::IsClosed( void ) const
+inline CNavArea *CNavArea::PopOpenList( void )
 {
-	if (IsMarked() && !IsOpen())
-		return true;
+	return CNavAreaSearch::GetCurrent()->PopOpenList();
+}
 
-	return false;
+inline bool CNavArea::IsClosed( void ) const
+{
+	return CNavAreaSearch::GetCurrent()->IsClosed( this );
 }
 
 inline void CNavArea::AddToClosedList( void )
 {
-	Mark();
+	CNavAreaSearch::GetCurrent()->AddToClosedList( this );
 }
 
 inline void CNavArea::RemoveFromClosedList( void )
@@ -475,6 +694,31 @@ inline void CNavArea::RemoveFromClosedList( void )
 	// since "closed" is defined as visited (marked) and not on open list, do nothing
 }
 
+inline void CNavArea::ClearSearchLists( void )
+{
+	CNavAreaSearch::GetCurrent()->ClearSearchLists();
+}
+
+inline void CNavArea::SetTotalCost( float value )
+{
+	CNavAreaSearch::GetCurrent()->SetTotalCost( this, value );
+}
+
+inline float CNavArea::GetTotalCost( void ) const
+{
+	return CNavAreaSearch::GetCurrent()->GetTotalCost( this );
+}
+
+inline void CNavArea::SetCostSoFar( float value )
+{
+	CNavAreaSearch::GetCurrent()->SetCostSoFar( this, value );
+}
+
+inline float CNavArea::GetCostSoFar( void ) const
+{
+	return CNavAreaSearch::GetCurrent()->GetCostSoFar( this );
+}
+
 //--------------------------------------------------------------------------------------------------------------
 
 /**
@@ -500,6 +744,24 @@ public:
 
 	Place GetPlace( const Vector *pos ) const;				///< return radio chatter place for given coordinate
 
+	//- for the nav file --------------------------------------------------------------------------------
+	float GetCellSize( void ) const							{ return m_cellSize; }
+	int GetGridSizeX( void ) const							{ return m_gridSizeX; }
+	int GetGridSizeY( void ) const							{ return m_gridSizeY; }
+	float GetMinX( void ) const								{ return m_minX; }
+	float GetMinY( void ) const								{ return m_minY; }
+	const NavAreaList *GetCell( int x, int y ) const		{ return &m_grid[ x + y*m_gridSizeX ]; }
+	void GetCellRange( const Extent *extent, int *loX, int *loY, int *hiX, int *hiY ) const	///< return the range of cells the extent covers
+	{
+		*loX = WorldToGridX( extent->lo.x );
+		*loY = WorldToGridY( extent->lo.y );
+		*hiX = WorldToGridX( extent->hi.x );
+		*hiY = WorldToGridY( extent->hi.y );
+	}
+	void InitializeCells( float minX, float minY, int sizeX, int sizeY );	///< clear and reset the grid to a saved size
+	void AddNavAreaToCell( CNavArea *area, int x, int y )	{ m_grid[ x + y*m_gridSizeX ].push_back( area ); }	///< add an area to one saved cell - also call AddNavAreaID()
+	void AddNavAreaID( CNavArea *area );					///< add an area to the ID lookup only, for areas placed in saved cells
+
 private:
 	const float m_cellSize;
 	NavAreaList *m_grid;
@@ -554,6 +816,9 @@ extern void SanityCheckNavigationMap( const char *mapName );	///< Performs a lig
 extern void ApproachAreaAnalysisPrep( void );
 extern void CleanupApproachAreaAnalysisPrep( void );
 
+extern bool AnalyzeNavigationMap( int threadCount = 0 );		///< recompute hiding spots, encounters and approach areas on a worker pool, then save
+extern void NavAnalyzeCommand( void );							///< handler for the "bot_nav_analyze [threads]" server command
+
 extern void BuildLadders( void );
 
 extern bool TestArea( CNavNode *node, int width, int height );
@@ -564,8 +829,10 @@ extern bool GetSimpleGroundHeight( const Vector *pos, float *height, Vector *nor
 
 class CBasePlayer;
 class CBaseEntity; 
+class CPlayerSnapshot;
 
 extern bool IsSpotOccupied( CBaseEntity *me, const Vector *pos );	// if a player is at the given spot, return true
+extern bool IsSpotOccupied( CBaseEntity *me, const Vector *pos, const CPlayerSnapshot &players );
 
 extern const Vector *FindNearbyHidingSpot( CBaseEntity *me, const Vector *pos, CNavArea *currentArea, float maxRange = 1000.0f, bool isSniper = false, bool useNearest = false );
 extern const Vector *FindRandomHidingSpot( CBaseEntity *me, Place place, bool isSniper = false );
@@ -666,17 +933,10 @@ public:
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Find path from startArea to goalArea via an A* search, using supplied cost heuristic.
- * If cost functor returns -1 for an area, that area is considered a dead end.
- * This doesn't actually build a path, but the path is defined by following parent
- * pointers back from goalArea to startArea.
- * If 'closestArea' is non-NULL, the closest area to the goal is returned (useful if the path fails).
- * If 'goalArea' is NULL, will compute a path as close as possible to 'goalPos'.
- * If 'goalPos' is NULL, will use the center of 'goalArea' as the goal position.
- * Returns true if a path exists.
+ * The A* search behind NavAreaBuildPath(), which always searches and never uses the path cache
  */
 template< typename CostFunctor >
-bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL )
+bool NavAreaSearchPath( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL )
 {
 	if (closestArea)
 		*closestArea = NULL;
@@ -693,12 +953,14 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 		return false;
 	}
 
-	startArea->SetParent( NULL );
+	CNavAreaSearch *search = CNavAreaSearch::GetCurrent();
+
+	search->SetParent( startArea, NULL );
 
 	// if we are already in the goal area, build trivial path
 	if (startArea == goalArea)
 	{
-		goalArea->SetParent( NULL );
+		search->SetParent( goalArea, NULL );
 
 		if (closestArea)
 			*closestArea = goalArea;
@@ -710,29 +972,30 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 	Vector actualGoalPos = (goalPos) ? *goalPos : *goalArea->GetCenter();
 
 	// start search
-	CNavArea::ClearSearchLists();
+	search->ClearSearchLists();
 
 	// compute estimate of path length
 	/// @todo Cost might work as "manhattan distance"
-	startArea->SetTotalCost( (*startArea->GetCenter() - actualGoalPos).Length() );
+	float startTotalCost = (*startArea->GetCenter() - actualGoalPos).Length();
+	search->SetTotalCost( startArea, startTotalCost );
 
 	float initCost = costFunc( startArea, NULL, NULL );	
 	if (initCost < 0.0f)
 		return false;
-	startArea->SetCostSoFar( initCost );
+	search->SetCostSoFar( startArea, initCost );
 
-	startArea->AddToOpenList();
+	search->AddToOpenList( startArea );
 
 	// keep track of the area we visit that is closest to the goal
 	if (closestArea)
 		*closestArea = startArea;
-	float closestAreaDist = startArea->GetTotalCost();
+	float closestAreaDist = startTotalCost;
 
 	// do A* search
-	while( !CNavArea::IsOpenListEmpty() )
+	while( !search->IsOpenListEmpty() )
 	{
 		// get next area to check
-		CNavArea *area = CNavArea::PopOpenList();
+		CNavArea *area = search->PopOpenList();
 
 		// check if we have found the goal area
 		if (area == goalArea)
@@ -743,129 +1006,23 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 			return true;
 		}
 
-		// search adjacent areas
-		bool searchFloor = true;
-		int dir = NORTH;
-		const NavConnectList *floorList = area->GetAdjacentList( NORTH );
-		NavConnectList::const_iterator floorIter = floorList->begin();
-
-		bool ladderUp = true;
-		const NavLadderList *ladderList = NULL;
-		NavLadderList::const_iterator ladderIter;
-		enum { AHEAD = 0, LEFT, RIGHT, BEHIND, NUM_TOP_DIRECTIONS };
-		int ladderTopDir;
-
-		while(true)
+		// relax the edge to an adjacent area
+		auto visit = [&]( CNavArea *newArea, NavTraverseType how, const CNavLadder *ladder )
 		{
-			CNavArea *newArea;
-			NavTraverseType how;
-			const CNavLadder *ladder = NULL;
-
-			//
-			// Get next adjacent area - either on floor or via ladder
-			//
-			if (searchFloor)
-			{
-				// if exhausted adjacent connections in current direction, begin checking next direction
-				if (floorIter == floorList->end())
-				{
-					++dir;
-
-					if (dir == NUM_DIRECTIONS)
-					{
-						// checked all directions on floor - check ladders next
-						searchFloor = false;
-
-						ladderList = area->GetLadderList( LADDER_UP );
-						ladderIter = ladderList->begin();
-						ladderTopDir = AHEAD;
-					}
-					else
-					{
-						// start next direction
-						floorList = area->GetAdjacentList( (NavDirType)dir );
-						floorIter = floorList->begin();
-					}
-
-					continue;
-				}
-
-				newArea = (*floorIter).area;
-				how = (NavTraverseType)dir;
-				++floorIter;
-			}
-			else	// search ladders
-			{
-				if (ladderIter == ladderList->end())
-				{
-					if (!ladderUp)
-					{
-						// checked both ladder directions - done
-						break;
-					}
-					else
-					{
-						// check down ladders
-						ladderUp = false;
-						ladderList = area->GetLadderList( LADDER_DOWN );
-						ladderIter = ladderList->begin();
-					}
-					continue;
-				}
-
-				if (ladderUp)
-				{
-					ladder = *ladderIter;
-
-					// cannot use this ladder if the ladder bottom is hanging above our head
-					if (ladder->m_isDangling)
-					{
-						++ladderIter;
-						continue;
-					}
-
-					// do not use BEHIND connection, as its very hard to get to when going up a ladder
-					if (ladderTopDir == AHEAD)
-						newArea = ladder->m_topForwardArea;
-					else if (ladderTopDir == LEFT)
-						newArea = ladder->m_topLeftArea;
-					else if (ladderTopDir == RIGHT)
-						newArea = ladder->m_topRightArea;
-					else
-					{
-						++ladderIter;
-						continue;
-					}
-
-					how = GO_LADDER_UP;
-					++ladderTopDir;
-				}
-				else
-				{
-					newArea = (*ladderIter)->m_bottomArea;
-					how = GO_LADDER_DOWN;
-					ladder = (*ladderIter);
-					++ladderIter;
-				}
-
-				if (newArea == NULL)
-					continue;
-			}
-
 			// don't backtrack
 			if (newArea == area)
-				continue;
+				return;
 
 			float newCostSoFar = costFunc( newArea, area, ladder );
 
 			// check if cost functor says this area is a dead-end
 			if (newCostSoFar < 0.0f)
-				continue;
+				return;
 
-			if ((newArea->IsOpen() || newArea->IsClosed()) && newArea->GetCostSoFar() <= newCostSoFar)
+			if ((search->IsOpen( newArea ) || search->IsClosed( newArea )) && search->GetCostSoFar( newArea ) <= newCostSoFar)
 			{
 				// this is a worse path - skip it
-				continue;
+				return;
 			}
 			else
 			{
@@ -879,32 +1036,195 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 					closestAreaDist = newCostRemaining;
 				}
 				
-				newArea->SetParent( area, how );
-				newArea->SetCostSoFar( newCostSoFar );
-				newArea->SetTotalCost( newCostSoFar + newCostRemaining );
+				search->SetParent( newArea, area, how );
+				search->SetCostSoFar( newArea, newCostSoFar );
+				search->SetTotalCost( newArea, newCostSoFar + newCostRemaining );
 
-				if (newArea->IsClosed())
-					newArea->RemoveFromClosedList();
+				if (search->IsClosed( newArea ))
+					search->RemoveFromClosedList( newArea );
 
-				if (newArea->IsOpen())
+				if (search->IsOpen( newArea ))
 				{
 					// area already on open list, update the list order to keep costs sorted
-					newArea->UpdateOnOpenList();
+					search->UpdateOnOpenList( newArea );
 				}
 				else
 				{
-					newArea->AddToOpenList();
+					search->AddToOpenList( newArea );
 				}
 			}
+		};
+
+		// search adjacent areas - use the flat copy of the mesh if there is one
+		if (TheNavFlatMesh.IsBuilt())
+		{
+			int index = TheNavFlatMesh.GetIndexByID( area->GetID() );
+			int end = TheNavFlatMesh.GetEdgeEnd( index );
+			for( int edge = TheNavFlatMesh.GetEdgeBegin( index ); edge < end; ++edge )
+			{
+				visit( TheNavFlatMesh.GetArea( TheNavFlatMesh.GetEdgeTarget( edge ) ), TheNavFlatMesh.GetEdgeHow( edge ), TheNavFlatMesh.GetEdgeLadder( edge ) );
+			}
+		}
+		else
+		{
+			bool searchFloor = true;
+			int dir = NORTH;
+			const NavConnectList *floorList = area->GetAdjacentList( NORTH );
+			NavConnectList::const_iterator floorIter = floorList->begin();
+
+			bool ladderUp = true;
+			const NavLadderList *ladderList = NULL;
+			NavLadderList::const_iterator ladderIter;
+			enum { AHEAD = 0, LEFT, RIGHT, BEHIND, NUM_TOP_DIRECTIONS };
+			int ladderTopDir;
+
+			while(true)
+			{
+				CNavArea *newArea;
+				NavTraverseType how;
+				const CNavLadder *ladder = NULL;
+
+				//
+				// Get next adjacent area - either on floor or via ladder
+				//
+				if (searchFloor)
+				{
+					// if exhausted adjacent connections in current direction, begin checking next direction
+					if (floorIter == floorList->end())
+					{
+						++dir;
+
+						if (dir == NUM_DIRECTIONS)
+						{
+							// checked all directions on floor - check ladders next
+							searchFloor = false;
+
+							ladderList = area->GetLadderList( LADDER_UP );
+							ladderIter = ladderList->begin();
+							ladderTopDir = AHEAD;
+						}
+						else
+						{
+							// start next direction
+							floorList = area->GetAdjacentList( (NavDirType)dir );
+							floorIter = floorList->begin();
+						}
+
+						continue;
+					}
+
+					newArea = (*floorIter).area;
+					how = (NavTraverseType)dir;
+					++floorIter;
+				}
+				else	// search ladders
+				{
+					if (ladderIter == ladderList->end())
+					{
+						if (!ladderUp)
+						{
+							// checked both ladder directions - done
+							break;
+						}
+						else
+						{
+							// check down ladders
+							ladderUp = false;
+							ladderList = area->GetLadderList( LADDER_DOWN );
+							ladderIter = ladderList->begin();
+						}
+						continue;
+					}
+
+					if (ladderUp)
+					{
+						ladder = *ladderIter;
+
+						// cannot use this ladder if the ladder bottom is hanging above our head
+						if (ladder->m_isDangling)
+						{
+							++ladderIter;
+							continue;
+						}
+
+						// do not use BEHIND connection, as its very hard to get to when going up a ladder
+						if (ladderTopDir == AHEAD)
+							newArea = ladder->m_topForwardArea;
+						else if (ladderTopDir == LEFT)
+							newArea = ladder->m_topLeftArea;
+						else if (ladderTopDir == RIGHT)
+							newArea = ladder->m_topRightArea;
+						else
+						{
+							++ladderIter;
+							continue;
+						}
+
+						how = GO_LADDER_UP;
+						++ladderTopDir;
+					}
+					else
+					{
+						newArea = (*ladderIter)->m_bottomArea;
+						how = GO_LADDER_DOWN;
+						ladder = (*ladderIter);
+						++ladderIter;
+					}
+
+					if (newArea == NULL)
+						continue;
+				}
+
+				visit( newArea, how, ladder );
+			}
 		}
 
 		// we have searched this area
-		area->AddToClosedList();
+		search->AddToClosedList( area );
 	}
 
 	return false;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find path from startArea to goalArea via an A* search, using supplied cost heuristic.
+ * If cost functor returns -1 for an area, that area is considered a dead end.
+ * This doesn't actually build a path, but the path is defined by following parent
+ * pointers back from goalArea to startArea.
+ * If 'closestArea' is non-NULL, the closest area to the goal is returned (useful if the path fails).
+ * If 'goalArea' is NULL, will compute a path as close as possible to 'goalPos'.
+ * If 'goalPos' is NULL, will use the center of 'goalArea' as the goal position.
+ * Returns true if a path exists.
+ * Runs on the calling thread's current search - use CNavAreaSearch::Scope to run it on another one.
+ * Searches between two areas with a cost functor that has no member data reuse the search's cached
+ * result if there is one, in which case only the parent links along the path are set.
+ */
+template< typename CostFunctor >
+bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL )
+{
+	if (!std::is_empty< CostFunctor >::value || startArea == NULL || goalArea == NULL || startArea == goalArea)
+		return NavAreaSearchPath( startArea, goalArea, goalPos, costFunc, closestArea );
+
+	CNavAreaSearch *search = CNavAreaSearch::GetCurrent();
+	CNavPathCache *cache = search->GetPathCache();
+	const void *costKey = CNavPathCache::GetCostKey< CostFunctor >();
+
+	bool found;
+	CNavArea *closest;
+
+	if (!cache->Lookup( search, costKey, startArea, goalArea, goalPos, &found, &closest ))
+	{
+		found = NavAreaSearchPath( startArea, goalArea, goalPos, costFunc, &closest );
+		cache->Store( search, costKey, startArea, goalArea, goalPos, found, closest );
+	}
+
+	if (closestArea)
+		*closestArea = closest;
+
+	return found;
+}
+
 
 //--------------------------------------------------------------------------------------------------------------
 /**
@@ -922,17 +1242,33 @@ float NavAreaTravelDistance( CNavArea *startArea, CNavArea *endArea, CostFunctor
 	if (startArea == endArea)
 		return 0.0f;
 
+	// distances along cached paths are remembered too
+	CNavPathCache *cache = (std::is_empty< CostFunctor >::value) ? CNavAreaSearch::GetCurrent()->GetPathCache() : NULL;
+	const void *costKey = CNavPathCache::GetCostKey< CostFunctor >();
+
+	float distance;
+	if (cache && cache->GetTravelDistance( costKey, startArea, endArea, &distance ))
+		return distance;
+
 	// compute path between areas using given cost heuristic
 	if (NavAreaBuildPath( startArea, endArea, NULL, costFunc ) == false)
+	{
+		if (cache)
+			cache->SetTravelDistance( costKey, startArea, endArea, -1.0f );
+
 		return -1.0f;
+	}
 
 	// compute distance along path
-	float distance = 0.0f;
+	distance = 0.0f;
 	for( CNavArea *area = endArea; area->GetParent(); area = area->GetParent() )
 	{
 		distance += (*area->GetCenter() - *area->GetParent()->GetCenter()).Length();
 	}
 
+	if (cache)
+		cache->SetTravelDistance( costKey, startArea, endArea, distance );
+
 	return distance;
 }
 
@@ -1047,6 +1383,19 @@ void SearchSurroundingAreas( CNavArea *startArea, const Vector *startPos, Functo
 		// invoke functor on area
 		if (func( area ))
 		{
+			if (TheNavFlatMesh.IsBuilt())
+			{
+				// explore adjacent areas using the flat copy of the mesh, which holds the same floor and ladder connections as below
+				int index = TheNavFlatMesh.GetIndexByID( area->GetID() );
+				int end = TheNavFlatMesh.GetEdgeEnd( index );
+				for( int edge = TheNavFlatMesh.GetEdgeBegin( index ); edge < end; ++edge )
+				{
+					AddAreaToOpenList( TheNavFlatMesh.GetArea( TheNavFlatMesh.GetEdgeTarget( edge ) ), area, startPos, maxRange );
+				}
+
+				continue;
+			}
+
 			// explore adjacent floor areas
 			for( int dir=0; dir<NUM_DIRECTIONS; ++dir )
 			{
@@ -1108,6 +1457,15 @@ void SearchSurroundingAreas( CNavArea *startArea, const Vector *startPos, Functo
 template < typename Functor >
 void ForAllAreas( Functor &func )
 {
+	if (TheNavFlatMesh.IsBuilt())
+	{
+		int count = TheNavFlatMesh.GetAreaCount();
+		for( int i=0; i<count; ++i )
+			func( TheNavFlatMesh.GetArea( i ) );
+
+		return;
+	}
+
 	NavAreaList::iterator iter;
 	for( iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
 	{
@@ -0,0 +1,167 @@
+// nav_danger.cpp
+// Per-team danger of each nav area, decayed as it is read
+
+#pragma warning( disable : 4530 )					// STL uses exceptions, but we are not compiling with them - ignore warning
+#pragma warning( disable : 4786 )					// long STL names get truncated in browse info.
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "profiler.h"
+
+#include "nav.h"
+#include "nav_area.h"
+#include "nav_danger.h"
+#include "nav_path_cache.h"
+
+CNavDangerMap TheNavDangerMap;
+
+// one kill == 1.0, which we will forget about in two minutes
+static const float DangerDecayRate = 1.0f / 120.0f;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the danger of the area for the team, with the decay since it was last increased taken off
+ */
+float CNavDangerMap::GetDanger( unsigned int areaID, int teamID ) const
+{
+	if (areaID >= m_danger[ teamID ].size())
+		return 0.0f;
+
+	float danger = m_danger[ teamID ][ areaID ] - DangerDecayRate * (gpGlobals->time - m_timestamp[ teamID ][ areaID ]);
+
+	return (danger > 0.0f) ? danger : 0.0f;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Increase the danger of the area for the team. This does not invalidate the path caches - the caller must.
+ */
+void CNavDangerMap::IncreaseDanger( unsigned int areaID, int teamID, float amount )
+{
+	if (areaID >= m_danger[ teamID ].size())
+	{
+		for( int t=0; t<MAX_TEAMS; ++t )
+		{
+			m_danger[t].resize( areaID+1, 0.0f );
+			m_timestamp[t].resize( areaID+1, 0.0f );
+		}
+	}
+
+	// before we add the new value, decay what's there
+	m_danger[ teamID ][ areaID ] = GetDanger( areaID, teamID ) + amount;
+	m_timestamp[ teamID ][ areaID ] = gpGlobals->time;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Queue an increase in the danger of the areas around 'pos', starting from 'startArea', to be applied
+ * at the start of the next frame
+ */
+void CNavDangerMap::QueueNearby( int teamID, float amount, const CNavArea *startArea, const Vector *pos, float maxRadius )
+{
+	if (startArea == NULL)
+		return;
+
+	// several events at the same spot - such as a volley of kills - spread out together
+	for( unsigned int i=0; i<m_queue.size(); ++i )
+	{
+		DangerEvent *event = &m_queue[i];
+
+		if (event->teamID == teamID && event->startAreaID == startArea->GetID() && event->pos == *pos && event->maxRadius == maxRadius)
+		{
+			event->amount += amount;
+			return;
+		}
+	}
+
+	DangerEvent event;
+	event.teamID = teamID;
+	event.amount = amount;
+	event.startAreaID = startArea->GetID();
+	event.pos = *pos;
+	event.maxRadius = maxRadius;
+
+	m_queue.push_back( event );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Apply the danger queued since the last update. Call at the start of each frame, while no path searches are running.
+ */
+void CNavDangerMap::Update( void )
+{
+	if (m_queue.empty())
+		return;
+
+	PROFILE_SCOPE( "CNavDangerMap::Update" );
+
+	for( unsigned int i=0; i<m_queue.size(); ++i )
+		Spread( &m_queue[i] );
+
+	m_queue.clear();
+
+	// paths that avoid danger may go another way now
+	CNavPathCache::Invalidate();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavDangerMap::Reset( void )
+{
+	for( int t=0; t<MAX_TEAMS; ++t )
+	{
+		m_danger[t].clear();
+		m_timestamp[t].clear();
+	}
+
+	m_queue.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Increase the danger of the event's area, and of the areas around it within range of its position
+ */
+void CNavDangerMap::Spread( const DangerEvent *event )
+{
+	CNavArea *startArea = TheNavAreaGrid.GetNavAreaByID( event->startAreaID );
+	if (startArea == NULL)
+		return;
+
+	CNavArea::MakeNewMarker();
+	CNavArea::ClearSearchLists();
+
+	startArea->AddToOpenList();
+	startArea->SetTotalCost( 0.0f );
+	startArea->Mark();
+	IncreaseDanger( startArea->GetID(), event->teamID, event->amount );
+
+	while( !CNavArea::IsOpenListEmpty() )
+	{
+		// get next area to check
+		CNavArea *area = CNavArea::PopOpenList();
+
+		// explore adjacent areas
+		for( int dir=0; dir<NUM_DIRECTIONS; ++dir )
+		{
+			int count = area->GetAdjacentCount( (NavDirType)dir );
+			for( int i=0; i<count; ++i )
+			{
+				CNavArea *adjArea = area->GetAdjacentArea( (NavDirType)dir, i );
+
+				if (!adjArea->IsMarked())
+				{
+					// compute distance from danger source
+					float cost = (*adjArea->GetCenter() - event->pos).Length();
+					if (cost <= event->maxRadius)
+					{
+						adjArea->AddToOpenList();
+						adjArea->SetTotalCost( cost );
+						adjArea->Mark();
+						IncreaseDanger( adjArea->GetID(), event->teamID, event->amount * cost/event->maxRadius );
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,58 @@
+// nav_danger.h
+// Per-team danger of each nav area, decayed as it is read
+
+#ifndef _NAV_DANGER_H_
+#define _NAV_DANGER_H_
+
+#include <vector>
+#include "nav.h"
+
+class CNavArea;
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The danger of every nav area, for each team, kept in dense arrays indexed by area ID.
+ * Danger lets bots avoid areas where they died in the past. One kill is 1.0 of danger, and it is
+ * forgotten over two minutes. Each value has the time it was last increased, and the decay since then
+ * is applied when it is read, so nothing ever has to sweep all the areas, and reading never writes -
+ * path searches running on worker threads can read danger freely.
+ *
+ * Danger spread out from an event by IncreaseDangerNearby() is queued, and applied all at once by Update()
+ * at the start of the next frame. Events at the same spot in the same frame are merged.
+ */
+class CNavDangerMap
+{
+public:
+	enum { MAX_TEAMS = 2 };
+
+	float GetDanger( unsigned int areaID, int teamID ) const;	///< return the danger of the area for the team, decayed to now
+	void IncreaseDanger( unsigned int areaID, int teamID, float amount );	///< increase the danger of one area right away
+
+	void QueueNearby( int teamID, float amount, const CNavArea *startArea, const Vector *pos, float maxRadius );	///< increase the danger around a spot at the next Update()
+
+	void Update( void );									///< apply the queued danger - call at the start of each frame
+	void Reset( void );										///< forget all danger - call when the nav mesh is destroyed
+
+	int GetQueuedCount( void ) const						{ return m_queue.size(); }
+
+private:
+	struct DangerEvent
+	{
+		int teamID;
+		float amount;
+		unsigned int startAreaID;							///< the area is found again when the event is applied, in case it was deleted meanwhile
+		Vector pos;
+		float maxRadius;
+	};
+
+	void Spread( const DangerEvent *event );				///< increase the danger of the areas within range of the event
+
+	std::vector< float > m_danger[ MAX_TEAMS ];				///< danger by area ID - zero is no danger
+	std::vector< float > m_timestamp[ MAX_TEAMS ];			///< time when the danger was last increased - used for decaying
+
+	std::vector< DangerEvent > m_queue;
+};
+
+extern CNavDangerMap TheNavDangerMap;
+
+#endif // _NAV_DANGER_H_
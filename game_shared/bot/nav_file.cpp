@@ -20,6 +20,7 @@
 #include <unistd.h>
 #define _write write
 #define _close close
+#define _unlink unlink
 #define MAX_OSPATH PATH_MAX
 #endif
 
@@ -38,6 +39,9 @@
 #include "nav.h"
 #include "nav_node.h"
 #include "nav_area.h"
+#include "nav_visibility.h"
+
+#include "filesystem_utils.h"
 
 
 //
@@ -101,6 +105,12 @@ public:
 		m_directory.push_back( place );
 	}
 
+	/// return the number of entries, not counting the zero entry
+	unsigned int GetEntryCount( void ) const
+	{
+		return m_directory.size();
+	}
+
 	/// given an entry, return the Place
 	Place EntryToPlace( EntryType entry ) const
 	{
@@ -174,6 +184,133 @@ private:
 
 static PlaceDirectory placeDirectory;
 
+//--------------------------------------------------------------------------------------------------------------
+//
+// Version 6 and later nav files are laid out in sections, so they can be used straight out of a mapped file.
+//
+// The header is followed by a table giving the offset and length of each section. Each section is
+// an array of fixed-width records, and records refer to each other by their index in those arrays
+// rather than by ID, so loading needs neither a parse nor an ID lookup. The saved area grid is included,
+// so the areas don't have to be added to the grid one at a time either.
+// Everything is stored little-endian, the byte order of every platform the game runs on.
+// Version 7 added the visibility sections to the end of the table; a version 6 table stops before them.
+//
+enum NavFileSectionType
+{
+	NAV_SECTION_PLACES,										///< NavFilePlace, indexed from 1 by NavFileArea::place
+	NAV_SECTION_AREAS,										///< NavFileArea
+	NAV_SECTION_CONNECTIONS,								///< area index, for each direction of each area
+	NAV_SECTION_SPOTS,										///< NavFileSpot
+	NAV_SECTION_APPROACHES,									///< NavFileApproach
+	NAV_SECTION_ENCOUNTERS,									///< NavFileEncounter
+	NAV_SECTION_SPOT_ORDERS,								///< NavFileSpotOrder
+	NAV_SECTION_GRID_CELLS,									///< first entry of each grid cell in NAV_SECTION_GRID_AREAS, plus one past the last
+	NAV_SECTION_GRID_AREAS,									///< area index
+	NAV_SECTION_VISIBILITY_ROWS,							///< start of each area's row in NAV_SECTION_VISIBILITY_DATA, plus one past the last - may be empty
+	NAV_SECTION_VISIBILITY_DATA,							///< compressed rows of CNavVisibility, padded to a multiple of 4 bytes
+
+	NAV_SECTION_COUNT
+};
+
+#define NAV_FIRST_SECTIONED_VERSION 6
+
+/// return the number of sections in the table of a sectioned nav file of the given version
+inline int GetNavFileSectionCount( unsigned int version )
+{
+	return (version >= 7) ? NAV_SECTION_COUNT : NAV_SECTION_VISIBILITY_ROWS;
+}
+
+struct NavFileSection
+{
+	unsigned int offset;									///< from the start of the file
+	unsigned int length;									///< in bytes
+};
+
+struct NavFileHeader
+{
+	unsigned int magic;										///< these three match the start of older versions
+	unsigned int version;
+	unsigned int bspSize;
+
+	int gridSizeX;
+	int gridSizeY;
+	float gridMinX;
+	float gridMinY;
+	float gridCellSize;
+
+	NavFileSection section[ NAV_SECTION_COUNT ];
+};
+
+struct NavFilePlace
+{
+	char name[64];
+};
+
+struct NavFileArea
+{
+	unsigned int id;
+	float lo[3];
+	float hi[3];
+	float neZ;
+	float swZ;
+
+	unsigned int firstConnection;
+	unsigned int firstSpot;
+	unsigned int firstApproach;
+	unsigned int firstEncounter;
+	unsigned short connectionCount[ NUM_DIRECTIONS ];
+	unsigned int encounterCount;
+
+	unsigned short place;									///< 0 for no place
+	unsigned short spotCount;
+	unsigned char approachCount;
+	unsigned char attributes;
+	unsigned char pad[2];
+};
+
+struct NavFileSpot
+{
+	unsigned int id;
+	float pos[3];
+	unsigned char flags;
+	unsigned char pad[3];
+};
+
+struct NavFileApproach
+{
+	int here;												///< area index, or -1
+	int prev;
+	int next;
+	unsigned char prevToHereHow;
+	unsigned char hereToNextHow;
+	unsigned char pad[2];
+};
+
+struct NavFileEncounter
+{
+	int from;												///< area index
+	int to;
+	unsigned int firstSpotOrder;
+	unsigned short spotOrderCount;
+	unsigned char fromDir;
+	unsigned char toDir;
+};
+
+struct NavFileSpotOrder
+{
+	unsigned int spot;										///< spot index
+	float t;
+};
+
+static_assert( sizeof(NavFileHeader) == 32 + NAV_SECTION_COUNT * sizeof(NavFileSection), "nav file header must not be padded" );
+static_assert( sizeof(NavFilePlace) == 64, "nav file place must not be padded" );
+static_assert( sizeof(NavFileArea) == 72, "nav file area must not be padded" );
+static_assert( sizeof(NavFileSpot) == 20, "nav file spot must not be padded" );
+static_assert( sizeof(NavFileApproach) == 16, "nav file approach must not be padded" );
+static_assert( sizeof(NavFileEncounter) == 16, "nav file encounter must not be padded" );
+static_assert( sizeof(NavFileSpotOrder) == 8, "nav file spot order must not be padded" );
+
+
 
 //--------------------------------------------------------------------------------------------------------------
 /**
@@ -563,6 +700,21 @@ void CNavArea::Load( SteamFile *file, unsigned int version )
 	SetPlace( placeDirectory.EntryToPlace( entry ) );
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Compute the path segment of an encounter, which isn't saved, from the portals to its areas
+ */
+void CNavArea::ComputeEncounterPath( SpotEncounter *e ) const
+{
+	float halfWidth;
+	ComputePortal( e->to.area, e->toDir, &e->path.to, &halfWidth );
+	ComputePortal( e->from.area, e->fromDir, &e->path.from, &halfWidth );
+
+	const float eyeHeight = HalfHumanHeight;
+	e->path.from.z = e->from.area->GetZ( &e->path.from ) + eyeHeight;
+	e->path.to.z = e->to.area->GetZ( &e->path.to ) + eyeHeight;
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Convert loaded IDs to pointers
@@ -636,16 +788,7 @@ NavErrorType CNavArea::PostLoad( void )
 		}
 
 		if (e->from.area && e->to.area)
-		{
-			// compute path
-			float halfWidth;
-			ComputePortal( e->to.area, e->toDir, &e->path.to, &halfWidth );
-			ComputePortal( e->from.area, e->fromDir, &e->path.from, &halfWidth );
-
-			const float eyeHeight = HalfHumanHeight;
-			e->path.from.z = e->from.area->GetZ( &e->path.from ) + eyeHeight;
-			e->path.to.z = e->to.area->GetZ( &e->path.to ) + eyeHeight;
-		}
+			ComputeEncounterPath( e );
 
 		// resolve HidingSpot IDs
 		for( SpotOrderList::iterator oiter = e->spotList.begin(); oiter != e->spotList.end(); ++oiter )
@@ -677,6 +820,653 @@ NavErrorType CNavArea::PostLoad( void )
 	return error;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Write the navigation mesh to the opened file in the sectioned layout of NAV_FILE_VERSION
+ */
+bool SaveNavigationMapSections( int fd, unsigned int bspSize )
+{
+	//
+	// Give areas and hiding spots the indices they are stored at, which are used instead of their IDs
+	//
+	std::vector< CNavArea * > area( TheNavAreaList.begin(), TheNavAreaList.end() );
+
+	unsigned int maxID = 0;
+	for( unsigned int i=0; i<area.size(); ++i )
+		if (area[i]->GetID() > maxID)
+			maxID = area[i]->GetID();
+
+	std::vector< int > areaIndex( maxID+1, -1 );
+	for( unsigned int i=0; i<area.size(); ++i )
+		areaIndex[ area[i]->GetID() ] = i;
+
+	maxID = 0;
+	for( HidingSpotList::iterator it = TheHidingSpotList.begin(); it != TheHidingSpotList.end(); ++it )
+		if ((*it)->GetID() > maxID)
+			maxID = (*it)->GetID();
+
+	std::vector< unsigned int > spotIndex( maxID+1, 0xFFFFFFFF );
+	std::vector< NavFileSpot > spot;
+
+	for( unsigned int i=0; i<area.size(); ++i )
+	{
+		const HidingSpotList *spotList = area[i]->GetHidingSpotList();
+		for( HidingSpotList::const_iterator it = spotList->begin(); it != spotList->end(); ++it )
+		{
+			const HidingSpot *hidingSpot = *it;
+
+			NavFileSpot out;
+			memset( &out, 0, sizeof(out) );
+			out.id = hidingSpot->GetID();
+			out.pos[0] = hidingSpot->GetPosition()->x;
+			out.pos[1] = hidingSpot->GetPosition()->y;
+			out.pos[2] = hidingSpot->GetPosition()->z;
+			out.flags = hidingSpot->GetFlags();
+
+			spotIndex[ out.id ] = spot.size();
+			spot.push_back( out );
+		}
+	}
+
+	//
+	// Build a directory of the Places in this map
+	//
+	placeDirectory.Reset();
+
+	for( unsigned int i=0; i<area.size(); ++i )
+		placeDirectory.AddPlace( area[i]->GetPlace() );
+
+	std::vector< NavFilePlace > place( placeDirectory.GetEntryCount() );
+	for( unsigned int i=0; i<place.size(); ++i )
+	{
+		memset( &place[i], 0, sizeof(NavFilePlace) );
+
+		const char *placeName = TheBotPhrases->IDToName( placeDirectory.EntryToPlace( i+1 ) );
+		if (placeName)
+			strncpy( place[i].name, placeName, sizeof(place[i].name)-1 );
+	}
+
+	//
+	// Store the areas and everything they refer to
+	//
+	std::vector< NavFileArea > fileArea( area.size() );
+	std::vector< unsigned int > connection;
+	std::vector< NavFileApproach > approach;
+	std::vector< NavFileEncounter > encounter;
+	std::vector< NavFileSpotOrder > spotOrder;
+
+	unsigned int firstSpot = 0;
+	for( unsigned int i=0; i<area.size(); ++i )
+	{
+		const CNavArea *in = area[i];
+		NavFileArea *out = &fileArea[i];
+
+		memset( out, 0, sizeof(NavFileArea) );
+		out->id = in->m_id;
+		out->lo[0] = in->m_extent.lo.x;
+		out->lo[1] = in->m_extent.lo.y;
+		out->lo[2] = in->m_extent.lo.z;
+		out->hi[0] = in->m_extent.hi.x;
+		out->hi[1] = in->m_extent.hi.y;
+		out->hi[2] = in->m_extent.hi.z;
+		out->neZ = in->m_neZ;
+		out->swZ = in->m_swZ;
+		out->attributes = in->m_attributeFlags;
+		out->place = placeDirectory.GetEntry( in->GetPlace() );
+
+		// connections, in the enum order NORTH, EAST, SOUTH, WEST
+		out->firstConnection = connection.size();
+		for( int d=0; d<NUM_DIRECTIONS; d++ )
+		{
+			for( NavConnectList::const_iterator it = in->m_connect[d].begin(); it != in->m_connect[d].end(); ++it )
+				connection.push_back( areaIndex[ (*it).area->m_id ] );
+
+			out->connectionCount[d] = in->m_connect[d].size();
+		}
+
+		out->firstSpot = firstSpot;
+		out->spotCount = in->m_hidingSpotList.size();
+		firstSpot += out->spotCount;
+
+		out->firstApproach = approach.size();
+		out->approachCount = in->m_approachCount;
+		for( int a=0; a<in->m_approachCount; ++a )
+		{
+			const CNavArea::ApproachInfo *info = &in->m_approach[a];
+
+			NavFileApproach outApproach;
+			memset( &outApproach, 0, sizeof(outApproach) );
+			outApproach.here = (info->here.area) ? areaIndex[ info->here.area->m_id ] : -1;
+			outApproach.prev = (info->prev.area) ? areaIndex[ info->prev.area->m_id ] : -1;
+			outApproach.next = (info->next.area) ? areaIndex[ info->next.area->m_id ] : -1;
+			outApproach.prevToHereHow = (unsigned char)info->prevToHereHow;
+			outApproach.hereToNextHow = (unsigned char)info->hereToNextHow;
+
+			approach.push_back( outApproach );
+		}
+
+		out->firstEncounter = encounter.size();
+		out->encounterCount = in->m_spotEncounterList.size();
+		for( SpotEncounterList::const_iterator it = in->m_spotEncounterList.begin(); it != in->m_spotEncounterList.end(); ++it )
+		{
+			const SpotEncounter *e = &(*it);
+
+			NavFileEncounter outEncounter;
+			outEncounter.from = (e->from.area) ? areaIndex[ e->from.area->m_id ] : -1;
+			outEncounter.to = (e->to.area) ? areaIndex[ e->to.area->m_id ] : -1;
+			outEncounter.fromDir = (unsigned char)e->fromDir;
+			outEncounter.toDir = (unsigned char)e->toDir;
+			outEncounter.firstSpotOrder = spotOrder.size();
+
+			for( SpotOrderList::const_iterator oiter = e->spotList.begin(); oiter != e->spotList.end(); ++oiter )
+			{
+				// order->spot may be NULL if we've loaded a nav mesh that has been edited but not re-analyzed
+				const SpotOrder *order = &(*oiter);
+				if (order->spot == NULL || spotIndex[ order->spot->GetID() ] == 0xFFFFFFFF)
+					continue;
+
+				if (spotOrder.size() - outEncounter.firstSpotOrder == 0xFFFF)
+				{
+					CONSOLE_ECHO( "Warning: NavArea #%d: Truncated encounter spot list to %d\n", in->m_id, 0xFFFF );
+					break;
+				}
+
+				NavFileSpotOrder outOrder;
+				outOrder.spot = spotIndex[ order->spot->GetID() ];
+				outOrder.t = order->t;
+
+				spotOrder.push_back( outOrder );
+			}
+
+			outEncounter.spotOrderCount = spotOrder.size() - outEncounter.firstSpotOrder;
+
+			encounter.push_back( outEncounter );
+		}
+	}
+
+	//
+	// Store the grid, so the loader needn't work out which cells each area covers
+	//
+	std::vector< unsigned int > gridCell;
+	std::vector< unsigned int > gridArea;
+
+	for( int y=0; y<TheNavAreaGrid.GetGridSizeY(); ++y )
+	{
+		for( int x=0; x<TheNavAreaGrid.GetGridSizeX(); ++x )
+		{
+			gridCell.push_back( gridArea.size() );
+
+			const NavAreaList *cell = TheNavAreaGrid.GetCell( x, y );
+			for( NavAreaList::const_iterator it = cell->begin(); it != cell->end(); ++it )
+				gridArea.push_back( areaIndex[ (*it)->GetID() ] );
+		}
+	}
+	gridCell.push_back( gridArea.size() );
+
+	//
+	// Store the visibility set, if it was computed for the areas being saved
+	//
+	std::vector< unsigned int > visRow;
+	std::vector< unsigned char > visData;
+
+	if (TheNavVisibility.IsBuiltFor( area ))
+	{
+		visRow = TheNavVisibility.GetRowStarts();
+		visData = TheNavVisibility.GetData();
+
+		while( visData.size() % 4 )
+			visData.push_back( 0 );
+	}
+
+	//
+	// Lay out the sections after the header, and write everything out
+	//
+	NavFileHeader header;
+	memset( &header, 0, sizeof(header) );
+	header.magic = NAV_MAGIC_NUMBER;
+	header.version = NAV_FILE_VERSION;
+	header.bspSize = bspSize;
+	header.gridSizeX = TheNavAreaGrid.GetGridSizeX();
+	header.gridSizeY = TheNavAreaGrid.GetGridSizeY();
+	header.gridMinX = TheNavAreaGrid.GetMinX();
+	header.gridMinY = TheNavAreaGrid.GetMinY();
+	header.gridCellSize = TheNavAreaGrid.GetCellSize();
+
+	const void *sectionData[ NAV_SECTION_COUNT ];
+	sectionData[ NAV_SECTION_PLACES ] = place.data();
+	sectionData[ NAV_SECTION_AREAS ] = fileArea.data();
+	sectionData[ NAV_SECTION_CONNECTIONS ] = connection.data();
+	sectionData[ NAV_SECTION_SPOTS ] = spot.data();
+	sectionData[ NAV_SECTION_APPROACHES ] = approach.data();
+	sectionData[ NAV_SECTION_ENCOUNTERS ] = encounter.data();
+	sectionData[ NAV_SECTION_SPOT_ORDERS ] = spotOrder.data();
+	sectionData[ NAV_SECTION_GRID_CELLS ] = gridCell.data();
+	sectionData[ NAV_SECTION_GRID_AREAS ] = gridArea.data();
+	sectionData[ NAV_SECTION_VISIBILITY_ROWS ] = visRow.data();
+	sectionData[ NAV_SECTION_VISIBILITY_DATA ] = visData.data();
+
+	header.section[ NAV_SECTION_PLACES ].length = place.size() * sizeof(NavFilePlace);
+	header.section[ NAV_SECTION_AREAS ].length = fileArea.size() * sizeof(NavFileArea);
+	header.section[ NAV_SECTION_CONNECTIONS ].length = connection.size() * sizeof(unsigned int);
+	header.section[ NAV_SECTION_SPOTS ].length = spot.size() * sizeof(NavFileSpot);
+	header.section[ NAV_SECTION_APPROACHES ].length = approach.size() * sizeof(NavFileApproach);
+	header.section[ NAV_SECTION_ENCOUNTERS ].length = encounter.size() * sizeof(NavFileEncounter);
+	header.section[ NAV_SECTION_SPOT_ORDERS ].length = spotOrder.size() * sizeof(NavFileSpotOrder);
+	header.section[ NAV_SECTION_GRID_CELLS ].length = gridCell.size() * sizeof(unsigned int);
+	header.section[ NAV_SECTION_GRID_AREAS ].length = gridArea.size() * sizeof(unsigned int);
+	header.section[ NAV_SECTION_VISIBILITY_ROWS ].length = visRow.size() * sizeof(unsigned int);
+	header.section[ NAV_SECTION_VISIBILITY_DATA ].length = visData.size();
+
+	unsigned int offset = sizeof(NavFileHeader);
+	for( int s=0; s<NAV_SECTION_COUNT; ++s )
+	{
+		header.section[s].offset = offset;
+		offset += header.section[s].length;
+	}
+
+	if (_write( fd, &header, sizeof(header) ) != sizeof(header))
+		return false;
+
+	for( int s=0; s<NAV_SECTION_COUNT; ++s )
+	{
+		int length = header.section[s].length;
+		if (length && _write( fd, sectionData[s], length ) != length)
+			return false;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Warn everyone if the map has changed since the nav file was made for it
+ */
+static bool CheckBspSize( const char *filename, unsigned int saveBspSize )
+{
+	// verify size
+	char *bspFilename = GetBspFilename( filename );
+	if (bspFilename == NULL)
+		return false;
+
+	unsigned int bspSize = (unsigned int)GET_FILE_SIZE( bspFilename );
+
+	if (bspSize != saveBspSize)
+	{
+		// this nav file is out of date for this bsp file
+		char *msg = "*** WARNING ***\nThe AI navigation data is from a different version of this map.\nThe CPU players will likely not perform well.\n";
+		HintMessageToAllPlayers( msg );
+		CONSOLE_ECHO( "\n-----------------\n" );
+		CONSOLE_ECHO( msg );
+		CONSOLE_ECHO( "-----------------\n\n" );
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Create the navigation mesh from a file in the sectioned layout of NAV_FIRST_SECTIONED_VERSION or later.
+ * The records are read where they lie, so 'data' can be a mapped view of the file.
+ * Ladders are not included, and must be built afterwards.
+ */
+NavErrorType LoadNavigationMapSections( const unsigned char *data, unsigned int size, const char *filename )
+{
+	const NavFileHeader *header = reinterpret_cast<const NavFileHeader *>( data );
+
+	if (size < sizeof(NavFileHeader) - sizeof(header->section) || header->magic != NAV_MAGIC_NUMBER ||
+		header->version < NAV_FIRST_SECTIONED_VERSION || header->version > NAV_FILE_VERSION)
+	{
+		CONSOLE_ECHO( "ERROR: Invalid navigation file '%s'.\n", filename );
+		return NAV_INVALID_FILE;
+	}
+
+	// older versions have fewer sections, and the ones they lack are left empty
+	int fileSectionCount = GetNavFileSectionCount( header->version );
+
+	if (size < sizeof(NavFileHeader) - sizeof(header->section) + fileSectionCount * sizeof(NavFileSection))
+	{
+		CONSOLE_ECHO( "ERROR: Invalid navigation file '%s'.\n", filename );
+		return NAV_INVALID_FILE;
+	}
+
+	// find the sections, and make sure they lie within the file
+	static const unsigned int recordSize[ NAV_SECTION_COUNT ] =
+	{
+		sizeof(NavFilePlace),
+		sizeof(NavFileArea),
+		sizeof(unsigned int),
+		sizeof(NavFileSpot),
+		sizeof(NavFileApproach),
+		sizeof(NavFileEncounter),
+		sizeof(NavFileSpotOrder),
+		sizeof(unsigned int),
+		sizeof(unsigned int),
+		sizeof(unsigned int),
+		sizeof(unsigned char),
+	};
+
+	const unsigned char *sectionData[ NAV_SECTION_COUNT ];
+	unsigned int sectionCount[ NAV_SECTION_COUNT ];
+
+	for( int s=0; s<NAV_SECTION_COUNT; ++s )
+	{
+		if (s >= fileSectionCount)
+		{
+			sectionData[s] = data;
+			sectionCount[s] = 0;
+			continue;
+		}
+
+		const NavFileSection *section = &header->section[s];
+
+		if (section->offset > size || section->length > size - section->offset || section->offset % 4 || section->length % recordSize[s])
+		{
+			CONSOLE_ECHO( "ERROR: Invalid navigation file '%s'.\n", filename );
+			return NAV_INVALID_FILE;
+		}
+
+		sectionData[s] = data + section->offset;
+		sectionCount[s] = section->length / recordSize[s];
+	}
+
+	const NavFilePlace *filePlace = reinterpret_cast<const NavFilePlace *>( sectionData[ NAV_SECTION_PLACES ] );
+	const NavFileArea *fileArea = reinterpret_cast<const NavFileArea *>( sectionData[ NAV_SECTION_AREAS ] );
+	const unsigned int *connection = reinterpret_cast<const unsigned int *>( sectionData[ NAV_SECTION_CONNECTIONS ] );
+	const NavFileSpot *fileSpot = reinterpret_cast<const NavFileSpot *>( sectionData[ NAV_SECTION_SPOTS ] );
+	const NavFileApproach *approach = reinterpret_cast<const NavFileApproach *>( sectionData[ NAV_SECTION_APPROACHES ] );
+	const NavFileEncounter *encounter = reinterpret_cast<const NavFileEncounter *>( sectionData[ NAV_SECTION_ENCOUNTERS ] );
+	const NavFileSpotOrder *spotOrder = reinterpret_cast<const NavFileSpotOrder *>( sectionData[ NAV_SECTION_SPOT_ORDERS ] );
+	const unsigned int *gridCell = reinterpret_cast<const unsigned int *>( sectionData[ NAV_SECTION_GRID_CELLS ] );
+	const unsigned int *gridArea = reinterpret_cast<const unsigned int *>( sectionData[ NAV_SECTION_GRID_AREAS ] );
+	const unsigned int *visRow = reinterpret_cast<const unsigned int *>( sectionData[ NAV_SECTION_VISIBILITY_ROWS ] );
+
+	unsigned int areaCount = sectionCount[ NAV_SECTION_AREAS ];
+	unsigned int spotCount = sectionCount[ NAV_SECTION_SPOTS ];
+
+	if (!CheckBspSize( filename, header->bspSize ))
+		return NAV_INVALID_FILE;
+
+	// look up the Places by name, as their IDs may have changed
+	std::vector< Place > place( sectionCount[ NAV_SECTION_PLACES ] );
+	for( unsigned int i=0; i<place.size(); ++i )
+	{
+		char placeName[ sizeof(filePlace[i].name) ];
+		memcpy( placeName, filePlace[i].name, sizeof(placeName) );
+		placeName[ sizeof(placeName)-1 ] = '\0';
+
+		place[i] = TheBotPhrases->NameToID( placeName );
+	}
+
+	// return true if the range [first, first+count) lies within an array of 'total' records
+	auto isInRange = []( unsigned int first, unsigned int count, unsigned int total )
+	{
+		return (first <= total && count <= total - first);
+	};
+
+	NavErrorType error = NAV_OK;
+
+	//
+	// Create the areas and their hiding spots
+	//
+	std::vector< CNavArea * > area( areaCount );
+	std::vector< HidingSpot * > spot( spotCount, (HidingSpot *)NULL );
+
+	Extent extent;
+	extent.lo.x = 9999999999.9f;
+	extent.lo.y = 9999999999.9f;
+	extent.hi.x = -9999999999.9f;
+	extent.hi.y = -9999999999.9f;
+
+	for( unsigned int i=0; i<areaCount; ++i )
+	{
+		const NavFileArea *in = &fileArea[i];
+
+		CNavArea *out = new CNavArea;
+		TheNavAreaList.push_back( out );
+		area[i] = out;
+
+		out->m_id = in->id;
+
+		// update nextID to avoid collisions
+		if (out->m_id >= CNavArea::m_nextID)
+			CNavArea::m_nextID = out->m_id+1;
+
+		out->m_attributeFlags = in->attributes;
+
+		out->m_extent.lo = Vector( in->lo[0], in->lo[1], in->lo[2] );
+		out->m_extent.hi = Vector( in->hi[0], in->hi[1], in->hi[2] );
+		out->m_center = (out->m_extent.lo + out->m_extent.hi)/2.0f;
+		out->m_neZ = in->neZ;
+		out->m_swZ = in->swZ;
+
+		out->SetPlace( (in->place && in->place <= place.size()) ? place[ in->place-1 ] : UNDEFINED_PLACE );
+
+		// check validity of nav area
+		if (out->m_extent.lo.x >= out->m_extent.hi.x || out->m_extent.lo.y >= out->m_extent.hi.y)
+			CONSOLE_ECHO( "WARNING: Degenerate Navigation Area #%d at ( %g, %g, %g )\n", 
+											out->GetID(), out->m_center.x, out->m_center.y, out->m_center.z );
+
+		if (out->m_extent.lo.x < extent.lo.x)
+			extent.lo.x = out->m_extent.lo.x;
+		if (out->m_extent.lo.y < extent.lo.y)
+			extent.lo.y = out->m_extent.lo.y;
+		if (out->m_extent.hi.x > extent.hi.x)
+			extent.hi.x = out->m_extent.hi.x;
+		if (out->m_extent.hi.y > extent.hi.y)
+			extent.hi.y = out->m_extent.hi.y;
+
+		if (!isInRange( in->firstSpot, in->spotCount, spotCount ))
+		{
+			error = NAV_CORRUPT_DATA;
+			continue;
+		}
+
+		for( unsigned int s=in->firstSpot; s<in->firstSpot + in->spotCount; ++s )
+		{
+			Vector pos( fileSpot[s].pos[0], fileSpot[s].pos[1], fileSpot[s].pos[2] );
+
+			spot[s] = new HidingSpot( &pos, fileSpot[s].flags, fileSpot[s].id );
+			out->m_hidingSpotList.push_back( spot[s] );
+		}
+	}
+
+	//
+	// Connect the areas together, now that they all exist
+	//
+	for( unsigned int i=0; i<areaCount && error == NAV_OK; ++i )
+	{
+		const NavFileArea *in = &fileArea[i];
+		CNavArea *out = area[i];
+
+		unsigned int c = in->firstConnection;
+		for( int d=0; d<NUM_DIRECTIONS; d++ )
+		{
+			if (!isInRange( c, in->connectionCount[d], sectionCount[ NAV_SECTION_CONNECTIONS ] ))
+			{
+				error = NAV_CORRUPT_DATA;
+				break;
+			}
+
+			for( unsigned int end = c + in->connectionCount[d]; c < end; ++c )
+			{
+				if (connection[c] >= areaCount)
+				{
+					error = NAV_CORRUPT_DATA;
+					break;
+				}
+
+				NavConnect connect;
+				connect.area = area[ connection[c] ];
+				out->m_connect[d].push_back( connect );
+			}
+		}
+
+		// approach areas
+		if (in->approachCount > CNavArea::MAX_APPROACH_AREAS || !isInRange( in->firstApproach, in->approachCount, sectionCount[ NAV_SECTION_APPROACHES ] ))
+		{
+			error = NAV_CORRUPT_DATA;
+			break;
+		}
+
+		out->m_approachCount = in->approachCount;
+		for( int a=0; a<in->approachCount; ++a )
+		{
+			const NavFileApproach *inApproach = &approach[ in->firstApproach + a ];
+			CNavArea::ApproachInfo *info = &out->m_approach[a];
+
+			if (inApproach->here >= (int)areaCount || inApproach->prev >= (int)areaCount || inApproach->next >= (int)areaCount)
+			{
+				error = NAV_CORRUPT_DATA;
+				break;
+			}
+
+			info->here.area = (inApproach->here >= 0) ? area[ inApproach->here ] : NULL;
+			info->prev.area = (inApproach->prev >= 0) ? area[ inApproach->prev ] : NULL;
+			info->next.area = (inApproach->next >= 0) ? area[ inApproach->next ] : NULL;
+			info->prevToHereHow = (NavTraverseType)inApproach->prevToHereHow;
+			info->hereToNextHow = (NavTraverseType)inApproach->hereToNextHow;
+		}
+
+		// encounter paths
+		if (!isInRange( in->firstEncounter, in->encounterCount, sectionCount[ NAV_SECTION_ENCOUNTERS ] ))
+		{
+			error = NAV_CORRUPT_DATA;
+			break;
+		}
+
+		for( unsigned int e=in->firstEncounter; e<in->firstEncounter + in->encounterCount; ++e )
+		{
+			const NavFileEncounter *inEncounter = &encounter[e];
+
+			if (inEncounter->from < 0 || inEncounter->from >= (int)areaCount || inEncounter->to < 0 || inEncounter->to >= (int)areaCount ||
+				!isInRange( inEncounter->firstSpotOrder, inEncounter->spotOrderCount, sectionCount[ NAV_SECTION_SPOT_ORDERS ] ))
+			{
+				error = NAV_CORRUPT_DATA;
+				break;
+			}
+
+			out->m_spotEncounterList.push_back( SpotEncounter() );
+			SpotEncounter *outEncounter = &out->m_spotEncounterList.back();
+
+			outEncounter->from.area = area[ inEncounter->from ];
+			outEncounter->fromDir = static_cast<NavDirType>( inEncounter->fromDir );
+			outEncounter->to.area = area[ inEncounter->to ];
+			outEncounter->toDir = static_cast<NavDirType>( inEncounter->toDir );
+
+			out->ComputeEncounterPath( outEncounter );
+
+			for( unsigned int s=inEncounter->firstSpotOrder; s<inEncounter->firstSpotOrder + inEncounter->spotOrderCount; ++s )
+			{
+				if (spotOrder[s].spot >= spotCount || spot[ spotOrder[s].spot ] == NULL)
+				{
+					error = NAV_CORRUPT_DATA;
+					break;
+				}
+
+				SpotOrder order;
+				order.spot = spot[ spotOrder[s].spot ];
+				order.t = spotOrder[s].t;
+
+				outEncounter->spotList.push_back( order );
+			}
+		}
+	}
+
+	if (error != NAV_OK)
+	{
+		CONSOLE_ECHO( "ERROR: Corrupt navigation data in '%s'.\n", filename );
+		DestroyNavigationMap();
+		return error;
+	}
+
+	//
+	// Add the areas to the grid, straight into their saved cells if the grid is still laid out the same way
+	//
+	int gridSizeX = header->gridSizeX;
+	int gridSizeY = header->gridSizeY;
+	unsigned int gridCellCount = (gridSizeX > 0 && gridSizeY > 0) ? gridSizeX * gridSizeY : 0;
+
+	bool isSavedGridValid = (gridCellCount && header->gridCellSize == TheNavAreaGrid.GetCellSize() &&
+							 sectionCount[ NAV_SECTION_GRID_CELLS ] == gridCellCount + 1 &&
+							 gridCell[ gridCellCount ] <= sectionCount[ NAV_SECTION_GRID_AREAS ]);
+
+	for( unsigned int c=0; c<gridCellCount && isSavedGridValid; ++c )
+		if (gridCell[c] > gridCell[c+1])
+			isSavedGridValid = false;
+
+	for( unsigned int a=0; a<sectionCount[ NAV_SECTION_GRID_AREAS ] && isSavedGridValid; ++a )
+		if (gridArea[a] >= areaCount)
+			isSavedGridValid = false;
+
+	if (isSavedGridValid)
+	{
+		TheNavAreaGrid.InitializeCells( header->gridMinX, header->gridMinY, gridSizeX, gridSizeY );
+
+		for( int y=0; y<gridSizeY; ++y )
+		{
+			for( int x=0; x<gridSizeX; ++x )
+			{
+				unsigned int c = x + y*gridSizeX;
+				for( unsigned int a=gridCell[c]; a<gridCell[c+1]; ++a )
+					TheNavAreaGrid.AddNavAreaToCell( area[ gridArea[a] ], x, y );
+			}
+		}
+
+		for( unsigned int i=0; i<areaCount; ++i )
+			TheNavAreaGrid.AddNavAreaID( area[i] );
+	}
+	else
+	{
+		TheNavAreaGrid.Initialize( extent.lo.x, extent.hi.x, extent.lo.y, extent.hi.y );
+
+		for( unsigned int i=0; i<areaCount; ++i )
+			TheNavAreaGrid.AddNavArea( area[i] );
+	}
+
+	//
+	// Build overlap lists. Overlapping areas share a grid cell, so only areas in the same cells need testing.
+	//
+	std::vector< CNavArea * > candidate;
+	for( unsigned int i=0; i<areaCount; ++i )
+	{
+		CNavArea *out = area[i];
+
+		int loX, loY, hiX, hiY;
+		TheNavAreaGrid.GetCellRange( out->GetExtent(), &loX, &loY, &hiX, &hiY );
+
+		candidate.clear();
+		for( int y = loY; y <= hiY; ++y )
+		{
+			for( int x = loX; x <= hiX; ++x )
+			{
+				const NavAreaList *cell = TheNavAreaGrid.GetCell( x, y );
+				candidate.insert( candidate.end(), cell->begin(), cell->end() );
+			}
+		}
+
+		// an area may lie in several of the cells
+		std::sort( candidate.begin(), candidate.end() );
+		candidate.erase( std::unique( candidate.begin(), candidate.end() ), candidate.end() );
+
+		for( unsigned int c=0; c<candidate.size(); ++c )
+		{
+			if (candidate[c] != out && out->IsOverlapping( candidate[c] ))
+				out->m_overlapList.push_back( candidate[c] );
+		}
+	}
+
+	//
+	// Install the visibility set, if the file has one. A bad set only costs the traces it would have saved.
+	//
+	if (sectionCount[ NAV_SECTION_VISIBILITY_ROWS ] == areaCount + 1)
+	{
+		if (!TheNavVisibility.Load( area, visRow, sectionData[ NAV_SECTION_VISIBILITY_DATA ], sectionCount[ NAV_SECTION_VISIBILITY_DATA ] ))
+			CONSOLE_ECHO( "Warning: Ignoring invalid visibility data in '%s'.\n", filename );
+	}
+
+	return NAV_OK;
+}
+
 
 //--------------------------------------------------------------------------------------------------------------
 /*
@@ -718,20 +1508,20 @@ bool SaveNavigationMap( const char *filename )
 	//
 	COM_FixSlashes( const_cast<char *>(filename) );
 
+	// write to a temporary file first, so a failed save doesn't destroy the existing file
+	char tempFilename[ MAX_OSPATH ];
+	snprintf( tempFilename, sizeof(tempFilename), "%s.tmp", filename );
+
 #ifdef WIN32
-	int fd = _open( filename, _O_BINARY | _O_CREAT | _O_WRONLY, _S_IREAD | _S_IWRITE );
+	int fd = _open( tempFilename, _O_BINARY | _O_CREAT | _O_TRUNC | _O_WRONLY, _S_IREAD | _S_IWRITE );
 #else
 #define _write write
-	int fd = creat( filename, S_IRUSR | S_IWUSR | S_IRGRP );
+	int fd = creat( tempFilename, S_IRUSR | S_IWUSR | S_IRGRP );
 #endif
 
 	if (fd < 0)
 		return false;
 
-	// store "magic number" to help identify this kind of file
-	unsigned int magic = NAV_MAGIC_NUMBER;
-	_write( fd, &magic, sizeof(unsigned int) );
-
 	// store version number of file
 	// 1 = hiding spots as plain vector array
 	// 2 = hiding spots as HidingSpot objects
@@ -739,61 +1529,44 @@ bool SaveNavigationMap( const char *filename )
 	// 4 = Includes size of source bsp file to verify nav data correlation
 	// ---- Beta Release at V4 -----
 	// 5 = Added Place info
-	unsigned int version = 5;
-	_write( fd, &version, sizeof(unsigned int) );
-
+	// 6 = Sections of fixed-width records that can be used in place, with the area grid
+	// 7 = Added the potential visibility between areas
+	// The magic number, version and bsp size stay at the start of the file in every version.
 
 	// get size of source bsp file and store it in the nav file
 	// so we can test if the bsp changed since the nav file was made
 	char *bspFilename = GetBspFilename( filename );
 	if (bspFilename == NULL)
+	{
+		_close( fd );
+		_unlink( tempFilename );
 		return false;
+	}
 
 	unsigned int bspSize = (unsigned int)GET_FILE_SIZE( bspFilename );
 	CONSOLE_ECHO( "Size of bsp file '%s' is %u bytes.\n", bspFilename, bspSize );
 
-	_write( fd, &bspSize, sizeof(unsigned int) );
-
+	bool isSaved = SaveNavigationMapSections( fd, bspSize );
 
-	//
-	// Build a directory of the Places in this map
-	//
-	placeDirectory.Reset();
+	_close( fd );
 
-	NavAreaList::iterator it;
-	for( it = TheNavAreaList.begin(); it != TheNavAreaList.end(); ++it )
+	if (!isSaved)
 	{
-		CNavArea *area = *it;
-
-		Place place = area->GetPlace();
-
-		if (place)
-		{
-			placeDirectory.AddPlace( place );
-		}
+		_unlink( tempFilename );
+		return false;
 	}
 
-	placeDirectory.Save( fd );
-
-
-	//
-	// Store navigation areas
-	//
-
-	// store number of areas
-	unsigned int count = TheNavAreaList.size();
-	_write( fd, &count, sizeof(unsigned int) );
+#ifdef _WIN32
+	// rename() won't replace an existing file here
+	_unlink( filename );
+#endif
 
-	// store each area
-	for( it = TheNavAreaList.begin(); it != TheNavAreaList.end(); ++it )
+	if (rename( tempFilename, filename ) != 0)
 	{
-		CNavArea *area = *it;
-
-		area->Save( fd, version );
+		_unlink( tempFilename );
+		return false;
 	}
 
-	_close( fd );
-
 
 #ifdef _WIN32
 	// output a simple Wavefront file to visualize the generated areas in 3DSMax
@@ -918,7 +1691,7 @@ void SanityCheckNavigationMap( const char *mapName )
 	// read file version number
 	unsigned int version;
 	result = navFile.Read( &version, sizeof(unsigned int) );
-	if (!result || version > 5)
+	if (!result || version > NAV_FILE_VERSION)
 	{
 		CONSOLE_ECHO( "ERROR: Unknown version in navigation file %s.\n", navFilename );
 		return;
@@ -971,6 +1744,26 @@ NavErrorType LoadNavigationMap( void )
 
 	CNavArea::m_nextID = 1;
 
+	// current nav files are used in place, straight from a mapping of the file
+	FSMappedFile mappedFile;
+	if (mappedFile.Open( filename ) && mappedFile.Size() >= sizeof(unsigned int) * 2)
+	{
+		const unsigned int *header = reinterpret_cast<const unsigned int *>( mappedFile.Data() );
+
+		if (header[0] == NAV_MAGIC_NUMBER && header[1] >= NAV_FIRST_SECTIONED_VERSION && header[1] <= NAV_FILE_VERSION)
+		{
+			NavErrorType error = LoadNavigationMapSections( reinterpret_cast<const unsigned char *>( mappedFile.Data() ), mappedFile.Size(), filename );
+			if (error != NAV_OK)
+				return error;
+
+			BuildLadders();
+			TheNavFlatMesh.Build();
+
+			return NAV_OK;
+		}
+	}
+	mappedFile.Close();
+
 	SteamFile navFile( filename );
 
 	if (!navFile.IsValid())
@@ -989,34 +1782,40 @@ NavErrorType LoadNavigationMap( void )
 	// read file version number
 	unsigned int version;
 	result = navFile.Read( &version, sizeof(unsigned int) );
-	if (!result || version > 5)
+	if (!result || version > NAV_FILE_VERSION)
 	{
 		CONSOLE_ECHO( "ERROR: Unknown navigation file version.\n" );
 		return NAV_BAD_FILE_VERSION;
 	}
 
+	if (version >= NAV_FIRST_SECTIONED_VERSION)
+	{
+		// the file couldn't be mapped, so use the copy the engine loaded
+		int length;
+		byte *data = (byte *)LOAD_FILE_FOR_ME( filename, &length );
+		if (data == NULL)
+			return NAV_CANT_ACCESS_FILE;
+
+		NavErrorType error = LoadNavigationMapSections( data, length, filename );
+		FREE_FILE( data );
+
+		if (error != NAV_OK)
+			return error;
+
+		BuildLadders();
+		TheNavFlatMesh.Build();
+
+		return NAV_OK;
+	}
+
 	if (version >= 4)
 	{
 		// get size of source bsp file and verify that the bsp hasn't changed
 		unsigned int saveBspSize;
 		navFile.Read( &saveBspSize, sizeof(unsigned int) );
 
-		// verify size
-		char *bspFilename = GetBspFilename( filename );
-		if (bspFilename == NULL)
+		if (!CheckBspSize( filename, saveBspSize ))
 			return NAV_INVALID_FILE;
-
-		unsigned int bspSize = (unsigned int)GET_FILE_SIZE( bspFilename );
-
-		if (bspSize != saveBspSize)
-		{
-			// this nav file is out of date for this bsp file
-			char *msg = "*** WARNING ***\nThe AI navigation data is from a different version of this map.\nThe CPU players will likely not perform well.\n";
-			HintMessageToAllPlayers( msg );
-			CONSOLE_ECHO( "\n-----------------\n" );
-			CONSOLE_ECHO( msg );
-			CONSOLE_ECHO( "-----------------\n\n" );
-		}
 	}
 
 	// load Place directory
@@ -1089,5 +1888,10 @@ NavErrorType LoadNavigationMap( void )
 	//
 	BuildLadders();
 
+	//
+	// Pack the finished mesh into flat arrays for the path and hiding spot searches
+	//
+	TheNavFlatMesh.Build();
+
 	return NAV_OK;
 }
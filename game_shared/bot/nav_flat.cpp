@@ -0,0 +1,167 @@
+// nav_flat.cpp
+// Flat, array based copy of the navigation mesh for fast searches
+
+#pragma warning( disable : 4530 )					// STL uses exceptions, but we are not compiling with them - ignore warning
+#pragma warning( disable : 4786 )					// long STL names get truncated in browse info.
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+
+#include "nav.h"
+#include "nav_area.h"
+#include "nav_flat.h"
+#include "nav_path_cache.h"
+
+CNavFlatMesh TheNavFlatMesh;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Discard the flat copy. Searches use the area lists until Build() is called again.
+ */
+void CNavFlatMesh::Reset( void )
+{
+	m_isBuilt = false;
+
+	// the mesh is changing, so paths found on it are stale too
+	CNavPathCache::Invalidate();
+
+	m_area.clear();
+	m_indexByID.clear();
+	m_attributes.clear();
+	m_place.clear();
+
+	m_edgeStart.clear();
+	m_edgeTarget.clear();
+	m_edgeHow.clear();
+	m_edgeLadder.clear();
+
+	m_spotStart.clear();
+	m_spot.clear();
+	m_spotPos.clear();
+	m_spotFlags.clear();
+	m_spotInCrouchArea.clear();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Append an edge to the area currently being built. Edges to NULL areas are dropped here,
+ * so the searches never need to check for them.
+ */
+void CNavFlatMesh::AddEdge( CNavArea *to, NavTraverseType how, const CNavLadder *ladder )
+{
+	if (to == NULL)
+		return;
+
+	int index = GetIndexByID( to->GetID() );
+	if (index < 0)
+		return;
+
+	m_edgeTarget.push_back( index );
+	m_edgeHow.push_back( (unsigned char)how );
+	m_edgeLadder.push_back( ladder );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Build the flat copy from TheNavAreaList.
+ * Must be called after the areas, their connections, ladders and hiding spots are all in place.
+ */
+void CNavFlatMesh::Build( void )
+{
+	Reset();
+
+	int areaCount = TheNavAreaList.size();
+	if (areaCount == 0)
+		return;
+
+	m_area.reserve( areaCount );
+	m_attributes.reserve( areaCount );
+	m_place.reserve( areaCount );
+
+	// assign dense indices
+	unsigned int maxID = 0;
+	NavAreaList::iterator iter;
+	for( iter = TheNavAreaList.begin(); iter != TheNavAreaList.end(); ++iter )
+	{
+		CNavArea *area = *iter;
+
+		if (area->GetID() > maxID)
+			maxID = area->GetID();
+
+		m_area.push_back( area );
+		m_attributes.push_back( area->GetAttributes() );
+		m_place.push_back( area->GetPlace() );
+	}
+
+	m_indexByID.assign( maxID + 1, -1 );
+	for( int i=0; i<areaCount; ++i )
+		m_indexByID[ m_area[i]->GetID() ] = i;
+
+	// store outgoing edges in the order the searches visit them
+	m_edgeStart.reserve( areaCount + 1 );
+	m_spotStart.reserve( areaCount + 1 );
+
+	for( int i=0; i<areaCount; ++i )
+	{
+		CNavArea *area = m_area[i];
+
+		m_edgeStart.push_back( m_edgeTarget.size() );
+
+		for( int dir=0; dir<NUM_DIRECTIONS; ++dir )
+		{
+			const NavConnectList *list = area->GetAdjacentList( (NavDirType)dir );
+			for( NavConnectList::const_iterator connect = list->begin(); connect != list->end(); ++connect )
+				AddEdge( (*connect).area, (NavTraverseType)dir, NULL );
+		}
+
+		NavLadderList::const_iterator ladderIt;
+
+		const NavLadderList *ladderList = area->GetLadderList( LADDER_UP );
+		for( ladderIt = ladderList->begin(); ladderIt != ladderList->end(); ++ladderIt )
+		{
+			const CNavLadder *ladder = *ladderIt;
+
+			// cannot use this ladder if the ladder bottom is hanging above our head
+			if (ladder->m_isDangling)
+				continue;
+
+			// do not use BEHIND connection, as its very hard to get to when going up a ladder
+			AddEdge( ladder->m_topForwardArea, GO_LADDER_UP, ladder );
+			AddEdge( ladder->m_topLeftArea, GO_LADDER_UP, ladder );
+			AddEdge( ladder->m_topRightArea, GO_LADDER_UP, ladder );
+		}
+
+		ladderList = area->GetLadderList( LADDER_DOWN );
+		for( ladderIt = ladderList->begin(); ladderIt != ladderList->end(); ++ladderIt )
+		{
+			const CNavLadder *ladder = *ladderIt;
+
+			AddEdge( ladder->m_bottomArea, GO_LADDER_DOWN, ladder );
+		}
+
+		// store hiding spots, along with whether they lie in a crouch area so queries needn't look it up
+		m_spotStart.push_back( m_spot.size() );
+
+		const HidingSpotList *spotList = area->GetHidingSpotList();
+		for( HidingSpotList::const_iterator spotIt = spotList->begin(); spotIt != spotList->end(); ++spotIt )
+		{
+			const HidingSpot *spot = *spotIt;
+
+			CNavArea *spotArea = TheNavAreaGrid.GetNavArea( spot->GetPosition() );
+
+			m_spot.push_back( spot );
+			m_spotPos.push_back( *spot->GetPosition() );
+			m_spotFlags.push_back( spot->GetFlags() );
+			m_spotInCrouchArea.push_back( (spotArea && (spotArea->GetAttributes() & NAV_CROUCH)) ? 1 : 0 );
+		}
+	}
+
+	m_edgeStart.push_back( m_edgeTarget.size() );
+	m_spotStart.push_back( m_spot.size() );
+
+	m_isBuilt = true;
+}
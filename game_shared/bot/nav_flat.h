@@ -0,0 +1,82 @@
+// nav_flat.h
+// Flat, array based copy of the navigation mesh for fast searches
+
+#ifndef _NAV_FLAT_H_
+#define _NAV_FLAT_H_
+
+#include <vector>
+#include "nav.h"
+
+class CNavArea;
+class CNavLadder;
+class HidingSpot;
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A compacted copy of the navigation mesh connectivity, built once the mesh is complete.
+ * CNavArea keeps its connections, ladders and hiding spots in std::lists, so walking the mesh
+ * jumps all over the heap. Here areas get a dense index and their outgoing edges and hiding spots
+ * are stored in contiguous arrays, in the same order the path search visits them:
+ * floor connections by direction, then usable up ladder tops, then ladder bottoms.
+ *
+ * Any change to the mesh must call Reset(), after which searches fall back to the lists.
+ */
+class CNavFlatMesh
+{
+public:
+	CNavFlatMesh( void )									{ m_isBuilt = false; }
+
+	void Build( void );										///< build from TheNavAreaList - call once the mesh is loaded or generated
+	void Reset( void );										///< discard the flat copy because the mesh is changing
+	bool IsBuilt( void ) const								{ return m_isBuilt; }
+
+	int GetAreaCount( void ) const							{ return m_area.size(); }
+	CNavArea *GetArea( int index ) const					{ return m_area[ index ]; }
+	int GetIndexByID( unsigned int id ) const				///< return the dense index of the area with the given ID, or -1
+	{
+		return (id < m_indexByID.size()) ? m_indexByID[ id ] : -1;
+	}
+
+	unsigned char GetAttributes( int index ) const			{ return m_attributes[ index ]; }
+	Place GetPlace( int index ) const						{ return m_place[ index ]; }
+
+	//- outgoing edges of an area -----------------------------------------------------------------------
+	int GetEdgeBegin( int index ) const						{ return m_edgeStart[ index ]; }
+	int GetEdgeEnd( int index ) const						{ return m_edgeStart[ index+1 ]; }
+	int GetEdgeTarget( int edge ) const						{ return m_edgeTarget[ edge ]; }
+	NavTraverseType GetEdgeHow( int edge ) const			{ return (NavTraverseType)m_edgeHow[ edge ]; }
+	const CNavLadder *GetEdgeLadder( int edge ) const		{ return m_edgeLadder[ edge ]; }	///< NULL for floor connections
+
+	//- hiding spots of an area -------------------------------------------------------------------------
+	int GetSpotBegin( int index ) const						{ return m_spotStart[ index ]; }
+	int GetSpotEnd( int index ) const						{ return m_spotStart[ index+1 ]; }
+	const HidingSpot *GetSpot( int spot ) const				{ return m_spot[ spot ]; }
+	const Vector *GetSpotPosition( int spot ) const			{ return &m_spotPos[ spot ]; }
+	unsigned char GetSpotFlags( int spot ) const			{ return m_spotFlags[ spot ]; }
+	bool IsSpotInCrouchArea( int spot ) const				{ return m_spotInCrouchArea[ spot ] ? true : false; }	///< true if the nav area under the spot is a crouch area
+
+private:
+	void AddEdge( CNavArea *to, NavTraverseType how, const CNavLadder *ladder );
+
+	bool m_isBuilt;
+
+	std::vector< CNavArea * > m_area;						///< areas by dense index
+	std::vector< int > m_indexByID;							///< dense index by area ID, -1 for unused IDs
+	std::vector< unsigned char > m_attributes;
+	std::vector< Place > m_place;
+
+	std::vector< int > m_edgeStart;							///< first edge of each area, plus one past the last edge
+	std::vector< int > m_edgeTarget;						///< dense index of the area the edge leads to
+	std::vector< unsigned char > m_edgeHow;					///< NavTraverseType of the edge
+	std::vector< const CNavLadder * > m_edgeLadder;
+
+	std::vector< int > m_spotStart;							///< first hiding spot of each area, plus one past the last spot
+	std::vector< const HidingSpot * > m_spot;
+	std::vector< Vector > m_spotPos;
+	std::vector< unsigned char > m_spotFlags;
+	std::vector< unsigned char > m_spotInCrouchArea;
+};
+
+extern CNavFlatMesh TheNavFlatMesh;
+
+#endif // _NAV_FLAT_H_
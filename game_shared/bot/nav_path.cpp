@@ -298,19 +298,45 @@ bool CNavPath::FindClosestPointOnPath( const Vector *worldPos, int startIndex, i
 	return true;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find the areas at the ends of a path, and put the path's end position on the ground
+ */
+bool CNavPath::FindEndpoints( const Vector *start, const Vector *goal, Endpoints *ends )
+{
+	if (start == NULL || goal == NULL)
+		return false;
+
+	ends->start = *start;
+	ends->goal = *goal;
+
+	ends->startArea = TheNavAreaGrid.GetNearestNavArea( start );
+	if (ends->startArea == NULL)
+		return false;
+
+	ends->goalArea = TheNavAreaGrid.GetNavArea( goal );
+
+	// make sure path end position is on the ground
+	ends->pathEnd = *goal;
+	if (ends->goalArea)
+		ends->pathEnd.z = ends->goalArea->GetZ( &ends->pathEnd );
+	else
+		GetGroundHeight( &ends->pathEnd, &ends->pathEnd.z );
+
+	return true;
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Build trivial path when start and goal are in the same nav area
  */
-bool CNavPath::BuildTrivialPath( const Vector *start, const Vector *goal )
+bool CNavPath::BuildTrivialPath( CNavArea *startArea, const Vector *start, CNavArea *goalArea, const Vector *goal )
 {
 	m_segmentCount = 0;
 
-	CNavArea *startArea = TheNavAreaGrid.GetNearestNavArea( start );
 	if (startArea == NULL)
 		return false;
 
-	CNavArea *goalArea = TheNavAreaGrid.GetNearestNavArea( goal );
 	if (goalArea == NULL)
 		return false;
 
@@ -52,7 +52,21 @@ public:
 	bool FindClosestPointOnPath( const Vector *worldPos, int startIndex, int endIndex, Vector *close ) const;
 
 	void Optimize( void );
-	
+
+	/**
+	 * The areas and positions at the ends of a path
+	 */
+	struct Endpoints
+	{
+		Vector start;
+		Vector goal;
+		Vector pathEnd;											///< the goal position, on the ground
+		CNavArea *startArea;
+		CNavArea *goalArea;										///< NULL if the goal isn't in any area
+	};
+
+	static bool FindEndpoints( const Vector *start, const Vector *goal, Endpoints *ends );	///< find the ends of a path - uses the engine, so game thread only
+
 	/**
 	 * Compute shortest path from 'start' to 'goal' via A* algorithm
 	 */
@@ -61,28 +75,37 @@ public:
 	{
 		Invalidate();
 
-		if (start == NULL || goal == NULL)
+		Endpoints ends;
+		if (FindEndpoints( start, goal, &ends ) == false)
 			return false;
 
-		CNavArea *startArea = TheNavAreaGrid.GetNearestNavArea( start );
-		if (startArea == NULL)
-			return false;
+		return Compute( ends, costFunc );
+	}
+
+	/**
+	 * Compute shortest path between the ends found by FindEndpoints() via A* algorithm.
+	 * This doesn't use the engine, so it can run on any thread while the mesh isn't changing,
+	 * as long as the cost functor only reads.
+	 */
+	template< typename CostFunctor >
+	bool Compute( const Endpoints &ends, CostFunctor &costFunc )
+	{
+		Invalidate();
 
-		CNavArea *goalArea = TheNavAreaGrid.GetNavArea( goal );
+		CNavArea *startArea = ends.startArea;
+		CNavArea *goalArea = ends.goalArea;
+		const Vector *start = &ends.start;
+		const Vector *goal = &ends.goal;
 
 		// if we are already in the goal area, build trivial path
 		if (startArea == goalArea)
 		{
-			BuildTrivialPath( start, goal );
+			BuildTrivialPath( startArea, start, goalArea, goal );
 			return true;
 		}
 
-		// make sure path end position is on the ground
-		Vector pathEndPosition = *goal;
-		if (goalArea)
-			pathEndPosition.z = goalArea->GetZ( &pathEndPosition );
-		else
-			GetGroundHeight( &pathEndPosition, &pathEndPosition.z );
+		// path end position is on the ground
+		Vector pathEndPosition = ends.pathEnd;
 
 		//
 		// Compute shortest path to goal
@@ -111,7 +134,8 @@ public:
 
 		if (count == 1)
 		{
-			BuildTrivialPath( start, goal );
+			// if the goal isn't in an area, we couldn't get any closer to it than where we are
+			BuildTrivialPath( startArea, start, (goalArea) ? goalArea : startArea, goal );
 			return true;
 		}
 
@@ -148,7 +172,7 @@ private:
 	int m_segmentCount;
 
 	bool ComputePathPositions( void );				///< determine actual path positions 
-	bool BuildTrivialPath( const Vector *start, const Vector *goal );		///< utility function for when start and goal are in the same area
+	bool BuildTrivialPath( CNavArea *startArea, const Vector *start, CNavArea *goalArea, const Vector *goal );	///< utility function for when start and goal are in the same area
 
 	int FindNextOccludedNode( int anchor );		///< used by Optimize()
 };
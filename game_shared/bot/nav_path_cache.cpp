@@ -0,0 +1,246 @@
+// nav_path_cache.cpp
+// Cache of recent path search results
+
+#pragma warning( disable : 4530 )					// STL uses exceptions, but we are not compiling with them - ignore warning
+#pragma warning( disable : 4786 )					// long STL names get truncated in browse info.
+
+#include <atomic>
+#include <algorithm>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+#include "bot_util.h"
+
+#include "nav.h"
+#include "nav_area.h"
+#include "nav_path_cache.h"
+
+/// bumped by Invalidate(), so each thread's cache can tell its entries are stale
+static std::atomic< unsigned int > pathCacheGeneration( 0 );
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavPathCache::CNavPathCache( void )
+{
+	m_capacity = 512;
+	m_generation = pathCacheGeneration;
+
+	ResetCounters();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Empty every thread's cache. Each cache notices the next time it is used.
+ */
+void CNavPathCache::Invalidate( void )
+{
+	++pathCacheGeneration;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathCache::Validate( void )
+{
+	unsigned int generation = pathCacheGeneration;
+
+	if (m_generation != generation)
+	{
+		Clear();
+		m_generation = generation;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathCache::Clear( void )
+{
+	m_entryList.clear();
+	m_index.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathCache::SetCapacity( int capacity )
+{
+	m_capacity = (capacity > 0) ? capacity : 1;
+
+	while( (int)m_index.size() > m_capacity )
+	{
+		m_index.erase( m_entryList.back().key );
+		m_entryList.pop_back();
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathCache::ResetCounters( void )
+{
+	m_pathHitCount = 0;
+	m_pathMissCount = 0;
+	m_distanceHitCount = 0;
+	m_distanceMissCount = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+CNavPathCache::Entry *CNavPathCache::Find( const Key &key )
+{
+	EntryIndex::iterator it = m_index.find( key );
+	if (it == m_index.end())
+		return NULL;
+
+	// move to the front of the list, as the most recently used
+	m_entryList.splice( m_entryList.begin(), m_entryList, it->second );
+
+	return &m_entryList.front();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * If the result of this search is cached, rebuild its parent links in the search and return true.
+ * As with a real search, the path is found by following parent links back from the goal area,
+ * or from 'closestArea' if the goal was not reached.
+ */
+bool CNavPathCache::Lookup( CNavAreaSearch *search, const void *costKey, CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, bool *found, CNavArea **closestArea )
+{
+	Validate();
+
+	Key key = { costKey, startArea, goalArea };
+	Entry *entry = Find( key );
+
+	// a failed search ends at the area closest to the goal position, so it only applies to the same position
+	if (entry && !entry->found)
+	{
+		if (entry->hasGoalPos != (goalPos != NULL) || (goalPos && !(entry->goalPos == *goalPos)))
+			entry = NULL;
+	}
+
+	if (entry == NULL)
+	{
+		++m_pathMissCount;
+		return false;
+	}
+
+	++m_pathHitCount;
+
+	search->ClearSearchLists();
+
+	CNavArea *parent = NULL;
+	for( unsigned int i=0; i<entry->path.size(); ++i )
+	{
+		const Step *step = &entry->path[i];
+
+		search->SetParent( step->area, parent, step->how );
+		search->SetCostSoFar( step->area, step->costSoFar );
+
+		parent = step->area;
+	}
+
+	*found = entry->found;
+	*closestArea = entry->closestArea;
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Remember the result of the search just run, by following its parent links
+ */
+void CNavPathCache::Store( CNavAreaSearch *search, const void *costKey, CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, bool found, CNavArea *closestArea )
+{
+	Validate();
+
+	Key key = { costKey, startArea, goalArea };
+
+	Entry *entry = Find( key );
+	if (entry == NULL)
+	{
+		// make room by discarding the least recently used entry
+		if ((int)m_index.size() >= m_capacity)
+		{
+			m_index.erase( m_entryList.back().key );
+			m_entryList.pop_back();
+		}
+
+		m_entryList.push_front( Entry() );
+		m_index[ key ] = m_entryList.begin();
+
+		entry = &m_entryList.front();
+		entry->key = key;
+	}
+
+	entry->found = found;
+	entry->hasGoalPos = (goalPos != NULL);
+	entry->goalPos = (goalPos) ? *goalPos : Vector( 0, 0, 0 );
+	entry->closestArea = closestArea;
+	entry->hasDistance = false;
+	entry->distance = -1.0f;
+
+	entry->path.clear();
+	for( CNavArea *area = (found) ? goalArea : closestArea; area; area = search->GetParent( area ) )
+	{
+		Step step;
+		step.area = area;
+		step.how = search->GetParentHow( area );
+		step.costSoFar = search->GetCostSoFar( area );
+
+		entry->path.push_back( step );
+	}
+
+	std::reverse( entry->path.begin(), entry->path.end() );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavPathCache::GetTravelDistance( const void *costKey, CNavArea *startArea, CNavArea *goalArea, float *distance )
+{
+	Validate();
+
+	Key key = { costKey, startArea, goalArea };
+	Entry *entry = Find( key );
+
+	if (entry == NULL || !entry->hasDistance)
+	{
+		++m_distanceMissCount;
+		return false;
+	}
+
+	++m_distanceHitCount;
+
+	*distance = entry->distance;
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathCache::SetTravelDistance( const void *costKey, CNavArea *startArea, CNavArea *goalArea, float distance )
+{
+	Validate();
+
+	Key key = { costKey, startArea, goalArea };
+	Entry *entry = Find( key );
+
+	if (entry == NULL)
+		return;
+
+	entry->hasDistance = true;
+	entry->distance = distance;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * "bot_nav_path_cache [size]" - report how well the game thread's path cache is doing, and optionally resize it
+ */
+void NavPathCacheCommand( void )
+{
+	CNavPathCache *cache = CNavAreaSearch::GetCurrent()->GetPathCache();
+
+	if (CMD_ARGC() > 1)
+	{
+		cache->SetCapacity( atoi( CMD_ARGV( 1 ) ) );
+		cache->ResetCounters();
+	}
+
+	unsigned int pathCount = cache->GetPathHitCount() + cache->GetPathMissCount();
+	unsigned int distanceCount = cache->GetDistanceHitCount() + cache->GetDistanceMissCount();
+
+	CONSOLE_ECHO( "Nav path cache: %d of %d entries used\n", cache->GetEntryCount(), cache->GetCapacity() );
+	CONSOLE_ECHO( "  Paths: %u hits, %u misses (%.1f%% hit rate)\n", cache->GetPathHitCount(), cache->GetPathMissCount(),
+					(pathCount) ? 100.0f * cache->GetPathHitCount() / pathCount : 0.0f );
+	CONSOLE_ECHO( "  Travel distances: %u hits, %u misses (%.1f%% hit rate)\n", cache->GetDistanceHitCount(), cache->GetDistanceMissCount(),
+					(distanceCount) ? 100.0f * cache->GetDistanceHitCount() / distanceCount : 0.0f );
+}
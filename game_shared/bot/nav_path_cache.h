@@ -0,0 +1,115 @@
+// nav_path_cache.h
+// Cache of recent path search results
+
+#ifndef _NAV_PATH_CACHE_H_
+#define _NAV_PATH_CACHE_H_
+
+#include <list>
+#include <map>
+#include <vector>
+#include "nav.h"
+
+class CNavArea;
+class CNavAreaSearch;
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Remembers the results of recent path searches, so a search repeated for the same start area,
+ * goal area and cost functor class - as bots on the same team often do - doesn't run the A* again.
+ * Travel distances along the cached paths are kept too.
+ *
+ * Each CNavAreaSearch has its own cache, so caches are only ever used by one thread.
+ * Only cost functors without member data are cached, since then the class alone determines the costs.
+ * Every cache is emptied by Invalidate(), which must be called whenever costs may have changed:
+ * when the mesh changes, when an area is blocked, or when an area's danger increases.
+ * Danger decaying over time does not invalidate the cache.
+ * The least recently used entry is discarded when the cache is full.
+ */
+class CNavPathCache
+{
+public:
+	CNavPathCache( void );
+
+	/// return a key that identifies the cost functor class
+	template< typename CostFunctor >
+	static const void *GetCostKey( void )
+	{
+		static const char key = 0;
+		return &key;
+	}
+
+	bool Lookup( CNavAreaSearch *search, const void *costKey, CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, bool *found, CNavArea **closestArea );	///< if cached, put the path into the search's parent links and return true
+	void Store( CNavAreaSearch *search, const void *costKey, CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, bool found, CNavArea *closestArea );	///< remember the path the search just found
+
+	bool GetTravelDistance( const void *costKey, CNavArea *startArea, CNavArea *goalArea, float *distance );	///< return true if the distance is known
+	void SetTravelDistance( const void *costKey, CNavArea *startArea, CNavArea *goalArea, float distance );	///< the path must have been stored already
+
+	void Clear( void );										///< discard all entries
+	void SetCapacity( int capacity );
+	int GetCapacity( void ) const							{ return m_capacity; }
+	int GetEntryCount( void ) const							{ return m_index.size(); }
+
+	unsigned int GetPathHitCount( void ) const				{ return m_pathHitCount; }
+	unsigned int GetPathMissCount( void ) const				{ return m_pathMissCount; }
+	unsigned int GetDistanceHitCount( void ) const			{ return m_distanceHitCount; }
+	unsigned int GetDistanceMissCount( void ) const			{ return m_distanceMissCount; }
+	void ResetCounters( void );
+
+	static void Invalidate( void );							///< empty every thread's cache - safe to call from any thread
+
+private:
+	struct Key
+	{
+		const void *costKey;
+		CNavArea *startArea;
+		CNavArea *goalArea;
+
+		bool operator<( const Key &other ) const
+		{
+			if (costKey != other.costKey)
+				return costKey < other.costKey;
+			if (startArea != other.startArea)
+				return startArea < other.startArea;
+			return goalArea < other.goalArea;
+		}
+	};
+
+	struct Step
+	{
+		CNavArea *area;
+		NavTraverseType how;								///< how we get to this area from the previous step
+		float costSoFar;
+	};
+
+	struct Entry
+	{
+		Key key;
+		bool found;											///< true if the goal was reached
+		bool hasGoalPos;
+		Vector goalPos;										///< failed searches depend on the goal position, as they end at the closest area to it
+		CNavArea *closestArea;
+		std::vector< Step > path;							///< from the start area to the goal area, or the closest area if the search failed
+		bool hasDistance;
+		float distance;
+	};
+
+	typedef std::list< Entry > EntryList;
+	typedef std::map< Key, EntryList::iterator > EntryIndex;
+
+	void Validate( void );									///< discard all entries if Invalidate() has been called since they were stored
+	Entry *Find( const Key &key );							///< find an entry and make it the most recently used one
+
+	EntryList m_entryList;									///< most recently used first
+	EntryIndex m_index;
+	int m_capacity;
+	unsigned int m_generation;								///< the value of the invalidation count when the entries were stored
+
+	unsigned int m_pathHitCount;
+	unsigned int m_pathMissCount;
+	unsigned int m_distanceHitCount;
+	unsigned int m_distanceMissCount;
+};
+
+extern void NavPathCacheCommand( void );
+
+#endif // _NAV_PATH_CACHE_H_
@@ -0,0 +1,436 @@
+// nav_trace.cpp
+// Thread-safe line traces against the map's BSP, used by offline navigation analysis
+
+#pragma warning( disable : 4530 )					// STL uses exceptions, but we are not compiling with them - ignore warning
+#pragma warning( disable : 4786 )					// long STL names get truncated in browse info.
+
+#include <vector>
+#include <string.h>
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+
+#include "nav.h"
+#include "nav_trace.h"
+#include "bot_util.h"
+
+CNavBspTracer TheNavBspTracer;
+
+//--------------------------------------------------------------------------------------------------------------
+// Just the parts of the version 30 BSP format needed to trace against the point hull
+
+#define BSP_VERSION			30
+#define BSP_LUMP_PLANES		1
+#define BSP_LUMP_NODES		5
+#define BSP_LUMP_LEAFS		10
+#define BSP_LUMP_MODELS		14
+#define BSP_HEADER_LUMPS	15
+
+#define DIST_EPSILON		(0.03125f)
+
+struct BspLump
+{
+	int fileofs, filelen;
+};
+
+struct BspHeader
+{
+	int version;
+	BspLump lumps[ BSP_HEADER_LUMPS ];
+};
+
+struct BspPlane
+{
+	float normal[3];
+	float dist;
+	int type;
+};
+
+struct BspNode
+{
+	int planenum;
+	short children[2];								///< negative numbers are -(leafs+1), not nodes
+	short mins[3];
+	short maxs[3];
+	unsigned short firstface;
+	unsigned short numfaces;
+};
+
+struct BspLeaf
+{
+	int contents;
+	int visofs;
+	short mins[3];
+	short maxs[3];
+	unsigned short firstmarksurface;
+	unsigned short nummarksurfaces;
+	byte ambient_level[4];
+};
+
+struct BspModel
+{
+	float mins[3], maxs[3];
+	float origin[3];
+	int headnode[4];
+	int visleafs;
+	int firstface, numfaces;
+};
+
+/**
+ * Copy a lump out of the file, returning false if it doesn't fit
+ */
+template < typename T >
+static bool CopyLump( const byte *data, int length, const BspLump &lump, std::vector< T > *out )
+{
+	if (lump.fileofs < 0 || lump.filelen < 0 || lump.fileofs + lump.filelen > length || (lump.filelen % sizeof(T)) != 0)
+		return false;
+
+	out->resize( lump.filelen / sizeof(T) );
+	if (!out->empty())
+		memcpy( &(*out)[0], data + lump.fileofs, lump.filelen );
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the point hull of the current map, and snapshot its solid brush entities.
+ * Must be called from the game thread.
+ */
+bool CNavBspTracer::Load( void )
+{
+	Reset();
+
+	char filename[256];
+	snprintf( filename, sizeof(filename), "maps/%s.bsp", STRING( gpGlobals->mapname ) );
+
+	int length = 0;
+	byte *data = LOAD_FILE_FOR_ME( filename, &length );
+	if (data == NULL)
+	{
+		CONSOLE_ECHO( "ERROR: Cannot read '%s'.\n", filename );
+		return false;
+	}
+
+	BspHeader header;
+	std::vector< BspPlane > planes;
+	std::vector< BspNode > nodes;
+	std::vector< BspLeaf > leafs;
+	std::vector< BspModel > models;
+
+	bool ok = (length >= (int)sizeof(BspHeader));
+	if (ok)
+	{
+		memcpy( &header, data, sizeof(BspHeader) );
+
+		ok = header.version == BSP_VERSION &&
+			 CopyLump( data, length, header.lumps[ BSP_LUMP_PLANES ], &planes ) &&
+			 CopyLump( data, length, header.lumps[ BSP_LUMP_NODES ], &nodes ) &&
+			 CopyLump( data, length, header.lumps[ BSP_LUMP_LEAFS ], &leafs ) &&
+			 CopyLump( data, length, header.lumps[ BSP_LUMP_MODELS ], &models ) &&
+			 !nodes.empty() && !models.empty();
+	}
+
+	FREE_FILE( data );
+
+	if (!ok)
+	{
+		CONSOLE_ECHO( "ERROR: '%s' is not a valid BSP file.\n", filename );
+		return false;
+	}
+
+	m_plane.resize( planes.size() );
+	for( unsigned int p=0; p<planes.size(); ++p )
+	{
+		m_plane[p].normal = Vector( planes[p].normal[0], planes[p].normal[1], planes[p].normal[2] );
+		m_plane[p].dist = planes[p].dist;
+		m_plane[p].type = planes[p].type;
+	}
+
+	// the point hull uses the drawing nodes, with the leaf contents in place of the leaves
+	m_node.resize( nodes.size() );
+	for( unsigned int n=0; n<nodes.size(); ++n )
+	{
+		m_node[n].plane = nodes[n].planenum;
+
+		for( int side=0; side<2; ++side )
+		{
+			int child = nodes[n].children[ side ];
+
+			if (child >= 0)
+				m_node[n].children[ side ] = child;
+			else if (-1 - child < (int)leafs.size())
+				m_node[n].children[ side ] = leafs[ -1 - child ].contents;
+			else
+				m_node[n].children[ side ] = CONTENTS_SOLID;
+		}
+	}
+
+	m_worldHeadNode = models[0].headnode[0];
+	m_world = INDEXENT( 0 );
+
+	// snapshot the brush entities that block traces
+	for( int i=1; i<gpGlobals->maxEntities; ++i )
+	{
+		edict_t *edict = INDEXENT( i );
+		if (edict == NULL || edict->free)
+			continue;
+
+		entvars_t *pev = VARS( edict );
+		if (pev->solid != SOLID_BSP)
+			continue;
+
+		const char *model = STRING( pev->model );
+		if (model == NULL || model[0] != '*')
+			continue;
+
+		int modelIndex = atoi( model+1 );
+		if (modelIndex <= 0 || modelIndex >= (int)models.size())
+			continue;
+
+		BrushEntity entity;
+		entity.edict = edict;
+		entity.headNode = models[ modelIndex ].headnode[0];
+		entity.origin = pev->origin;
+		entity.absMin = pev->absmin;
+		entity.absMax = pev->absmax;
+		entity.isGlass = (pev->rendermode != kRenderNormal && !(pev->flags & FL_WORLDBRUSH));
+
+		m_brushEntity.push_back( entity );
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavBspTracer::Reset( void )
+{
+	m_isActive = false;
+
+	m_plane.clear();
+	m_node.clear();
+	m_brushEntity.clear();
+	m_world = NULL;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+int CNavBspTracer::PointContents( int num, const Vector &point ) const
+{
+	while( num >= 0 )
+	{
+		const Node *node = &m_node[ num ];
+		const Plane *plane = &m_plane[ node->plane ];
+
+		float d;
+		if (plane->type < 3)
+			d = point[ plane->type ] - plane->dist;
+		else
+			d = DotProduct( plane->normal, point ) - plane->dist;
+
+		num = (d < 0.0f) ? node->children[1] : node->children[0];
+	}
+
+	return num;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The engine's recursive hull check. Returns false once the trace has hit something.
+ */
+bool CNavBspTracer::RecursiveHullCheck( int num, float p1f, float p2f, const Vector &p1, const Vector &p2, Trace *trace ) const
+{
+	// check for empty
+	if (num < 0)
+	{
+		if (num != CONTENTS_SOLID)
+		{
+			trace->allSolid = false;
+
+			if (num == CONTENTS_EMPTY)
+				trace->inOpen = true;
+			else
+				trace->inWater = true;
+		}
+		else
+		{
+			trace->startSolid = true;
+		}
+
+		return true;
+	}
+
+	const Node *node = &m_node[ num ];
+	const Plane *plane = &m_plane[ node->plane ];
+
+	float t1, t2;
+	if (plane->type < 3)
+	{
+		t1 = p1[ plane->type ] - plane->dist;
+		t2 = p2[ plane->type ] - plane->dist;
+	}
+	else
+	{
+		t1 = DotProduct( plane->normal, p1 ) - plane->dist;
+		t2 = DotProduct( plane->normal, p2 ) - plane->dist;
+	}
+
+	if (t1 >= 0.0f && t2 >= 0.0f)
+		return RecursiveHullCheck( node->children[0], p1f, p2f, p1, p2, trace );
+
+	if (t1 < 0.0f && t2 < 0.0f)
+		return RecursiveHullCheck( node->children[1], p1f, p2f, p1, p2, trace );
+
+	// put the crosspoint DIST_EPSILON units on the near side
+	float frac;
+	if (t1 < 0.0f)
+		frac = (t1 + DIST_EPSILON) / (t1 - t2);
+	else
+		frac = (t1 - DIST_EPSILON) / (t1 - t2);
+
+	if (frac < 0.0f)
+		frac = 0.0f;
+	else if (frac > 1.0f)
+		frac = 1.0f;
+
+	float midf = p1f + (p2f - p1f) * frac;
+	Vector mid = p1 + frac * (p2 - p1);
+
+	int side = (t1 < 0.0f) ? 1 : 0;
+
+	// move up to the node
+	if (!RecursiveHullCheck( node->children[ side ], p1f, midf, p1, mid, trace ))
+		return false;
+
+	if (PointContents( node->children[ side^1 ], mid ) != CONTENTS_SOLID)
+	{
+		// go past the node
+		return RecursiveHullCheck( node->children[ side^1 ], midf, p2f, mid, p2, trace );
+	}
+
+	// never got out of the solid area
+	if (trace->allSolid)
+		return false;
+
+	// the other side of the node is solid, this is the impact point
+	if (side == 0)
+	{
+		trace->planeNormal = plane->normal;
+		trace->planeDist = plane->dist;
+	}
+	else
+	{
+		trace->planeNormal = -plane->normal;
+		trace->planeDist = -plane->dist;
+	}
+
+	while( PointContents( trace->headNode, mid ) == CONTENTS_SOLID )
+	{
+		// shouldn't really happen, but does occasionally
+		frac -= 0.1f;
+		if (frac < 0.0f)
+		{
+			trace->fraction = midf;
+			trace->endPos = mid;
+			return false;
+		}
+
+		midf = p1f + (p2f - p1f) * frac;
+		mid = p1 + frac * (p2 - p1);
+	}
+
+	trace->fraction = midf;
+	trace->endPos = mid;
+
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavBspTracer::ClipToModel( int headNode, const Vector &start, const Vector &end, Trace *trace ) const
+{
+	trace->headNode = headNode;
+	trace->allSolid = true;
+	trace->startSolid = false;
+	trace->inOpen = false;
+	trace->inWater = false;
+	trace->fraction = 1.0f;
+	trace->endPos = end;
+	trace->planeNormal = Vector( 0, 0, 0 );
+	trace->planeDist = 0.0f;
+
+	RecursiveHullCheck( headNode, 0.0f, 1.0f, start, end, trace );
+
+	if (trace->allSolid)
+		trace->startSolid = true;
+
+	if (trace->fraction == 1.0f)
+		trace->endPos = end;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Trace a line against the world and the snapshotted brush entities.
+ * Only reads data set up by Load(), so any number of threads may trace at once.
+ */
+void CNavBspTracer::TraceLine( const Vector &start, const Vector &end, bool ignoreGlass, edict_t *ignore, TraceResult *result ) const
+{
+	Trace trace;
+	ClipToModel( m_worldHeadNode, start, end, &trace );
+
+	edict_t *hit = (trace.fraction < 1.0f) ? m_world : NULL;
+
+	if (!trace.allSolid)
+	{
+		Vector traceMin, traceMax;
+		for( int i=0; i<3; ++i )
+		{
+			traceMin[i] = (start[i] < end[i]) ? start[i] : end[i];
+			traceMax[i] = (start[i] > end[i]) ? start[i] : end[i];
+		}
+
+		for( unsigned int e=0; e<m_brushEntity.size(); ++e )
+		{
+			const BrushEntity *entity = &m_brushEntity[e];
+
+			if (entity->edict == ignore)
+				continue;
+
+			if (ignoreGlass && entity->isGlass)
+				continue;
+
+			if (traceMin.x > entity->absMax.x || traceMin.y > entity->absMax.y || traceMin.z > entity->absMax.z ||
+				traceMax.x < entity->absMin.x || traceMax.y < entity->absMin.y || traceMax.z < entity->absMin.z)
+				continue;
+
+			// trace in the entity's model space
+			Trace entityTrace;
+			ClipToModel( entity->headNode, start - entity->origin, end - entity->origin, &entityTrace );
+
+			if (entityTrace.allSolid || entityTrace.startSolid || entityTrace.fraction < trace.fraction)
+			{
+				bool startSolid = trace.startSolid;
+
+				trace = entityTrace;
+				trace.endPos = trace.endPos + entity->origin;
+				trace.planeDist += DotProduct( trace.planeNormal, entity->origin );
+
+				if (startSolid)
+					trace.startSolid = true;
+
+				hit = entity->edict;
+			}
+		}
+	}
+
+	result->fAllSolid = trace.allSolid;
+	result->fStartSolid = trace.startSolid;
+	result->fInOpen = trace.inOpen;
+	result->fInWater = trace.inWater;
+	result->flFraction = trace.fraction;
+	result->vecEndPos = trace.endPos;
+	result->flPlaneDist = trace.planeDist;
+	result->vecPlaneNormal = trace.planeNormal;
+	result->pHit = hit;
+	result->iHitgroup = 0;
+}
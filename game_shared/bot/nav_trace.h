@@ -0,0 +1,107 @@
+// nav_trace.h
+// Thread-safe line traces against the map's BSP, used by offline navigation analysis
+
+#ifndef _NAV_TRACE_H_
+#define _NAV_TRACE_H_
+
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A copy of the point hull of the current map, and of the solid brush entities in it,
+ * that can be traced against from any thread.
+ * The engine's trace functions may only be called from the game thread, so navigation analysis
+ * running on worker threads loads one of these and routes its traces here via NavTraceLine().
+ *
+ * Brush entities are snapshotted when the tracer is loaded and are treated as unrotated.
+ * Monsters and players are never hit, as if every trace used ignore_monsters.
+ */
+class CNavBspTracer
+{
+public:
+	CNavBspTracer( void )								{ m_isActive = false; m_world = NULL; }
+
+	bool Load( void );									///< load the BSP of the current map - game thread only
+	void Reset( void );									///< free the copy and stop routing traces here
+
+	bool IsLoaded( void ) const							{ return !m_node.empty(); }
+
+	void SetActive( bool active )						{ m_isActive = active && IsLoaded(); }	///< route NavTraceLine() here - only change while no worker threads are running
+	bool IsActive( void ) const							{ return m_isActive; }
+
+	void TraceLine( const Vector &start, const Vector &end, bool ignoreGlass, edict_t *ignore, TraceResult *result ) const;	///< safe to call from any thread
+
+private:
+	struct Plane
+	{
+		Vector normal;
+		float dist;
+		int type;										///< 0-2 if the plane is axial, for quick distance checks
+	};
+
+	struct Node
+	{
+		int plane;
+		int children[2];								///< node index, or leaf contents if negative
+	};
+
+	struct BrushEntity
+	{
+		edict_t *edict;
+		int headNode;									///< first node of the entity's model
+		Vector origin;
+		Vector absMin, absMax;
+		bool isGlass;									///< not rendered normally, skipped by ignore_glass traces
+	};
+
+	struct Trace
+	{
+		int headNode;									///< first node of the model being traced
+		bool allSolid;
+		bool startSolid;
+		bool inOpen;
+		bool inWater;
+		float fraction;
+		Vector endPos;
+		Vector planeNormal;
+		float planeDist;
+	};
+
+	int PointContents( int num, const Vector &point ) const;
+	bool RecursiveHullCheck( int num, float p1f, float p2f, const Vector &p1, const Vector &p2, Trace *trace ) const;
+	void ClipToModel( int headNode, const Vector &start, const Vector &end, Trace *trace ) const;
+
+	bool m_isActive;
+
+	std::vector< Plane > m_plane;
+	std::vector< Node > m_node;							///< the BSP drawing nodes, with leaves replaced by their contents
+	int m_worldHeadNode;
+	edict_t *m_world;
+
+	std::vector< BrushEntity > m_brushEntity;
+};
+
+extern CNavBspTracer TheNavBspTracer;
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Line traces used by navigation analysis.
+ * These go to the thread-safe BSP tracer while it is active, and to the engine otherwise.
+ */
+inline void NavTraceLine( const Vector &start, const Vector &end, IGNORE_MONSTERS igmon, IGNORE_GLASS igglass, edict_t *ignore, TraceResult *result )
+{
+	if (TheNavBspTracer.IsActive())
+		TheNavBspTracer.TraceLine( start, end, (igglass == ignore_glass), ignore, result );
+	else
+		UTIL_TraceLine( start, end, igmon, igglass, ignore, result );
+}
+
+inline void NavTraceLine( const Vector &start, const Vector &end, IGNORE_MONSTERS igmon, edict_t *ignore, TraceResult *result )
+{
+	if (TheNavBspTracer.IsActive())
+		TheNavBspTracer.TraceLine( start, end, false, ignore, result );
+	else
+		UTIL_TraceLine( start, end, igmon, ignore, result );
+}
+
+#endif // _NAV_TRACE_H_
@@ -0,0 +1,314 @@
+// nav_visibility.cpp
+// Precomputed potential visibility between nav areas
+
+#pragma warning( disable : 4530 )					// STL uses exceptions, but we are not compiling with them - ignore warning
+#pragma warning( disable : 4786 )					// long STL names get truncated in browse info.
+
+#include "extdll.h"
+#include "util.h"
+#include "cbase.h"
+
+#include "nav.h"
+#include "nav_area.h"
+#include "nav_trace.h"
+#include "nav_visibility.h"
+
+CNavVisibility TheNavVisibility;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find the points the area's visibility is computed from and to.
+ * These are the same points ComputeApproachAreas() and ClassifySniperSpot() trace between.
+ */
+void CNavVisibility::ComputeSamples( const CNavArea *area, Samples *samples )
+{
+	// the "view" point of ComputeApproachAreas()
+	samples->eye = *area->GetCenter();
+	samples->hasEye = GetGroundHeight( &samples->eye, &samples->eye.z );
+
+	if (area->GetAttributes() & NAV_CROUCH)
+		samples->eye.z += 0.9f * HalfHumanHeight;
+	else
+		samples->eye.z += 0.9f * HumanHeight;
+
+	// sniper eyes, assuming we are crouching
+	samples->spotEye.clear();
+
+	const HidingSpotList *spotList = area->GetHidingSpotList();
+	for( HidingSpotList::const_iterator iter = spotList->begin(); iter != spotList->end(); ++iter )
+		samples->spotEye.push_back( *(*iter)->GetPosition() + Vector( 0, 0, HalfHumanHeight ) );
+
+	// the corners, as IsAreaVisible() sees them
+	for( int c=0; c<NUM_CORNERS; ++c )
+	{
+		samples->corner[c] = *area->GetCorner( (NavCornerType)c );
+		samples->corner[c].z += 0.75f * HumanHeight;
+	}
+
+	// the center, and the walkable points nearest the corners, as ClassifySniperSpot() scans them
+	const Extent *extent = area->GetExtent();
+	float insetX = (extent->SizeX() > GenerationStepSize) ? GenerationStepSize/2.0f : extent->SizeX()/2.0f;
+	float insetY = (extent->SizeY() > GenerationStepSize) ? GenerationStepSize/2.0f : extent->SizeY()/2.0f;
+
+	samples->walkable[0] = *area->GetCenter();
+	samples->walkable[1] = Vector( extent->lo.x + insetX, extent->lo.y + insetY, 0.0f );
+	samples->walkable[2] = Vector( extent->hi.x - insetX, extent->lo.y + insetY, 0.0f );
+	samples->walkable[3] = Vector( extent->hi.x - insetX, extent->hi.y - insetY, 0.0f );
+	samples->walkable[4] = Vector( extent->lo.x + insetX, extent->hi.y - insetY, 0.0f );
+
+	for( int w=0; w<NUM_CORNERS+1; ++w )
+		samples->walkable[w].z = area->GetZ( &samples->walkable[w] ) + HalfHumanHeight;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if any of the eyes of 'from' can see any of the sample points of 'to'
+ */
+static bool CanSeeSamples( const CNavVisibility::Samples *from, const CNavVisibility::Samples *to )
+{
+	TraceResult result;
+
+	if (from->hasEye)
+	{
+		for( int c=0; c<NUM_CORNERS; ++c )
+		{
+			NavTraceLine( from->eye, to->corner[c], ignore_monsters, NULL, &result );
+			if (result.flFraction == 1.0f)
+				return true;
+		}
+	}
+
+	for( unsigned int e=0; e<from->spotEye.size(); ++e )
+	{
+		for( int w=0; w<NUM_CORNERS+1; ++w )
+		{
+			NavTraceLine( from->spotEye[e], to->walkable[w], ignore_monsters, ignore_glass, NULL, &result );
+			if (result.flFraction == 1.0f && !result.fStartSolid)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Trace from area 'from' to every area, and store the compressed row of bits.
+ * A zero byte is followed by the number of zero bytes in its run, from 1 to 255.
+ */
+void CNavVisibility::ComputeRow( const std::vector< Samples > &samples, int from, std::vector< unsigned char > *row )
+{
+	int count = samples.size();
+
+	std::vector< unsigned char > bits( (count+7)/8, 0 );
+
+	for( int to=0; to<count; ++to )
+	{
+		// an area can always see itself
+		if (to == from || CanSeeSamples( &samples[ from ], &samples[ to ] ))
+			bits[ to >> 3 ] |= 1 << (to & 7);
+	}
+
+	row->clear();
+	for( unsigned int i=0; i<bits.size(); )
+	{
+		if (bits[i])
+		{
+			row->push_back( bits[i++] );
+			continue;
+		}
+
+		int run = 0;
+		while( i < bits.size() && bits[i] == 0 && run < 255 )
+		{
+			++run;
+			++i;
+		}
+
+		row->push_back( 0 );
+		row->push_back( run );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Decompress a row into 'bits', which must have room for 'byteCount' bytes.
+ * Return false if the row does not decompress to exactly that many bytes.
+ */
+static bool DecompressRow( const unsigned char *in, const unsigned char *end, unsigned char *bits, unsigned int byteCount )
+{
+	unsigned int length = 0;
+
+	while( in < end )
+	{
+		if (*in)
+		{
+			if (length == byteCount)
+				return false;
+
+			bits[ length++ ] = *in++;
+			continue;
+		}
+
+		if (end - in < 2 || in[1] == 0 || in[1] > byteCount - length)
+			return false;
+
+		memset( bits + length, 0, in[1] );
+		length += in[1];
+		in += 2;
+	}
+
+	return (length == byteCount);
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Install rows computed for 'areas', in that order
+ */
+void CNavVisibility::Set( const std::vector< CNavArea * > &areas, const std::vector< std::vector< unsigned char > > &rows )
+{
+	Reset();
+
+	unsigned int maxID = 0;
+	for( unsigned int i=0; i<areas.size(); ++i )
+		if (areas[i]->GetID() > maxID)
+			maxID = areas[i]->GetID();
+
+	m_indexByID.assign( maxID+1, -1 );
+
+	for( unsigned int i=0; i<areas.size(); ++i )
+	{
+		m_areaID.push_back( areas[i]->GetID() );
+		m_indexByID[ areas[i]->GetID() ] = i;
+
+		m_rowStart.push_back( m_data.size() );
+		m_data.insert( m_data.end(), rows[i].begin(), rows[i].end() );
+	}
+
+	m_rowStart.push_back( m_data.size() );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Install rows read from a file, given the start of each row plus one past the last.
+ * The data is copied, so it need not outlive the call.
+ */
+bool CNavVisibility::Load( const std::vector< CNavArea * > &areas, const unsigned int *rowStart, const unsigned char *data, unsigned int dataLength )
+{
+	Reset();
+
+	unsigned int byteCount = (areas.size()+7)/8;
+	std::vector< unsigned char > bits( byteCount );
+
+	for( unsigned int i=0; i<areas.size(); ++i )
+	{
+		if (rowStart[i] > rowStart[i+1] || rowStart[i+1] > dataLength)
+			return false;
+
+		if (!DecompressRow( data + rowStart[i], data + rowStart[i+1], bits.data(), byteCount ))
+			return false;
+	}
+
+	std::vector< std::vector< unsigned char > > rows( areas.size() );
+	for( unsigned int i=0; i<areas.size(); ++i )
+		rows[i].assign( data + rowStart[i], data + rowStart[i+1] );
+
+	Set( areas, rows );
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavVisibility::Reset( void )
+{
+	m_areaID.clear();
+	m_indexByID.clear();
+	m_rowStart.clear();
+	m_data.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavVisibility::IsBuiltFor( const std::vector< CNavArea * > &areas ) const
+{
+	if (!IsBuilt() || areas.size() != m_areaID.size())
+		return false;
+
+	for( unsigned int i=0; i<areas.size(); ++i )
+		if (areas[i]->GetID() != m_areaID[i])
+			return false;
+
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline int CNavVisibility::GetIndex( const CNavArea *area ) const
+{
+	unsigned int id = area->GetID();
+	return (id < m_indexByID.size()) ? m_indexByID[ id ] : -1;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return false if 'from' cannot see 'to', and true if it might.
+ * Only the row of 'from' up to the byte of 'to' is decompressed.
+ */
+bool CNavVisibility::IsPotentiallyVisible( const CNavArea *from, const CNavArea *to ) const
+{
+	int fromIndex = GetIndex( from );
+	int toIndex = GetIndex( to );
+
+	if (fromIndex < 0 || toIndex < 0)
+		return true;
+
+	const unsigned char *in = &m_data[0] + m_rowStart[ fromIndex ];
+	const unsigned char *end = &m_data[0] + m_rowStart[ fromIndex+1 ];
+	int target = toIndex >> 3;
+	int length = 0;
+
+	while( in < end )
+	{
+		if (*in)
+		{
+			if (length == target)
+				return (*in & (1 << (toIndex & 7))) ? true : false;
+
+			++length;
+			++in;
+		}
+		else
+		{
+			length += in[1];
+			if (target < length)
+				return false;
+
+			in += 2;
+		}
+	}
+
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Decompress the row of 'from', so many areas can be tested against it with IsInRow()
+ */
+bool CNavVisibility::GetRow( const CNavArea *from, std::vector< unsigned char > *row ) const
+{
+	int fromIndex = GetIndex( from );
+	if (fromIndex < 0)
+		return false;
+
+	row->resize( (m_areaID.size()+7)/8 );
+
+	return DecompressRow( &m_data[0] + m_rowStart[ fromIndex ], &m_data[0] + m_rowStart[ fromIndex+1 ], row->data(), row->size() );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavVisibility::IsInRow( const std::vector< unsigned char > &row, const CNavArea *to ) const
+{
+	int toIndex = GetIndex( to );
+	if (toIndex < 0)
+		return true;
+
+	return (row[ toIndex >> 3 ] & (1 << (toIndex & 7))) ? true : false;
+}
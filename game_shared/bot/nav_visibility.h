@@ -0,0 +1,71 @@
+// nav_visibility.h
+// Precomputed potential visibility between nav areas
+
+#ifndef _NAV_VISIBILITY_H_
+#define _NAV_VISIBILITY_H_
+
+#include <vector>
+#include "nav.h"
+
+class CNavArea;
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * For each pair of nav areas, whether the first can possibly see the second, computed by the offline
+ * analysis and saved in the .nav file. Each area has a row of bits, one per area, compressed by
+ * replacing runs of zero bytes with a zero and a count - most areas can't see most others.
+ *
+ * An area "sees" another if a trace from one of its sample eyes reaches one of the other's sample points:
+ * - from the eye above the area's center to the corners of the other, as IsAreaVisible() traces
+ * - from the eye above each hiding spot to the center and inset corners of the other, as ClassifySniperSpot() traces
+ * A clear bit means none of those traces are clear, so the traces can be skipped. A set bit means
+ * the traces must still be made.
+ *
+ * Areas that weren't part of the analysis are treated as visible from and to everything.
+ * Deleting an area discards the whole set; re-analyze the mesh after editing it.
+ */
+class CNavVisibility
+{
+public:
+	/// the points an area's visibility is computed from and to
+	struct Samples
+	{
+		bool hasEye;
+		Vector eye;											///< above the center of the area
+		std::vector< Vector > spotEye;						///< above each hiding spot, as a crouching sniper
+
+		Vector corner[ NUM_CORNERS ];						///< targets for the center eye
+		Vector walkable[ NUM_CORNERS+1 ];					///< targets for the hiding spot eyes - the center and inset corners
+	};
+
+	static void ComputeSamples( const CNavArea *area, Samples *samples );	///< find the area's sample points - safe on analysis threads
+	static void ComputeRow( const std::vector< Samples > &samples, int from, std::vector< unsigned char > *row );	///< trace from one area to all others, and compress the result - safe on analysis threads
+
+	void Set( const std::vector< CNavArea * > &areas, const std::vector< std::vector< unsigned char > > &rows );	///< install rows computed for 'areas', in that order
+	bool Load( const std::vector< CNavArea * > &areas, const unsigned int *rowStart, const unsigned char *data, unsigned int dataLength );	///< install rows read from a file - return false if they are invalid
+	void Reset( void );										///< discard the set because the mesh is changing
+
+	bool IsBuilt( void ) const								{ return !m_rowStart.empty(); }
+	bool IsBuiltFor( const std::vector< CNavArea * > &areas ) const;	///< true if the set was computed for exactly these areas, in this order
+
+	bool IsPotentiallyVisible( const CNavArea *from, const CNavArea *to ) const;	///< return false if 'from' cannot see 'to', true if it might
+
+	bool GetRow( const CNavArea *from, std::vector< unsigned char > *row ) const;	///< decompress the row of 'from', for testing many areas - return false if unknown
+	bool IsInRow( const std::vector< unsigned char > &row, const CNavArea *to ) const;	///< return false if the row shows 'to' cannot be seen
+
+	// the compressed rows, in the order of the areas they were computed for - for saving
+	const std::vector< unsigned int > &GetRowStarts( void ) const	{ return m_rowStart; }
+	const std::vector< unsigned char > &GetData( void ) const	{ return m_data; }
+
+private:
+	int GetIndex( const CNavArea *area ) const;				///< return the row and bit index of the area, or -1
+
+	std::vector< unsigned int > m_areaID;					///< area ID by index
+	std::vector< int > m_indexByID;							///< index by area ID, -1 for areas not in the set
+	std::vector< unsigned int > m_rowStart;					///< start of each compressed row in m_data, plus one past the last row
+	std::vector< unsigned char > m_data;
+};
+
+extern CNavVisibility TheNavVisibility;
+
+#endif // _NAV_VISIBILITY_H_
@@ -27,8 +27,10 @@
 #endif
 
 #ifdef LINUX
+#include <fcntl.h>
 #include <limits.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #endif
 
@@ -316,6 +318,132 @@ bool FileSystem_WriteTextToFile(const char* fileName, const char* text, const ch
 	return false;
 }
 
+bool FileSystem_ReplaceFile(const char* oldFileName, const char* newFileName)
+{
+	if (nullptr == oldFileName || nullptr == newFileName)
+	{
+		return false;
+	}
+
+	std::string absoluteOldFileName = g_ModDirectory + DefaultPathSeparatorChar + oldFileName;
+	std::string absoluteNewFileName = g_ModDirectory + DefaultPathSeparatorChar + newFileName;
+
+	FileSystem_FixSlashes(absoluteOldFileName);
+	FileSystem_FixSlashes(absoluteNewFileName);
+
+#ifdef WIN32
+	if (0 == MoveFileExA(absoluteOldFileName.c_str(), absoluteNewFileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+#else
+	if (0 != rename(absoluteOldFileName.c_str(), absoluteNewFileName.c_str()))
+#endif
+	{
+		ALERT(at_console, "FileSystem_ReplaceFile: couldn't rename \"%s\" to \"%s\"\n", oldFileName, newFileName);
+		return false;
+	}
+
+	return true;
+}
+
+bool FSMappedFile::Open(const char* fileName)
+{
+	Close();
+
+	if (nullptr == fileName)
+	{
+		return false;
+	}
+
+	std::string absoluteFileName = g_ModDirectory + DefaultPathSeparatorChar + fileName;
+
+	FileSystem_FixSlashes(absoluteFileName);
+
+#ifdef WIN32
+	const HANDLE file = CreateFileA(absoluteFileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+
+	if (0 == GetFileSizeEx(file, &size) || 0 == size.QuadPart)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	// The mapping keeps the file open, so the file handle isn't needed anymore.
+	const HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+
+	if (NULL == mapping)
+	{
+		return false;
+	}
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (nullptr == data)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+
+	_mapping = mapping;
+	_size = static_cast<std::size_t>(size.QuadPart);
+#else
+	const int file = open(absoluteFileName.c_str(), O_RDONLY);
+
+	if (file < 0)
+	{
+		return false;
+	}
+
+	struct stat buf;
+
+	if (0 != fstat(file, &buf) || 0 == buf.st_size)
+	{
+		close(file);
+		return false;
+	}
+
+	// The mapping keeps the file open, so the file descriptor isn't needed anymore.
+	void* data = mmap(nullptr, buf.st_size, PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+
+	_size = static_cast<std::size_t>(buf.st_size);
+#endif
+
+	_data = reinterpret_cast<const std::byte*>(data);
+
+	return true;
+}
+
+void FSMappedFile::Close()
+{
+	if (!IsOpen())
+	{
+		return;
+	}
+
+#ifdef WIN32
+	UnmapViewOfFile(_data);
+	CloseHandle(_mapping);
+	_mapping = nullptr;
+#else
+	munmap(const_cast<std::byte*>(_data), _size);
+#endif
+
+	_data = nullptr;
+	_size = 0;
+}
+
 constexpr const char* ValveGameDirectoryPrefixes[] =
 	{
 		"valve",
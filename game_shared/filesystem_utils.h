@@ -107,6 +107,13 @@ std::vector<std::byte> FileSystem_LoadFileIntoBuffer(const char* fileName, FileC
 */
 bool FileSystem_WriteTextToFile(const char* fileName, const char* text, const char* pathID = nullptr);
 
+/**
+*	@brief Renames a file located in the mod directory, replacing the destination if it exists.
+*	@details Used to replace files that other server instances may have mapped without truncating them underneath those instances.
+*	@return True if the file was renamed, false if an error occurred.
+*/
+bool FileSystem_ReplaceFile(const char* oldFileName, const char* newFileName);
+
 /**
 *	@brief Returns @c true if the current game directory is that of a Valve game.
 *	Any directory whose name starts with that of a Valve game's directory name is considered to be one, matching Steam's behavior.
@@ -215,3 +222,41 @@ inline int FSFile::Write(const void* input, int size)
 {
 	return g_pFileSystem->Write(input, size, _handle);
 }
+
+/**
+*	@brief Maps a file located in the mod directory into memory, read-only.
+*	@details The mapping is backed by the OS page cache, so every process that maps the same file shares one copy of it.
+*	Only files that exist on disk in the mod directory itself can be mapped.
+*/
+class FSMappedFile
+{
+public:
+	FSMappedFile() noexcept = default;
+	FSMappedFile(const FSMappedFile&) = delete;
+	FSMappedFile& operator=(const FSMappedFile&) = delete;
+
+	~FSMappedFile();
+
+	constexpr bool IsOpen() const { return _data != nullptr; }
+
+	const std::byte* Data() const { return _data; }
+	std::size_t Size() const { return _size; }
+
+	bool Open(const char* fileName);
+	void Close();
+
+	constexpr operator bool() const { return IsOpen(); }
+
+private:
+	const std::byte* _data = nullptr;
+	std::size_t _size = 0;
+
+#ifdef WIN32
+	void* _mapping = nullptr;
+#endif
+};
+
+inline FSMappedFile::~FSMappedFile()
+{
+	Close();
+}
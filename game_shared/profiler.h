@@ -0,0 +1,190 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+
+#pragma once
+
+/**
+*	@file
+*
+*	Scoped zone profiler for the server frame.
+*	Zones are recorded into ring buffers that hold the last few hundred frames,
+*	so the frames leading up to a stall can be written out as a Chrome trace (chrome://tracing, Perfetto)
+*	with the sv_profile_dump server command.
+*	Recording is enabled with the sv_profile cvar. While disabled a zone costs a single load and branch.
+*	Code shared with the client, like pm_shared, can use PROFILE_SCOPE too: it is empty in the client library,
+*	which has no profiler.
+*/
+
+#ifdef CLIENT_DLL
+
+#define PROFILE_SCOPE(name)
+
+#else
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+constexpr std::size_t ProfilerMaxZones = 1 << 16; //!< Must be a power of 2.
+constexpr std::size_t ProfilerMaxFrames = 1 << 9; //!< Must be a power of 2.
+
+struct ProfilerZone
+{
+	const char* Name; //!< Must have static storage duration.
+	std::uint64_t StartTime;
+	std::uint64_t EndTime;
+};
+
+struct ProfilerFrame
+{
+	unsigned int Number;
+	std::uint64_t StartTime;
+	std::uint64_t FirstZone; //!< Index of the first zone recorded in this frame.
+};
+
+/**
+*	@brief Records zones into a ring buffer.
+*	@details Zones may only be recorded on the main thread, but the write positions are atomic
+*	so a reader only ever sees fully written entries.
+*/
+class FrameProfiler
+{
+public:
+	bool IsEnabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+	/**
+	*	@brief Returns the current time in nanoseconds.
+	*/
+	static std::uint64_t Now()
+	{
+		return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch())
+											  .count());
+	}
+
+	/**
+	*	@brief Called at the start of every server frame.
+	*/
+	void BeginFrame(bool enabled)
+	{
+		_enabled.store(enabled, std::memory_order_relaxed);
+
+		if (!enabled)
+		{
+			return;
+		}
+
+		const std::uint64_t frame = _frameCount.load(std::memory_order_relaxed);
+
+		ProfilerFrame& entry = _frames[frame & (ProfilerMaxFrames - 1)];
+		entry.Number = _frameNumber++;
+		entry.StartTime = Now();
+		entry.FirstZone = _zoneCount.load(std::memory_order_relaxed);
+
+		_frameCount.store(frame + 1, std::memory_order_release);
+	}
+
+	void Record(const char* name, std::uint64_t startTime, std::uint64_t endTime)
+	{
+		const std::uint64_t zone = _zoneCount.load(std::memory_order_relaxed);
+
+		_zones[zone & (ProfilerMaxZones - 1)] = {name, startTime, endTime};
+
+		_zoneCount.store(zone + 1, std::memory_order_release);
+	}
+
+	/**
+	*	@brief Calls @p frameCallback for every frame still in the buffers, oldest first,
+	*	and @p zoneCallback for every zone recorded during that frame that hasn't been overwritten.
+	*/
+	template <typename FrameCallback, typename ZoneCallback>
+	void ForEachFrame(FrameCallback&& frameCallback, ZoneCallback&& zoneCallback) const
+	{
+		const std::uint64_t frameCount = _frameCount.load(std::memory_order_acquire);
+		const std::uint64_t zoneCount = _zoneCount.load(std::memory_order_acquire);
+
+		const std::uint64_t firstFrame = frameCount > ProfilerMaxFrames ? frameCount - ProfilerMaxFrames : 0;
+		const std::uint64_t oldestZone = zoneCount > ProfilerMaxZones ? zoneCount - ProfilerMaxZones : 0;
+
+		for (std::uint64_t frame = firstFrame; frame < frameCount; ++frame)
+		{
+			const ProfilerFrame& entry = _frames[frame & (ProfilerMaxFrames - 1)];
+
+			const std::uint64_t endZone = frame + 1 < frameCount ? _frames[(frame + 1) & (ProfilerMaxFrames - 1)].FirstZone : zoneCount;
+			const std::uint64_t endTime = frame + 1 < frameCount ? _frames[(frame + 1) & (ProfilerMaxFrames - 1)].StartTime : Now();
+
+			frameCallback(entry, endTime);
+
+			for (std::uint64_t zone = entry.FirstZone > oldestZone ? entry.FirstZone : oldestZone; zone < endZone; ++zone)
+			{
+				zoneCallback(_zones[zone & (ProfilerMaxZones - 1)]);
+			}
+		}
+	}
+
+private:
+	std::atomic<bool> _enabled{false};
+	std::atomic<std::uint64_t> _zoneCount{0};
+	std::atomic<std::uint64_t> _frameCount{0};
+	unsigned int _frameNumber = 0;
+
+	ProfilerZone _zones[ProfilerMaxZones]{};
+	ProfilerFrame _frames[ProfilerMaxFrames]{};
+};
+
+inline FrameProfiler g_FrameProfiler;
+
+/**
+*	@brief Records the time between construction and destruction as a zone.
+*/
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name)
+		: _name(name), _startTime(g_FrameProfiler.IsEnabled() ? FrameProfiler::Now() : 0)
+	{
+	}
+
+	~ProfileScope()
+	{
+		if (_startTime != 0 && g_FrameProfiler.IsEnabled())
+		{
+			g_FrameProfiler.Record(_name, _startTime, FrameProfiler::Now());
+		}
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	const char* const _name;
+	const std::uint64_t _startTime;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+/**
+*	@brief Profiles the rest of the enclosing scope. @p name must be a string literal.
+*/
+#define PROFILE_SCOPE(name) const ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+/**
+*	@brief Registers the server commands used to control the profiler. Server only.
+*/
+void Profiler_RegisterCommands();
+
+#endif
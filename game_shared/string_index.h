@@ -0,0 +1,210 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+*   Use, distribution, and modification of this source code and/or resulting
+*   object code is restricted to non-commercial enhancements to products from
+*   Valve LLC.  All other use, distribution, or modification is prohibited
+*   without written permission from Valve LLC.
+*
+****/
+
+#pragma once
+
+/**
+*	@file
+*
+*	Hash index used to look up names loaded from text files (sentence groups, material types)
+*	without searching the whole table.
+*/
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/**
+*	@brief Case insensitive index that maps names to integer values.
+*	@details Only the first @c maxLength characters of a name are compared,
+*	so a lookup matches the same entries as <tt>strnicmp(name, entry, maxLength) == 0</tt>.
+*	If a name is added more than once the first value is kept, the same result a front to back search would give.
+*/
+class CaseInsensitiveStringIndex
+{
+public:
+	static constexpr std::size_t NoLengthLimit = std::numeric_limits<std::size_t>::max();
+
+	explicit CaseInsensitiveStringIndex(std::size_t maxLength = NoLengthLimit)
+		: _maxLength(maxLength)
+	{
+	}
+
+	std::size_t Count() const { return _entries.size(); }
+
+	void Clear();
+
+	/**
+	*	@brief Adds a name to the index. Does nothing if the name is already in the index.
+	*/
+	void Add(const char* name, int value);
+
+	/**
+	*	@brief Returns the value associated with @p name, or -1 if the name is not in the index.
+	*/
+	int Find(const char* name) const;
+
+private:
+	struct Entry
+	{
+		std::uint32_t Hash;
+		int Value;
+		std::size_t NameOffset;
+	};
+
+	static constexpr int EmptySlot = -1;
+
+	static char ToLower(char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); }
+
+	std::uint32_t Hash(const char* name) const;
+	bool Matches(const char* name, const Entry& entry) const;
+	int FindEntry(const char* name, std::uint32_t hash) const;
+	void Rehash(std::size_t slotCount);
+
+	std::size_t _maxLength;
+	std::vector<char> _names; //!< Lowercase, truncated names. Each is null terminated.
+	std::vector<Entry> _entries;
+	std::vector<int> _slots; //!< Indices into _entries. The size is always a power of 2 and at least twice the number of entries.
+};
+
+inline void CaseInsensitiveStringIndex::Clear()
+{
+	_names.clear();
+	_entries.clear();
+	_slots.clear();
+}
+
+inline void CaseInsensitiveStringIndex::Add(const char* name, int value)
+{
+	const std::uint32_t hash = Hash(name);
+
+	if (FindEntry(name, hash) != EmptySlot)
+	{
+		return;
+	}
+
+	const std::size_t nameOffset = _names.size();
+
+	for (std::size_t i = 0; i < _maxLength && name[i] != '\0'; ++i)
+	{
+		_names.push_back(ToLower(name[i]));
+	}
+
+	_names.push_back('\0');
+
+	_entries.push_back({hash, value, nameOffset});
+
+	if (_entries.size() * 2 > _slots.size())
+	{
+		Rehash(_slots.empty() ? 16 : _slots.size() * 2);
+		return;
+	}
+
+	const std::size_t mask = _slots.size() - 1;
+
+	std::size_t slot = hash & mask;
+
+	while (_slots[slot] != EmptySlot)
+	{
+		slot = (slot + 1) & mask;
+	}
+
+	_slots[slot] = static_cast<int>(_entries.size() - 1);
+}
+
+inline int CaseInsensitiveStringIndex::Find(const char* name) const
+{
+	const int index = FindEntry(name, Hash(name));
+
+	return index != EmptySlot ? _entries[index].Value : -1;
+}
+
+inline std::uint32_t CaseInsensitiveStringIndex::Hash(const char* name) const
+{
+	// FNV-1a
+	std::uint32_t hash = 2166136261u;
+
+	for (std::size_t i = 0; i < _maxLength && name[i] != '\0'; ++i)
+	{
+		hash ^= static_cast<unsigned char>(ToLower(name[i]));
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+inline bool CaseInsensitiveStringIndex::Matches(const char* name, const Entry& entry) const
+{
+	const char* key = _names.data() + entry.NameOffset;
+
+	for (std::size_t i = 0; i < _maxLength; ++i)
+	{
+		const char c = ToLower(name[i]);
+
+		if (c != key[i])
+		{
+			return false;
+		}
+
+		if (c == '\0')
+		{
+			break;
+		}
+	}
+
+	return true;
+}
+
+inline int CaseInsensitiveStringIndex::FindEntry(const char* name, std::uint32_t hash) const
+{
+	if (_slots.empty())
+	{
+		return EmptySlot;
+	}
+
+	const std::size_t mask = _slots.size() - 1;
+
+	// There is always at least one empty slot, so this ends.
+	for (std::size_t slot = hash & mask;; slot = (slot + 1) & mask)
+	{
+		const int index = _slots[slot];
+
+		if (index == EmptySlot || (_entries[index].Hash == hash && Matches(name, _entries[index])))
+		{
+			return index;
+		}
+	}
+}
+
+inline void CaseInsensitiveStringIndex::Rehash(std::size_t slotCount)
+{
+	_slots.assign(slotCount, EmptySlot);
+
+	const std::size_t mask = slotCount - 1;
+
+	for (std::size_t i = 0; i < _entries.size(); ++i)
+	{
+		std::size_t slot = _entries[i].Hash & mask;
+
+		while (_slots[slot] != EmptySlot)
+		{
+			slot = (slot + 1) & mask;
+		}
+
+		_slots[slot] = static_cast<int>(i);
+	}
+}
@@ -25,6 +25,8 @@
 #include "pm_materials.h"
 #include "pm_movevars.h"
 #include "pm_debug.h"
+#include "profiler.h"
+#include "string_index.h"
 #include <stdio.h>	// NULL
 #include <string.h> // strcpy
 #include <stdlib.h> // atoi
@@ -129,6 +131,7 @@ static int rgStuckLast[MAX_PLAYERS][2];
 static int gcTextures = 0;
 static char grgszTextureName[CTEXTURESMAX][CBTEXTURENAMEMAX];
 static char grgchTextureType[CTEXTURESMAX];
+static CaseInsensitiveStringIndex g_TextureTypeIndex{CBTEXTURENAMEMAX - 1};
 
 bool g_onladder = false;
 
@@ -146,41 +149,6 @@ static void PM_TraceModel(physent_t* pEnt, const Vector& start, const Vector& en
 	pmove->PM_TraceModel(pEnt, start, end, trace);
 }
 
-void PM_SwapTextures(int i, int j)
-{
-	char chTemp;
-	char szTemp[CBTEXTURENAMEMAX];
-
-	strcpy(szTemp, grgszTextureName[i]);
-	chTemp = grgchTextureType[i];
-
-	strcpy(grgszTextureName[i], grgszTextureName[j]);
-	grgchTextureType[i] = grgchTextureType[j];
-
-	strcpy(grgszTextureName[j], szTemp);
-	grgchTextureType[j] = chTemp;
-}
-
-void PM_SortTextures()
-{
-	// Bubble sort, yuck, but this only occurs at startup and it's only 512 elements...
-	//
-	int i, j;
-
-	for (i = 0; i < gcTextures; i++)
-	{
-		for (j = i + 1; j < gcTextures; j++)
-		{
-			if (stricmp(grgszTextureName[i], grgszTextureName[j]) > 0)
-			{
-				// Swap
-				//
-				PM_SwapTextures(i, j);
-			}
-		}
-	}
-}
-
 void PM_InitTextureTypes()
 {
 	char buffer[512];
@@ -196,6 +164,7 @@ void PM_InitTextureTypes()
 	memset(grgchTextureType, 0, CTEXTURESMAX);
 
 	gcTextures = 0;
+	g_TextureTypeIndex.Clear();
 	memset(buffer, 0, 512);
 
 	fileSize = pmove->COM_FileSize("sound/materials.txt");
@@ -246,38 +215,23 @@ void PM_InitTextureTypes()
 	// Must use engine to free since we are in a .dll
 	pmove->COM_FreeFile(pMemFile);
 
-	PM_SortTextures();
+	for (i = 0; i < gcTextures; i++)
+	{
+		g_TextureTypeIndex.Add(grgszTextureName[i], i);
+	}
 
 	bTextureTypeInit = true;
 }
 
 char PM_FindTextureType(const char* name)
 {
-	int left, right, pivot;
-	int val;
-
 	assert(pm_shared_initialized);
 
-	left = 0;
-	right = gcTextures - 1;
+	const int index = g_TextureTypeIndex.Find(name);
 
-	while (left <= right)
+	if (index != -1)
 	{
-		pivot = (left + right) / 2;
-
-		val = strnicmp(name, grgszTextureName[pivot], CBTEXTURENAMEMAX - 1);
-		if (val == 0)
-		{
-			return grgchTextureType[pivot];
-		}
-		else if (val > 0)
-		{
-			left = pivot + 1;
-		}
-		else if (val < 0)
-		{
-			right = pivot - 1;
-		}
+		return grgchTextureType[index];
 	}
 
 	return CHAR_TEX_CONCRETE;
@@ -3440,6 +3394,8 @@ and client.  This will ensure that prediction behaves appropriately.
 
 void PM_Move(struct playermove_s* ppmove, qboolean server)
 {
+	PROFILE_SCOPE("PM_Move");
+
 	assert(pm_shared_initialized);
 
 	pmove = ppmove;
@@ -84,6 +84,13 @@ FastChecksum
 ===============
 */
 
+#ifndef WIN32
+static int _rotl(int value, int shift)
+{
+	return static_cast<int>((static_cast<unsigned int>(value) << shift) | (static_cast<unsigned int>(value) >> (32 - shift)));
+}
+#endif
+
 int FastChecksum(void* buffer, int bytes)
 {
 	char* byteBuffer = reinterpret_cast<char*>(buffer);
@@ -16,6 +16,8 @@
 
 #ifdef WIN32
 #include <direct.h>
+#else
+#include <unistd.h>
 #endif
 
 #ifdef NeXT
@@ -226,7 +228,8 @@ void Q_getwd(char* out)
 	_getcwd(out, 256);
 	strcat(out, "\\");
 #else
-	getwd(out);
+	getcwd(out, 256);
+	strcat(out, "/");
 #endif
 }
 
@@ -0,0 +1,560 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// bsptrace.cpp - hull collision for the benchmark's stub engine, the same
+// recursive hull check the engine uses.
+
+#include <vector>
+
+#include "cmdlib.h"
+#include "mathlib.h"
+#include "bspfile.h"
+
+#include "bsptrace.h"
+
+#define DIST_EPSILON (0.03125)
+
+// Must match mplane_t in the game's pm_shared.cpp
+typedef struct
+{
+	float normal[3];
+	float dist;
+	unsigned char type;
+	unsigned char signbits;
+	unsigned char pad[2];
+} bsp_mplane_t;
+
+// Must match hull_t in the game's pm_shared.cpp
+typedef struct
+{
+	dclipnode_t* clipnodes;
+	bsp_mplane_t* planes;
+	int firstclipnode;
+	int lastclipnode;
+	float clip_mins[3];
+	float clip_maxs[3];
+} bsp_hull_t;
+
+static const float g_HullMins[BSP_MAX_HULLS][3] = {{0, 0, 0}, {-16, -16, -36}, {-32, -32, -32}, {-16, -16, -18}};
+static const float g_HullMaxs[BSP_MAX_HULLS][3] = {{0, 0, 0}, {16, 16, 36}, {32, 32, 32}, {16, 16, 18}};
+
+static std::vector<bsp_mplane_t> g_Planes;
+static std::vector<dclipnode_t> g_Hull0ClipNodes;
+static std::vector<bsp_hull_t> g_ModelHulls; // nummodels * BSP_MAX_HULLS
+
+// Texture space bounds of each face, used to find the face a trace hits
+typedef struct
+{
+	float mins[2];
+	float maxs[2];
+} bsp_face_extents_t;
+
+static std::vector<bsp_face_extents_t> g_FaceExtents;
+
+static dclipnode_t g_BoxClipNodes[6];
+static bsp_mplane_t g_BoxPlanes[6];
+static bsp_hull_t g_BoxHull;
+
+//=========================================================
+// Bsp_InitBoxHull - the box hull is a hull with six planes
+// whose distances are set for each box that is traced.
+//=========================================================
+static void Bsp_InitBoxHull()
+{
+	g_BoxHull.clipnodes = g_BoxClipNodes;
+	g_BoxHull.planes = g_BoxPlanes;
+	g_BoxHull.firstclipnode = 0;
+	g_BoxHull.lastclipnode = 5;
+
+	for (int i = 0; i < 6; i++)
+	{
+		g_BoxClipNodes[i].planenum = i;
+
+		const int side = i & 1;
+
+		g_BoxClipNodes[i].children[side] = CONTENTS_EMPTY;
+
+		if (i != 5)
+			g_BoxClipNodes[i].children[side ^ 1] = i + 1;
+		else
+			g_BoxClipNodes[i].children[side ^ 1] = CONTENTS_SOLID;
+
+		g_BoxPlanes[i].type = i >> 1;
+		g_BoxPlanes[i].normal[i >> 1] = 1;
+	}
+}
+
+void Bsp_Load(const char* fileName)
+{
+	LoadBSPFile(const_cast<char*>(fileName));
+
+	g_Planes.resize(numplanes);
+
+	for (int i = 0; i < numplanes; i++)
+	{
+		bsp_mplane_t& plane = g_Planes[i];
+
+		int bits = 0;
+
+		for (int j = 0; j < 3; j++)
+		{
+			plane.normal[j] = dplanes[i].normal[j];
+
+			if (plane.normal[j] < 0)
+				bits |= 1 << j;
+		}
+
+		plane.dist = dplanes[i].dist;
+		plane.type = dplanes[i].type;
+		plane.signbits = bits;
+	}
+
+	// The point hull uses the drawing nodes, with the leaf contents in place of the leaves.
+	g_Hull0ClipNodes.resize(numnodes);
+
+	for (int i = 0; i < numnodes; i++)
+	{
+		g_Hull0ClipNodes[i].planenum = dnodes[i].planenum;
+
+		for (int j = 0; j < 2; j++)
+		{
+			const int child = dnodes[i].children[j];
+
+			g_Hull0ClipNodes[i].children[j] = child < 0 ? dleafs[-1 - child].contents : child;
+		}
+	}
+
+	g_ModelHulls.resize(nummodels * BSP_MAX_HULLS);
+
+	for (int i = 0; i < nummodels; i++)
+	{
+		for (int j = 0; j < BSP_MAX_HULLS; j++)
+		{
+			bsp_hull_t& hull = g_ModelHulls[i * BSP_MAX_HULLS + j];
+
+			hull.clipnodes = j == 0 ? g_Hull0ClipNodes.data() : dclipnodes;
+			hull.planes = g_Planes.data();
+			hull.firstclipnode = dmodels[i].headnode[j];
+			hull.lastclipnode = (j == 0 ? numnodes : numclipnodes) - 1;
+			VectorCopy(g_HullMins[j], hull.clip_mins);
+			VectorCopy(g_HullMaxs[j], hull.clip_maxs);
+		}
+	}
+
+	g_FaceExtents.resize(numfaces);
+
+	for (int i = 0; i < numfaces; i++)
+	{
+		const dface_t* face = &dfaces[i];
+		const texinfo_t* tex = &texinfo[face->texinfo];
+		bsp_face_extents_t& extents = g_FaceExtents[i];
+
+		extents.mins[0] = extents.mins[1] = 999999;
+		extents.maxs[0] = extents.maxs[1] = -999999;
+
+		for (int j = 0; j < face->numedges; j++)
+		{
+			const int edge = dsurfedges[face->firstedge + j];
+			const dvertex_t* vertex = &dvertexes[edge >= 0 ? dedges[edge].v[0] : dedges[-edge].v[1]];
+
+			for (int k = 0; k < 2; k++)
+			{
+				const float value = DotProduct(vertex->point, tex->vecs[k]) + tex->vecs[k][3];
+
+				if (value < extents.mins[k])
+					extents.mins[k] = value;
+
+				if (value > extents.maxs[k])
+					extents.maxs[k] = value;
+			}
+		}
+	}
+
+	Bsp_InitBoxHull();
+}
+
+const char* Bsp_EntityString()
+{
+	return dentdata;
+}
+
+int Bsp_NumModels()
+{
+	return nummodels;
+}
+
+void Bsp_ModelBounds(int model, float* mins, float* maxs)
+{
+	VectorCopy(dmodels[model].mins, mins);
+	VectorCopy(dmodels[model].maxs, maxs);
+}
+
+void* Bsp_ModelHull(int model, int hull)
+{
+	return &g_ModelHulls[model * BSP_MAX_HULLS + hull];
+}
+
+void* Bsp_BoxHull(const float* mins, const float* maxs)
+{
+	g_BoxPlanes[0].dist = maxs[0];
+	g_BoxPlanes[1].dist = mins[0];
+	g_BoxPlanes[2].dist = maxs[1];
+	g_BoxPlanes[3].dist = mins[1];
+	g_BoxPlanes[4].dist = maxs[2];
+	g_BoxPlanes[5].dist = mins[2];
+
+	return &g_BoxHull;
+}
+
+void Bsp_HullSize(int hull, float* mins, float* maxs)
+{
+	VectorCopy(g_HullMins[hull], mins);
+	VectorCopy(g_HullMaxs[hull], maxs);
+}
+
+int Bsp_HullFirstClipNode(void* hull)
+{
+	return static_cast<bsp_hull_t*>(hull)->firstclipnode;
+}
+
+int Bsp_HullPointContents(void* pHull, int num, const float* point)
+{
+	const bsp_hull_t* hull = static_cast<bsp_hull_t*>(pHull);
+
+	while (num >= 0)
+	{
+		const dclipnode_t* node = &hull->clipnodes[num];
+		const bsp_mplane_t* plane = &hull->planes[node->planenum];
+
+		float d;
+
+		if (plane->type < 3)
+			d = point[plane->type] - plane->dist;
+		else
+			d = DotProduct(plane->normal, point) - plane->dist;
+
+		num = d < 0 ? node->children[1] : node->children[0];
+	}
+
+	return num;
+}
+
+void Bsp_InitTrace(BspTrace& trace, const float* end)
+{
+	trace = {};
+	trace.AllSolid = true;
+	trace.Fraction = 1;
+	VectorCopy(end, trace.EndPos);
+}
+
+//=========================================================
+// Bsp_RecursiveHullCheck - returns false once the trace
+// has hit something.
+//=========================================================
+static bool Bsp_RecursiveHullCheck(const bsp_hull_t* hull, int num, float p1f, float p2f, const float* p1, const float* p2, BspTrace& trace)
+{
+	// check for empty
+	if (num < 0)
+	{
+		if (num != CONTENTS_SOLID)
+		{
+			trace.AllSolid = false;
+
+			if (num == CONTENTS_EMPTY)
+				trace.InOpen = true;
+			else
+				trace.InWater = true;
+		}
+		else
+		{
+			trace.StartSolid = true;
+		}
+
+		return true; // empty
+	}
+
+	const dclipnode_t* node = &hull->clipnodes[num];
+	const bsp_mplane_t* plane = &hull->planes[node->planenum];
+
+	float t1, t2;
+
+	if (plane->type < 3)
+	{
+		t1 = p1[plane->type] - plane->dist;
+		t2 = p2[plane->type] - plane->dist;
+	}
+	else
+	{
+		t1 = DotProduct(plane->normal, p1) - plane->dist;
+		t2 = DotProduct(plane->normal, p2) - plane->dist;
+	}
+
+	if (t1 >= 0 && t2 >= 0)
+		return Bsp_RecursiveHullCheck(hull, node->children[0], p1f, p2f, p1, p2, trace);
+
+	if (t1 < 0 && t2 < 0)
+		return Bsp_RecursiveHullCheck(hull, node->children[1], p1f, p2f, p1, p2, trace);
+
+	// put the crosspoint DIST_EPSILON pixels on the near side
+	float frac;
+
+	if (t1 < 0)
+		frac = (t1 + DIST_EPSILON) / (t1 - t2);
+	else
+		frac = (t1 - DIST_EPSILON) / (t1 - t2);
+
+	if (frac < 0)
+		frac = 0;
+
+	if (frac > 1)
+		frac = 1;
+
+	float midf = p1f + (p2f - p1f) * frac;
+	float mid[3];
+
+	for (int i = 0; i < 3; i++)
+		mid[i] = p1[i] + frac * (p2[i] - p1[i]);
+
+	const int side = t1 < 0 ? 1 : 0;
+
+	// move up to the node
+	if (!Bsp_RecursiveHullCheck(hull, node->children[side], p1f, midf, p1, mid, trace))
+		return false;
+
+	if (Bsp_HullPointContents(const_cast<bsp_hull_t*>(hull), node->children[side ^ 1], mid) != CONTENTS_SOLID)
+	{
+		// go past the node
+		return Bsp_RecursiveHullCheck(hull, node->children[side ^ 1], midf, p2f, mid, p2, trace);
+	}
+
+	if (trace.AllSolid)
+		return false; // never got out of the solid area
+
+	// the other side of the node is solid, this is the impact point
+	if (0 == side)
+	{
+		VectorCopy(plane->normal, trace.PlaneNormal);
+		trace.PlaneDist = plane->dist;
+	}
+	else
+	{
+		VectorSubtract(vec3_origin, plane->normal, trace.PlaneNormal);
+		trace.PlaneDist = -plane->dist;
+	}
+
+	while (Bsp_HullPointContents(const_cast<bsp_hull_t*>(hull), hull->firstclipnode, mid) == CONTENTS_SOLID)
+	{
+		// shouldn't really happen, but does occasionally
+		frac -= 0.1f;
+
+		if (frac < 0)
+		{
+			trace.Fraction = midf;
+			VectorCopy(mid, trace.EndPos);
+			return false;
+		}
+
+		midf = p1f + (p2f - p1f) * frac;
+
+		for (int i = 0; i < 3; i++)
+			mid[i] = p1[i] + frac * (p2[i] - p1[i]);
+	}
+
+	trace.Fraction = midf;
+	VectorCopy(mid, trace.EndPos);
+
+	return false;
+}
+
+void Bsp_ClipToHull(void* pHull, const float* start, const float* end, BspTrace& trace)
+{
+	const bsp_hull_t* hull = static_cast<bsp_hull_t*>(pHull);
+
+	Bsp_RecursiveHullCheck(hull, hull->firstclipnode, 0, 1, start, end, trace);
+
+	if (trace.AllSolid)
+		trace.StartSolid = true;
+
+	if (trace.Fraction == 1)
+		VectorCopy(end, trace.EndPos);
+}
+
+//=========================================================
+// Bsp_SurfaceAtPoint - walks the drawing nodes along the
+// line and returns the texture of the first face that
+// contains the point where the line crosses its node.
+//=========================================================
+static const char* Bsp_SurfaceAtPoint(int num, const float* start, const float* end)
+{
+	if (num < 0)
+		return nullptr;
+
+	const dnode_t* node = &dnodes[num];
+	const dplane_t* plane = &dplanes[node->planenum];
+
+	const float front = DotProduct(start, plane->normal) - plane->dist;
+	const float back = DotProduct(end, plane->normal) - plane->dist;
+
+	const int side = front < 0 ? 1 : 0;
+
+	if ((back < 0 ? 1 : 0) == side)
+		return Bsp_SurfaceAtPoint(node->children[side], start, end);
+
+	const float frac = front / (front - back);
+
+	float mid[3];
+
+	for (int i = 0; i < 3; i++)
+		mid[i] = start[i] + (end[i] - start[i]) * frac;
+
+	// go down front side
+	if (const char* name = Bsp_SurfaceAtPoint(node->children[side], start, mid); name)
+		return name;
+
+	// check for impact on this node
+	for (int i = 0; i < node->numfaces; i++)
+	{
+		const int faceIndex = node->firstface + i;
+		const texinfo_t* tex = &texinfo[dfaces[faceIndex].texinfo];
+		const bsp_face_extents_t& extents = g_FaceExtents[faceIndex];
+
+		const float ds = DotProduct(mid, tex->vecs[0]) + tex->vecs[0][3];
+		const float dt = DotProduct(mid, tex->vecs[1]) + tex->vecs[1][3];
+
+		if (ds < extents.mins[0] || ds > extents.maxs[0] || dt < extents.mins[1] || dt > extents.maxs[1])
+			continue;
+
+		const dmiptexlump_t* lump = reinterpret_cast<const dmiptexlump_t*>(dtexdata);
+
+		if (texdatasize <= 0 || tex->miptex < 0 || tex->miptex >= lump->nummiptex || lump->dataofs[tex->miptex] == -1)
+			return nullptr;
+
+		return reinterpret_cast<const miptex_t*>(dtexdata + lump->dataofs[tex->miptex])->name;
+	}
+
+	// go down back side
+	return Bsp_SurfaceAtPoint(node->children[side ^ 1], mid, end);
+}
+
+const char* Bsp_TraceTexture(int model, const float* start, const float* end)
+{
+	return Bsp_SurfaceAtPoint(dmodels[model].headnode[0], start, end);
+}
+
+int Bsp_PVSBytes()
+{
+	return (dmodels[0].visleafs + 7) >> 3;
+}
+
+int Bsp_PointLeaf(const float* point)
+{
+	int num = dmodels[0].headnode[0];
+
+	while (num >= 0)
+	{
+		const dnode_t* node = &dnodes[num];
+		const dplane_t* plane = &dplanes[node->planenum];
+
+		num = DotProduct(point, plane->normal) - plane->dist < 0 ? node->children[1] : node->children[0];
+	}
+
+	return -1 - num;
+}
+
+void Bsp_LeafPVS(int leaf, unsigned char* pvs)
+{
+	const int row = Bsp_PVSBytes();
+
+	if (leaf <= 0 || visdatasize <= 0 || dleafs[leaf].visofs < 0)
+	{
+		memset(pvs, 0xFF, row);
+		return;
+	}
+
+	const byte* in = dvisdata + dleafs[leaf].visofs;
+	unsigned char* out = pvs;
+
+	while (out - pvs < row)
+	{
+		if (*in)
+		{
+			*out++ = *in++;
+			continue;
+		}
+
+		int c = in[1];
+		in += 2;
+
+		while (c && out - pvs < row)
+		{
+			*out++ = 0;
+			c--;
+		}
+	}
+}
+
+static void Bsp_BoxLeafs_r(int num, const float* mins, const float* maxs, short* leafs, int maxLeafs, int& count)
+{
+	while (num >= 0)
+	{
+		const dnode_t* node = &dnodes[num];
+		const dplane_t* plane = &dplanes[node->planenum];
+
+		// BoxOnPlaneSide without the sign bit table
+		float dmin = 0, dmax = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			if (plane->normal[i] >= 0)
+			{
+				dmin += plane->normal[i] * mins[i];
+				dmax += plane->normal[i] * maxs[i];
+			}
+			else
+			{
+				dmin += plane->normal[i] * maxs[i];
+				dmax += plane->normal[i] * mins[i];
+			}
+		}
+
+		if (dmin >= plane->dist)
+		{
+			num = node->children[0];
+		}
+		else if (dmax < plane->dist)
+		{
+			num = node->children[1];
+		}
+		else
+		{
+			Bsp_BoxLeafs_r(node->children[0], mins, maxs, leafs, maxLeafs, count);
+			num = node->children[1];
+		}
+	}
+
+	const int leaf = -1 - num;
+
+	if (leaf == 0 || dleafs[leaf].contents == CONTENTS_SOLID)
+		return;
+
+	if (count < maxLeafs)
+		leafs[count] = leaf - 1;
+
+	++count;
+}
+
+int Bsp_BoxLeafs(const float* mins, const float* maxs, short* leafs, int maxLeafs)
+{
+	int count = 0;
+
+	Bsp_BoxLeafs_r(dmodels[0].headnode[0], mins, maxs, leafs, maxLeafs, count);
+
+	return count;
+}
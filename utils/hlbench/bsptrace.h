@@ -0,0 +1,99 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+#pragma once
+
+/**
+*	@file
+*
+*	Collision against the hulls stored in a BSP file, loaded with utils/common/bspfile.
+*	This header only uses plain types because the SDK and the tools each have their own mathlib.h.
+*/
+
+constexpr int BSP_MAX_HULLS = 4;
+
+/**
+*	@brief Result of a hull trace. Same meaning as the fields of the engine's trace_t.
+*/
+struct BspTrace
+{
+	bool AllSolid;
+	bool StartSolid;
+	bool InOpen;
+	bool InWater;
+	float Fraction;
+	float EndPos[3];
+	float PlaneNormal[3];
+	float PlaneDist;
+};
+
+/**
+*	@brief Loads the BSP file and builds the point hull from its nodes. Exits on failure.
+*/
+void Bsp_Load(const char* fileName);
+
+const char* Bsp_EntityString();
+
+int Bsp_NumModels();
+
+void Bsp_ModelBounds(int model, float* mins, float* maxs);
+
+/**
+*	@brief Returns a hull laid out like the game's hull_t so it can be handed to PM_HullForBsp callers.
+*/
+void* Bsp_ModelHull(int model, int hull);
+
+/**
+*	@brief Returns a hull for a box with the given extents, valid until the next call.
+*/
+void* Bsp_BoxHull(const float* mins, const float* maxs);
+
+/**
+*	@brief Gets the size of the box that the BSP compiler expanded the brushes by for @p hull.
+*/
+void Bsp_HullSize(int hull, float* mins, float* maxs);
+
+int Bsp_HullFirstClipNode(void* hull);
+
+int Bsp_HullPointContents(void* hull, int num, const float* point);
+
+/**
+*	@brief Clips the line from @p start to @p end against @p hull. @p trace must have been initialized with Bsp_InitTrace.
+*/
+void Bsp_ClipToHull(void* hull, const float* start, const float* end, BspTrace& trace);
+
+void Bsp_InitTrace(BspTrace& trace, const float* end);
+
+/**
+*	@brief Returns the name of the texture on the surface of @p model that the line from @p start to @p end hits first,
+*	or null if it doesn't hit one. The points are in model space.
+*/
+const char* Bsp_TraceTexture(int model, const float* start, const float* end);
+
+/**
+*	@brief Returns the number of bytes in a PVS row.
+*/
+int Bsp_PVSBytes();
+
+/**
+*	@brief Returns the world leaf that contains @p point. Leaf 0 is the shared solid leaf.
+*/
+int Bsp_PointLeaf(const float* point);
+
+/**
+*	@brief Decompresses the PVS of @p leaf into @p pvs. Bit n is set if leaf n + 1 is visible.
+*/
+void Bsp_LeafPVS(int leaf, unsigned char* pvs);
+
+/**
+*	@brief Finds the world leaves touched by the box. The leaves are stored as PVS bit numbers.
+*	@return The number of leaves found, which can be larger than @p maxLeafs if the array overflowed.
+*/
+int Bsp_BoxLeafs(const float* mins, const float* maxs, short* leafs, int maxLeafs);
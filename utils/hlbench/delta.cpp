@@ -0,0 +1,773 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// delta.cpp - delta encodes the client updates the way the engine does, using the field definitions in delta.lst
+// and the game's encoders, to measure what each field costs. Can write a copy of delta.lst with the bit counts
+// cut down to the values that were actually sent.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <regex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hlbench.h"
+
+// Field types, see the engine's delta.h
+constexpr unsigned int DT_BYTE = 1 << 0;
+constexpr unsigned int DT_SHORT = 1 << 1;
+constexpr unsigned int DT_FLOAT = 1 << 2;
+constexpr unsigned int DT_INTEGER = 1 << 3;
+constexpr unsigned int DT_ANGLE = 1 << 4;
+constexpr unsigned int DT_TIMEWINDOW_8 = 1 << 5;
+constexpr unsigned int DT_TIMEWINDOW_BIG = 1 << 6;
+constexpr unsigned int DT_STRING = 1 << 7;
+constexpr unsigned int DT_SIGNED = 1u << 31;
+
+struct DeltaField
+{
+	std::string Name;
+	unsigned int Type = 0;
+	int Bits = 0;
+	float Multiplier = 1;
+	int Line = -1;	 //!< Line of the definition in delta.lst
+	int Offset = -1; //!< In the structure, -1 if the structure isn't known.
+	int Size = 0;
+
+	std::int64_t Sends = 0;
+	std::int64_t QuantizedSends = 0; //!< Sent although the client ends up with the same value.
+	std::int64_t Overflows = 0;		 //!< Didn't fit in Bits, so the client got a clamped or truncated value.
+	std::int64_t BitsSent = 0;
+	std::int64_t Min = INT64_MAX; //!< Smallest value sent, after scaling
+	std::int64_t Max = INT64_MIN;
+};
+
+using DeltaEncoder = void (*)(delta_s* fields, const unsigned char* from, const unsigned char* to);
+
+/**
+*	@brief One structure from delta.lst, with the fields marked for sending in the delta being written.
+*/
+struct delta_s
+{
+	std::string Name;
+	std::string EncoderName;
+	DeltaEncoder Encoder = nullptr;
+	std::vector<DeltaField> Fields;
+	std::vector<bool> Send;
+
+	std::int64_t Updates = 0;
+	std::int64_t BitsSent = 0; //!< Including the bits saying which fields follow.
+};
+
+/**
+*	@brief Where a field named in delta.lst is found in its structure.
+*/
+struct DeltaLayout
+{
+	const char* Name;
+	int Offset;
+	int Size;
+	bool IsArray;
+};
+
+#define DELTA_FIELD(type, name) {#name, static_cast<int>(offsetof(type, name)), static_cast<int>(sizeof(type::name)), false}
+#define DELTA_ARRAY(type, name) {#name, static_cast<int>(offsetof(type, name)), static_cast<int>(sizeof(std::declval<type&>().name[0])), true}
+
+static const DeltaLayout EntityStateLayout[] =
+	{
+		DELTA_FIELD(entity_state_t, animtime),
+		DELTA_FIELD(entity_state_t, frame),
+		DELTA_ARRAY(entity_state_t, origin),
+		DELTA_ARRAY(entity_state_t, angles),
+		DELTA_FIELD(entity_state_t, sequence),
+		DELTA_FIELD(entity_state_t, modelindex),
+		DELTA_FIELD(entity_state_t, movetype),
+		DELTA_FIELD(entity_state_t, solid),
+		DELTA_ARRAY(entity_state_t, mins),
+		DELTA_ARRAY(entity_state_t, maxs),
+		DELTA_ARRAY(entity_state_t, endpos),
+		DELTA_ARRAY(entity_state_t, startpos),
+		DELTA_FIELD(entity_state_t, impacttime),
+		DELTA_FIELD(entity_state_t, starttime),
+		DELTA_FIELD(entity_state_t, weaponmodel),
+		DELTA_FIELD(entity_state_t, owner),
+		DELTA_FIELD(entity_state_t, effects),
+		DELTA_FIELD(entity_state_t, eflags),
+		DELTA_FIELD(entity_state_t, colormap),
+		DELTA_FIELD(entity_state_t, framerate),
+		DELTA_FIELD(entity_state_t, skin),
+		DELTA_ARRAY(entity_state_t, controller),
+		DELTA_ARRAY(entity_state_t, blending),
+		DELTA_FIELD(entity_state_t, body),
+		DELTA_FIELD(entity_state_t, rendermode),
+		DELTA_FIELD(entity_state_t, renderamt),
+		DELTA_FIELD(entity_state_t, renderfx),
+		DELTA_FIELD(entity_state_t, scale),
+		DELTA_FIELD(entity_state_t, rendercolor.r),
+		DELTA_FIELD(entity_state_t, rendercolor.g),
+		DELTA_FIELD(entity_state_t, rendercolor.b),
+		DELTA_FIELD(entity_state_t, aiment),
+		DELTA_ARRAY(entity_state_t, basevelocity),
+		DELTA_FIELD(entity_state_t, playerclass),
+		DELTA_FIELD(entity_state_t, gaitsequence),
+		DELTA_FIELD(entity_state_t, team),
+		DELTA_FIELD(entity_state_t, friction),
+		DELTA_FIELD(entity_state_t, usehull),
+		DELTA_FIELD(entity_state_t, gravity),
+		DELTA_FIELD(entity_state_t, spectator),
+		{nullptr, 0, 0, false}};
+
+static const DeltaLayout ClientDataLayout[] =
+	{
+		DELTA_ARRAY(clientdata_t, origin),
+		DELTA_ARRAY(clientdata_t, velocity),
+		DELTA_FIELD(clientdata_t, viewmodel),
+		DELTA_ARRAY(clientdata_t, punchangle),
+		DELTA_FIELD(clientdata_t, flags),
+		DELTA_FIELD(clientdata_t, waterlevel),
+		DELTA_FIELD(clientdata_t, watertype),
+		DELTA_ARRAY(clientdata_t, view_ofs),
+		DELTA_FIELD(clientdata_t, health),
+		DELTA_FIELD(clientdata_t, bInDuck),
+		DELTA_FIELD(clientdata_t, weapons),
+		DELTA_FIELD(clientdata_t, flTimeStepSound),
+		DELTA_FIELD(clientdata_t, flDuckTime),
+		DELTA_FIELD(clientdata_t, flSwimTime),
+		DELTA_FIELD(clientdata_t, waterjumptime),
+		DELTA_FIELD(clientdata_t, maxspeed),
+		DELTA_FIELD(clientdata_t, fov),
+		DELTA_FIELD(clientdata_t, weaponanim),
+		DELTA_FIELD(clientdata_t, m_iId),
+		DELTA_FIELD(clientdata_t, ammo_shells),
+		DELTA_FIELD(clientdata_t, ammo_nails),
+		DELTA_FIELD(clientdata_t, ammo_cells),
+		DELTA_FIELD(clientdata_t, ammo_rockets),
+		DELTA_FIELD(clientdata_t, m_flNextAttack),
+		DELTA_FIELD(clientdata_t, tfstate),
+		DELTA_FIELD(clientdata_t, pushmsec),
+		DELTA_FIELD(clientdata_t, deadflag),
+		DELTA_FIELD(clientdata_t, physinfo),
+		DELTA_FIELD(clientdata_t, iuser1),
+		DELTA_FIELD(clientdata_t, iuser2),
+		DELTA_FIELD(clientdata_t, iuser3),
+		DELTA_FIELD(clientdata_t, iuser4),
+		DELTA_FIELD(clientdata_t, fuser1),
+		DELTA_FIELD(clientdata_t, fuser2),
+		DELTA_FIELD(clientdata_t, fuser3),
+		DELTA_FIELD(clientdata_t, fuser4),
+		DELTA_ARRAY(clientdata_t, vuser1),
+		DELTA_ARRAY(clientdata_t, vuser2),
+		DELTA_ARRAY(clientdata_t, vuser3),
+		DELTA_ARRAY(clientdata_t, vuser4),
+		{nullptr, 0, 0, false}};
+
+#undef DELTA_FIELD
+#undef DELTA_ARRAY
+
+static std::vector<std::string> g_DeltaLines;
+static bool g_DeltaEndsWithNewline = true;
+static std::vector<delta_s> g_Deltas;
+
+static delta_s* g_EntityDelta = nullptr;
+static delta_s* g_PlayerDelta = nullptr;
+static delta_s* g_CustomDelta = nullptr;
+static delta_s* g_ClientDataDelta = nullptr;
+
+static int g_DeltaCurrentPlayer = -1;
+
+/**
+*	@brief What was last sent to a client, to delta the next update from.
+*/
+struct DeltaClient
+{
+	std::vector<entity_state_t> Entities;
+	std::vector<int> EntityUpdate; //!< Update each entity was last sent in
+	clientdata_t ClientData{};
+	int Update = 0;
+};
+
+static std::vector<DeltaClient> g_DeltaClients;
+
+//=========================================================
+// Delta_FindLayout - works out where a field like
+// "origin[2]" or "rendercolor.r" is in its structure.
+//=========================================================
+static bool Delta_FindLayout(const DeltaLayout* layout, const std::string& name, int& offset, int& size)
+{
+	std::string baseName = name;
+	int index = 0;
+
+	if (const auto bracket = name.find('['); bracket != std::string::npos)
+	{
+		baseName = name.substr(0, bracket);
+		index = atoi(name.c_str() + bracket + 1);
+	}
+
+	for (; layout->Name; ++layout)
+	{
+		if (baseName != layout->Name || layout->IsArray != (baseName != name))
+			continue;
+
+		offset = layout->Offset + index * layout->Size;
+		size = layout->Size;
+
+		return true;
+	}
+
+	return false;
+}
+
+static void Delta_Parse()
+{
+	static const std::regex header(R"(^\s*(\w+)\s+(none|gamedll|clientdll)\s*(\w*))");
+	static const std::regex field(R"(DEFINE_DELTA(?:_POST)?\(\s*([^,\s]+)\s*,\s*([^,]+?)\s*,\s*(\d+)\s*,\s*([-+0-9.eE]+))");
+	static const std::regex type(R"(\w+)");
+
+	delta_s* delta = nullptr;
+
+	for (int line = 0; line < static_cast<int>(g_DeltaLines.size()); line++)
+	{
+		const std::string& text = g_DeltaLines[line];
+
+		// Skip comments.
+		const std::string code = text.substr(0, text.find("//"));
+
+		std::smatch match;
+
+		if (std::regex_search(code, match, field))
+		{
+			if (!delta)
+				continue;
+
+			DeltaField def;
+			def.Name = match[1];
+			def.Bits = atoi(match[3].str().c_str());
+			def.Multiplier = static_cast<float>(atof(match[4].str().c_str()));
+			def.Line = line;
+
+			const std::string types = match[2];
+
+			for (std::sregex_iterator it(types.begin(), types.end(), type), end; it != end; ++it)
+			{
+				static const std::pair<const char*, unsigned int> TypeNames[] =
+					{
+						{"DT_BYTE", DT_BYTE},
+						{"DT_SHORT", DT_SHORT},
+						{"DT_FLOAT", DT_FLOAT},
+						{"DT_INTEGER", DT_INTEGER},
+						{"DT_ANGLE", DT_ANGLE},
+						{"DT_TIMEWINDOW_8", DT_TIMEWINDOW_8},
+						{"DT_TIMEWINDOW_BIG", DT_TIMEWINDOW_BIG},
+						{"DT_STRING", DT_STRING},
+						{"DT_SIGNED", DT_SIGNED}};
+
+				for (const auto& [name, value] : TypeNames)
+				{
+					if (it->str() == name)
+						def.Type |= value;
+				}
+			}
+
+			delta->Fields.push_back(std::move(def));
+		}
+		else if (std::regex_search(code, match, header))
+		{
+			g_Deltas.emplace_back();
+			delta = &g_Deltas.back();
+			delta->Name = match[1];
+
+			if (match[2] == "gamedll")
+				delta->EncoderName = match[3];
+		}
+	}
+}
+
+void Delta_Init(const char* fileName)
+{
+	std::ifstream file(fileName, std::ios::binary);
+
+	if (!file)
+		Engine_Error("Couldn't open %s\n", fileName);
+
+	const std::string contents{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+	std::size_t start = 0;
+
+	while (start < contents.size())
+	{
+		std::size_t end = contents.find('\n', start);
+
+		if (end == std::string::npos)
+			end = contents.size();
+
+		std::string line = contents.substr(start, end - start);
+
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		g_DeltaLines.push_back(std::move(line));
+
+		start = end + 1;
+	}
+
+	g_DeltaEndsWithNewline = contents.empty() || contents.back() == '\n';
+
+	Delta_Parse();
+
+	// Pointers into g_Deltas stay valid from here on.
+	for (auto& delta : g_Deltas)
+	{
+		const DeltaLayout* layout = nullptr;
+
+		if (delta.Name == "entity_state_t")
+		{
+			g_EntityDelta = &delta;
+			layout = EntityStateLayout;
+		}
+		else if (delta.Name == "entity_state_player_t")
+		{
+			g_PlayerDelta = &delta;
+			layout = EntityStateLayout;
+		}
+		else if (delta.Name == "custom_entity_state_t")
+		{
+			g_CustomDelta = &delta;
+			layout = EntityStateLayout;
+		}
+		else if (delta.Name == "clientdata_t")
+		{
+			g_ClientDataDelta = &delta;
+			layout = ClientDataLayout;
+		}
+
+		if (!layout)
+			continue;
+
+		for (auto& field : delta.Fields)
+		{
+			if (!Delta_FindLayout(layout, field.Name, field.Offset, field.Size))
+				Engine_Error("%s: unknown field %s in %s\n", fileName, field.Name.c_str(), delta.Name.c_str());
+		}
+
+		delta.Send.resize(delta.Fields.size());
+	}
+
+	if (!g_EntityDelta || !g_PlayerDelta || !g_CustomDelta || !g_ClientDataDelta)
+		Engine_Error("%s doesn't define all of the client update structures\n", fileName);
+
+	// Like the engine, let the game attach its encoders now that the structures exist.
+	if (g_GameFuncs.pfnRegisterEncoders)
+		g_GameFuncs.pfnRegisterEncoders();
+
+	g_DeltaClients.resize(g_Globals.maxClients);
+}
+
+bool Delta_IsActive()
+{
+	return !g_Deltas.empty();
+}
+
+//=========================================================
+// Functions the game's encoders call
+//=========================================================
+void Delta_AddEncoder(const char* name, DeltaEncoder encoder)
+{
+	for (auto& delta : g_Deltas)
+	{
+		if (delta.EncoderName == name)
+			delta.Encoder = encoder;
+	}
+}
+
+int Delta_FindField(delta_s* fields, const char* fieldName)
+{
+	if (!fields)
+		return -1;
+
+	for (std::size_t i = 0; i < fields->Fields.size(); i++)
+	{
+		if (0 == stricmp(fields->Fields[i].Name.c_str(), fieldName))
+			return static_cast<int>(i);
+	}
+
+	return -1;
+}
+
+void Delta_SetFieldByIndex(delta_s* fields, int fieldNumber)
+{
+	if (fields && fieldNumber >= 0 && fieldNumber < static_cast<int>(fields->Send.size()))
+		fields->Send[fieldNumber] = true;
+}
+
+void Delta_UnsetFieldByIndex(delta_s* fields, int fieldNumber)
+{
+	if (fields && fieldNumber >= 0 && fieldNumber < static_cast<int>(fields->Send.size()))
+		fields->Send[fieldNumber] = false;
+}
+
+void Delta_SetField(delta_s* fields, const char* fieldName)
+{
+	Delta_SetFieldByIndex(fields, Delta_FindField(fields, fieldName));
+}
+
+void Delta_UnsetField(delta_s* fields, const char* fieldName)
+{
+	Delta_UnsetFieldByIndex(fields, Delta_FindField(fields, fieldName));
+}
+
+int Delta_CurrentPlayer()
+{
+	return g_DeltaCurrentPlayer;
+}
+
+//=========================================================
+// Delta_Quantize - the value the engine writes for a field,
+// before it is cut to the field's bits.
+//=========================================================
+static std::int64_t Delta_Quantize(const DeltaField& field, const unsigned char* data)
+{
+	const unsigned char* p = data + field.Offset;
+	const bool isSigned = (field.Type & DT_SIGNED) != 0;
+
+	switch (field.Type & ~DT_SIGNED)
+	{
+	case DT_BYTE:
+		return static_cast<std::int64_t>((isSigned ? *reinterpret_cast<const signed char*>(p) : *p) * field.Multiplier);
+
+	case DT_SHORT:
+	{
+		std::int16_t value;
+		memcpy(&value, p, sizeof(value));
+		return static_cast<std::int64_t>((isSigned ? value : static_cast<std::uint16_t>(value)) * field.Multiplier);
+	}
+
+	case DT_INTEGER:
+	{
+		std::int32_t value;
+		memcpy(&value, p, sizeof(value));
+		return isSigned ? static_cast<std::int64_t>(value * field.Multiplier) : static_cast<std::int64_t>(static_cast<std::uint32_t>(value) * static_cast<double>(field.Multiplier));
+	}
+
+	case DT_FLOAT:
+	{
+		float value;
+		memcpy(&value, p, sizeof(value));
+		return static_cast<std::int64_t>(value * field.Multiplier);
+	}
+
+	case DT_ANGLE:
+	{
+		float value;
+		memcpy(&value, p, sizeof(value));
+		return static_cast<std::int64_t>(value * (1 << field.Bits) / 360.0) & ((1 << field.Bits) - 1);
+	}
+
+	case DT_TIMEWINDOW_8:
+	{
+		float value;
+		memcpy(&value, p, sizeof(value));
+		return static_cast<std::int64_t>(g_Globals.time * 100.0) - static_cast<std::int64_t>(value * 100.0);
+	}
+
+	case DT_TIMEWINDOW_BIG:
+	{
+		float value;
+		memcpy(&value, p, sizeof(value));
+		return static_cast<std::int64_t>(g_Globals.time * field.Multiplier) - static_cast<std::int64_t>(value * field.Multiplier);
+	}
+	}
+
+	return 0;
+}
+
+static bool Delta_IsSigned(const DeltaField& field)
+{
+	return (field.Type & (DT_SIGNED | DT_TIMEWINDOW_8 | DT_TIMEWINDOW_BIG)) != 0;
+}
+
+static bool Delta_Fits(const DeltaField& field, std::int64_t value)
+{
+	if (Delta_IsSigned(field))
+	{
+		const std::int64_t limit = (std::int64_t{1} << (field.Bits - 1)) - 1;
+		return value >= -limit && value <= limit;
+	}
+
+	return value >= 0 && value < (std::int64_t{1} << field.Bits);
+}
+
+//=========================================================
+// Delta_Write - marks the fields that differ like the
+// engine does, lets the game's encoder change that, and
+// counts what sending the rest would cost.
+//=========================================================
+static void Delta_Write(delta_s& delta, const unsigned char* from, const unsigned char* to)
+{
+	for (std::size_t i = 0; i < delta.Fields.size(); i++)
+	{
+		const DeltaField& field = delta.Fields[i];
+
+		if ((field.Type & DT_STRING) != 0)
+			delta.Send[i] = 0 != stricmp(reinterpret_cast<const char*>(from + field.Offset), reinterpret_cast<const char*>(to + field.Offset));
+		else
+			delta.Send[i] = 0 != memcmp(from + field.Offset, to + field.Offset, field.Size);
+	}
+
+	if (delta.Encoder)
+		delta.Encoder(&delta, from, to);
+
+	++delta.Updates;
+
+	int lastSent = -1;
+
+	for (std::size_t i = 0; i < delta.Fields.size(); i++)
+	{
+		if (!delta.Send[i])
+			continue;
+
+		lastSent = static_cast<int>(i);
+
+		DeltaField& field = delta.Fields[i];
+
+		++field.Sends;
+
+		if ((field.Type & DT_STRING) != 0)
+		{
+			field.BitsSent += 8 * (strlen(reinterpret_cast<const char*>(to + field.Offset)) + 1);
+			continue;
+		}
+
+		field.BitsSent += field.Bits;
+
+		const std::int64_t value = Delta_Quantize(field, to);
+
+		field.Min = std::min(field.Min, value);
+		field.Max = std::max(field.Max, value);
+
+		if (!Delta_Fits(field, value))
+			++field.Overflows;
+
+		// Time windows are relative to the current time, so they can't be compared.
+		if ((field.Type & (DT_TIMEWINDOW_8 | DT_TIMEWINDOW_BIG)) == 0 && value == Delta_Quantize(field, from))
+			++field.QuantizedSends;
+	}
+
+	// The number of bytes of field bits, then the field bits up to the last field sent.
+	delta.BitsSent += 3 + 8 * ((lastSent + 8) / 8);
+}
+
+void Delta_WriteClientUpdate(edict_t* client, const entity_state_t* states, int count, const clientdata_t& clientData)
+{
+	const int clientIndex = ED_Index(client) - 1;
+
+	if (clientIndex < 0 || clientIndex >= static_cast<int>(g_DeltaClients.size()))
+		return;
+
+	DeltaClient& last = g_DeltaClients[clientIndex];
+
+	if (last.Entities.size() < static_cast<std::size_t>(g_Globals.maxEntities))
+	{
+		last.Entities.resize(g_Globals.maxEntities);
+		last.EntityUpdate.resize(g_Globals.maxEntities, -1);
+	}
+
+	g_DeltaCurrentPlayer = clientIndex;
+
+	static const entity_state_t NullState{};
+
+	for (int i = 0; i < count; i++)
+	{
+		const entity_state_t& state = states[i];
+
+		if (state.number < 0 || state.number >= g_Globals.maxEntities)
+			continue;
+
+		// An entity that wasn't in the last update is sent from scratch. The engine uses the entity's baseline,
+		// which only exists for entities spawned with the map, so this overestimates the cost of the others.
+		const bool hadState = last.EntityUpdate[state.number] == last.Update;
+		const entity_state_t& from = hadState ? last.Entities[state.number] : NullState;
+
+		delta_s* delta = g_EntityDelta;
+
+		if (state.entityType == ENTITY_BEAM)
+			delta = g_CustomDelta;
+		else if (state.number >= 1 && state.number <= g_Globals.maxClients)
+			delta = g_PlayerDelta;
+
+		Delta_Write(*delta, reinterpret_cast<const unsigned char*>(&from), reinterpret_cast<const unsigned char*>(&state));
+
+		last.Entities[state.number] = state;
+		last.EntityUpdate[state.number] = last.Update + 1;
+	}
+
+	Delta_Write(*g_ClientDataDelta, reinterpret_cast<const unsigned char*>(&last.ClientData), reinterpret_cast<const unsigned char*>(&clientData));
+
+	last.ClientData = clientData;
+	++last.Update;
+
+	g_DeltaCurrentPlayer = -1;
+}
+
+/**
+*	@brief The fewest bits the values sent would fit in, or 0 if they can't be cut.
+*/
+static int Delta_NeededBits(const DeltaField& field)
+{
+	if ((field.Type & (DT_ANGLE | DT_TIMEWINDOW_8 | DT_TIMEWINDOW_BIG | DT_STRING)) != 0 || 0 == field.Sends || 0 != field.Overflows)
+		return 0;
+
+	if (Delta_IsSigned(field))
+	{
+		const std::int64_t magnitude = std::max(std::llabs(field.Min), std::llabs(field.Max));
+
+		int bits = 1;
+
+		while ((std::int64_t{1} << (bits - 1)) - 1 < magnitude)
+			++bits;
+
+		return bits;
+	}
+
+	if (field.Min < 0)
+		return 0;
+
+	int bits = 1;
+
+	while ((std::int64_t{1} << bits) <= field.Max)
+		++bits;
+
+	return bits;
+}
+
+static void Delta_PrintReport(const delta_s& delta)
+{
+	if (0 == delta.Updates)
+		return;
+
+	std::int64_t total = delta.BitsSent;
+
+	for (const auto& field : delta.Fields)
+		total += field.BitsSent;
+
+	printf("%s: %" PRId64 " updates, %.1f bits each\n", delta.Name.c_str(), delta.Updates, static_cast<double>(total) / delta.Updates);
+	printf("  %-20s %5s %8s %8s %8s %22s %6s %9s\n", "field", "bits", "sent %", "same %", "bits %", "range", "needs", "overflows");
+
+	std::vector<const DeltaField*> fields;
+
+	for (const auto& field : delta.Fields)
+	{
+		if (0 != field.Sends)
+			fields.push_back(&field);
+	}
+
+	std::sort(fields.begin(), fields.end(), [](const DeltaField* lhs, const DeltaField* rhs)
+		{ return lhs->BitsSent > rhs->BitsSent; });
+
+	for (const DeltaField* field : fields)
+	{
+		char range[64] = "";
+
+		if ((field->Type & DT_STRING) == 0)
+		{
+			const double scale = (field->Type & (DT_ANGLE | DT_TIMEWINDOW_8)) != 0 ? 1.0 : field->Multiplier;
+
+			snprintf(range, sizeof(range), "%g .. %g", field->Min / scale, field->Max / scale);
+		}
+
+		char needs[16] = "";
+
+		if (const int bits = Delta_NeededBits(*field); 0 != bits)
+			snprintf(needs, sizeof(needs), "%d", bits);
+
+		printf("  %-20s %5d %8.2f %8.2f %8.2f %22s %6s %9" PRId64 "\n",
+			field->Name.c_str(),
+			field->Bits,
+			100.0 * field->Sends / delta.Updates,
+			100.0 * field->QuantizedSends / field->Sends,
+			100.0 * field->BitsSent / total,
+			range,
+			needs,
+			field->Overflows);
+	}
+}
+
+//=========================================================
+// Delta_WriteTightened - writes a copy of delta.lst with
+// each field that always had room to spare cut down to the
+// bits its values needed.
+//=========================================================
+static void Delta_WriteTightened(const char* fileName)
+{
+	static const std::regex bits(R"(DEFINE_DELTA(?:_POST)?\(\s*[^,\s]+\s*,\s*[^,]+?\s*,\s*(\d+))");
+
+	std::vector<std::string> lines = g_DeltaLines;
+	int changed = 0;
+
+	for (const auto& delta : g_Deltas)
+	{
+		for (const auto& field : delta.Fields)
+		{
+			const int needed = Delta_NeededBits(field);
+
+			if (0 == needed || needed >= field.Bits)
+				continue;
+
+			std::string& line = lines[field.Line];
+
+			std::smatch match;
+
+			if (!std::regex_search(line, match, bits))
+				continue;
+
+			line.replace(match.position(1), match.length(1), std::to_string(needed));
+
+			char note[128];
+			snprintf(note, sizeof(note), "hlbench: was %d bits, sent %g .. %g", field.Bits, field.Min / field.Multiplier, field.Max / field.Multiplier);
+
+			line += line.find("//") != std::string::npos ? " - " : " // ";
+			line += note;
+
+			++changed;
+		}
+	}
+
+	FILE* file = fopen(fileName, "w");
+
+	if (!file)
+		Engine_Error("Couldn't write %s\n", fileName);
+
+	for (std::size_t i = 0; i < lines.size(); i++)
+		fprintf(file, i + 1 < lines.size() || g_DeltaEndsWithNewline ? "%s\n" : "%s", lines[i].c_str());
+
+	fclose(file);
+
+	printf("%s: %d fields cut down\n", fileName, changed);
+}
+
+void Delta_Report(const char* outputFileName)
+{
+	if (!Delta_IsActive())
+		return;
+
+	Delta_PrintReport(*g_EntityDelta);
+	Delta_PrintReport(*g_PlayerDelta);
+	Delta_PrintReport(*g_CustomDelta);
+	Delta_PrintReport(*g_ClientDataDelta);
+
+	if (outputFileName && '\0' != *outputFileName)
+		Delta_WriteTightened(outputFileName);
+}
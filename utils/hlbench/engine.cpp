@@ -0,0 +1,1992 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// engine.cpp - the engine functions handed to the game DLL by the benchmark:
+// edicts, strings, cvars, commands, precaching and files.
+
+#include <cctype>
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+#include <dlfcn.h>
+
+#include "hlbench.h"
+#include "studio.h"
+#include "interface.h"
+#include "FileSystem.h"
+
+BenchOptions g_Options;
+enginefuncs_t g_EngineFuncs;
+globalvars_t g_Globals;
+DLL_FUNCTIONS g_GameFuncs;
+NEW_DLL_FUNCTIONS g_NewGameFuncs;
+IFileSystem* g_pBenchFileSystem = nullptr;
+
+edict_t* g_Edicts = nullptr;
+int g_NumEdicts = 0;
+movevars_t g_MoveVars;
+
+static void* g_pGameLibrary = nullptr;
+static CSysModule* g_pFileSystemModule = nullptr;
+
+// string_t is an offset from pStringBase, so every string handed to the game comes from one block.
+constexpr std::size_t StringPoolSize = 8 * 1024 * 1024;
+static char g_StringPool[StringPoolSize];
+static std::size_t g_StringPoolUsed = 1; // offset 0 is the empty string
+
+static std::mt19937 g_Random;
+
+//=========================================================
+// Errors and messages
+//=========================================================
+void Engine_Error(const char* format, ...)
+{
+	va_list list;
+	va_start(list, format);
+	fprintf(stderr, "Error: ");
+	vfprintf(stderr, format, list);
+	va_end(list);
+
+	exit(EXIT_FAILURE);
+}
+
+static void Engine_AlertMessage(ALERT_TYPE atype, const char* format, ...)
+{
+	const float developer = Cvar_Value("developer");
+
+	switch (atype)
+	{
+	case at_warning:
+	case at_error:
+		break;
+
+	case at_aiconsole:
+		if (developer < 2)
+			return;
+		break;
+
+	default:
+		if (developer < 1)
+			return;
+		break;
+	}
+
+	va_list list;
+	va_start(list, format);
+	vprintf(format, list);
+	va_end(list);
+}
+
+static void Engine_Fprintf(void* file, const char* format, ...)
+{
+	va_list list;
+	va_start(list, format);
+	vfprintf(static_cast<FILE*>(file), format, list);
+	va_end(list);
+}
+
+static void Engine_ServerPrint(const char* message)
+{
+	if (Cvar_Value("developer") >= 1)
+		fputs(message, stdout);
+}
+
+static void Engine_ClientPrintf(edict_t* client, PRINT_TYPE type, const char* message)
+{
+}
+
+//=========================================================
+// Strings
+//=========================================================
+int Engine_AllocString(const char* string)
+{
+	const std::size_t length = strlen(string) + 1;
+
+	if (g_StringPoolUsed + length > StringPoolSize)
+		Engine_Error("Engine_AllocString: string pool is full\n");
+
+	char* dest = g_StringPool + g_StringPoolUsed;
+
+	// Keyvalues use \n for line breaks, like the engine's ED_NewString.
+	char* out = dest;
+
+	for (const char* in = string; *in; ++in)
+	{
+		if (in[0] == '\\' && in[1] == 'n')
+		{
+			*out++ = '\n';
+			++in;
+		}
+		else
+		{
+			*out++ = *in;
+		}
+	}
+
+	*out++ = '\0';
+
+	g_StringPoolUsed += out - dest;
+
+	return static_cast<int>(dest - g_StringPool);
+}
+
+static const char* Engine_SzFromIndex(int index)
+{
+	return g_StringPool + index;
+}
+
+//=========================================================
+// Cvars
+//=========================================================
+struct EngineCvar
+{
+	cvar_t* Var;
+	std::string Value;
+};
+
+static std::unordered_map<std::string, EngineCvar> g_Cvars;
+static std::deque<cvar_t> g_EngineCvars;
+
+static std::string Engine_LowerCase(const char* string)
+{
+	std::string result{string};
+
+	for (auto& c : result)
+		c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+
+	return result;
+}
+
+static EngineCvar* Cvar_Find(const char* name)
+{
+	auto it = g_Cvars.find(Engine_LowerCase(name));
+
+	return it != g_Cvars.end() ? &it->second : nullptr;
+}
+
+static void Cvar_SetEntry(EngineCvar& entry, const char* value)
+{
+	entry.Value = value;
+	entry.Var->string = entry.Value.c_str();
+	entry.Var->value = static_cast<float>(atof(value));
+}
+
+static void Cvar_Register(cvar_t* var)
+{
+	auto [it, inserted] = g_Cvars.try_emplace(Engine_LowerCase(var->name), EngineCvar{var, {}});
+
+	if (!inserted)
+	{
+		Engine_AlertMessage(at_warning, "Can't register variable %s, already defined\n", var->name);
+		return;
+	}
+
+	Cvar_SetEntry(it->second, var->string);
+}
+
+static void Cvar_RegisterEngineVariable(const char* name, const char* value, int flags = 0)
+{
+	cvar_t& var = g_EngineCvars.emplace_back();
+	var.name = name;
+	var.string = value;
+	var.flags = flags;
+
+	Cvar_Register(&var);
+}
+
+float Cvar_Value(const char* name)
+{
+	const EngineCvar* entry = Cvar_Find(name);
+
+	return entry ? entry->Var->value : 0;
+}
+
+static const char* Cvar_String(const char* name)
+{
+	const EngineCvar* entry = Cvar_Find(name);
+
+	return entry ? entry->Var->string : "";
+}
+
+void Cvar_Set(const char* name, const char* value)
+{
+	EngineCvar* entry = Cvar_Find(name);
+
+	if (!entry)
+	{
+		Engine_AlertMessage(at_warning, "Cvar_Set: variable %s not found\n", name);
+		return;
+	}
+
+	Cvar_SetEntry(*entry, value);
+}
+
+static void Cvar_SetFloat(const char* name, float value)
+{
+	char string[32];
+
+	if (value == static_cast<int>(value))
+		snprintf(string, sizeof(string), "%d", static_cast<int>(value));
+	else
+		snprintf(string, sizeof(string), "%f", value);
+
+	Cvar_Set(name, string);
+}
+
+static cvar_t* Cvar_GetPointer(const char* name)
+{
+	EngineCvar* entry = Cvar_Find(name);
+
+	return entry ? entry->Var : nullptr;
+}
+
+static void Cvar_DirectSet(cvar_t* var, const char* value)
+{
+	if (var)
+		Cvar_Set(var->name, value);
+}
+
+//=========================================================
+// Commands
+//=========================================================
+static std::unordered_map<std::string, void (*)()> g_Commands;
+static std::vector<std::string> g_CommandArgv;
+static std::string g_CommandArgs;
+static std::string g_CommandBuffer;
+
+static void Cmd_AddServerCommand(const char* name, void (*function)())
+{
+	g_Commands[Engine_LowerCase(name)] = function;
+}
+
+static const char* Cmd_Args()
+{
+	return g_CommandArgs.c_str();
+}
+
+static const char* Cmd_Argv(int argc)
+{
+	return argc >= 0 && argc < static_cast<int>(g_CommandArgv.size()) ? g_CommandArgv[argc].c_str() : "";
+}
+
+static int Cmd_Argc()
+{
+	return static_cast<int>(g_CommandArgv.size());
+}
+
+//=========================================================
+// Cmd_TokenizeString - splits a command into arguments.
+// Quoted arguments keep their spaces, // starts a comment.
+//=========================================================
+static void Cmd_TokenizeString(const char* text)
+{
+	g_CommandArgv.clear();
+	g_CommandArgs.clear();
+
+	const char* p = text;
+
+	while (true)
+	{
+		while (*p && *p <= ' ')
+			++p;
+
+		if (!*p || (p[0] == '/' && p[1] == '/'))
+			break;
+
+		if (g_CommandArgv.size() == 1)
+		{
+			g_CommandArgs = p;
+
+			while (!g_CommandArgs.empty() && static_cast<unsigned char>(g_CommandArgs.back()) <= ' ')
+				g_CommandArgs.pop_back();
+		}
+
+		std::string token;
+
+		if (*p == '"')
+		{
+			++p;
+
+			while (*p && *p != '"')
+				token += *p++;
+
+			if (*p)
+				++p;
+		}
+		else
+		{
+			while (*p > ' ')
+				token += *p++;
+		}
+
+		g_CommandArgv.push_back(std::move(token));
+	}
+}
+
+static void Cbuf_InsertFile(const char* fileName)
+{
+	int length = 0;
+	byte* data = Engine_LoadFile(fileName, &length);
+
+	if (!data)
+	{
+		Engine_AlertMessage(at_console, "couldn't exec %s\n", fileName);
+		return;
+	}
+
+	g_CommandBuffer.insert(0, std::string(reinterpret_cast<const char*>(data), length) + "\n");
+
+	Engine_FreeFile(data);
+}
+
+static void Cmd_ExecuteString(const char* text)
+{
+	Cmd_TokenizeString(text);
+
+	if (g_CommandArgv.empty())
+		return;
+
+	const std::string name = Engine_LowerCase(g_CommandArgv[0].c_str());
+
+	if (auto command = g_Commands.find(name); command != g_Commands.end())
+	{
+		command->second();
+		return;
+	}
+
+	if (EngineCvar* entry = Cvar_Find(name.c_str()); entry)
+	{
+		if (g_CommandArgv.size() >= 2)
+			Cvar_SetEntry(*entry, g_CommandArgv[1].c_str());
+		else
+			printf("\"%s\" is \"%s\"\n", entry->Var->name, entry->Var->string);
+
+		return;
+	}
+
+	if (name == "exec")
+	{
+		if (g_CommandArgv.size() >= 2)
+			Cbuf_InsertFile(g_CommandArgv[1].c_str());
+	}
+	else if (name == "echo")
+	{
+		printf("%s\n", Cmd_Args());
+	}
+	else if (name == "changelevel" || name == "map")
+	{
+		printf("Ignoring \"%s\": the benchmark stays on one map\n", text);
+	}
+	else
+	{
+		Engine_AlertMessage(at_console, "Unknown command \"%s\"\n", name.c_str());
+	}
+}
+
+void Cbuf_AddText(const char* text)
+{
+	g_CommandBuffer += text;
+}
+
+void Cbuf_Execute()
+{
+	while (!g_CommandBuffer.empty())
+	{
+		// Find the end of the command, ignoring semicolons in quotes.
+		std::size_t end = 0;
+		bool quoted = false;
+
+		for (; end < g_CommandBuffer.size(); ++end)
+		{
+			const char c = g_CommandBuffer[end];
+
+			if (c == '"')
+				quoted = !quoted;
+
+			if ((!quoted && c == ';') || c == '\n')
+				break;
+		}
+
+		const std::string line = g_CommandBuffer.substr(0, end);
+
+		g_CommandBuffer.erase(0, end < g_CommandBuffer.size() ? end + 1 : end);
+
+		Cmd_ExecuteString(line.c_str());
+	}
+}
+
+static void Engine_ServerCommand(const char* text)
+{
+	Cbuf_AddText(text);
+}
+
+static void Engine_ClientCommand(edict_t* ed, const char* format, ...)
+{
+}
+
+//=========================================================
+// Files
+//=========================================================
+byte* Engine_LoadFile(const char* fileName, int* length)
+{
+	if (length)
+		*length = 0;
+
+	FileHandle_t file = g_pBenchFileSystem->Open(fileName, "rb");
+
+	if (!file)
+		return nullptr;
+
+	const int size = static_cast<int>(g_pBenchFileSystem->Size(file));
+
+	auto data = static_cast<byte*>(malloc(size + 1));
+
+	g_pBenchFileSystem->Read(data, size, file);
+	g_pBenchFileSystem->Close(file);
+
+	data[size] = '\0';
+
+	if (length)
+		*length = size;
+
+	return data;
+}
+
+void Engine_FreeFile(void* buffer)
+{
+	free(buffer);
+}
+
+static int Engine_CompareFileTime(const char* fileName1, const char* fileName2, int* compare)
+{
+	*compare = 0;
+
+	if (!fileName1 || !fileName2)
+		return 0;
+
+	const long time1 = g_pBenchFileSystem->GetFileTime(fileName1);
+	const long time2 = g_pBenchFileSystem->GetFileTime(fileName2);
+
+	if (time1 < time2)
+		*compare = -1;
+	else if (time1 > time2)
+		*compare = 1;
+
+	return 1;
+}
+
+static void Engine_GetGameDir(char* gameDir)
+{
+	strcpy(gameDir, g_Options.GameDirectory.c_str());
+}
+
+static int Engine_GetFileSize(const char* fileName)
+{
+	FileHandle_t file = g_pBenchFileSystem->Open(fileName, "rb");
+
+	if (!file)
+		return -1;
+
+	const int size = static_cast<int>(g_pBenchFileSystem->Size(file));
+
+	g_pBenchFileSystem->Close(file);
+
+	return size;
+}
+
+static int Engine_IsMapValid(const char* mapName)
+{
+	char fileName[256];
+	snprintf(fileName, sizeof(fileName), "maps/%s.bsp", mapName);
+
+	return g_pBenchFileSystem->FileExists(fileName) ? 1 : 0;
+}
+
+//=========================================================
+// Precaching
+//=========================================================
+static std::vector<std::unique_ptr<model_s>> g_Models;
+static std::unordered_map<std::string, int> g_ModelIndices;
+static std::unordered_map<std::string, int> g_SoundIndices;
+static std::unordered_map<std::string, int> g_GenericIndices;
+static std::unordered_map<std::string, int> g_EventIndices;
+static std::unordered_map<std::string, int> g_DecalIndices;
+
+// Header of a .spr file
+struct SpriteHeader
+{
+	int Ident;
+	int Version;
+	int Type;
+	int TextureFormat;
+	float BoundingRadius;
+	int Width;
+	int Height;
+	int NumFrames;
+};
+
+static void Mod_Load(model_s& model)
+{
+	const char* name = model.Name.c_str();
+
+	if (name[0] == '*')
+	{
+		model.Type = BENCH_MOD_BRUSH;
+		model.BspModel = atoi(name + 1);
+	}
+	else if (const char* extension = strrchr(name, '.'); extension && 0 == strcasecmp(extension, ".bsp"))
+	{
+		// Only the map being run can be loaded
+		model.Type = BENCH_MOD_BRUSH;
+		model.BspModel = 0;
+	}
+	else if (extension && 0 == strcasecmp(extension, ".mdl"))
+	{
+		model.Type = BENCH_MOD_STUDIO;
+	}
+	else
+	{
+		model.Type = BENCH_MOD_SPRITE;
+	}
+
+	if (model.Type == BENCH_MOD_BRUSH)
+	{
+		if (model.BspModel < 0 || model.BspModel >= Bsp_NumModels())
+			Engine_Error("Mod_Load: bad brush model %s\n", name);
+
+		Bsp_ModelBounds(model.BspModel, model.Mins, model.Maxs);
+		return;
+	}
+
+	int length = 0;
+	byte* data = Engine_LoadFile(name, &length);
+
+	if (!data)
+	{
+		Engine_AlertMessage(at_warning, "Mod_Load: %s not found\n", name);
+		return;
+	}
+
+	model.Data.assign(data, data + length);
+
+	Engine_FreeFile(data);
+}
+
+int Mod_Precache(const char* name)
+{
+	if (!name || !*name)
+		return 0;
+
+	if (auto it = g_ModelIndices.find(name); it != g_ModelIndices.end())
+		return it->second;
+
+	if (g_Models.empty())
+		g_Models.emplace_back(); // index 0 is no model
+
+	auto model = std::make_unique<model_s>();
+	model->Name = name;
+	model->NameString = Engine_AllocString(name);
+
+	Mod_Load(*model);
+
+	const int index = static_cast<int>(g_Models.size());
+
+	g_Models.push_back(std::move(model));
+	g_ModelIndices.emplace(name, index);
+
+	return index;
+}
+
+model_s* Mod_ForIndex(int index)
+{
+	return index > 0 && index < static_cast<int>(g_Models.size()) ? g_Models[index].get() : nullptr;
+}
+
+static int Engine_ModelIndex(const char* name)
+{
+	auto it = g_ModelIndices.find(name);
+
+	if (it == g_ModelIndices.end())
+		Engine_Error("SV_ModelIndex: model %s not precached\n", name);
+
+	return it->second;
+}
+
+static int Engine_ModelFrames(int modelIndex)
+{
+	const model_s* model = Mod_ForIndex(modelIndex);
+
+	if (!model || model->Data.empty())
+		return 1;
+
+	if (model->Type == BENCH_MOD_SPRITE && model->Data.size() >= sizeof(SpriteHeader))
+		return reinterpret_cast<const SpriteHeader*>(model->Data.data())->NumFrames;
+
+	if (model->Type == BENCH_MOD_STUDIO)
+	{
+		// Number of body variations
+		const auto header = reinterpret_cast<const studiohdr_t*>(model->Data.data());
+		const auto bodyParts = reinterpret_cast<const mstudiobodyparts_t*>(model->Data.data() + header->bodypartindex);
+
+		int frames = 1;
+
+		for (int i = 0; i < header->numbodyparts; i++)
+			frames *= bodyParts[i].nummodels;
+
+		return frames;
+	}
+
+	return 1;
+}
+
+static int Engine_PrecacheIndex(std::unordered_map<std::string, int>& indices, const char* name, int first)
+{
+	auto [it, inserted] = indices.try_emplace(name, static_cast<int>(indices.size()) + first);
+
+	return it->second;
+}
+
+static int Engine_PrecacheSound(const char* name)
+{
+	return Engine_PrecacheIndex(g_SoundIndices, name, 1);
+}
+
+static int Engine_PrecacheGeneric(const char* name)
+{
+	return Engine_PrecacheIndex(g_GenericIndices, name, 1);
+}
+
+static unsigned short Engine_PrecacheEvent(int type, const char* name)
+{
+	return static_cast<unsigned short>(Engine_PrecacheIndex(g_EventIndices, name, 1));
+}
+
+static int Engine_DecalIndex(const char* name)
+{
+	return Engine_PrecacheIndex(g_DecalIndices, name, 0);
+}
+
+static void Engine_SetModel(edict_t* ed, const char* name)
+{
+	const int index = Engine_ModelIndex(name);
+	const model_s* model = Mod_ForIndex(index);
+
+	ed->v.model = model->NameString;
+	ed->v.modelindex = index;
+
+	Vector mins = g_vecZero, maxs = g_vecZero;
+
+	if (model->Type == BENCH_MOD_BRUSH)
+	{
+		mins = model->Mins;
+		maxs = model->Maxs;
+	}
+
+	ed->v.mins = mins;
+	ed->v.maxs = maxs;
+	ed->v.size = maxs - mins;
+
+	SV_LinkEdict(ed, false);
+}
+
+static void* Engine_GetModelPtr(edict_t* ed)
+{
+	if (!ed)
+		return nullptr;
+
+	model_s* model = Mod_ForIndex(ed->v.modelindex);
+
+	if (!model || model->Type != BENCH_MOD_STUDIO || model->Data.empty())
+		return nullptr;
+
+	return model->Data.data();
+}
+
+//=========================================================
+// Edicts
+//=========================================================
+static void ED_Clear(edict_t* ed)
+{
+	memset(&ed->v, 0, sizeof(ed->v));
+	ed->free = 0;
+	ed->headnode = -1;
+	ed->num_leafs = 0;
+	ed->v.pContainingEntity = ed;
+}
+
+edict_t* ED_Alloc()
+{
+	int i;
+
+	for (i = g_Globals.maxClients + 1; i < g_NumEdicts; i++)
+	{
+		edict_t* ed = &g_Edicts[i];
+
+		// Don't reuse an edict that was freed recently, so clients don't lerp the new entity from the old one.
+		if (0 != ed->free && (ed->freetime < 2 || g_Globals.time - ed->freetime > 0.5f))
+		{
+			ED_Clear(ed);
+			return ed;
+		}
+	}
+
+	if (i >= g_Globals.maxEntities)
+		Engine_Error("ED_Alloc: no free edicts\n");
+
+	++g_NumEdicts;
+
+	edict_t* ed = &g_Edicts[i];
+	ED_Clear(ed);
+
+	return ed;
+}
+
+static void Engine_FreePrivateData(edict_t* ed)
+{
+	if (ed->pvPrivateData)
+	{
+		if (g_NewGameFuncs.pfnOnFreeEntPrivateData)
+			g_NewGameFuncs.pfnOnFreeEntPrivateData(ed);
+
+		free(ed->pvPrivateData);
+		ed->pvPrivateData = nullptr;
+	}
+}
+
+void ED_Free(edict_t* ed)
+{
+	if (0 != ed->free)
+		return;
+
+	SV_UnlinkEdict(ed);
+
+	Engine_FreePrivateData(ed);
+
+	ed->free = 1;
+	++ed->serialnumber;
+	ed->freetime = g_Globals.time;
+
+	ed->v.flags = 0;
+	ed->v.model = 0;
+	ed->v.takedamage = 0;
+	ed->v.modelindex = 0;
+	ed->v.colormap = 0;
+	ed->v.skin = 0;
+	ed->v.frame = 0;
+	ed->v.scale = 0;
+	ed->v.gravity = 0;
+	ed->v.nextthink = -1;
+	ed->v.solid = SOLID_NOT;
+	ed->v.origin = g_vecZero;
+	ed->v.angles = g_vecZero;
+}
+
+int ED_Index(const edict_t* ed)
+{
+	return static_cast<int>(ed - g_Edicts);
+}
+
+static edict_t* Engine_CreateEntity()
+{
+	return ED_Alloc();
+}
+
+static void Engine_RemoveEntity(edict_t* ed)
+{
+	ED_Free(ed);
+}
+
+void* Engine_EntityFunction(const char* className)
+{
+	return dlsym(g_pGameLibrary, className);
+}
+
+edict_t* Engine_CreateNamedEntity(int className)
+{
+	using EntityFunction = void (*)(entvars_t*);
+
+	auto function = reinterpret_cast<EntityFunction>(Engine_EntityFunction(Engine_SzFromIndex(className)));
+
+	if (!function)
+	{
+		Engine_AlertMessage(at_console, "Can't create entity: %s\n", Engine_SzFromIndex(className));
+		return nullptr;
+	}
+
+	edict_t* ed = ED_Alloc();
+	ed->v.classname = className;
+
+	function(&ed->v);
+
+	return ed;
+}
+
+static void Engine_MakeStatic(edict_t* ed)
+{
+	// Static entities only exist on the client.
+	ED_Free(ed);
+}
+
+static void* Engine_PvAllocEntPrivateData(edict_t* ed, int32 size)
+{
+	Engine_FreePrivateData(ed);
+
+	if (size <= 0)
+		return nullptr;
+
+	ed->pvPrivateData = calloc(1, size);
+
+	return ed->pvPrivateData;
+}
+
+static void* Engine_PvEntPrivateData(edict_t* ed)
+{
+	return ed ? ed->pvPrivateData : nullptr;
+}
+
+static entvars_t* Engine_GetVarsOfEnt(edict_t* ed)
+{
+	return &ed->v;
+}
+
+static edict_t* Engine_PEntityOfEntOffset(int offset)
+{
+	return reinterpret_cast<edict_t*>(reinterpret_cast<char*>(g_Edicts) + offset);
+}
+
+static int Engine_EntOffsetOfPEntity(const edict_t* ed)
+{
+	return static_cast<int>(reinterpret_cast<const char*>(ed) - reinterpret_cast<const char*>(g_Edicts));
+}
+
+static int Engine_IndexOfEdict(const edict_t* ed)
+{
+	if (!ed)
+		return 0;
+
+	return ED_Index(ed);
+}
+
+static edict_t* Engine_PEntityOfEntIndexAllEntities(int index)
+{
+	if (index < 0 || index >= g_Globals.maxEntities)
+		return nullptr;
+
+	edict_t* ed = &g_Edicts[index];
+
+	return 0 == ed->free ? ed : nullptr;
+}
+
+static edict_t* Engine_PEntityOfEntIndex(int index)
+{
+	edict_t* ed = Engine_PEntityOfEntIndexAllEntities(index);
+
+	// Client slots are valid before the player entity has been created.
+	if (ed && !ed->pvPrivateData && index > g_Globals.maxClients)
+		return nullptr;
+
+	return ed;
+}
+
+static edict_t* Engine_FindEntityByVars(entvars_t* vars)
+{
+	return reinterpret_cast<edict_t*>(reinterpret_cast<char*>(vars) - offsetof(edict_t, v));
+}
+
+static int Engine_NumberOfEntities()
+{
+	int count = 0;
+
+	for (int i = 0; i < g_NumEdicts; i++)
+	{
+		if (0 == g_Edicts[i].free)
+			++count;
+	}
+
+	return count;
+}
+
+//=========================================================
+// Engine_EntityStringField - offset of a string_t field of
+// entvars_t, for FindEntityByString.
+//=========================================================
+static int Engine_EntityStringField(const char* field)
+{
+	static const std::unordered_map<std::string, int> fields = {
+#define ENTVARS_STRING_FIELD(name) {#name, offsetof(entvars_t, name)}
+		ENTVARS_STRING_FIELD(classname),
+		ENTVARS_STRING_FIELD(globalname),
+		ENTVARS_STRING_FIELD(model),
+		ENTVARS_STRING_FIELD(target),
+		ENTVARS_STRING_FIELD(targetname),
+		ENTVARS_STRING_FIELD(netname),
+		ENTVARS_STRING_FIELD(message),
+		ENTVARS_STRING_FIELD(noise),
+		ENTVARS_STRING_FIELD(noise1),
+		ENTVARS_STRING_FIELD(noise2),
+		ENTVARS_STRING_FIELD(noise3),
+		ENTVARS_STRING_FIELD(viewmodel),
+		ENTVARS_STRING_FIELD(weaponmodel),
+#undef ENTVARS_STRING_FIELD
+	};
+
+	auto it = fields.find(field);
+
+	return it != fields.end() ? it->second : -1;
+}
+
+static edict_t* Engine_FindEntityByString(edict_t* startAfter, const char* field, const char* value)
+{
+	const int offset = Engine_EntityStringField(field);
+
+	if (offset < 0)
+	{
+		Engine_AlertMessage(at_error, "FindEntityByString: bad field %s\n", field);
+		return nullptr;
+	}
+
+	for (int i = startAfter ? ED_Index(startAfter) + 1 : 1; i < g_NumEdicts; i++)
+	{
+		edict_t* ed = &g_Edicts[i];
+
+		if (0 != ed->free)
+			continue;
+
+		const auto string = *reinterpret_cast<const string_t*>(reinterpret_cast<const char*>(&ed->v) + offset);
+
+		if (0 != string && 0 == strcmp(Engine_SzFromIndex(string), value))
+			return ed;
+	}
+
+	return nullptr;
+}
+
+static edict_t* Engine_FindEntityInSphere(edict_t* startAfter, const float* origin, float radius)
+{
+	const float radiusSquared = radius * radius;
+
+	for (int i = startAfter ? ED_Index(startAfter) + 1 : 1; i < g_NumEdicts; i++)
+	{
+		edict_t* ed = &g_Edicts[i];
+
+		if (0 != ed->free || !ed->pvPrivateData)
+			continue;
+
+		// Distance to the nearest point of the entity's box
+		float distanceSquared = 0;
+
+		for (int j = 0; j < 3; j++)
+		{
+			float delta = 0;
+
+			if (origin[j] < ed->v.absmin[j])
+				delta = ed->v.absmin[j] - origin[j];
+			else if (origin[j] > ed->v.absmax[j])
+				delta = origin[j] - ed->v.absmax[j];
+
+			distanceSquared += delta * delta;
+		}
+
+		if (distanceSquared <= radiusSquared)
+			return ed;
+	}
+
+	return nullptr;
+}
+
+//=========================================================
+// Math
+//=========================================================
+void Engine_AngleVectors(const float* angles, float* forward, float* right, float* up)
+{
+	float angle = angles[YAW] * (M_PI * 2 / 360);
+	const float sy = sin(angle);
+	const float cy = cos(angle);
+	angle = angles[PITCH] * (M_PI * 2 / 360);
+	const float sp = sin(angle);
+	const float cp = cos(angle);
+	angle = angles[ROLL] * (M_PI * 2 / 360);
+	const float sr = sin(angle);
+	const float cr = cos(angle);
+
+	if (forward)
+	{
+		forward[0] = cp * cy;
+		forward[1] = cp * sy;
+		forward[2] = -sp;
+	}
+
+	if (right)
+	{
+		right[0] = -1 * sr * sp * cy + -1 * cr * -sy;
+		right[1] = -1 * sr * sp * sy + -1 * cr * cy;
+		right[2] = -1 * sr * cp;
+	}
+
+	if (up)
+	{
+		up[0] = cr * sp * cy + -sr * -sy;
+		up[1] = cr * sp * sy + -sr * cy;
+		up[2] = cr * cp;
+	}
+}
+
+static void Engine_MakeVectors(const float* angles)
+{
+	Engine_AngleVectors(angles, g_Globals.v_forward, g_Globals.v_right, g_Globals.v_up);
+}
+
+float Engine_VecToYaw(const float* vector)
+{
+	if (vector[1] == 0 && vector[0] == 0)
+		return 0;
+
+	float yaw = static_cast<int>(atan2(vector[1], vector[0]) * 180 / M_PI);
+
+	if (yaw < 0)
+		yaw += 360;
+
+	return yaw;
+}
+
+static void Engine_VecToAngles(const float* forward, float* angles)
+{
+	float yaw, pitch;
+
+	if (forward[1] == 0 && forward[0] == 0)
+	{
+		yaw = 0;
+		pitch = forward[2] > 0 ? 90 : 270;
+	}
+	else
+	{
+		yaw = static_cast<int>(atan2(forward[1], forward[0]) * 180 / M_PI);
+
+		if (yaw < 0)
+			yaw += 360;
+
+		const float tmp = sqrt(forward[0] * forward[0] + forward[1] * forward[1]);
+		pitch = static_cast<int>(atan2(forward[2], tmp) * 180 / M_PI);
+
+		if (pitch < 0)
+			pitch += 360;
+	}
+
+	angles[0] = pitch;
+	angles[1] = yaw;
+	angles[2] = 0;
+}
+
+static float Engine_AngleMod(float angle)
+{
+	return (360.0f / 65536) * (static_cast<int>(angle * (65536 / 360.0f)) & 65535);
+}
+
+//=========================================================
+// Engine_TurnTowards - turns @p current towards @p ideal by
+// at most @p speed degrees.
+//=========================================================
+static float Engine_TurnTowards(float current, float ideal, float speed)
+{
+	current = Engine_AngleMod(current);
+
+	if (current == ideal)
+		return current;
+
+	float move = ideal - current;
+
+	if (ideal > current)
+	{
+		if (move >= 180)
+			move = move - 360;
+	}
+	else
+	{
+		if (move <= -180)
+			move = move + 360;
+	}
+
+	if (move > 0)
+	{
+		if (move > speed)
+			move = speed;
+	}
+	else
+	{
+		if (move < -speed)
+			move = -speed;
+	}
+
+	return Engine_AngleMod(current + move);
+}
+
+static void Engine_ChangeYaw(edict_t* ed)
+{
+	ed->v.angles[YAW] = Engine_TurnTowards(ed->v.angles[YAW], ed->v.ideal_yaw, ed->v.yaw_speed);
+}
+
+static void Engine_ChangePitch(edict_t* ed)
+{
+	ed->v.angles[PITCH] = Engine_TurnTowards(ed->v.angles[PITCH], ed->v.idealpitch, ed->v.pitch_speed);
+}
+
+static void Engine_GetAimVector(edict_t* ed, float speed, float* result)
+{
+	// No auto-aim
+	Engine_AngleVectors(ed->v.v_angle, result, nullptr, nullptr);
+}
+
+std::int32_t Engine_RandomLong(std::int32_t low, std::int32_t high)
+{
+	if (high <= low)
+		return low;
+
+	return std::uniform_int_distribution<std::int32_t>{low, high}(g_Random);
+}
+
+float Engine_RandomFloat(float low, float high)
+{
+	if (high <= low)
+		return low;
+
+	return std::uniform_real_distribution<float>{low, high}(g_Random);
+}
+
+static float Engine_Time()
+{
+	return g_Globals.time;
+}
+
+//=========================================================
+// CRC32 - the node graph uses this to hash node positions.
+//=========================================================
+static void Engine_CRC32_Init(CRC32_t* crc)
+{
+	*crc = 0xFFFFFFFFUL;
+}
+
+static void Engine_CRC32_ProcessByte(CRC32_t* crc, unsigned char ch)
+{
+	CRC32_t value = *crc ^ ch;
+
+	for (int i = 0; i < 8; i++)
+		value = (value >> 1) ^ (0xEDB88320UL & (0 - (value & 1)));
+
+	*crc = value;
+}
+
+static void Engine_CRC32_ProcessBuffer(CRC32_t* crc, void* buffer, int length)
+{
+	auto bytes = static_cast<const unsigned char*>(buffer);
+
+	for (int i = 0; i < length; i++)
+		Engine_CRC32_ProcessByte(crc, bytes[i]);
+}
+
+static CRC32_t Engine_CRC32_Final(CRC32_t crc)
+{
+	return crc ^ 0xFFFFFFFFUL;
+}
+
+//=========================================================
+// Entity helpers
+//=========================================================
+static void Engine_SetOrigin(edict_t* ed, const float* origin)
+{
+	ed->v.origin = origin;
+	SV_LinkEdict(ed, false);
+}
+
+static void Engine_SetSize(edict_t* ed, const float* mins, const float* maxs)
+{
+	ed->v.mins = mins;
+	ed->v.maxs = maxs;
+	ed->v.size = ed->v.maxs - ed->v.mins;
+	SV_LinkEdict(ed, false);
+}
+
+static int Engine_EntIsOnFloor(edict_t* ed)
+{
+	return SV_CheckBottom(ed) ? 1 : 0;
+}
+
+static int Engine_DropToFloor(edict_t* ed)
+{
+	return SV_DropToFloor(ed);
+}
+
+static int Engine_WalkMove(edict_t* ed, float yaw, float dist, int mode)
+{
+	return SV_WalkMove(ed, yaw, dist, mode);
+}
+
+static void Engine_MoveToOrigin(edict_t* ed, const float* goal, float dist, int moveType)
+{
+	SV_MoveToOrigin(ed, goal, dist, moveType);
+}
+
+static int Engine_GetEntityIllum(edict_t* ed)
+{
+	return 128;
+}
+
+static void Engine_GetBonePosition(const edict_t* ed, int bone, float* origin, float* angles)
+{
+	// Bones aren't set up, the entity's origin is the closest approximation.
+	if (origin)
+		VectorCopy(ed->v.origin, origin);
+
+	if (angles)
+		VectorCopy(ed->v.angles, angles);
+}
+
+static void Engine_GetAttachment(const edict_t* ed, int attachment, float* origin, float* angles)
+{
+	Engine_GetBonePosition(ed, 0, origin, angles);
+}
+
+static void Engine_AnimationAutomove(const edict_t* ed, float time)
+{
+}
+
+static void Engine_SetClientMaxspeed(const edict_t* ed, float maxspeed)
+{
+	const_cast<edict_t*>(ed)->v.maxspeed = maxspeed;
+}
+
+static uint32 Engine_FunctionFromName(const char* name)
+{
+	return static_cast<uint32>(reinterpret_cast<std::uintptr_t>(dlsym(g_pGameLibrary, name)));
+}
+
+static const char* Engine_NameForFunction(uint32 function)
+{
+	Dl_info info;
+
+	if (0 != dladdr(reinterpret_cast<void*>(static_cast<std::uintptr_t>(function)), &info) && info.dli_sname)
+		return info.dli_sname;
+
+	return nullptr;
+}
+
+//=========================================================
+// Info strings
+//=========================================================
+constexpr int InfoStringSize = 256;
+
+static char g_ServerInfo[InfoStringSize];
+static char g_ClientInfo[BENCH_MAX_CLIENTS][InfoStringSize];
+static char g_PhysicsInfo[BENCH_MAX_CLIENTS][InfoStringSize];
+
+const char* Info_ValueForKey(const char* s, const char* key)
+{
+	// Cycle between buffers so callers can compare two values.
+	static char values[4][InfoStringSize];
+	static int valueIndex = 0;
+
+	char* value = values[valueIndex];
+	valueIndex = (valueIndex + 1) & 3;
+
+	if (*s == '\\')
+		++s;
+
+	while (*s)
+	{
+		char pkey[InfoStringSize];
+		char* o = pkey;
+
+		while (*s && *s != '\\')
+			*o++ = *s++;
+
+		*o = '\0';
+
+		if (*s)
+			++s;
+
+		o = value;
+
+		while (*s && *s != '\\')
+			*o++ = *s++;
+
+		*o = '\0';
+
+		if (0 == strcmp(key, pkey))
+			return value;
+
+		if (*s)
+			++s;
+	}
+
+	value[0] = '\0';
+
+	return value;
+}
+
+static void Info_RemoveKey(char* s, const char* key)
+{
+	if (strchr(key, '\\'))
+		return;
+
+	while (true)
+	{
+		char* start = s;
+
+		if (*s == '\\')
+			++s;
+
+		char pkey[InfoStringSize];
+		char* o = pkey;
+
+		while (*s && *s != '\\')
+			*o++ = *s++;
+
+		*o = '\0';
+
+		if (!*s)
+			return;
+
+		++s;
+
+		while (*s && *s != '\\')
+			++s;
+
+		if (0 == strcmp(key, pkey))
+		{
+			memmove(start, s, strlen(s) + 1);
+			return;
+		}
+
+		if (!*s)
+			return;
+	}
+}
+
+static void Info_SetValueForKey(char* s, const char* key, const char* value)
+{
+	if (strchr(key, '\\') || strchr(value, '\\') || strchr(key, '"') || strchr(value, '"'))
+		return;
+
+	Info_RemoveKey(s, key);
+
+	if (!*value)
+		return;
+
+	char entry[InfoStringSize];
+	snprintf(entry, sizeof(entry), "\\%s\\%s", key, value);
+
+	if (strlen(s) + strlen(entry) >= InfoStringSize)
+	{
+		Engine_AlertMessage(at_warning, "Info string length exceeded\n");
+		return;
+	}
+
+	strcat(s, entry);
+}
+
+char* Engine_ClientInfoBuffer(int clientIndex)
+{
+	return g_ClientInfo[clientIndex];
+}
+
+static char* Engine_GetInfoKeyBuffer(edict_t* ed)
+{
+	if (!ed)
+		return g_ServerInfo;
+
+	const int index = ED_Index(ed);
+
+	if (index < 1 || index > g_Globals.maxClients)
+		return const_cast<char*>("");
+
+	return g_ClientInfo[index - 1];
+}
+
+static char* Engine_InfoKeyValue(char* buffer, const char* key)
+{
+	return const_cast<char*>(Info_ValueForKey(buffer, key));
+}
+
+static void Engine_SetKeyValue(char* buffer, const char* key, const char* value)
+{
+	Info_SetValueForKey(buffer, key, value);
+}
+
+static void Engine_SetClientKeyValue(int clientIndex, char* buffer, const char* key, const char* value)
+{
+	Info_SetValueForKey(buffer, key, value);
+}
+
+static void Engine_Info_RemoveKey(char* buffer, const char* key)
+{
+	Info_RemoveKey(buffer, key);
+}
+
+static int Engine_ClientSlot(const edict_t* client)
+{
+	const int index = client ? ED_Index(client) : 0;
+
+	return index >= 1 && index <= g_Globals.maxClients ? index - 1 : -1;
+}
+
+static const char* Engine_GetPhysicsKeyValue(const edict_t* client, const char* key)
+{
+	const int slot = Engine_ClientSlot(client);
+
+	return slot >= 0 ? Info_ValueForKey(g_PhysicsInfo[slot], key) : "";
+}
+
+static void Engine_SetPhysicsKeyValue(const edict_t* client, const char* key, const char* value)
+{
+	const int slot = Engine_ClientSlot(client);
+
+	if (slot >= 0)
+		Info_SetValueForKey(g_PhysicsInfo[slot], key, value);
+}
+
+const char* Engine_GetPhysicsInfoString(const edict_t* client)
+{
+	const int slot = Engine_ClientSlot(client);
+
+	return slot >= 0 ? g_PhysicsInfo[slot] : "";
+}
+
+//=========================================================
+// Clients
+//=========================================================
+edict_t* Engine_CreateFakeClient(const char* netname)
+{
+	for (int i = 1; i <= g_Globals.maxClients; i++)
+	{
+		edict_t* ed = &g_Edicts[i];
+
+		if (0 == ed->free && ed->pvPrivateData)
+			continue;
+
+		ED_Clear(ed);
+
+		ed->v.netname = Engine_AllocString(netname);
+		ed->v.flags = FL_CLIENT | FL_FAKECLIENT;
+
+		char* info = g_ClientInfo[i - 1];
+		info[0] = '\0';
+		Info_SetValueForKey(info, "name", netname);
+		Info_SetValueForKey(info, "model", "gordon");
+		Info_SetValueForKey(info, "topcolor", "1");
+		Info_SetValueForKey(info, "bottomcolor", "1");
+
+		g_PhysicsInfo[i - 1][0] = '\0';
+
+		return ed;
+	}
+
+	return nullptr;
+}
+
+static void Engine_RunPlayerMove(edict_t* fakeClient, const float* viewAngles, float forwardMove, float sideMove, float upMove,
+	unsigned short buttons, byte impulse, byte msec)
+{
+	usercmd_t cmd{};
+	VectorCopy(viewAngles, cmd.viewangles);
+	cmd.forwardmove = forwardMove;
+	cmd.sidemove = sideMove;
+	cmd.upmove = upMove;
+	cmd.buttons = buttons;
+	cmd.impulse = impulse;
+	cmd.msec = msec;
+
+	SV_RunCmd(fakeClient, cmd, Engine_RandomLong(0, 0x7FFFFFFF));
+}
+
+static int Engine_GetPlayerUserId(edict_t* ed)
+{
+	const int slot = Engine_ClientSlot(ed);
+
+	return slot >= 0 ? slot + 1 : -1;
+}
+
+static unsigned int Engine_GetPlayerWONId(edict_t* ed)
+{
+	return static_cast<unsigned int>(-1);
+}
+
+static const char* Engine_GetPlayerAuthId(edict_t* ed)
+{
+	return Engine_ClientSlot(ed) >= 0 ? "BOT" : "";
+}
+
+static void Engine_GetPlayerStats(const edict_t* client, int* ping, int* packetLoss)
+{
+	*ping = 0;
+	*packetLoss = 0;
+}
+
+static int Engine_GetCurrentPlayer()
+{
+	return Delta_CurrentPlayer();
+}
+
+static int Engine_CanSkipPlayer(const edict_t* player)
+{
+	return 0;
+}
+
+static int Engine_IsDedicatedServer()
+{
+	return 1;
+}
+
+//=========================================================
+// Things a headless server has no use for
+//=========================================================
+static void Engine_ChangeLevel(const char* level, const char* landmark)
+{
+	Engine_AlertMessage(at_console, "Ignoring changelevel to %s\n", level);
+}
+
+static void Engine_SpawnParms(edict_t* ed) {}
+static void Engine_EmitSound(edict_t* ed, int channel, const char* sample, float volume, float attenuation, int flags, int pitch) {}
+static void Engine_EmitAmbientSound(edict_t* ed, float* pos, const char* sample, float volume, float attenuation, int flags, int pitch) {}
+static void Engine_ServerExecute() { Cbuf_Execute(); }
+static void Engine_ParticleEffect(const float* origin, const float* direction, float color, float count) {}
+static void Engine_LightStyle(int style, const char* value) {}
+static void Engine_MessageBegin(int dest, int type, const float* origin, edict_t* ed) {}
+static void Engine_MessageEnd() {}
+static void Engine_WriteInt(int value) {}
+static void Engine_WriteFloat(float value) {}
+static void Engine_WriteString(const char* value) {}
+static int Engine_RegUserMsg(const char* name, int size)
+{
+	static int nextMessage = 64;
+	return nextMessage++;
+}
+static void Engine_SetView(const edict_t* client, const edict_t* viewEntity) {}
+static void Engine_CrosshairAngle(const edict_t* client, float pitch, float yaw) {}
+static void Engine_EndSection(const char* sectionName) {}
+static void Engine_FadeClientVolume(const edict_t* ed, int fadePercent, int fadeOutSeconds, int holdTime, int fadeInSeconds) {}
+static void Engine_StaticDecal(const float* origin, int decalIndex, int entityIndex, int modelIndex) {}
+static void Engine_BuildSoundMsg(edict_t* ed, int channel, const char* sample, float volume, float attenuation, int flags, int pitch,
+	int dest, int type, const float* origin, edict_t* ed2) {}
+static void Engine_PlaybackEvent(int flags, const edict_t* invoker, unsigned short eventIndex, float delay, const float* origin,
+	const float* angles, float fparam1, float fparam2, int iparam1, int iparam2, int bparam1, int bparam2) {}
+static void Engine_SetGroupMask(int mask, int op) {}
+static int Engine_CreateInstancedBaseline(int className, struct entity_state_s* baseline) { return 0; }
+static void Engine_ForceUnmodified(FORCE_TYPE type, float* mins, float* maxs, const char* fileName) {}
+static qboolean Engine_Voice_GetClientListening(int receiver, int sender) { return 0; }
+static qboolean Engine_Voice_SetClientListening(int receiver, int sender, qboolean listen) { return 1; }
+static sequenceEntry_s* Engine_SequenceGet(const char* fileName, const char* entryName) { return nullptr; }
+static sentenceEntry_s* Engine_SequencePickSentence(const char* groupName, int pickMethod, int* picked) { return nullptr; }
+static unsigned int Engine_GetApproxWavePlayLen(const char* path) { return 0; }
+static int Engine_IsCareerMatch() { return 0; }
+static int Engine_GetLocalizedStringLength(const char* label) { return 0; }
+static void Engine_RegisterTutorMessageShown(int id) {}
+static int Engine_GetTimesTutorMessageShown(int id) { return 0; }
+static void Engine_TutorMessageDecayBuffer(int* buffer, int length) {}
+static void Engine_ResetTutorMessageDecayData() {}
+static void Engine_QueryClientCvarValue(const edict_t* player, const char* cvarName) {}
+static void Engine_QueryClientCvarValue2(const edict_t* player, const char* cvarName, int requestId) {}
+static int Engine_CheckParm(const char* token, const char** next) { return 0; }
+
+static void Engine_SetupFunctions()
+{
+	enginefuncs_t& f = g_EngineFuncs;
+
+	f.pfnPrecacheModel = &Mod_Precache;
+	f.pfnPrecacheSound = &Engine_PrecacheSound;
+	f.pfnSetModel = &Engine_SetModel;
+	f.pfnModelIndex = &Engine_ModelIndex;
+	f.pfnModelFrames = &Engine_ModelFrames;
+	f.pfnSetSize = &Engine_SetSize;
+	f.pfnChangeLevel = &Engine_ChangeLevel;
+	f.pfnGetSpawnParms = &Engine_SpawnParms;
+	f.pfnSaveSpawnParms = &Engine_SpawnParms;
+	f.pfnVecToYaw = &Engine_VecToYaw;
+	f.pfnVecToAngles = &Engine_VecToAngles;
+	f.pfnMoveToOrigin = &Engine_MoveToOrigin;
+	f.pfnChangeYaw = &Engine_ChangeYaw;
+	f.pfnChangePitch = &Engine_ChangePitch;
+	f.pfnFindEntityByString = &Engine_FindEntityByString;
+	f.pfnGetEntityIllum = &Engine_GetEntityIllum;
+	f.pfnFindEntityInSphere = &Engine_FindEntityInSphere;
+	f.pfnFindClientInPVS = &SV_FindClientInPVS;
+	f.pfnEntitiesInPVS = &SV_EntitiesInPVS;
+	f.pfnMakeVectors = &Engine_MakeVectors;
+	f.pfnAngleVectors = &Engine_AngleVectors;
+	f.pfnCreateEntity = &Engine_CreateEntity;
+	f.pfnRemoveEntity = &Engine_RemoveEntity;
+	f.pfnCreateNamedEntity = &Engine_CreateNamedEntity;
+	f.pfnMakeStatic = &Engine_MakeStatic;
+	f.pfnEntIsOnFloor = &Engine_EntIsOnFloor;
+	f.pfnDropToFloor = &Engine_DropToFloor;
+	f.pfnWalkMove = &Engine_WalkMove;
+	f.pfnSetOrigin = &Engine_SetOrigin;
+	f.pfnEmitSound = &Engine_EmitSound;
+	f.pfnEmitAmbientSound = &Engine_EmitAmbientSound;
+	f.pfnTraceLine = &SV_TraceLine;
+	f.pfnTraceToss = &SV_TraceToss;
+	f.pfnTraceMonsterHull = &SV_TraceMonsterHull;
+	f.pfnTraceHull = &SV_TraceHull;
+	f.pfnTraceModel = &SV_TraceModel;
+	f.pfnTraceTexture = &SV_TraceTexture;
+	f.pfnTraceSphere = &SV_TraceSphere;
+	f.pfnGetAimVector = &Engine_GetAimVector;
+	f.pfnServerCommand = &Engine_ServerCommand;
+	f.pfnServerExecute = &Engine_ServerExecute;
+	f.pfnClientCommand = &Engine_ClientCommand;
+	f.pfnParticleEffect = &Engine_ParticleEffect;
+	f.pfnLightStyle = &Engine_LightStyle;
+	f.pfnDecalIndex = &Engine_DecalIndex;
+	f.pfnPointContents = &SV_PointContents;
+	f.pfnMessageBegin = &Engine_MessageBegin;
+	f.pfnMessageEnd = &Engine_MessageEnd;
+	f.pfnWriteByte = &Engine_WriteInt;
+	f.pfnWriteChar = &Engine_WriteInt;
+	f.pfnWriteShort = &Engine_WriteInt;
+	f.pfnWriteLong = &Engine_WriteInt;
+	f.pfnWriteAngle = &Engine_WriteFloat;
+	f.pfnWriteCoord = &Engine_WriteFloat;
+	f.pfnWriteString = &Engine_WriteString;
+	f.pfnWriteEntity = &Engine_WriteInt;
+	f.pfnCVarRegister = &Cvar_Register;
+	f.pfnCVarGetFloat = &Cvar_Value;
+	f.pfnCVarGetString = &Cvar_String;
+	f.pfnCVarSetFloat = &Cvar_SetFloat;
+	f.pfnCVarSetString = &Cvar_Set;
+	f.pfnAlertMessage = &Engine_AlertMessage;
+	f.pfnEngineFprintf = &Engine_Fprintf;
+	f.pfnPvAllocEntPrivateData = &Engine_PvAllocEntPrivateData;
+	f.pfnPvEntPrivateData = &Engine_PvEntPrivateData;
+	f.pfnFreeEntPrivateData = &Engine_FreePrivateData;
+	f.pfnSzFromIndex = &Engine_SzFromIndex;
+	f.pfnAllocString = &Engine_AllocString;
+	f.pfnGetVarsOfEnt = &Engine_GetVarsOfEnt;
+	f.pfnPEntityOfEntOffset = &Engine_PEntityOfEntOffset;
+	f.pfnEntOffsetOfPEntity = &Engine_EntOffsetOfPEntity;
+	f.pfnIndexOfEdict = &Engine_IndexOfEdict;
+	f.pfnPEntityOfEntIndex = &Engine_PEntityOfEntIndex;
+	f.pfnFindEntityByVars = &Engine_FindEntityByVars;
+	f.pfnGetModelPtr = &Engine_GetModelPtr;
+	f.pfnRegUserMsg = &Engine_RegUserMsg;
+	f.pfnAnimationAutomove = &Engine_AnimationAutomove;
+	f.pfnGetBonePosition = &Engine_GetBonePosition;
+	f.pfnFunctionFromName = &Engine_FunctionFromName;
+	f.pfnNameForFunction = &Engine_NameForFunction;
+	f.pfnClientPrintf = &Engine_ClientPrintf;
+	f.pfnServerPrint = &Engine_ServerPrint;
+	f.pfnCmd_Args = &Cmd_Args;
+	f.pfnCmd_Argv = &Cmd_Argv;
+	f.pfnCmd_Argc = &Cmd_Argc;
+	f.pfnGetAttachment = &Engine_GetAttachment;
+	f.pfnCRC32_Init = &Engine_CRC32_Init;
+	f.pfnCRC32_ProcessBuffer = &Engine_CRC32_ProcessBuffer;
+	f.pfnCRC32_ProcessByte = &Engine_CRC32_ProcessByte;
+	f.pfnCRC32_Final = &Engine_CRC32_Final;
+	f.pfnRandomLong = &Engine_RandomLong;
+	f.pfnRandomFloat = &Engine_RandomFloat;
+	f.pfnSetView = &Engine_SetView;
+	f.pfnTime = &Engine_Time;
+	f.pfnCrosshairAngle = &Engine_CrosshairAngle;
+	f.pfnLoadFileForMe = &Engine_LoadFile;
+	f.pfnFreeFile = &Engine_FreeFile;
+	f.pfnEndSection = &Engine_EndSection;
+	f.pfnCompareFileTime = &Engine_CompareFileTime;
+	f.pfnGetGameDir = &Engine_GetGameDir;
+	f.pfnCvar_RegisterVariable = &Cvar_Register;
+	f.pfnFadeClientVolume = &Engine_FadeClientVolume;
+	f.pfnSetClientMaxspeed = &Engine_SetClientMaxspeed;
+	f.pfnCreateFakeClient = &Engine_CreateFakeClient;
+	f.pfnRunPlayerMove = &Engine_RunPlayerMove;
+	f.pfnNumberOfEntities = &Engine_NumberOfEntities;
+	f.pfnGetInfoKeyBuffer = &Engine_GetInfoKeyBuffer;
+	f.pfnInfoKeyValue = &Engine_InfoKeyValue;
+	f.pfnSetKeyValue = &Engine_SetKeyValue;
+	f.pfnSetClientKeyValue = &Engine_SetClientKeyValue;
+	f.pfnIsMapValid = &Engine_IsMapValid;
+	f.pfnStaticDecal = &Engine_StaticDecal;
+	f.pfnPrecacheGeneric = &Engine_PrecacheGeneric;
+	f.pfnGetPlayerUserId = &Engine_GetPlayerUserId;
+	f.pfnBuildSoundMsg = &Engine_BuildSoundMsg;
+	f.pfnIsDedicatedServer = &Engine_IsDedicatedServer;
+	f.pfnCVarGetPointer = &Cvar_GetPointer;
+	f.pfnGetPlayerWONId = &Engine_GetPlayerWONId;
+	f.pfnInfo_RemoveKey = &Engine_Info_RemoveKey;
+	f.pfnGetPhysicsKeyValue = &Engine_GetPhysicsKeyValue;
+	f.pfnSetPhysicsKeyValue = &Engine_SetPhysicsKeyValue;
+	f.pfnGetPhysicsInfoString = &Engine_GetPhysicsInfoString;
+	f.pfnPrecacheEvent = &Engine_PrecacheEvent;
+	f.pfnPlaybackEvent = &Engine_PlaybackEvent;
+	f.pfnSetFatPVS = &SV_SetFatPVS;
+	f.pfnSetFatPAS = &SV_SetFatPAS;
+	f.pfnCheckVisibility = &SV_CheckVisibility;
+	f.pfnDeltaSetField = &Delta_SetField;
+	f.pfnDeltaUnsetField = &Delta_UnsetField;
+	f.pfnDeltaAddEncoder = &Delta_AddEncoder;
+	f.pfnGetCurrentPlayer = &Engine_GetCurrentPlayer;
+	f.pfnCanSkipPlayer = &Engine_CanSkipPlayer;
+	f.pfnDeltaFindField = &Delta_FindField;
+	f.pfnDeltaSetFieldByIndex = &Delta_SetFieldByIndex;
+	f.pfnDeltaUnsetFieldByIndex = &Delta_UnsetFieldByIndex;
+	f.pfnSetGroupMask = &Engine_SetGroupMask;
+	f.pfnCreateInstancedBaseline = &Engine_CreateInstancedBaseline;
+	f.pfnCvar_DirectSet = &Cvar_DirectSet;
+	f.pfnForceUnmodified = &Engine_ForceUnmodified;
+	f.pfnGetPlayerStats = &Engine_GetPlayerStats;
+	f.pfnAddServerCommand = &Cmd_AddServerCommand;
+	f.pfnVoice_GetClientListening = &Engine_Voice_GetClientListening;
+	f.pfnVoice_SetClientListening = &Engine_Voice_SetClientListening;
+	f.pfnGetPlayerAuthId = &Engine_GetPlayerAuthId;
+	f.pfnSequenceGet = &Engine_SequenceGet;
+	f.pfnSequencePickSentence = &Engine_SequencePickSentence;
+	f.pfnGetFileSize = &Engine_GetFileSize;
+	f.pfnGetApproxWavePlayLen = &Engine_GetApproxWavePlayLen;
+	f.pfnIsCareerMatch = &Engine_IsCareerMatch;
+	f.pfnGetLocalizedStringLength = &Engine_GetLocalizedStringLength;
+	f.pfnRegisterTutorMessageShown = &Engine_RegisterTutorMessageShown;
+	f.pfnGetTimesTutorMessageShown = &Engine_GetTimesTutorMessageShown;
+	f.ProcessTutorMessageDecayBuffer = &Engine_TutorMessageDecayBuffer;
+	f.ConstructTutorMessageDecayBuffer = &Engine_TutorMessageDecayBuffer;
+	f.ResetTutorMessageDecayData = &Engine_ResetTutorMessageDecayData;
+	f.pfnQueryClientCvarValue = &Engine_QueryClientCvarValue;
+	f.pfnQueryClientCvarValue2 = &Engine_QueryClientCvarValue2;
+	f.pfnCheckParm = &Engine_CheckParm;
+	f.pfnPEntityOfEntIndexAllEntities = &Engine_PEntityOfEntIndexAllEntities;
+}
+
+//=========================================================
+// Engine_RegisterVariables - cvars that the engine owns.
+//=========================================================
+static void Engine_RegisterVariables()
+{
+	Cvar_RegisterEngineVariable("sv_gravity", "800", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_stopspeed", "100", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_maxspeed", "320", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_spectatormaxspeed", "500");
+	Cvar_RegisterEngineVariable("sv_accelerate", "10", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_airaccelerate", "10", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_wateraccelerate", "10", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_friction", "4", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("edgefriction", "2", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_waterfriction", "1", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_bounce", "1", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_stepsize", "18", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_maxvelocity", "2000");
+	Cvar_RegisterEngineVariable("sv_zmax", "4096", FCVAR_SPONLY);
+	Cvar_RegisterEngineVariable("sv_wateramp", "0");
+	Cvar_RegisterEngineVariable("sv_footsteps", "1", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_rollangle", "2");
+	Cvar_RegisterEngineVariable("sv_rollspeed", "0");
+	Cvar_RegisterEngineVariable("sv_skyname", "desert");
+	Cvar_RegisterEngineVariable("sv_skycolor_r", "0");
+	Cvar_RegisterEngineVariable("sv_skycolor_g", "0");
+	Cvar_RegisterEngineVariable("sv_skycolor_b", "0");
+	Cvar_RegisterEngineVariable("sv_skyvec_x", "0");
+	Cvar_RegisterEngineVariable("sv_skyvec_y", "0");
+	Cvar_RegisterEngineVariable("sv_skyvec_z", "0");
+	Cvar_RegisterEngineVariable("sv_cheats", "0", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_password", "", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("sv_aim", "0");
+	Cvar_RegisterEngineVariable("sv_allow_upload", "1", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("deathmatch", "0", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("coop", "0", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("teamplay", "0", FCVAR_SERVER);
+	Cvar_RegisterEngineVariable("skill", "1");
+	Cvar_RegisterEngineVariable("hostname", "hlbench");
+	Cvar_RegisterEngineVariable("maxplayers", "1");
+	Cvar_RegisterEngineVariable("mp_logecho", "0");
+	Cvar_RegisterEngineVariable("mp_logfile", "0");
+	Cvar_RegisterEngineVariable("motdfile", "motd.txt");
+	Cvar_RegisterEngineVariable("mapcyclefile", "mapcycle.txt");
+	Cvar_RegisterEngineVariable("servercfgfile", "server.cfg");
+	Cvar_RegisterEngineVariable("lservercfgfile", "listenserver.cfg");
+	Cvar_RegisterEngineVariable("developer", "0");
+	Cvar_RegisterEngineVariable("sys_ticrate", "100");
+}
+
+void Engine_SetupMoveVars()
+{
+	g_MoveVars.gravity = Cvar_Value("sv_gravity");
+	g_MoveVars.stopspeed = Cvar_Value("sv_stopspeed");
+	g_MoveVars.maxspeed = Cvar_Value("sv_maxspeed");
+	g_MoveVars.spectatormaxspeed = Cvar_Value("sv_spectatormaxspeed");
+	g_MoveVars.accelerate = Cvar_Value("sv_accelerate");
+	g_MoveVars.airaccelerate = Cvar_Value("sv_airaccelerate");
+	g_MoveVars.wateraccelerate = Cvar_Value("sv_wateraccelerate");
+	g_MoveVars.friction = Cvar_Value("sv_friction");
+	g_MoveVars.edgefriction = Cvar_Value("edgefriction");
+	g_MoveVars.waterfriction = Cvar_Value("sv_waterfriction");
+	g_MoveVars.entgravity = 1;
+	g_MoveVars.bounce = Cvar_Value("sv_bounce");
+	g_MoveVars.stepsize = Cvar_Value("sv_stepsize");
+	g_MoveVars.maxvelocity = Cvar_Value("sv_maxvelocity");
+	g_MoveVars.zmax = Cvar_Value("sv_zmax");
+	g_MoveVars.waveHeight = 0;
+	g_MoveVars.footsteps = Cvar_Value("sv_footsteps") != 0 ? 1 : 0;
+	strncpy(g_MoveVars.skyName, Cvar_String("sv_skyname"), sizeof(g_MoveVars.skyName) - 1);
+	g_MoveVars.rollangle = Cvar_Value("sv_rollangle");
+	g_MoveVars.rollspeed = Cvar_Value("sv_rollspeed");
+}
+
+//=========================================================
+// Engine_LoadFileSystem - uses the filesystem library that
+// ships with the game so files are found the same way.
+//=========================================================
+static void Engine_LoadFileSystem()
+{
+	g_pFileSystemModule = Sys_LoadModule("filesystem_stdio.so");
+
+	if (!g_pFileSystemModule)
+		Engine_Error("Couldn't load filesystem_stdio.so, run the benchmark from the game's root directory\n");
+
+	CreateInterfaceFn factory = Sys_GetFactory(g_pFileSystemModule);
+
+	g_pBenchFileSystem = factory ? static_cast<IFileSystem*>(factory(FILESYSTEM_INTERFACE_VERSION, nullptr)) : nullptr;
+
+	if (!g_pBenchFileSystem)
+		Engine_Error("Couldn't get the %s interface\n", FILESYSTEM_INTERFACE_VERSION);
+
+	g_pBenchFileSystem->Mount();
+
+	const std::string& game = g_Options.GameDirectory;
+
+	g_pBenchFileSystem->AddSearchPath(game.c_str(), "GAMECONFIG");
+	g_pBenchFileSystem->AddSearchPath(game.c_str(), "GAME");
+
+	if (game != "valve")
+		g_pBenchFileSystem->AddSearchPath("valve", "GAME");
+
+	g_pBenchFileSystem->AddSearchPath(".", "ROOT");
+}
+
+static void Engine_LoadGameLibrary()
+{
+	std::string library = g_Options.GameLibrary;
+
+	if (library.empty())
+		library = g_Options.GameDirectory + "/dlls/hl.so";
+
+	g_pGameLibrary = dlopen(library.c_str(), RTLD_NOW);
+
+	if (!g_pGameLibrary)
+		Engine_Error("Couldn't load %s: %s\n", library.c_str(), dlerror());
+
+	using GiveFnptrsToDllFunction = void (*)(enginefuncs_t*, globalvars_t*);
+
+	auto giveFnptrsToDll = reinterpret_cast<GiveFnptrsToDllFunction>(dlsym(g_pGameLibrary, "GiveFnptrsToDll"));
+
+	if (!giveFnptrsToDll)
+		Engine_Error("%s has no GiveFnptrsToDll\n", library.c_str());
+
+	giveFnptrsToDll(&g_EngineFuncs, &g_Globals);
+
+	int version = INTERFACE_VERSION;
+
+	if (auto getEntityAPI2 = reinterpret_cast<APIFUNCTION2>(dlsym(g_pGameLibrary, "GetEntityAPI2")); getEntityAPI2)
+	{
+		if (0 == getEntityAPI2(&g_GameFuncs, &version))
+			Engine_Error("GetEntityAPI2: interface version %d, expected %d\n", version, INTERFACE_VERSION);
+	}
+	else if (auto getEntityAPI = reinterpret_cast<APIFUNCTION>(dlsym(g_pGameLibrary, "GetEntityAPI")); getEntityAPI)
+	{
+		if (0 == getEntityAPI(&g_GameFuncs, INTERFACE_VERSION))
+			Engine_Error("GetEntityAPI: interface version mismatch\n");
+	}
+	else
+	{
+		Engine_Error("%s exports no entity API\n", library.c_str());
+	}
+
+	using NewAPIFunction = int (*)(NEW_DLL_FUNCTIONS*, int*);
+
+	if (auto getNewDLLFunctions = reinterpret_cast<NewAPIFunction>(dlsym(g_pGameLibrary, "GetNewDLLFunctions")); getNewDLLFunctions)
+	{
+		version = NEW_DLL_FUNCTIONS_VERSION;
+		getNewDLLFunctions(&g_NewGameFuncs, &version);
+	}
+}
+
+void Engine_Init()
+{
+	g_Random.seed(g_Options.Seed);
+
+	Engine_SetupFunctions();
+	Engine_RegisterVariables();
+	Engine_LoadFileSystem();
+
+	g_Globals.maxClients = g_Options.Clients;
+	g_Globals.maxEntities = g_Options.MaxEntities;
+	g_Globals.pStringBase = g_StringPool;
+	g_Globals.time = 1.0f;
+
+	g_Edicts = static_cast<edict_t*>(calloc(g_Globals.maxEntities, sizeof(edict_t)));
+
+	for (int i = 0; i < g_Globals.maxEntities; i++)
+	{
+		g_Edicts[i].free = 1;
+		g_Edicts[i].v.pContainingEntity = &g_Edicts[i];
+	}
+
+	// The world and the client slots always exist.
+	g_NumEdicts = g_Globals.maxClients + 1;
+
+	for (int i = 0; i < g_NumEdicts; i++)
+		ED_Clear(&g_Edicts[i]);
+
+	Cvar_SetFloat("maxplayers", static_cast<float>(g_Options.Clients));
+
+	if (g_Options.Clients > 1)
+		Cvar_Set("deathmatch", "1");
+
+	Engine_LoadGameLibrary();
+
+	g_GameFuncs.pfnGameInit();
+	Cbuf_Execute();
+
+	for (const auto& command : g_Options.Commands)
+		Cbuf_AddText((command + "\n").c_str());
+
+	Cbuf_Execute();
+
+	g_Globals.deathmatch = Cvar_Value("deathmatch");
+	g_Globals.coop = Cvar_Value("coop");
+	g_Globals.teamplay = Cvar_Value("teamplay");
+}
+
+void Engine_Shutdown()
+{
+	if (g_GameFuncs.pfnServerDeactivate)
+		g_GameFuncs.pfnServerDeactivate();
+
+	for (int i = 0; i < g_NumEdicts; i++)
+		Engine_FreePrivateData(&g_Edicts[i]);
+
+	if (g_NewGameFuncs.pfnGameShutdown)
+		g_NewGameFuncs.pfnGameShutdown();
+
+	free(g_Edicts);
+	g_Edicts = nullptr;
+
+	dlclose(g_pGameLibrary);
+	g_pGameLibrary = nullptr;
+
+	if (g_pBenchFileSystem)
+		g_pBenchFileSystem->Unmount();
+
+	Sys_UnloadModule(g_pFileSystemModule);
+	g_pFileSystemModule = nullptr;
+	g_pBenchFileSystem = nullptr;
+}
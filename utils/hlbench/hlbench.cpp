@@ -0,0 +1,517 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// hlbench.cpp - runs a map with fake clients through the game DLL and reports how long server frames take.
+// Usage: hlbench -map <name> [-game dir] [-dll path] [-clients n] [-frames n] [-warmup n] [-maxentities n]
+//                [-frametime seconds] [-seed n] [-saves n] [-savedir dir] [-delta file] [-deltaout file]
+//                [+command args...]
+// Run it from the game's root directory (the one containing filesystem_stdio.so).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hlbench.h"
+#include "FileSystem.h"
+
+constexpr int SF_NOT_IN_DEATHMATCH = 2048;
+
+static void PrintUsage()
+{
+	printf("Usage: hlbench -map <name> [-game dir] [-dll path] [-clients n] [-frames n] [-warmup n] [-maxentities n]\n"
+		   "               [-frametime seconds] [-seed n] [-saves n] [-savedir dir] [-delta file] [-deltaout file]\n"
+		   "               [+command args...]\n");
+}
+
+static bool ParseArguments(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+
+		if (arg[0] == '+')
+		{
+			// Everything up to the next + or - is part of the command.
+			std::string command = arg + 1;
+
+			while (i + 1 < argc && argv[i + 1][0] != '+' && argv[i + 1][0] != '-')
+			{
+				command += ' ';
+				command += argv[++i];
+			}
+
+			g_Options.Commands.push_back(std::move(command));
+			continue;
+		}
+
+		if (i + 1 >= argc)
+		{
+			fprintf(stderr, "Missing value for %s\n", arg);
+			return false;
+		}
+
+		const char* value = argv[++i];
+
+		if (0 == strcmp(arg, "-map"))
+			g_Options.MapName = value;
+		else if (0 == strcmp(arg, "-game"))
+			g_Options.GameDirectory = value;
+		else if (0 == strcmp(arg, "-dll"))
+			g_Options.GameLibrary = value;
+		else if (0 == strcmp(arg, "-clients"))
+			g_Options.Clients = std::clamp(atoi(value), 1, BENCH_MAX_CLIENTS);
+		else if (0 == strcmp(arg, "-frames"))
+			g_Options.Frames = std::max(1, atoi(value));
+		else if (0 == strcmp(arg, "-warmup"))
+			g_Options.WarmupFrames = std::max(0, atoi(value));
+		else if (0 == strcmp(arg, "-maxentities"))
+			g_Options.MaxEntities = std::max(g_Options.Clients + 64, atoi(value));
+		else if (0 == strcmp(arg, "-frametime"))
+			g_Options.FrameTime = std::clamp(static_cast<float>(atof(value)), 0.001f, 0.25f);
+		else if (0 == strcmp(arg, "-seed"))
+			g_Options.Seed = static_cast<unsigned int>(strtoul(value, nullptr, 10));
+		else if (0 == strcmp(arg, "-saves"))
+			g_Options.Saves = std::max(0, atoi(value));
+		else if (0 == strcmp(arg, "-savedir"))
+			g_Options.SaveDirectory = value;
+		else if (0 == strcmp(arg, "-delta"))
+			g_Options.DeltaFile = value;
+		else if (0 == strcmp(arg, "-deltaout"))
+			g_Options.DeltaOutput = value;
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	return !g_Options.MapName.empty();
+}
+
+//=========================================================
+// ParseToken - reads the next token of the entity string,
+// which is either a brace or a quoted string.
+//=========================================================
+static const char* ParseToken(const char* data, std::string& token)
+{
+	token.clear();
+
+	while (*data && static_cast<unsigned char>(*data) <= ' ')
+		++data;
+
+	if (!*data)
+		return nullptr;
+
+	if (*data == '"')
+	{
+		++data;
+
+		while (*data && *data != '"')
+			token += *data++;
+
+		if (*data == '"')
+			++data;
+
+		return data;
+	}
+
+	while (*data && static_cast<unsigned char>(*data) > ' ')
+		token += *data++;
+
+	return data;
+}
+
+//=========================================================
+// LoadEntities - spawns the entities in the map's entity
+// lump the way the engine does. The first one is always
+// worldspawn and uses edict 0.
+//=========================================================
+static void LoadEntities(const char* data)
+{
+	std::string token;
+	std::vector<std::pair<std::string, std::string>> keyValues;
+
+	int spawned = 0;
+	bool isWorld = true;
+
+	while ((data = ParseToken(data, token)) != nullptr)
+	{
+		if (token != "{")
+			Engine_Error("LoadEntities: found %s when expecting {\n", token.c_str());
+
+		keyValues.clear();
+
+		std::string className;
+
+		while (true)
+		{
+			data = ParseToken(data, token);
+
+			if (!data)
+				Engine_Error("LoadEntities: EOF without closing brace\n");
+
+			if (token == "}")
+				break;
+
+			std::string key = token;
+
+			data = ParseToken(data, token);
+
+			if (!data || token == "}")
+				Engine_Error("LoadEntities: closing brace without data\n");
+
+			// "angle" is shorthand for a yaw, with -1 and -2 meaning up and down.
+			if (key == "angle")
+			{
+				const float angle = static_cast<float>(atof(token.c_str()));
+
+				key = "angles";
+
+				if (angle == -1)
+					token = "-90 0 0";
+				else if (angle == -2)
+					token = "90 0 0";
+				else
+					token = "0 " + token + " 0";
+			}
+
+			if (key == "classname")
+				className = token;
+
+			keyValues.emplace_back(std::move(key), std::move(token));
+		}
+
+		const bool world = std::exchange(isWorld, false);
+
+		if (className.empty())
+			continue;
+
+		edict_t* ent;
+
+		if (world)
+		{
+			using EntityFunction = void (*)(entvars_t*);
+
+			auto function = reinterpret_cast<EntityFunction>(Engine_EntityFunction(className.c_str()));
+
+			if (!function)
+				Engine_Error("LoadEntities: no spawn function for %s\n", className.c_str());
+
+			ent = g_Edicts;
+			ent->v.classname = Engine_AllocString(className.c_str());
+
+			function(&ent->v);
+		}
+		else
+		{
+			ent = Engine_CreateNamedEntity(Engine_AllocString(className.c_str()));
+
+			if (!ent)
+				continue;
+		}
+
+		for (const auto& [key, value] : keyValues)
+		{
+			KeyValueData kvd;
+			kvd.szClassName = className.c_str();
+			kvd.szKeyName = key.c_str();
+			kvd.szValue = value.c_str();
+			kvd.fHandled = 0;
+
+			g_GameFuncs.pfnKeyValue(ent, &kvd);
+		}
+
+		if (!world && 0 != g_Globals.deathmatch && (ent->v.spawnflags & SF_NOT_IN_DEATHMATCH) != 0)
+		{
+			ED_Free(ent);
+			continue;
+		}
+
+		if (g_GameFuncs.pfnSpawn(ent) < 0 || (ent->v.flags & FL_KILLME) != 0)
+		{
+			if (!world)
+				ED_Free(ent);
+
+			continue;
+		}
+
+		++spawned;
+	}
+
+	printf("%d entities spawned\n", spawned);
+}
+
+static void LoadMap()
+{
+	const std::string mapFile = "maps/" + g_Options.MapName + ".bsp";
+
+	char localPath[512];
+
+	if (!g_pBenchFileSystem->GetLocalPath(mapFile.c_str(), localPath, sizeof(localPath)))
+		Engine_Error("Couldn't find %s\n", mapFile.c_str());
+
+	Bsp_Load(localPath);
+
+	SV_ClearWorld();
+
+	g_Globals.mapname = Engine_AllocString(g_Options.MapName.c_str());
+
+	// The world model always has index 1, followed by the map's brush models.
+	Mod_Precache(mapFile.c_str());
+
+	for (int i = 1; i < Bsp_NumModels(); i++)
+		Mod_Precache(("*" + std::to_string(i)).c_str());
+
+	edict_t* world = g_Edicts;
+
+	world->v.model = Mod_ForIndex(1)->NameString;
+	world->v.modelindex = 1;
+	world->v.solid = SOLID_BSP;
+	world->v.movetype = MOVETYPE_PUSH;
+
+	LoadEntities(Bsp_EntityString());
+
+	// Let doors and plats settle like the engine does before the first client connects.
+	const float frameTime = g_Options.FrameTime;
+	g_Options.FrameTime = 0.1f;
+
+	SV_Physics();
+	SV_Physics();
+
+	g_Options.FrameTime = frameTime;
+
+	g_GameFuncs.pfnServerActivate(g_Edicts, g_NumEdicts, g_Globals.maxClients);
+}
+
+struct BenchClient
+{
+	edict_t* Edict;
+	float Yaw;
+};
+
+static std::vector<BenchClient> ConnectClients()
+{
+	std::vector<BenchClient> clients;
+
+	for (int i = 0; i < g_Options.Clients; i++)
+	{
+		const std::string name = "bench" + std::to_string(i + 1);
+
+		edict_t* ed = Engine_CreateFakeClient(name.c_str());
+
+		if (!ed)
+			break;
+
+		char rejectReason[128]{};
+
+		if (0 == g_GameFuncs.pfnClientConnect(ed, name.c_str(), "127.0.0.1", rejectReason))
+			Engine_Error("%s rejected: %s\n", name.c_str(), rejectReason);
+
+		g_GameFuncs.pfnClientPutInServer(ed);
+
+		clients.push_back({ed, 0});
+	}
+
+	return clients;
+}
+
+//=========================================================
+// BuildCommand - makes a client run around, turning
+// slowly and jumping and attacking now and then. Only
+// depends on the random number generator so runs with the
+// same seed are identical.
+//=========================================================
+static usercmd_t BuildCommand(BenchClient& client, std::mt19937& random)
+{
+	std::uniform_real_distribution<float> turn(-4.0f, 4.0f);
+	std::uniform_int_distribution<int> chance(0, 99);
+
+	client.Yaw += turn(random);
+
+	if (client.Yaw >= 360)
+		client.Yaw -= 360;
+	else if (client.Yaw < 0)
+		client.Yaw += 360;
+
+	usercmd_t cmd{};
+	cmd.msec = static_cast<byte>(std::clamp(static_cast<int>(g_Options.FrameTime * 1000 + 0.5f), 1, 255));
+	cmd.viewangles[YAW] = client.Yaw;
+	cmd.forwardmove = 250;
+	cmd.sidemove = chance(random) < 20 ? 100.0f : 0.0f;
+
+	if (chance(random) < 5)
+		cmd.buttons |= IN_JUMP;
+
+	if (chance(random) < 10)
+		cmd.buttons |= IN_ATTACK;
+
+	cmd.buttons |= IN_FORWARD;
+
+	return cmd;
+}
+
+//=========================================================
+// SendClientData - does the game side of building a
+// client's snapshot: visibility, AddToFullPack for every
+// entity, and UpdateClientData.
+//=========================================================
+static void SendClientData(edict_t* client, std::vector<entity_state_t>& states)
+{
+	unsigned char* pvs = nullptr;
+	unsigned char* pas = nullptr;
+
+	g_GameFuncs.pfnSetupVisibility(nullptr, client, &pvs, &pas);
+
+	states.resize(g_NumEdicts);
+
+	int count = 0;
+
+	for (int e = 1; e < g_NumEdicts; e++)
+	{
+		edict_t* ent = &g_Edicts[e];
+
+		if (0 != ent->free)
+			continue;
+
+		const int player = e <= g_Globals.maxClients ? 1 : 0;
+
+		if (0 != g_GameFuncs.pfnAddToFullPack(&states[count], e, ent, client, 0, player, pvs))
+			++count;
+	}
+
+	clientdata_t clientData{};
+	g_GameFuncs.pfnUpdateClientData(client, 1, &clientData);
+
+	if (Delta_IsActive())
+		Delta_WriteClientUpdate(client, states.data(), count, clientData);
+}
+
+//=========================================================
+// RunFrame - runs every client's command, a frame of
+// physics, and builds every client's snapshot.
+//=========================================================
+static void RunFrame(std::vector<BenchClient>& clients, std::mt19937& random, std::vector<entity_state_t>& states)
+{
+	for (auto& client : clients)
+	{
+		if (0 != client.Edict->free)
+			continue;
+
+		const usercmd_t cmd = BuildCommand(client, random);
+
+		SV_RunCmd(client.Edict, cmd, static_cast<unsigned int>(random()));
+	}
+
+	SV_Physics();
+
+	for (const auto& client : clients)
+	{
+		if (0 == client.Edict->free)
+			SendClientData(client.Edict, states);
+	}
+}
+
+static double Percentile(const std::vector<double>& sorted, double fraction)
+{
+	const std::size_t index = std::min(sorted.size() - 1, static_cast<std::size_t>(fraction * (sorted.size() - 1) + 0.5));
+
+	return sorted[index];
+}
+
+static void PrintReport(std::vector<double> frameTimes)
+{
+	if (frameTimes.empty())
+		return;
+
+	std::sort(frameTimes.begin(), frameTimes.end());
+
+	double total = 0;
+
+	for (double time : frameTimes)
+		total += time;
+
+	printf("%d frames, %d clients, %d edicts\n", static_cast<int>(frameTimes.size()), g_Globals.maxClients, g_NumEdicts);
+	printf("frame time (us): min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f  mean %.1f\n",
+		frameTimes.front(),
+		Percentile(frameTimes, 0.5),
+		Percentile(frameTimes, 0.9),
+		Percentile(frameTimes, 0.99),
+		Percentile(frameTimes, 0.999),
+		frameTimes.back(),
+		total / frameTimes.size());
+}
+
+int main(int argc, char* argv[])
+{
+	if (!ParseArguments(argc, argv))
+	{
+		PrintUsage();
+		return EXIT_FAILURE;
+	}
+
+	Engine_Init();
+
+	if (!g_Options.DeltaFile.empty())
+		Delta_Init(g_Options.DeltaFile.c_str());
+
+	LoadMap();
+
+	std::vector<BenchClient> clients = ConnectClients();
+
+	SV_InitPlayerMove();
+
+	std::mt19937 random(g_Options.Seed);
+	std::vector<entity_state_t> states;
+	std::vector<double> frameTimes;
+
+	frameTimes.reserve(g_Options.Frames);
+
+	const int totalFrames = g_Options.WarmupFrames + g_Options.Frames;
+
+	for (int frame = 0; frame < totalFrames; frame++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		RunFrame(clients, random, states);
+
+		const auto end = std::chrono::steady_clock::now();
+
+		if (frame >= g_Options.WarmupFrames)
+			frameTimes.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+	}
+
+	PrintReport(std::move(frameTimes));
+
+	Delta_Report(g_Options.DeltaOutput.c_str());
+
+	// Save about once a second of game time, like autosaves while the game keeps running.
+	const int saveInterval = std::max(1, static_cast<int>(1.0f / g_Options.FrameTime));
+
+	for (int save = 0; save < g_Options.Saves; save++)
+	{
+		for (int frame = 0; frame < saveInterval; frame++)
+			RunFrame(clients, random, states);
+
+		SaveBench_Save();
+	}
+
+	SaveBench_Finish();
+
+	Engine_Shutdown();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,219 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+#pragma once
+
+/**
+*	@file
+*
+*	Stub engine used to benchmark the game DLL without the real engine.
+*	It implements just enough of enginefuncs_t to load a map, spawn its entities and run server frames:
+*	collision against the BSP hulls and entity boxes, simple entity physics, and player movement through the DLL's PM_Move.
+*	Networking, sound and rendering are not emulated. Save games are made and restored through the DLL
+*	but kept in the harness's own format, not the engine's.
+*/
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "extdll.h"
+#include "entity_state.h"
+#include "usercmd.h"
+#include "pm_defs.h"
+#include "pm_movevars.h"
+
+#include "bsptrace.h"
+
+class IFileSystem;
+
+constexpr int BENCH_MAX_CLIENTS = 32;
+
+// up / down
+constexpr int PITCH = 0;
+// left / right
+constexpr int YAW = 1;
+// fall over
+constexpr int ROLL = 2;
+
+// Contents only found in BSP files, see bspfile.h
+constexpr int CONTENTS_CURRENT_0 = -9;
+constexpr int CONTENTS_CURRENT_DOWN = -14;
+constexpr int CONTENTS_TRANSLUCENT = -15;
+
+enum BenchModelType
+{
+	BENCH_MOD_BRUSH = 0,
+	BENCH_MOD_SPRITE,
+	BENCH_MOD_ALIAS,
+	BENCH_MOD_STUDIO
+};
+
+/**
+*	@brief A precached model. Only the engine looks inside; the game DLL sees it as an opaque model_t.
+*/
+struct model_s
+{
+	std::string Name;
+	int NameString = 0; //!< Name in the string pool, for entvars_t::model
+	BenchModelType Type = BENCH_MOD_SPRITE;
+	int BspModel = -1; //!< Model number in the BSP file for brush models.
+	Vector Mins, Maxs;
+	std::vector<byte> Data; //!< File contents for studio models.
+};
+
+struct BenchOptions
+{
+	std::string GameDirectory = "halflife_op4_updated";
+	std::string GameLibrary; //!< Defaults to <game>/dlls/hl.so
+	std::string MapName;
+	int Clients = 8;
+	int Frames = 3000;
+	int WarmupFrames = 100; //!< Frames run before timing starts.
+	int MaxEntities = 900;
+	float FrameTime = 0.01f;
+	unsigned int Seed = 1;
+	std::vector<std::string> Commands; //!< +cvar value / +command args from the command line.
+	int Saves = 0;					   //!< Save games made after the timed frames.
+	std::string SaveDirectory;		   //!< If set, compressed saves are written here.
+	std::string DeltaFile;			   //!< If set, client updates are delta encoded with the definitions in this delta.lst
+	std::string DeltaOutput;		   //!< If set, a copy of DeltaFile cut down to the values sent is written here.
+};
+
+// engine.cpp
+extern BenchOptions g_Options;
+extern enginefuncs_t g_EngineFuncs;
+extern globalvars_t g_Globals;
+extern DLL_FUNCTIONS g_GameFuncs;
+extern NEW_DLL_FUNCTIONS g_NewGameFuncs;
+extern IFileSystem* g_pBenchFileSystem;
+
+extern edict_t* g_Edicts;
+extern int g_NumEdicts; //!< One past the highest edict index in use.
+extern movevars_t g_MoveVars;
+
+/**
+*	@brief Loads the filesystem and the game library and initializes the game. Exits on failure.
+*/
+void Engine_Init();
+void Engine_Shutdown();
+[[noreturn]] void Engine_Error(const char* format, ...);
+edict_t* ED_Alloc();
+void ED_Free(edict_t* ed);
+int ED_Index(const edict_t* ed);
+void* Engine_EntityFunction(const char* className);
+edict_t* Engine_CreateNamedEntity(int className);
+edict_t* Engine_CreateFakeClient(const char* netname);
+int Engine_AllocString(const char* string);
+float Cvar_Value(const char* name);
+void Cvar_Set(const char* name, const char* value);
+void Cbuf_AddText(const char* text);
+void Cbuf_Execute();
+byte* Engine_LoadFile(const char* fileName, int* length);
+void Engine_FreeFile(void* buffer);
+int Mod_Precache(const char* name);
+model_s* Mod_ForIndex(int index);
+std::int32_t Engine_RandomLong(std::int32_t low, std::int32_t high);
+float Engine_RandomFloat(float low, float high);
+void Engine_AngleVectors(const float* angles, float* forward, float* right, float* up);
+float Engine_VecToYaw(const float* vector);
+char* Engine_ClientInfoBuffer(int clientIndex);
+const char* Engine_GetPhysicsInfoString(const edict_t* client);
+const char* Info_ValueForKey(const char* s, const char* key);
+void Engine_SetupMoveVars();
+
+// world.cpp
+constexpr int MOVE_NORMAL = 0;
+constexpr int MOVE_NOMONSTERS = 1;
+constexpr int MOVE_MISSILE = 2;
+
+/**
+*	@brief Sets up the area nodes for the loaded map. Call after Bsp_Load.
+*/
+void SV_ClearWorld();
+void SV_LinkEdict(edict_t* ent, bool touchTriggers);
+void SV_UnlinkEdict(edict_t* ent);
+trace_t SV_Move(const Vector& start, const Vector& mins, const Vector& maxs, const Vector& end, int type, edict_t* passedict);
+int SV_PointContents(const float* point);
+int SV_WalkMove(edict_t* ent, float yaw, float dist, int mode);
+void SV_MoveToOrigin(edict_t* ent, const float* goal, float dist, int moveType);
+int SV_DropToFloor(edict_t* ent);
+bool SV_CheckBottom(edict_t* ent);
+
+void SV_TraceLine(const float* v1, const float* v2, int noMonsters, edict_t* pentToSkip, TraceResult* ptr);
+void SV_TraceToss(edict_t* pent, edict_t* pentToIgnore, TraceResult* ptr);
+int SV_TraceMonsterHull(edict_t* pEdict, const float* v1, const float* v2, int noMonsters, edict_t* pentToSkip, TraceResult* ptr);
+void SV_TraceHull(const float* v1, const float* v2, int noMonsters, int hullNumber, edict_t* pentToSkip, TraceResult* ptr);
+void SV_TraceModel(const float* v1, const float* v2, int hullNumber, edict_t* pent, TraceResult* ptr);
+const char* SV_TraceTexture(edict_t* pTextureEntity, const float* v1, const float* v2);
+void SV_TraceSphere(const float* v1, const float* v2, int noMonsters, float radius, edict_t* pentToSkip, TraceResult* ptr);
+
+unsigned char* SV_SetFatPVS(float* origin);
+unsigned char* SV_SetFatPAS(float* origin);
+int SV_CheckVisibility(const edict_t* ent, unsigned char* pset);
+edict_t* SV_FindClientInPVS(edict_t* ed);
+edict_t* SV_EntitiesInPVS(edict_t* player);
+
+/**
+*	@brief Runs StartFrame and a frame of physics for every entity that isn't a client.
+*/
+void SV_Physics();
+
+/**
+*	@brief Runs one user command for a player: PlayerPreThink, PM_Move and PlayerPostThink.
+*/
+void SV_RunCmd(edict_t* player, const usercmd_t& cmd, unsigned int randomSeed);
+
+/**
+*	@brief Hooks up the engine side of playermove_t and calls the game's PM_Init.
+*/
+void SV_InitPlayerMove();
+
+// savegame.cpp
+/**
+*	@brief Saves the game through the DLL and hands the save to a background thread,
+*	which compresses it and writes it to BenchOptions::SaveDirectory if set.
+*/
+void SaveBench_Save();
+
+/**
+*	@brief Waits for the background thread, then decompresses and restores every save and prints how long each step took.
+*/
+void SaveBench_Finish();
+
+// delta.cpp
+/**
+*	@brief Reads the field definitions in a delta.lst and has the game register its encoders.
+*	Client updates can then be delta encoded the way the engine does to measure what each field costs.
+*/
+void Delta_Init(const char* fileName);
+bool Delta_IsActive();
+void Delta_AddEncoder(const char* name, void (*encoder)(delta_s* fields, const unsigned char* from, const unsigned char* to));
+int Delta_FindField(delta_s* fields, const char* fieldName);
+void Delta_SetField(delta_s* fields, const char* fieldName);
+void Delta_UnsetField(delta_s* fields, const char* fieldName);
+void Delta_SetFieldByIndex(delta_s* fields, int fieldNumber);
+void Delta_UnsetFieldByIndex(delta_s* fields, int fieldNumber);
+
+/**
+*	@brief The index of the client whose update is being encoded, or -1.
+*/
+int Delta_CurrentPlayer();
+
+/**
+*	@brief Delta encodes a client's update from the last one it was sent.
+*/
+void Delta_WriteClientUpdate(edict_t* client, const entity_state_t* states, int count, const clientdata_t& clientData);
+
+/**
+*	@brief Prints what each field cost and, if @p outputFileName is set, writes a copy of delta.lst
+*	with each field cut down to the bits its values needed.
+*/
+void Delta_Report(const char* outputFileName);
@@ -0,0 +1,208 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// lzblock.cpp - LZ4 block format compression for saved games.
+
+#include <cstdint>
+#include <cstring>
+
+#include "lzblock.h"
+
+constexpr int LZ_MinMatch = 4;
+constexpr int LZ_LastLiterals = 5;	  //!< The last bytes of a block are always literals
+constexpr int LZ_MatchSearchEnd = 12; //!< No match may start in the last bytes of a block
+constexpr int LZ_MaxOffset = 65535;
+constexpr int LZ_HashLog = 14;
+
+static std::uint32_t LZ_Read32(const unsigned char* p)
+{
+	std::uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static std::uint32_t LZ_Hash(std::uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32 - LZ_HashLog);
+}
+
+// Lengths of 15 or more continue in the following bytes, 255 at a time.
+static unsigned char* LZ_WriteLength(unsigned char* op, std::size_t length)
+{
+	for (; length >= 255; length -= 255)
+		*op++ = 255;
+
+	*op++ = static_cast<unsigned char>(length);
+
+	return op;
+}
+
+static unsigned char* LZ_WriteSequence(unsigned char* op, const unsigned char* literals, std::size_t literalLength, std::size_t offset, std::size_t matchLength)
+{
+	unsigned char* token = op++;
+
+	*token = static_cast<unsigned char>((literalLength >= 15 ? 15 : literalLength) << 4);
+
+	if (literalLength >= 15)
+		op = LZ_WriteLength(op, literalLength - 15);
+
+	memcpy(op, literals, literalLength);
+	op += literalLength;
+
+	// The last sequence has no match.
+	if (0 == matchLength)
+		return op;
+
+	*op++ = static_cast<unsigned char>(offset & 0xFF);
+	*op++ = static_cast<unsigned char>(offset >> 8);
+
+	const std::size_t length = matchLength - LZ_MinMatch;
+
+	*token |= static_cast<unsigned char>(length >= 15 ? 15 : length);
+
+	if (length >= 15)
+		op = LZ_WriteLength(op, length - 15);
+
+	return op;
+}
+
+std::size_t LZ_CompressBound(std::size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+std::size_t LZ_Compress(const unsigned char* in, std::size_t size, unsigned char* out)
+{
+	unsigned char* op = out;
+	const unsigned char* anchor = in;
+
+	if (size > LZ_MatchSearchEnd)
+	{
+		// Position + 1 of the last sequence with each hash, 0 if none.
+		static thread_local std::uint32_t table[1 << LZ_HashLog];
+		memset(table, 0, sizeof(table));
+
+		const unsigned char* ip = in;
+		const unsigned char* const searchEnd = in + size - LZ_MatchSearchEnd;
+		const unsigned char* const matchEnd = in + size - LZ_LastLiterals;
+
+		while (ip < searchEnd)
+		{
+			const std::uint32_t sequence = LZ_Read32(ip);
+			const std::uint32_t hash = LZ_Hash(sequence);
+			const std::uint32_t candidate = table[hash];
+
+			table[hash] = static_cast<std::uint32_t>(ip - in) + 1;
+
+			if (0 == candidate)
+			{
+				++ip;
+				continue;
+			}
+
+			const unsigned char* match = in + candidate - 1;
+
+			if (ip - match > LZ_MaxOffset || LZ_Read32(match) != sequence)
+			{
+				++ip;
+				continue;
+			}
+
+			std::size_t length = LZ_MinMatch;
+
+			while (ip + length < matchEnd && ip[length] == match[length])
+				++length;
+
+			op = LZ_WriteSequence(op, anchor, ip - anchor, ip - match, length);
+
+			ip += length;
+			anchor = ip;
+		}
+	}
+
+	op = LZ_WriteSequence(op, anchor, in + size - anchor, 0, 0);
+
+	return op - out;
+}
+
+// Reads the rest of a length that continues past its token.
+static bool LZ_ReadLength(const unsigned char*& ip, const unsigned char* end, std::size_t& length)
+{
+	unsigned char byte;
+
+	do
+	{
+		if (ip >= end)
+			return false;
+
+		byte = *ip++;
+		length += byte;
+	} while (byte == 255);
+
+	return true;
+}
+
+bool LZ_Decompress(const unsigned char* in, std::size_t size, unsigned char* out, std::size_t outSize)
+{
+	const unsigned char* ip = in;
+	const unsigned char* const end = in + size;
+	unsigned char* op = out;
+	unsigned char* const outEnd = out + outSize;
+
+	while (ip < end)
+	{
+		const unsigned char token = *ip++;
+
+		std::size_t literalLength = token >> 4;
+
+		if (literalLength == 15 && !LZ_ReadLength(ip, end, literalLength))
+			return false;
+
+		if (literalLength > static_cast<std::size_t>(end - ip) || literalLength > static_cast<std::size_t>(outEnd - op))
+			return false;
+
+		memcpy(op, ip, literalLength);
+		ip += literalLength;
+		op += literalLength;
+
+		// The last sequence ends after its literals.
+		if (ip == end)
+			break;
+
+		if (end - ip < 2)
+			return false;
+
+		const std::size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		if (0 == offset || offset > static_cast<std::size_t>(op - out))
+			return false;
+
+		std::size_t matchLength = token & 15;
+
+		if (matchLength == 15 && !LZ_ReadLength(ip, end, matchLength))
+			return false;
+
+		matchLength += LZ_MinMatch;
+
+		if (matchLength > static_cast<std::size_t>(outEnd - op))
+			return false;
+
+		// The match may overlap the bytes it produces, so copy forwards one byte at a time.
+		const unsigned char* match = op - offset;
+
+		for (std::size_t i = 0; i < matchLength; i++)
+			op[i] = match[i];
+
+		op += matchLength;
+	}
+
+	return op == outEnd;
+}
@@ -0,0 +1,38 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+#pragma once
+
+/**
+*	@file
+*
+*	Byte-oriented LZ77 compression using the LZ4 block format: each sequence is a token byte holding the literal and match lengths,
+*	the literals, and a 16 bit little endian offset back into the output. Fast to compress and very fast to decompress,
+*	which is what saving in the background needs. Only blocks are supported, not the LZ4 frame format.
+*/
+
+#include <cstddef>
+
+/**
+*	@brief Returns the largest size compressing @p size bytes can produce.
+*/
+std::size_t LZ_CompressBound(std::size_t size);
+
+/**
+*	@brief Compresses @p size bytes from @p in into @p out, which must have room for LZ_CompressBound(size) bytes.
+*	@return The compressed size.
+*/
+std::size_t LZ_Compress(const unsigned char* in, std::size_t size, unsigned char* out);
+
+/**
+*	@brief Decompresses a block of @p size bytes into @p out, which must be exactly @p outSize bytes long.
+*	@return false if the block is malformed or doesn't decompress to exactly @p outSize bytes.
+*/
+bool LZ_Decompress(const unsigned char* in, std::size_t size, unsigned char* out, std::size_t outSize);
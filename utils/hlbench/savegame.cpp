@@ -0,0 +1,615 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// savegame.cpp - saves the game through the DLL the way the engine does, compresses and writes the saves on a
+// background thread so the frame only pays for serializing, and restores them again to time the load path.
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "hlbench.h"
+#include "lzblock.h"
+
+constexpr int SaveBufferSize = 8 * 1024 * 1024;
+constexpr int SaveTokenCount = 0xFFF; // Same as the engine
+
+constexpr char SaveFileMagic[4] = {'H', 'L', 'B', 'Z'};
+constexpr int SaveFileVersion = 1;
+
+/**
+*	@brief Starts a compressed save file, followed by the LZ block.
+*/
+struct SaveFileHeader
+{
+	char Magic[4];
+	int Version;
+	int UncompressedSize;
+	int CompressedSize;
+};
+
+/**
+*	@brief Starts an uncompressed save: the entity table, the token strings and the data written by the game follow.
+*/
+struct SavePayloadHeader
+{
+	float Time;
+	int TableCount;
+	int TokenCount;
+	int DataSize;
+	int GlobalStateLocation;
+};
+
+/**
+*	@brief A save on its way through the writer thread.
+*/
+struct SaveJob
+{
+	std::vector<unsigned char> Payload;
+	std::vector<unsigned char> File; //!< Header and compressed payload
+	std::string FileName;			 //!< Empty to keep the save in memory only.
+	double CompressTime = 0;
+	double WriteTime = 0;
+};
+
+static double Elapsed(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+//=========================================================
+// BenchSaveWriter - compresses saves and writes them out
+// on its own thread, in the order they were submitted.
+//=========================================================
+class BenchSaveWriter
+{
+public:
+	BenchSaveWriter()
+		: m_Thread(&BenchSaveWriter::Run, this)
+	{
+	}
+
+	~BenchSaveWriter()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Quit = true;
+		}
+
+		m_Wake.notify_one();
+		m_Thread.join();
+	}
+
+	BenchSaveWriter(const BenchSaveWriter&) = delete;
+	BenchSaveWriter& operator=(const BenchSaveWriter&) = delete;
+
+	/**
+	*	@brief Queues a save and returns right away.
+	*/
+	void Submit(std::unique_ptr<SaveJob> job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Queue.push_back(std::move(job));
+			++m_Submitted;
+		}
+
+		m_Wake.notify_one();
+	}
+
+	/**
+	*	@brief Waits for every queued save to be written and returns them all.
+	*/
+	std::vector<std::unique_ptr<SaveJob>> Finish()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+
+		m_Finished.wait(lock, [this]()
+			{ return m_Done.size() == m_Submitted; });
+
+		m_Submitted = 0;
+
+		return std::move(m_Done);
+	}
+
+private:
+	void Run()
+	{
+		while (true)
+		{
+			std::unique_ptr<SaveJob> job;
+
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+
+				m_Wake.wait(lock, [this]()
+					{ return m_Quit || !m_Queue.empty(); });
+
+				if (m_Queue.empty())
+					return;
+
+				job = std::move(m_Queue.front());
+				m_Queue.pop_front();
+			}
+
+			Compress(*job);
+
+			if (!job->FileName.empty())
+				Write(*job);
+
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Done.push_back(std::move(job));
+			}
+
+			m_Finished.notify_all();
+		}
+	}
+
+	static void Compress(SaveJob& job)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		job.File.resize(sizeof(SaveFileHeader) + LZ_CompressBound(job.Payload.size()));
+
+		const std::size_t size = LZ_Compress(job.Payload.data(), job.Payload.size(), job.File.data() + sizeof(SaveFileHeader));
+
+		SaveFileHeader header;
+		memcpy(header.Magic, SaveFileMagic, sizeof(header.Magic));
+		header.Version = SaveFileVersion;
+		header.UncompressedSize = static_cast<int>(job.Payload.size());
+		header.CompressedSize = static_cast<int>(size);
+
+		memcpy(job.File.data(), &header, sizeof(header));
+		job.File.resize(sizeof(header) + size);
+
+		job.CompressTime = Elapsed(start);
+	}
+
+	static void Write(SaveJob& job)
+	{
+		const auto start = std::chrono::steady_clock::now();
+
+		FILE* file = fopen(job.FileName.c_str(), "wb");
+
+		if (!file || fwrite(job.File.data(), 1, job.File.size(), file) != job.File.size())
+			fprintf(stderr, "Couldn't write %s\n", job.FileName.c_str());
+
+		if (file)
+			fclose(file);
+
+		job.WriteTime = Elapsed(start);
+	}
+
+	std::mutex m_Mutex;
+	std::condition_variable m_Wake;
+	std::condition_variable m_Finished;
+	std::deque<std::unique_ptr<SaveJob>> m_Queue;
+	std::vector<std::unique_ptr<SaveJob>> m_Done;
+	std::size_t m_Submitted = 0;
+	bool m_Quit = false;
+
+	// Last, so everything it uses is constructed before it starts.
+	std::thread m_Thread;
+};
+
+static std::unique_ptr<BenchSaveWriter> g_SaveWriter;
+static std::vector<char> g_SaveBuffer;
+static std::vector<double> g_SerializeTimes;
+static std::vector<double> g_HandoffTimes;
+static int g_SaveEdicts = 0;
+
+static void Payload_Write(std::vector<unsigned char>& payload, const void* data, std::size_t size)
+{
+	const auto bytes = reinterpret_cast<const unsigned char*>(data);
+
+	payload.insert(payload.end(), bytes, bytes + size);
+}
+
+static void Payload_WriteString(std::vector<unsigned char>& payload, const char* string)
+{
+	const int length = string ? static_cast<int>(strlen(string)) : 0;
+
+	Payload_Write(payload, &length, sizeof(length));
+	Payload_Write(payload, string, length);
+}
+
+struct PayloadReader
+{
+	unsigned char* Position;
+	unsigned char* End;
+
+	bool Read(void* data, std::size_t size)
+	{
+		if (size > static_cast<std::size_t>(End - Position))
+			return false;
+
+		memcpy(data, Position, size);
+		Position += size;
+
+		return true;
+	}
+
+	bool ReadString(std::string& string)
+	{
+		int length;
+
+		if (!Read(&length, sizeof(length)) || length < 0 || length > End - Position)
+			return false;
+
+		string.assign(reinterpret_cast<const char*>(Position), length);
+		Position += length;
+
+		return true;
+	}
+};
+
+//=========================================================
+// SaveBench_Serialize - has the game save every entity and
+// the global state like the engine does for a save game,
+// and packs it with the entity table and tokens into one
+// block.
+//=========================================================
+static std::vector<unsigned char> SaveBench_Serialize()
+{
+	g_SaveBuffer.resize(SaveBufferSize);
+
+	std::vector<char*> tokens(SaveTokenCount, nullptr);
+	std::vector<ENTITYTABLE> table(g_NumEdicts);
+
+	for (int i = 0; i < g_NumEdicts; i++)
+	{
+		table[i].id = i;
+		table[i].pent = &g_Edicts[i];
+	}
+
+	SAVERESTOREDATA data{};
+	data.pBaseData = data.pCurrentData = g_SaveBuffer.data();
+	data.bufferSize = SaveBufferSize;
+	data.tokenCount = SaveTokenCount;
+	data.pTokens = tokens.data();
+	data.tableCount = g_NumEdicts;
+	data.pTable = table.data();
+	data.time = g_Globals.time;
+	strncpy(data.szCurrentMapName, g_Options.MapName.c_str(), sizeof(data.szCurrentMapName) - 1);
+
+	g_Globals.pSaveData = &data;
+
+	for (int i = 0; i < g_NumEdicts; i++)
+	{
+		if (0 != g_Edicts[i].free)
+			continue;
+
+		data.currentIndex = i;
+		g_GameFuncs.pfnSave(&g_Edicts[i], &data);
+	}
+
+	const int globalStateLocation = data.size;
+
+	g_GameFuncs.pfnSaveGlobalState(&data);
+
+	g_Globals.pSaveData = nullptr;
+
+	const SavePayloadHeader header{data.time, data.tableCount, data.tokenCount, data.size, globalStateLocation};
+
+	std::vector<unsigned char> payload;
+	payload.reserve(sizeof(header) + data.tableCount * 64 + data.size);
+
+	Payload_Write(payload, &header, sizeof(header));
+
+	for (const auto& entry : table)
+	{
+		Payload_Write(payload, &entry.location, sizeof(entry.location));
+		Payload_Write(payload, &entry.size, sizeof(entry.size));
+		Payload_Write(payload, &entry.flags, sizeof(entry.flags));
+		Payload_WriteString(payload, 0 != entry.size ? g_Globals.pStringBase + entry.classname : nullptr);
+	}
+
+	for (const char* token : tokens)
+		Payload_WriteString(payload, token);
+
+	Payload_Write(payload, data.pBaseData, data.size);
+
+	return payload;
+}
+
+void SaveBench_Save()
+{
+	if (!g_SaveWriter)
+		g_SaveWriter = std::make_unique<BenchSaveWriter>();
+
+	auto start = std::chrono::steady_clock::now();
+
+	auto job = std::make_unique<SaveJob>();
+	job->Payload = SaveBench_Serialize();
+
+	g_SerializeTimes.push_back(Elapsed(start));
+	g_SaveEdicts = g_NumEdicts;
+
+	if (!g_Options.SaveDirectory.empty())
+	{
+		job->FileName = g_Options.SaveDirectory + "/" + g_Options.MapName + "_" + std::to_string(g_SerializeTimes.size()) + ".hlz";
+	}
+
+	start = std::chrono::steady_clock::now();
+
+	g_SaveWriter->Submit(std::move(job));
+
+	g_HandoffTimes.push_back(Elapsed(start));
+}
+
+static bool SaveBench_ReadFile(const std::string& fileName, std::vector<unsigned char>& contents)
+{
+	FILE* file = fopen(fileName.c_str(), "rb");
+
+	if (!file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	contents.resize(ftell(file));
+	fseek(file, 0, SEEK_SET);
+
+	const bool read = fread(contents.data(), 1, contents.size(), file) == contents.size();
+
+	fclose(file);
+
+	return read;
+}
+
+static bool SaveBench_Decompress(const std::vector<unsigned char>& file, std::vector<unsigned char>& payload)
+{
+	SaveFileHeader header;
+
+	if (file.size() < sizeof(header))
+		return false;
+
+	memcpy(&header, file.data(), sizeof(header));
+
+	if (0 != memcmp(header.Magic, SaveFileMagic, sizeof(header.Magic)) || header.Version != SaveFileVersion || header.UncompressedSize < 0 || header.CompressedSize < 0 || static_cast<std::size_t>(header.CompressedSize) != file.size() - sizeof(header))
+	{
+		return false;
+	}
+
+	payload.resize(header.UncompressedSize);
+
+	return LZ_Decompress(file.data() + sizeof(header), header.CompressedSize, payload.data(), payload.size());
+}
+
+//=========================================================
+// SaveBench_Restore - loads a save like the engine does:
+// creates every saved entity, then has each one restore
+// itself from its part of the data. The world and clients
+// are live, so saved references to them resolve to the
+// running game instead of being restored over it. The new
+// entities are freed again afterwards.
+//=========================================================
+static bool SaveBench_Restore(std::vector<unsigned char>& payload)
+{
+	PayloadReader reader{payload.data(), payload.data() + payload.size()};
+
+	SavePayloadHeader header;
+
+	if (!reader.Read(&header, sizeof(header)) || header.TableCount < 0 || header.TokenCount <= 0)
+		return false;
+
+	std::vector<ENTITYTABLE> table(header.TableCount);
+	std::vector<std::string> classNames(header.TableCount);
+
+	for (int i = 0; i < header.TableCount; i++)
+	{
+		auto& entry = table[i];
+
+		entry.id = i;
+
+		if (!reader.Read(&entry.location, sizeof(entry.location)) || !reader.Read(&entry.size, sizeof(entry.size)) || !reader.Read(&entry.flags, sizeof(entry.flags)) || !reader.ReadString(classNames[i]))
+		{
+			return false;
+		}
+	}
+
+	std::vector<std::string> tokenNames(header.TokenCount);
+	std::vector<char*> tokens(header.TokenCount, nullptr);
+
+	for (int i = 0; i < header.TokenCount; i++)
+	{
+		if (!reader.ReadString(tokenNames[i]))
+			return false;
+
+		if (!tokenNames[i].empty())
+			tokens[i] = tokenNames[i].data();
+	}
+
+	if (reader.End - reader.Position < header.DataSize || header.GlobalStateLocation < 0 || header.GlobalStateLocation > header.DataSize)
+		return false;
+
+	// Saves of the same map use the same classnames, so don't grow the string pool for every restore.
+	static std::unordered_map<std::string, int> classNameStrings;
+
+	std::vector<edict_t*> restored;
+
+	for (int i = 0; i < header.TableCount; i++)
+	{
+		auto& entry = table[i];
+
+		if (i <= g_Globals.maxClients)
+		{
+			entry.pent = i < g_NumEdicts ? &g_Edicts[i] : nullptr;
+			continue;
+		}
+
+		if (0 == entry.size || classNames[i].empty())
+			continue;
+
+		if (entry.location < 0 || entry.size < 0 || entry.location + entry.size > header.GlobalStateLocation)
+			return false;
+
+		auto className = classNameStrings.find(classNames[i]);
+
+		if (className == classNameStrings.end())
+			className = classNameStrings.emplace(classNames[i], Engine_AllocString(classNames[i].c_str())).first;
+
+		entry.pent = Engine_CreateNamedEntity(className->second);
+		entry.classname = className->second;
+
+		if (entry.pent)
+			restored.push_back(entry.pent);
+	}
+
+	SAVERESTOREDATA data{};
+	data.pBaseData = reinterpret_cast<char*>(reader.Position);
+	data.bufferSize = header.DataSize;
+	data.tokenCount = header.TokenCount;
+	data.pTokens = tokens.data();
+	data.tableCount = header.TableCount;
+	data.pTable = table.data();
+	data.time = header.Time;
+	strncpy(data.szCurrentMapName, g_Options.MapName.c_str(), sizeof(data.szCurrentMapName) - 1);
+
+	const float time = g_Globals.time;
+
+	g_Globals.pSaveData = &data;
+
+	data.size = header.GlobalStateLocation;
+	data.pCurrentData = data.pBaseData + data.size;
+	g_GameFuncs.pfnRestoreGlobalState(&data);
+
+	for (int i = g_Globals.maxClients + 1; i < header.TableCount; i++)
+	{
+		const auto& entry = table[i];
+
+		if (!entry.pent || 0 == entry.size)
+			continue;
+
+		data.currentIndex = i;
+		data.size = entry.location;
+		data.pCurrentData = data.pBaseData + data.size;
+
+		g_GameFuncs.pfnRestore(entry.pent, &data, 0);
+	}
+
+	g_Globals.pSaveData = nullptr;
+	g_Globals.time = time;
+
+	for (edict_t* ed : restored)
+	{
+		ED_Free(ed);
+
+		// Never sent to a client, so they can be reused right away.
+		ed->freetime = 0;
+	}
+
+	return true;
+}
+
+static void PrintTimes(const char* name, const std::vector<double>& times)
+{
+	if (times.empty())
+		return;
+
+	double total = 0;
+
+	for (double time : times)
+		total += time;
+
+	printf("  %-12s mean %.1f  max %.1f\n", name, total / times.size(), *std::max_element(times.begin(), times.end()));
+}
+
+void SaveBench_Finish()
+{
+	if (!g_SaveWriter)
+		return;
+
+	std::vector<std::unique_ptr<SaveJob>> saves = g_SaveWriter->Finish();
+
+	g_SaveWriter.reset();
+
+	std::vector<double> compressTimes, writeTimes, readTimes, decompressTimes, restoreTimes;
+	std::size_t payloadBytes = 0, fileBytes = 0;
+	int failed = 0;
+
+	std::vector<unsigned char> file;
+	std::vector<unsigned char> payload;
+
+	for (auto& save : saves)
+	{
+		compressTimes.push_back(save->CompressTime);
+		payloadBytes += save->Payload.size();
+		fileBytes += save->File.size();
+
+		// Load it back the way it was stored.
+		if (!save->FileName.empty())
+		{
+			writeTimes.push_back(save->WriteTime);
+
+			const auto start = std::chrono::steady_clock::now();
+
+			if (!SaveBench_ReadFile(save->FileName, file))
+				Engine_Error("Couldn't read %s\n", save->FileName.c_str());
+
+			readTimes.push_back(Elapsed(start));
+		}
+		else
+		{
+			file = save->File;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		if (!SaveBench_Decompress(file, payload) || payload != save->Payload)
+			Engine_Error("Save %s didn't decompress to what was saved\n", save->FileName.c_str());
+
+		decompressTimes.push_back(Elapsed(start));
+
+		start = std::chrono::steady_clock::now();
+
+		if (!SaveBench_Restore(payload))
+			++failed;
+
+		restoreTimes.push_back(Elapsed(start));
+	}
+
+	if (saves.empty())
+		return;
+
+	printf("%d saves of %d edicts, %.1f KB each, compressed to %.1f KB (%.1f%%)\n",
+		static_cast<int>(saves.size()),
+		g_SaveEdicts,
+		payloadBytes / 1024.0 / saves.size(),
+		fileBytes / 1024.0 / saves.size(),
+		100.0 * fileBytes / payloadBytes);
+
+	printf("in the frame (us):\n");
+	PrintTimes("serialize", g_SerializeTimes);
+	PrintTimes("handoff", g_HandoffTimes);
+
+	printf("writer thread (us):\n");
+	PrintTimes("compress", compressTimes);
+	PrintTimes("write", writeTimes);
+
+	printf("load (us):\n");
+	PrintTimes("read", readTimes);
+	PrintTimes("decompress", decompressTimes);
+	PrintTimes("restore", restoreTimes);
+
+	if (0 != failed)
+		printf("%d saves couldn't be restored\n", failed);
+
+	g_SerializeTimes.clear();
+	g_HandoffTimes.clear();
+}
@@ -0,0 +1,2715 @@
+/***
+*
+*	Copyright (c) 1996-2002, Valve LLC. All rights reserved.
+*
+*	This product contains software technology licensed from Id
+*	Software, Inc. ("Id Technology").  Id Technology (c) 1996 Id Software, Inc.
+*	All Rights Reserved.
+*
+****/
+
+// world.cpp - collision, entity physics, monster movement, visibility and player
+// movement for the benchmark's stub engine. Follows the engine's sv_world/sv_phys/sv_move.
+
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "hlbench.h"
+
+//=========================================================
+// Area nodes
+//=========================================================
+struct areanode_t
+{
+	int axis; // -1 = leaf node
+	float dist;
+	areanode_t* children[2];
+	link_t trigger_edicts;
+	link_t solid_edicts;
+};
+
+constexpr int AREA_DEPTH = 4;
+constexpr int AREA_NODES = 32;
+
+static areanode_t g_AreaNodes[AREA_NODES];
+static int g_NumAreaNodes;
+
+#define EDICT_FROM_AREA(l) reinterpret_cast<edict_t*>(reinterpret_cast<char*>(l) - offsetof(edict_t, area))
+
+static bool SV_IsNullEntity(const edict_t* ent)
+{
+	return !ent || ent == g_Edicts;
+}
+
+static void ClearLink(link_t* l)
+{
+	l->prev = l->next = l;
+}
+
+static void RemoveLink(link_t* l)
+{
+	l->next->prev = l->prev;
+	l->prev->next = l->next;
+}
+
+static void InsertLinkBefore(link_t* l, link_t* before)
+{
+	l->next = before;
+	l->prev = before->prev;
+	l->prev->next = l;
+	l->next->prev = l;
+}
+
+static areanode_t* SV_CreateAreaNode(int depth, const Vector& mins, const Vector& maxs)
+{
+	areanode_t* anode = &g_AreaNodes[g_NumAreaNodes++];
+
+	ClearLink(&anode->trigger_edicts);
+	ClearLink(&anode->solid_edicts);
+
+	if (depth == AREA_DEPTH)
+	{
+		anode->axis = -1;
+		anode->children[0] = anode->children[1] = nullptr;
+		return anode;
+	}
+
+	const Vector size = maxs - mins;
+
+	anode->axis = size[0] > size[1] ? 0 : 1;
+	anode->dist = 0.5f * (maxs[anode->axis] + mins[anode->axis]);
+
+	Vector mins1 = mins, maxs1 = maxs;
+	Vector mins2 = mins, maxs2 = maxs;
+
+	maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
+
+	anode->children[0] = SV_CreateAreaNode(depth + 1, mins2, maxs2);
+	anode->children[1] = SV_CreateAreaNode(depth + 1, mins1, maxs1);
+
+	return anode;
+}
+
+void SV_ClearWorld()
+{
+	memset(g_AreaNodes, 0, sizeof(g_AreaNodes));
+	g_NumAreaNodes = 0;
+
+	Vector mins, maxs;
+	Bsp_ModelBounds(0, mins, maxs);
+
+	SV_CreateAreaNode(0, mins, maxs);
+}
+
+void SV_UnlinkEdict(edict_t* ent)
+{
+	if (!ent->area.prev)
+		return; // not linked in anywhere
+
+	RemoveLink(&ent->area);
+	ent->area.prev = ent->area.next = nullptr;
+}
+
+static bool SV_BoxesOverlap(const Vector& mins1, const Vector& maxs1, const Vector& mins2, const Vector& maxs2)
+{
+	return mins1[0] <= maxs2[0] && mins1[1] <= maxs2[1] && mins1[2] <= maxs2[2] && maxs1[0] >= mins2[0] && maxs1[1] >= mins2[1] && maxs1[2] >= mins2[2];
+}
+
+//=========================================================
+// SV_TouchLinks - calls Touch on every trigger the entity
+// is inside of. The triggers are collected first because
+// touching can link and unlink entities.
+//=========================================================
+static void SV_TouchLinks(edict_t* ent, areanode_t* node, std::vector<edict_t*>& touched)
+{
+	for (link_t* l = node->trigger_edicts.next; l != &node->trigger_edicts; l = l->next)
+	{
+		edict_t* touch = EDICT_FROM_AREA(l);
+
+		if (touch == ent || touch->v.solid != SOLID_TRIGGER)
+			continue;
+
+		if (!SV_BoxesOverlap(ent->v.absmin, ent->v.absmax, touch->v.absmin, touch->v.absmax))
+			continue;
+
+		touched.push_back(touch);
+	}
+
+	if (node->axis == -1)
+		return;
+
+	if (ent->v.absmax[node->axis] > node->dist)
+		SV_TouchLinks(ent, node->children[0], touched);
+
+	if (ent->v.absmin[node->axis] < node->dist)
+		SV_TouchLinks(ent, node->children[1], touched);
+}
+
+static void SV_FindTouchedLeafs(edict_t* ent)
+{
+	ent->num_leafs = 0;
+	ent->headnode = -1;
+
+	if (0 == ent->v.modelindex)
+		return;
+
+	const int count = Bsp_BoxLeafs(ent->v.absmin, ent->v.absmax, ent->leafnums, MAX_ENT_LEAFS);
+
+	if (count > MAX_ENT_LEAFS)
+	{
+		// Too many leafs to list, treat it as visible from everywhere.
+		ent->num_leafs = 0;
+		ent->headnode = 0;
+		return;
+	}
+
+	ent->num_leafs = count;
+}
+
+void SV_LinkEdict(edict_t* ent, bool touchTriggers)
+{
+	if (ent->area.prev)
+		SV_UnlinkEdict(ent); // unlink from old position
+
+	if (ent == g_Edicts || 0 != ent->free)
+		return;
+
+	g_GameFuncs.pfnSetAbsBox(ent);
+
+	if (ent->v.movetype == MOVETYPE_FOLLOW && !SV_IsNullEntity(ent->v.aiment))
+	{
+		ent->headnode = ent->v.aiment->headnode;
+		ent->num_leafs = ent->v.aiment->num_leafs;
+		memcpy(ent->leafnums, ent->v.aiment->leafnums, sizeof(ent->leafnums));
+	}
+	else
+	{
+		SV_FindTouchedLeafs(ent);
+	}
+
+	// Non-solid entities are only linked if they are water brushes, for SV_PointContents.
+	if (ent->v.solid == SOLID_NOT && ent->v.skin >= -1)
+		return;
+
+	areanode_t* node = g_AreaNodes;
+
+	while (node->axis != -1)
+	{
+		if (ent->v.absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if (ent->v.absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break; // crosses the node
+	}
+
+	if (ent->v.solid == SOLID_TRIGGER)
+		InsertLinkBefore(&ent->area, &node->trigger_edicts);
+	else
+		InsertLinkBefore(&ent->area, &node->solid_edicts);
+
+	if (touchTriggers)
+	{
+		std::vector<edict_t*> touched;
+		SV_TouchLinks(ent, g_AreaNodes, touched);
+
+		const float time = g_Globals.time;
+
+		for (edict_t* touch : touched)
+		{
+			if (0 != touch->free || 0 != ent->free || touch->v.solid != SOLID_TRIGGER)
+				continue;
+
+			g_Globals.time = time;
+			g_GameFuncs.pfnTouch(touch, ent);
+		}
+	}
+}
+
+//=========================================================
+// Point contents
+//=========================================================
+static int SV_LinkContents(areanode_t* node, const float* point)
+{
+	for (link_t* l = node->solid_edicts.next; l != &node->solid_edicts; l = l->next)
+	{
+		edict_t* touch = EDICT_FROM_AREA(l);
+
+		if (touch->v.solid != SOLID_NOT)
+			continue;
+
+		const model_s* model = Mod_ForIndex(touch->v.modelindex);
+
+		if (!model || model->Type != BENCH_MOD_BRUSH)
+			continue;
+
+		if (point[0] > touch->v.absmax[0] || point[1] > touch->v.absmax[1] || point[2] > touch->v.absmax[2] || point[0] < touch->v.absmin[0] || point[1] < touch->v.absmin[1] || point[2] < touch->v.absmin[2])
+			continue;
+
+		const Vector local = Vector(point) - touch->v.origin;
+		void* hull = Bsp_ModelHull(model->BspModel, 0);
+
+		if (Bsp_HullPointContents(hull, Bsp_HullFirstClipNode(hull), local) != CONTENTS_EMPTY)
+			return touch->v.skin;
+	}
+
+	if (node->axis == -1)
+		return CONTENTS_EMPTY;
+
+	if (point[node->axis] > node->dist)
+		return SV_LinkContents(node->children[0], point);
+
+	if (point[node->axis] < node->dist)
+		return SV_LinkContents(node->children[1], point);
+
+	return CONTENTS_EMPTY;
+}
+
+static int SV_TruePointContents(const float* point)
+{
+	void* hull = Bsp_ModelHull(0, 0);
+
+	return Bsp_HullPointContents(hull, Bsp_HullFirstClipNode(hull), point);
+}
+
+int SV_PointContents(const float* point)
+{
+	int contents = SV_TruePointContents(point);
+
+	if (contents <= CONTENTS_CURRENT_0 && contents >= CONTENTS_CURRENT_DOWN)
+		contents = CONTENTS_WATER;
+
+	if (contents == CONTENTS_SOLID)
+		return contents;
+
+	const int entityContents = SV_LinkContents(g_AreaNodes, point);
+
+	return entityContents != CONTENTS_EMPTY ? entityContents : contents;
+}
+
+//=========================================================
+// Collision
+//=========================================================
+struct moveclip_t
+{
+	Vector boxmins, boxmaxs; // enclose the test object along entire move
+	Vector mins, maxs;		 // size of the moving object
+	Vector mins2, maxs2;	 // size when clipping against monsters
+	Vector start, end;
+	trace_t trace;
+	int type;
+	bool ignoreTrans;
+	edict_t* passedict;
+};
+
+//=========================================================
+// SV_HullForEntity - returns a hull that can be collided
+// with at the origin by a box of the given size. @p offset
+// is filled with the amount the hull is offset from the
+// entity's origin.
+//=========================================================
+static void* SV_HullForEntity(edict_t* ent, const Vector& mins, const Vector& maxs, Vector& offset)
+{
+	if (ent->v.solid == SOLID_BSP)
+	{
+		const model_s* model = Mod_ForIndex(ent->v.modelindex);
+
+		if (model && model->Type == BENCH_MOD_BRUSH)
+		{
+			const Vector size = maxs - mins;
+
+			int hullNumber;
+
+			if (size[0] <= 8)
+				hullNumber = 0;
+			else if (size[0] <= 36)
+				hullNumber = size[2] <= 36 ? 3 : 1;
+			else
+				hullNumber = 2;
+
+			Vector clipMins, clipMaxs;
+			Bsp_HullSize(hullNumber, clipMins, clipMaxs);
+
+			offset = (hullNumber == 0 ? clipMins : clipMins - mins) + ent->v.origin;
+
+			return Bsp_ModelHull(model->BspModel, hullNumber);
+		}
+	}
+
+	// create a temp hull from bounding box sizes
+	const Vector hullMins = ent->v.mins - maxs;
+	const Vector hullMaxs = ent->v.maxs - mins;
+
+	offset = ent->v.origin;
+
+	return Bsp_BoxHull(hullMins, hullMaxs);
+}
+
+static bool SV_IsRotated(const edict_t* ent)
+{
+	return ent->v.solid == SOLID_BSP && ent->v.angles != g_vecZero;
+}
+
+static Vector SV_RotateIntoEntity(const Vector& point, const Vector& forward, const Vector& right, const Vector& up)
+{
+	return Vector(DotProduct(point, forward), -DotProduct(point, right), DotProduct(point, up));
+}
+
+static trace_t SV_ToTrace(const BspTrace& result)
+{
+	trace_t trace{};
+	trace.allsolid = result.AllSolid ? 1 : 0;
+	trace.startsolid = result.StartSolid ? 1 : 0;
+	trace.inopen = result.InOpen ? 1 : 0;
+	trace.inwater = result.InWater ? 1 : 0;
+	trace.fraction = result.Fraction;
+	trace.endpos = result.EndPos;
+	trace.plane.normal = result.PlaneNormal;
+	trace.plane.dist = result.PlaneDist;
+
+	return trace;
+}
+
+//=========================================================
+// SV_ClipMoveToEntity - handles selection or creation of a
+// clipping hull, and offsetting (and eventually rotation)
+// of the end points.
+//=========================================================
+static trace_t SV_ClipMoveToEntity(edict_t* ent, const Vector& start, const Vector& mins, const Vector& maxs, const Vector& end)
+{
+	Vector offset;
+	void* hull = SV_HullForEntity(ent, mins, maxs, offset);
+
+	Vector startLocal = start - offset;
+	Vector endLocal = end - offset;
+
+	const bool rotated = SV_IsRotated(ent);
+	Vector forward, right, up;
+
+	if (rotated)
+	{
+		Engine_AngleVectors(ent->v.angles, forward, right, up);
+
+		startLocal = SV_RotateIntoEntity(startLocal, forward, right, up);
+		endLocal = SV_RotateIntoEntity(endLocal, forward, right, up);
+	}
+
+	BspTrace result;
+	Bsp_InitTrace(result, endLocal);
+	Bsp_ClipToHull(hull, startLocal, endLocal, result);
+
+	trace_t trace = SV_ToTrace(result);
+
+	if (trace.fraction != 1)
+	{
+		if (rotated)
+		{
+			// rotate the normal back into world space
+			Engine_AngleVectors(-ent->v.angles, forward, right, up);
+			trace.plane.normal = SV_RotateIntoEntity(trace.plane.normal, forward, right, up);
+		}
+
+		trace.endpos = start + trace.fraction * (end - start);
+	}
+	else
+	{
+		trace.endpos = end;
+	}
+
+	if (trace.fraction < 1 || 0 != trace.startsolid)
+		trace.ent = ent;
+
+	return trace;
+}
+
+static void SV_ClipToLinks(areanode_t* node, moveclip_t& clip)
+{
+	for (link_t* l = node->solid_edicts.next; l != &node->solid_edicts; l = l->next)
+	{
+		edict_t* touch = EDICT_FROM_AREA(l);
+
+		if (touch->v.solid == SOLID_NOT || touch == clip.passedict)
+			continue;
+
+		if (clip.passedict && g_NewGameFuncs.pfnShouldCollide && 0 == g_NewGameFuncs.pfnShouldCollide(touch, clip.passedict))
+			continue;
+
+		if (clip.type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
+			continue;
+
+		if (clip.ignoreTrans && touch->v.rendermode != kRenderNormal && (touch->v.flags & FL_WORLDBRUSH) == 0)
+			continue;
+
+		if (!SV_BoxesOverlap(clip.boxmins, clip.boxmaxs, touch->v.absmin, touch->v.absmax))
+			continue;
+
+		// points never interact
+		if (clip.passedict && clip.passedict->v.size[0] != 0 && touch->v.size[0] == 0)
+			continue;
+
+		if (0 != clip.trace.allsolid)
+			return;
+
+		if (clip.passedict)
+		{
+			if (touch->v.owner == clip.passedict)
+				continue; // don't clip against own missiles
+
+			if (clip.passedict->v.owner == touch)
+				continue; // don't clip against owner
+		}
+
+		trace_t trace;
+
+		if ((touch->v.flags & FL_MONSTER) != 0)
+			trace = SV_ClipMoveToEntity(touch, clip.start, clip.mins2, clip.maxs2, clip.end);
+		else
+			trace = SV_ClipMoveToEntity(touch, clip.start, clip.mins, clip.maxs, clip.end);
+
+		if (0 != trace.allsolid || 0 != trace.startsolid || trace.fraction < clip.trace.fraction)
+		{
+			trace.ent = touch;
+
+			const qboolean startSolid = clip.trace.startsolid;
+
+			clip.trace = trace;
+
+			if (0 != startSolid)
+				clip.trace.startsolid = 1;
+		}
+		else if (0 != trace.startsolid)
+		{
+			clip.trace.startsolid = 1;
+		}
+	}
+
+	// recurse down both sides
+	if (node->axis == -1)
+		return;
+
+	if (clip.boxmaxs[node->axis] > node->dist)
+		SV_ClipToLinks(node->children[0], clip);
+
+	if (clip.boxmins[node->axis] < node->dist)
+		SV_ClipToLinks(node->children[1], clip);
+}
+
+trace_t SV_Move(const Vector& start, const Vector& mins, const Vector& maxs, const Vector& end, int type, edict_t* passedict)
+{
+	moveclip_t clip;
+
+	// clip to world
+	clip.trace = SV_ClipMoveToEntity(g_Edicts, start, mins, maxs, end);
+
+	clip.start = start;
+	clip.end = end;
+	clip.mins = mins;
+	clip.maxs = maxs;
+	clip.type = type & 0xFF;
+	clip.ignoreTrans = (type >> 8) != 0;
+	clip.passedict = passedict;
+
+	if (clip.type == MOVE_MISSILE)
+	{
+		clip.mins2 = Vector(-15, -15, -15);
+		clip.maxs2 = Vector(15, 15, 15);
+	}
+	else
+	{
+		clip.mins2 = mins;
+		clip.maxs2 = maxs;
+	}
+
+	// create the bounding box of the entire move
+	for (int i = 0; i < 3; i++)
+	{
+		if (end[i] > start[i])
+		{
+			clip.boxmins[i] = start[i] + clip.mins2[i] - 1;
+			clip.boxmaxs[i] = end[i] + clip.maxs2[i] + 1;
+		}
+		else
+		{
+			clip.boxmins[i] = end[i] + clip.mins2[i] - 1;
+			clip.boxmaxs[i] = start[i] + clip.maxs2[i] + 1;
+		}
+	}
+
+	SV_ClipToLinks(g_AreaNodes, clip);
+
+	return clip.trace;
+}
+
+static void SV_SetGlobalTrace(const trace_t& trace)
+{
+	g_Globals.trace_allsolid = trace.allsolid;
+	g_Globals.trace_startsolid = trace.startsolid;
+	g_Globals.trace_fraction = trace.fraction;
+	g_Globals.trace_inwater = trace.inwater;
+	g_Globals.trace_inopen = trace.inopen;
+	g_Globals.trace_endpos = trace.endpos;
+	g_Globals.trace_plane_normal = trace.plane.normal;
+	g_Globals.trace_plane_dist = trace.plane.dist;
+	g_Globals.trace_ent = trace.ent ? trace.ent : g_Edicts;
+	g_Globals.trace_hitgroup = trace.hitgroup;
+}
+
+static void SV_SetTraceResult(const trace_t& trace, TraceResult* ptr)
+{
+	SV_SetGlobalTrace(trace);
+
+	ptr->fAllSolid = trace.allsolid;
+	ptr->fStartSolid = trace.startsolid;
+	ptr->fInOpen = trace.inopen;
+	ptr->fInWater = trace.inwater;
+	ptr->flFraction = trace.fraction;
+	ptr->vecEndPos = trace.endpos;
+	ptr->flPlaneDist = trace.plane.dist;
+	ptr->vecPlaneNormal = trace.plane.normal;
+	ptr->pHit = trace.ent ? trace.ent : g_Edicts;
+	ptr->iHitgroup = trace.hitgroup;
+}
+
+void SV_TraceLine(const float* v1, const float* v2, int noMonsters, edict_t* pentToSkip, TraceResult* ptr)
+{
+	SV_SetTraceResult(SV_Move(v1, g_vecZero, g_vecZero, v2, noMonsters, pentToSkip), ptr);
+}
+
+void SV_TraceHull(const float* v1, const float* v2, int noMonsters, int hullNumber, edict_t* pentToSkip, TraceResult* ptr)
+{
+	if (hullNumber < 0 || hullNumber >= BSP_MAX_HULLS)
+		hullNumber = 0;
+
+	Vector mins, maxs;
+	Bsp_HullSize(hullNumber, mins, maxs);
+
+	SV_SetTraceResult(SV_Move(v1, mins, maxs, v2, noMonsters, pentToSkip), ptr);
+}
+
+int SV_TraceMonsterHull(edict_t* pEdict, const float* v1, const float* v2, int noMonsters, edict_t* pentToSkip, TraceResult* ptr)
+{
+	const trace_t trace = SV_Move(v1, pEdict->v.mins, pEdict->v.maxs, v2, noMonsters, pentToSkip);
+
+	if (ptr)
+		SV_SetTraceResult(trace, ptr);
+
+	return 0 != trace.allsolid || trace.fraction != 1 ? 1 : 0;
+}
+
+void SV_TraceModel(const float* v1, const float* v2, int hullNumber, edict_t* pent, TraceResult* ptr)
+{
+	if (hullNumber < 0 || hullNumber >= BSP_MAX_HULLS)
+		hullNumber = 0;
+
+	Vector mins, maxs;
+	Bsp_HullSize(hullNumber, mins, maxs);
+
+	SV_SetTraceResult(SV_ClipMoveToEntity(pent, v1, mins, maxs, v2), ptr);
+}
+
+void SV_TraceToss(edict_t* pent, edict_t* pentToIgnore, TraceResult* ptr)
+{
+	// Simulate the entity's flight without moving it.
+	Vector origin = pent->v.origin;
+	Vector velocity = pent->v.velocity;
+
+	const float gravity = (0 != pent->v.gravity ? pent->v.gravity : 1.0f) * g_MoveVars.gravity;
+
+	trace_t trace{};
+	trace.fraction = 1;
+	trace.endpos = origin;
+
+	for (int i = 0; i < 200; i++)
+	{
+		velocity[2] -= gravity * 0.05f;
+
+		const Vector end = origin + velocity * 0.05f;
+
+		trace = SV_Move(origin, pent->v.mins, pent->v.maxs, end, MOVE_NORMAL, pent);
+
+		if (trace.ent && trace.ent != pentToIgnore || 0 != trace.allsolid || trace.fraction != 1)
+			break;
+
+		origin = trace.endpos;
+	}
+
+	SV_SetTraceResult(trace, ptr);
+}
+
+void SV_TraceSphere(const float* v1, const float* v2, int noMonsters, float radius, edict_t* pentToSkip, TraceResult* ptr)
+{
+	// The engine doesn't implement this either, a line is the closest match.
+	SV_TraceLine(v1, v2, noMonsters, pentToSkip, ptr);
+}
+
+const char* SV_TraceTexture(edict_t* pTextureEntity, const float* v1, const float* v2)
+{
+	int bspModel = 0;
+	Vector start = v1, end = v2;
+
+	if (pTextureEntity)
+	{
+		const model_s* model = Mod_ForIndex(pTextureEntity->v.modelindex);
+
+		if (!model || model->Type != BENCH_MOD_BRUSH)
+			return nullptr;
+
+		bspModel = model->BspModel;
+		start = start - pTextureEntity->v.origin;
+		end = end - pTextureEntity->v.origin;
+	}
+
+	return Bsp_TraceTexture(bspModel, start, end);
+}
+
+//=========================================================
+// Physics helpers
+//=========================================================
+constexpr float STOP_EPSILON = 0.1f;
+
+static void SV_CheckVelocity(edict_t* ent)
+{
+	const float maxVelocity = g_MoveVars.maxvelocity;
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (std::isnan(ent->v.velocity[i]))
+			ent->v.velocity[i] = 0;
+
+		if (std::isnan(ent->v.origin[i]))
+			ent->v.origin[i] = 0;
+
+		if (ent->v.velocity[i] > maxVelocity)
+			ent->v.velocity[i] = maxVelocity;
+		else if (ent->v.velocity[i] < -maxVelocity)
+			ent->v.velocity[i] = -maxVelocity;
+	}
+}
+
+//=========================================================
+// SV_RunThink - runs the entity's think function if it's
+// due this frame. Returns false if the entity removed
+// itself.
+//=========================================================
+static bool SV_RunThink(edict_t* ent)
+{
+	float thinkTime = ent->v.nextthink;
+
+	if (thinkTime <= 0 || thinkTime > g_Globals.time + g_Globals.frametime)
+		return true;
+
+	if (thinkTime < g_Globals.time)
+		thinkTime = g_Globals.time; // don't let things stay in the past.
+
+	const float time = g_Globals.time;
+
+	ent->v.nextthink = 0;
+	g_Globals.time = thinkTime;
+
+	if ((ent->v.flags & FL_KILLME) == 0)
+		g_GameFuncs.pfnThink(ent);
+
+	g_Globals.time = time;
+
+	if ((ent->v.flags & FL_KILLME) != 0)
+		ED_Free(ent);
+
+	return 0 == ent->free;
+}
+
+//=========================================================
+// SV_Impact - two entities have touched, so run their
+// touch functions.
+//=========================================================
+static void SV_Impact(edict_t* e1, edict_t* e2, const trace_t& trace)
+{
+	if (((e1->v.flags | e2->v.flags) & FL_KILLME) != 0)
+		return;
+
+	if (e1->v.solid != SOLID_NOT)
+	{
+		SV_SetGlobalTrace(trace);
+		g_GameFuncs.pfnTouch(e1, e2);
+	}
+
+	if (e2->v.solid != SOLID_NOT)
+	{
+		SV_SetGlobalTrace(trace);
+		g_GameFuncs.pfnTouch(e2, e1);
+	}
+}
+
+//=========================================================
+// SV_ClipVelocity - slide off of the impacting object.
+//=========================================================
+static int SV_ClipVelocity(const Vector& in, const Vector& normal, Vector& out, float overbounce)
+{
+	int blocked = 0;
+
+	if (normal[2] > 0)
+		blocked |= 1; // floor
+
+	if (0 == normal[2])
+		blocked |= 2; // step
+
+	const float backoff = DotProduct(in, normal) * overbounce;
+
+	for (int i = 0; i < 3; i++)
+	{
+		out[i] = in[i] - normal[i] * backoff;
+
+		if (out[i] > -STOP_EPSILON && out[i] < STOP_EPSILON)
+			out[i] = 0;
+	}
+
+	return blocked;
+}
+
+static void SV_AddGravity(edict_t* ent)
+{
+	const float gravity = 0 != ent->v.gravity ? ent->v.gravity : 1.0f;
+
+	ent->v.velocity[2] -= gravity * g_MoveVars.gravity * g_Globals.frametime;
+	ent->v.velocity[2] += ent->v.basevelocity[2] * g_Globals.frametime;
+	ent->v.basevelocity[2] = 0;
+
+	SV_CheckVelocity(ent);
+}
+
+static bool SV_CheckWater(edict_t* ent)
+{
+	Vector point = ent->v.origin;
+	point[2] += ent->v.mins[2] + 1;
+
+	ent->v.waterlevel = 0;
+	ent->v.watertype = CONTENTS_EMPTY;
+
+	int contents = SV_PointContents(point);
+
+	if (contents <= CONTENTS_WATER && contents > CONTENTS_TRANSLUCENT)
+	{
+		ent->v.watertype = contents;
+		ent->v.waterlevel = 1;
+
+		point[2] = ent->v.origin[2] + (ent->v.mins[2] + ent->v.maxs[2]) * 0.5f;
+
+		contents = SV_PointContents(point);
+
+		if (contents <= CONTENTS_WATER && contents > CONTENTS_TRANSLUCENT)
+		{
+			ent->v.waterlevel = 2;
+
+			point = ent->v.origin + ent->v.view_ofs;
+
+			contents = SV_PointContents(point);
+
+			if (contents <= CONTENTS_WATER && contents > CONTENTS_TRANSLUCENT)
+				ent->v.waterlevel = 3;
+		}
+	}
+
+	return ent->v.waterlevel > 1;
+}
+
+//=========================================================
+// SV_FlyMove - the basic solid body movement clip that
+// slides along multiple planes.
+//=========================================================
+static int SV_FlyMove(edict_t* ent, float time)
+{
+	Vector planes[MAX_CLIP_PLANES];
+	int numPlanes = 0;
+	int blocked = 0;
+
+	const Vector primalVelocity = ent->v.velocity;
+	Vector originalVelocity = ent->v.velocity;
+	Vector newVelocity;
+
+	float timeLeft = time;
+
+	for (int bumpCount = 0; bumpCount < 4; bumpCount++)
+	{
+		if (ent->v.velocity == g_vecZero)
+			break;
+
+		const Vector end = ent->v.origin + timeLeft * ent->v.velocity;
+
+		const trace_t trace = SV_Move(ent->v.origin, ent->v.mins, ent->v.maxs, end, MOVE_NORMAL, ent);
+
+		if (0 != trace.allsolid)
+		{
+			// entity is trapped in another solid
+			ent->v.velocity = g_vecZero;
+			return 4;
+		}
+
+		if (trace.fraction > 0)
+		{
+			// actually covered some distance
+			ent->v.origin = trace.endpos;
+			originalVelocity = ent->v.velocity;
+			numPlanes = 0;
+		}
+
+		if (trace.fraction == 1)
+			break; // moved the entire distance
+
+		if (trace.plane.normal[2] > 0.7f)
+		{
+			blocked |= 1; // floor
+
+			if (trace.ent->v.solid == SOLID_BSP || trace.ent->v.movetype == MOVETYPE_PUSHSTEP || (trace.ent->v.flags & FL_CLIENT) != 0)
+			{
+				ent->v.flags |= FL_ONGROUND;
+				ent->v.groundentity = trace.ent;
+			}
+		}
+
+		if (0 == trace.plane.normal[2])
+			blocked |= 2; // step
+
+		SV_Impact(ent, trace.ent, trace);
+
+		if (0 != ent->free)
+			break; // removed by the impact function
+
+		timeLeft -= timeLeft * trace.fraction;
+
+		// cliped to another plane
+		if (numPlanes >= MAX_CLIP_PLANES)
+		{
+			ent->v.velocity = g_vecZero;
+			break;
+		}
+
+		planes[numPlanes++] = trace.plane.normal;
+
+		// modify original_velocity so it parallels all of the clip planes
+		int i;
+
+		for (i = 0; i < numPlanes; i++)
+		{
+			SV_ClipVelocity(originalVelocity, planes[i], newVelocity, 1);
+
+			int j;
+
+			for (j = 0; j < numPlanes; j++)
+			{
+				if (j != i && DotProduct(newVelocity, planes[j]) < 0)
+					break; // not ok
+			}
+
+			if (j == numPlanes)
+				break;
+		}
+
+		if (i != numPlanes)
+		{
+			// go along this plane
+			ent->v.velocity = newVelocity;
+		}
+		else
+		{
+			// go along the crease
+			if (numPlanes != 2)
+			{
+				ent->v.velocity = g_vecZero;
+				break;
+			}
+
+			const Vector dir = CrossProduct(planes[0], planes[1]);
+			ent->v.velocity = dir * DotProduct(dir, ent->v.velocity);
+		}
+
+		// if original velocity is against the original velocity, stop dead
+		// to avoid tiny occilations in sloping corners
+		if (DotProduct(ent->v.velocity, primalVelocity) <= 0)
+		{
+			ent->v.velocity = g_vecZero;
+			break;
+		}
+	}
+
+	return blocked;
+}
+
+//=========================================================
+// SV_PushEntity - does not change the entity's velocity.
+//=========================================================
+static trace_t SV_PushEntity(edict_t* ent, const Vector& push)
+{
+	const Vector end = ent->v.origin + push;
+
+	int type;
+
+	if (ent->v.movetype == MOVETYPE_FLYMISSILE || ent->v.movetype == MOVETYPE_BOUNCEMISSILE)
+		type = MOVE_MISSILE;
+	else if (ent->v.solid == SOLID_TRIGGER || ent->v.solid == SOLID_NOT)
+		type = MOVE_NOMONSTERS; // only clip against bmodels
+	else
+		type = MOVE_NORMAL;
+
+	const trace_t trace = SV_Move(ent->v.origin, ent->v.mins, ent->v.maxs, end, type, ent);
+
+	if (trace.fraction != 0)
+		ent->v.origin = trace.endpos;
+
+	SV_LinkEdict(ent, true);
+
+	if (trace.ent)
+		SV_Impact(ent, trace.ent, trace);
+
+	return trace;
+}
+
+static bool SV_TestEntityPosition(edict_t* ent)
+{
+	const trace_t trace = SV_Move(ent->v.origin, ent->v.mins, ent->v.maxs, ent->v.origin, MOVE_NORMAL, ent);
+
+	return 0 != trace.startsolid;
+}
+
+//=========================================================
+// SV_PushMove - moves a pusher and everything standing on
+// or in the way of it. If something can't be moved out of
+// the way, the pusher is moved back and Blocked is called.
+//=========================================================
+static void SV_PushMove(edict_t* pusher, float moveTime)
+{
+	if (pusher->v.velocity == g_vecZero)
+	{
+		pusher->v.ltime += moveTime;
+		return;
+	}
+
+	const Vector move = pusher->v.velocity * moveTime;
+	const Vector mins = pusher->v.absmin + move;
+	const Vector maxs = pusher->v.absmax + move;
+	const Vector pushOrigin = pusher->v.origin;
+
+	// move the pusher to its final position
+	pusher->v.origin = pusher->v.origin + move;
+	pusher->v.ltime += moveTime;
+	SV_LinkEdict(pusher, false);
+
+	if (pusher->v.solid == SOLID_NOT)
+		return;
+
+	struct MovedEntity
+	{
+		edict_t* Entity;
+		Vector Origin;
+	};
+
+	std::vector<MovedEntity> moved;
+
+	// see if any solid entities are inside the final position
+	for (int i = 1; i < g_NumEdicts; i++)
+	{
+		edict_t* check = &g_Edicts[i];
+
+		if (0 != check->free)
+			continue;
+
+		if (check->v.movetype == MOVETYPE_PUSH || check->v.movetype == MOVETYPE_NONE || check->v.movetype == MOVETYPE_FOLLOW || check->v.movetype == MOVETYPE_NOCLIP)
+			continue;
+
+		// if the entity is standing on the pusher, it will definately be moved
+		if ((check->v.flags & FL_ONGROUND) == 0 || check->v.groundentity != pusher)
+		{
+			if (!SV_BoxesOverlap(check->v.absmin, check->v.absmax, mins, maxs))
+				continue;
+
+			// see if the ent's bbox is inside the pusher's final position
+			if (!SV_TestEntityPosition(check))
+				continue;
+		}
+
+		// remove the onground flag for non-players
+		if (check->v.movetype != MOVETYPE_WALK)
+			check->v.flags &= ~FL_ONGROUND;
+
+		moved.push_back({check, check->v.origin});
+
+		// try moving the contacted entity
+		pusher->v.solid = SOLID_NOT;
+		SV_PushEntity(check, move);
+		pusher->v.solid = SOLID_BSP;
+
+		// if it is still inside the pusher, block
+		if (!SV_TestEntityPosition(check))
+			continue;
+
+		// fail the move
+		if (check->v.mins[0] == check->v.maxs[0])
+			continue;
+
+		if (check->v.solid == SOLID_NOT || check->v.solid == SOLID_TRIGGER)
+		{
+			// corpse
+			check->v.mins[0] = check->v.mins[1] = 0;
+			check->v.maxs = check->v.mins;
+			continue;
+		}
+
+		pusher->v.origin = pushOrigin;
+		SV_LinkEdict(pusher, false);
+		pusher->v.ltime -= moveTime;
+
+		// if the pusher has a "blocked" function, call it
+		// otherwise, just stay in place until the obstacle is gone
+		g_GameFuncs.pfnBlocked(pusher, check);
+
+		// move back any entities we already moved
+		for (const auto& entry : moved)
+		{
+			if (0 != entry.Entity->free)
+				continue;
+
+			entry.Entity->v.origin = entry.Origin;
+			SV_LinkEdict(entry.Entity, false);
+		}
+
+		return;
+	}
+}
+
+//=========================================================
+// SV_PushRotate - rotates a pusher. Entities in the way
+// block it, but riders aren't carried around.
+//=========================================================
+static void SV_PushRotate(edict_t* pusher, float moveTime)
+{
+	const Vector pushAngles = pusher->v.angles;
+
+	pusher->v.angles = pusher->v.angles + pusher->v.avelocity * moveTime;
+	pusher->v.ltime += moveTime;
+	SV_LinkEdict(pusher, false);
+
+	if (pusher->v.solid == SOLID_NOT)
+		return;
+
+	for (int i = 1; i < g_NumEdicts; i++)
+	{
+		edict_t* check = &g_Edicts[i];
+
+		if (0 != check->free)
+			continue;
+
+		if (check->v.movetype == MOVETYPE_PUSH || check->v.movetype == MOVETYPE_NONE || check->v.movetype == MOVETYPE_FOLLOW || check->v.movetype == MOVETYPE_NOCLIP)
+			continue;
+
+		if (check->v.solid == SOLID_NOT || check->v.solid == SOLID_TRIGGER)
+			continue;
+
+		if (!SV_BoxesOverlap(check->v.absmin, check->v.absmax, pusher->v.absmin, pusher->v.absmax))
+			continue;
+
+		if (!SV_TestEntityPosition(check))
+			continue;
+
+		pusher->v.angles = pushAngles;
+		SV_LinkEdict(pusher, false);
+		pusher->v.ltime -= moveTime;
+
+		g_GameFuncs.pfnBlocked(pusher, check);
+
+		return;
+	}
+}
+
+static void SV_Physics_Pusher(edict_t* ent)
+{
+	const float oldLTime = ent->v.ltime;
+	const float thinkTime = ent->v.nextthink;
+
+	float moveTime;
+
+	if (thinkTime < ent->v.ltime + g_Globals.frametime)
+	{
+		moveTime = thinkTime - ent->v.ltime;
+
+		if (moveTime < 0)
+			moveTime = 0;
+	}
+	else
+	{
+		moveTime = g_Globals.frametime;
+	}
+
+	if (0 != moveTime)
+	{
+		if (ent->v.avelocity != g_vecZero)
+		{
+			if (ent->v.velocity != g_vecZero)
+			{
+				// rotate and then move, the move adds the time
+				SV_PushRotate(ent, moveTime);
+				ent->v.ltime -= moveTime;
+			}
+
+			SV_PushRotate(ent, moveTime);
+
+			if (ent->v.velocity != g_vecZero)
+			{
+				ent->v.ltime -= moveTime;
+				SV_PushMove(ent, moveTime);
+			}
+		}
+		else
+		{
+			SV_PushMove(ent, moveTime);
+		}
+	}
+
+	if (thinkTime > oldLTime && ((ent->v.flags & FL_ALWAYSTHINK) != 0 || thinkTime <= ent->v.ltime))
+	{
+		ent->v.nextthink = 0;
+
+		const float time = g_Globals.time;
+
+		g_GameFuncs.pfnThink(ent);
+
+		g_Globals.time = time;
+	}
+}
+
+static void SV_Physics_None(edict_t* ent)
+{
+	SV_RunThink(ent);
+}
+
+static void SV_Physics_Follow(edict_t* ent)
+{
+	if (!SV_RunThink(ent))
+		return;
+
+	edict_t* parent = ent->v.aiment;
+
+	if (SV_IsNullEntity(parent))
+	{
+		ent->v.movetype = MOVETYPE_NONE;
+		return;
+	}
+
+	ent->v.origin = parent->v.origin + ent->v.v_angle;
+	ent->v.angles = parent->v.angles;
+
+	SV_LinkEdict(ent, true);
+}
+
+static void SV_Physics_Noclip(edict_t* ent)
+{
+	if (!SV_RunThink(ent))
+		return;
+
+	ent->v.angles = ent->v.angles + g_Globals.frametime * ent->v.avelocity;
+	ent->v.origin = ent->v.origin + g_Globals.frametime * ent->v.velocity;
+
+	SV_LinkEdict(ent, false);
+}
+
+static void SV_Physics_Toss(edict_t* ent)
+{
+	SV_CheckWater(ent);
+
+	if (!SV_RunThink(ent))
+		return;
+
+	if (ent->v.velocity[2] > 0 || SV_IsNullEntity(ent->v.groundentity) || (ent->v.groundentity->v.flags & (FL_MONSTER | FL_CLIENT)) != 0)
+		ent->v.flags &= ~FL_ONGROUND;
+
+	// if on ground and not moving, return.
+	if ((ent->v.flags & FL_ONGROUND) != 0 && ent->v.velocity == g_vecZero)
+	{
+		ent->v.avelocity = g_vecZero;
+
+		if (ent->v.basevelocity == g_vecZero)
+			return; // at rest
+	}
+
+	SV_CheckVelocity(ent);
+
+	// add gravity
+	if (ent->v.movetype != MOVETYPE_FLY && ent->v.movetype != MOVETYPE_FLYMISSILE && ent->v.movetype != MOVETYPE_BOUNCEMISSILE)
+		SV_AddGravity(ent);
+
+	// move angles
+	ent->v.angles = ent->v.angles + g_Globals.frametime * ent->v.avelocity;
+
+	// move origin
+	ent->v.velocity = ent->v.velocity + ent->v.basevelocity;
+	SV_CheckVelocity(ent);
+
+	trace_t trace = SV_PushEntity(ent, ent->v.velocity * g_Globals.frametime);
+
+	ent->v.velocity = ent->v.velocity - ent->v.basevelocity;
+	SV_CheckVelocity(ent);
+
+	if (0 != trace.allsolid)
+	{
+		// entity is trapped in another solid
+		ent->v.velocity = g_vecZero;
+		ent->v.avelocity = g_vecZero;
+		return;
+	}
+
+	if (trace.fraction == 1 || 0 != ent->free)
+		return;
+
+	float backoff;
+
+	if (ent->v.movetype == MOVETYPE_BOUNCE)
+		backoff = 2.0f - ent->v.friction;
+	else if (ent->v.movetype == MOVETYPE_BOUNCEMISSILE)
+		backoff = 2.0f;
+	else
+		backoff = 1;
+
+	SV_ClipVelocity(ent->v.velocity, trace.plane.normal, ent->v.velocity, backoff);
+
+	// stop if on ground
+	if (trace.plane.normal[2] > 0.7f)
+	{
+		const Vector move = ent->v.basevelocity + ent->v.velocity;
+
+		if (move[2] < g_MoveVars.gravity * g_Globals.frametime)
+		{
+			// we're rolling on the ground, add static friction.
+			ent->v.groundentity = trace.ent;
+			ent->v.flags |= FL_ONGROUND;
+			ent->v.velocity[2] = 0;
+		}
+
+		if (DotProduct(move, move) < 30 * 30 || (ent->v.movetype != MOVETYPE_BOUNCE && ent->v.movetype != MOVETYPE_BOUNCEMISSILE))
+		{
+			ent->v.flags |= FL_ONGROUND;
+			ent->v.groundentity = trace.ent;
+			ent->v.velocity = g_vecZero;
+			ent->v.avelocity = g_vecZero;
+		}
+		else
+		{
+			const float scale = (1.0f - trace.fraction) * g_Globals.frametime * 0.9f;
+			trace = SV_PushEntity(ent, (ent->v.velocity + ent->v.basevelocity) * scale);
+		}
+	}
+
+	if (0 == ent->free)
+		SV_CheckWater(ent);
+}
+
+//=========================================================
+// SV_Physics_Step - monsters. Gravity and friction are
+// applied when the monster isn't standing on something,
+// and the monster's think function does the walking.
+//=========================================================
+static void SV_Physics_Step(edict_t* ent)
+{
+	SV_CheckVelocity(ent);
+
+	const bool wasOnGround = (ent->v.flags & FL_ONGROUND) != 0;
+	const bool inWater = SV_CheckWater(ent);
+
+	if (!wasOnGround && (ent->v.flags & FL_FLY) == 0 && !((ent->v.flags & FL_SWIM) != 0 && ent->v.waterlevel > 0))
+	{
+		if (!inWater)
+			SV_AddGravity(ent);
+	}
+
+	if (ent->v.velocity != g_vecZero || ent->v.basevelocity != g_vecZero)
+	{
+		ent->v.flags &= ~FL_ONGROUND;
+
+		// apply friction
+		if (wasOnGround && (ent->v.health > 0 || SV_CheckBottom(ent)))
+		{
+			const float speed = sqrt(ent->v.velocity[0] * ent->v.velocity[0] + ent->v.velocity[1] * ent->v.velocity[1]);
+
+			if (0 != speed)
+			{
+				const float friction = g_MoveVars.friction * (0 != ent->v.friction ? ent->v.friction : 1.0f);
+				ent->v.friction = 1;
+
+				const float control = speed < g_MoveVars.stopspeed ? g_MoveVars.stopspeed : speed;
+
+				float newSpeed = speed - g_Globals.frametime * control * friction;
+
+				if (newSpeed < 0)
+					newSpeed = 0;
+
+				newSpeed /= speed;
+
+				ent->v.velocity[0] *= newSpeed;
+				ent->v.velocity[1] *= newSpeed;
+			}
+		}
+
+		ent->v.velocity = ent->v.velocity + ent->v.basevelocity;
+		SV_CheckVelocity(ent);
+
+		SV_FlyMove(ent, g_Globals.frametime);
+
+		if (0 != ent->free)
+			return;
+
+		ent->v.velocity = ent->v.velocity - ent->v.basevelocity;
+		SV_CheckVelocity(ent);
+
+		// determine if it's on solid ground at all
+		const Vector mins = ent->v.origin + ent->v.mins;
+		const Vector maxs = ent->v.origin + ent->v.maxs;
+
+		Vector point;
+		point[2] = mins[2] - 1;
+
+		for (int x = 0; x <= 1 && (ent->v.flags & FL_ONGROUND) == 0; x++)
+		{
+			for (int y = 0; y <= 1; y++)
+			{
+				point[0] = x ? maxs[0] : mins[0];
+				point[1] = y ? maxs[1] : mins[1];
+
+				if (SV_PointContents(point) == CONTENTS_SOLID)
+				{
+					ent->v.flags |= FL_ONGROUND;
+					break;
+				}
+			}
+		}
+
+		SV_LinkEdict(ent, true);
+	}
+	else if (0 != g_Globals.force_retouch)
+	{
+		const trace_t trace = SV_Move(ent->v.origin, ent->v.mins, ent->v.maxs, ent->v.origin, MOVE_NORMAL, ent);
+
+		if ((trace.fraction < 1 || 0 != trace.startsolid) && trace.ent)
+			SV_Impact(ent, trace.ent, trace);
+	}
+
+	if (!SV_RunThink(ent))
+		return;
+
+	SV_CheckWater(ent);
+}
+
+void SV_Physics()
+{
+	g_Globals.frametime = g_Options.FrameTime;
+
+	g_GameFuncs.pfnStartFrame();
+
+	for (int i = 0; i < g_NumEdicts; i++)
+	{
+		edict_t* ent = &g_Edicts[i];
+
+		if (0 != ent->free)
+			continue;
+
+		if (0 != g_Globals.force_retouch)
+			SV_LinkEdict(ent, true); // force retouch even for stationary
+
+		// clients are run by SV_RunCmd
+		if (i > 0 && i <= g_Globals.maxClients)
+			continue;
+
+		switch (ent->v.movetype)
+		{
+		case MOVETYPE_PUSH:
+			SV_Physics_Pusher(ent);
+			break;
+
+		case MOVETYPE_NONE:
+			SV_Physics_None(ent);
+			break;
+
+		case MOVETYPE_FOLLOW:
+			SV_Physics_Follow(ent);
+			break;
+
+		case MOVETYPE_NOCLIP:
+			SV_Physics_Noclip(ent);
+			break;
+
+		case MOVETYPE_STEP:
+		case MOVETYPE_PUSHSTEP:
+			SV_Physics_Step(ent);
+			break;
+
+		case MOVETYPE_TOSS:
+		case MOVETYPE_BOUNCE:
+		case MOVETYPE_BOUNCEMISSILE:
+		case MOVETYPE_FLY:
+		case MOVETYPE_FLYMISSILE:
+			SV_Physics_Toss(ent);
+			break;
+
+		default:
+			Engine_Error("SV_Physics: %s bad movetype %d\n", g_Globals.pStringBase + ent->v.classname, static_cast<int>(ent->v.movetype));
+		}
+
+		if (0 == ent->free && (ent->v.flags & FL_KILLME) != 0)
+			ED_Free(ent);
+	}
+
+	if (0 != g_Globals.force_retouch)
+		g_Globals.force_retouch = g_Globals.force_retouch - 1;
+
+	g_Globals.time += g_Globals.frametime;
+}
+
+//=========================================================
+// Monster movement
+//=========================================================
+constexpr float DI_NODIR = -1;
+
+//=========================================================
+// SV_CheckBottom - returns false if any part of the bottom
+// of the entity is off an edge that is not a staircase.
+//=========================================================
+bool SV_CheckBottom(edict_t* ent)
+{
+	const Vector mins = ent->v.origin + ent->v.mins;
+	const Vector maxs = ent->v.origin + ent->v.maxs;
+
+	// if all of the points under the corners are solid world, don't bother
+	// with the tougher checks
+	// the corners must be within 16 of the midpoint
+	Vector start;
+	start[2] = mins[2] - 1;
+
+	bool allSolid = true;
+
+	for (int x = 0; x <= 1 && allSolid; x++)
+	{
+		for (int y = 0; y <= 1; y++)
+		{
+			start[0] = x ? maxs[0] : mins[0];
+			start[1] = y ? maxs[1] : mins[1];
+
+			if (SV_PointContents(start) != CONTENTS_SOLID)
+			{
+				allSolid = false;
+				break;
+			}
+		}
+	}
+
+	if (allSolid)
+		return true;
+
+	// check it for real...
+	start[2] = mins[2] + g_MoveVars.stepsize;
+
+	// the midpoint must be within 16 of the bottom
+	start[0] = (mins[0] + maxs[0]) * 0.5f;
+	start[1] = (mins[1] + maxs[1]) * 0.5f;
+
+	Vector stop = start;
+	stop[2] = start[2] - 2 * g_MoveVars.stepsize;
+
+	trace_t trace = SV_Move(start, g_vecZero, g_vecZero, stop, MOVE_NOMONSTERS, ent);
+
+	if (trace.fraction == 1.0f)
+		return false;
+
+	const float mid = trace.endpos[2];
+	float bottom = mid;
+
+	// the corners must be within 16 of the midpoint
+	for (int x = 0; x <= 1; x++)
+	{
+		for (int y = 0; y <= 1; y++)
+		{
+			start[0] = stop[0] = x ? maxs[0] : mins[0];
+			start[1] = stop[1] = y ? maxs[1] : mins[1];
+
+			trace = SV_Move(start, g_vecZero, g_vecZero, stop, MOVE_NOMONSTERS, ent);
+
+			if (trace.fraction != 1.0f && trace.endpos[2] > bottom)
+				bottom = trace.endpos[2];
+
+			if (trace.fraction == 1.0f || mid - trace.endpos[2] > g_MoveVars.stepsize)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+//=========================================================
+// SV_MoveStep - called by monster program code. The move
+// will be adjusted for slopes and stairs, but if the move
+// isn't possible, no move is done and false is returned.
+//=========================================================
+static bool SV_MoveStep(edict_t* ent, const Vector& move, bool relink, int moveType)
+{
+	const Vector oldOrigin = ent->v.origin;
+	Vector newOrigin = ent->v.origin + move;
+
+	// flying monsters don't step up
+	if ((ent->v.flags & (FL_SWIM | FL_FLY)) != 0)
+	{
+		// try one move with vertical motion, then one without
+		for (int i = 0; i < 2; i++)
+		{
+			newOrigin = ent->v.origin + move;
+
+			edict_t* enemy = ent->v.enemy;
+
+			if (i == 0 && !SV_IsNullEntity(enemy))
+			{
+				const float dz = ent->v.origin[2] - enemy->v.origin[2];
+
+				if (dz > 40)
+					newOrigin[2] -= 8;
+
+				if (dz < 30)
+					newOrigin[2] += 8;
+			}
+
+			const trace_t trace = SV_Move(ent->v.origin, ent->v.mins, ent->v.maxs, newOrigin, moveType, ent);
+
+			if (trace.fraction == 1)
+			{
+				if ((ent->v.flags & FL_SWIM) != 0 && SV_PointContents(trace.endpos) == CONTENTS_EMPTY)
+					return false; // swim monster left water
+
+				ent->v.origin = trace.endpos;
+
+				if (relink)
+					SV_LinkEdict(ent, true);
+
+				return true;
+			}
+
+			if (SV_IsNullEntity(enemy))
+				break;
+		}
+
+		return false;
+	}
+
+	// push down from a step height above the wished position
+	newOrigin[2] += g_MoveVars.stepsize;
+
+	Vector end = newOrigin;
+	end[2] -= g_MoveVars.stepsize * 2;
+
+	trace_t trace = SV_Move(newOrigin, ent->v.mins, ent->v.maxs, end, moveType, ent);
+
+	if (0 != trace.allsolid)
+		return false;
+
+	if (0 != trace.startsolid)
+	{
+		newOrigin[2] -= g_MoveVars.stepsize;
+		trace = SV_Move(newOrigin, ent->v.mins, ent->v.maxs, end, moveType, ent);
+
+		if (0 != trace.allsolid || 0 != trace.startsolid)
+			return false;
+	}
+
+	if (trace.fraction == 1)
+	{
+		// if monster had the ground pulled out, go ahead and fall
+		if ((ent->v.flags & FL_PARTIALGROUND) != 0)
+		{
+			ent->v.origin = ent->v.origin + move;
+
+			if (relink)
+				SV_LinkEdict(ent, true);
+
+			ent->v.flags &= ~FL_ONGROUND;
+
+			return true;
+		}
+
+		return false; // walked off an edge
+	}
+
+	// check point traces down for dangling corners
+	ent->v.origin = trace.endpos;
+
+	if (!SV_CheckBottom(ent))
+	{
+		if ((ent->v.flags & FL_PARTIALGROUND) != 0)
+		{
+			// entity had floor mostly pulled out from underneath it
+			// and is trying to correct
+			if (relink)
+				SV_LinkEdict(ent, true);
+
+			return true;
+		}
+
+		ent->v.origin = oldOrigin;
+		return false;
+	}
+
+	ent->v.flags &= ~FL_PARTIALGROUND;
+	ent->v.groundentity = trace.ent;
+
+	if (relink)
+		SV_LinkEdict(ent, true);
+
+	return true;
+}
+
+int SV_WalkMove(edict_t* ent, float yaw, float dist, int mode)
+{
+	if ((ent->v.flags & (FL_ONGROUND | FL_FLY | FL_SWIM)) == 0)
+		return 0;
+
+	yaw = yaw * M_PI * 2 / 360;
+
+	const Vector move(cos(yaw) * dist, sin(yaw) * dist, 0);
+
+	switch (mode)
+	{
+	case WALKMOVE_WORLDONLY:
+		return SV_MoveStep(ent, move, true, MOVE_NOMONSTERS) ? 1 : 0;
+
+	case WALKMOVE_CHECKONLY:
+	{
+		const Vector origin = ent->v.origin;
+		const int flags = ent->v.flags;
+		edict_t* groundEntity = ent->v.groundentity;
+
+		const bool result = SV_MoveStep(ent, move, false, MOVE_NORMAL);
+
+		ent->v.origin = origin;
+		ent->v.flags = flags;
+		ent->v.groundentity = groundEntity;
+
+		return result ? 1 : 0;
+	}
+
+	default:
+		return SV_MoveStep(ent, move, true, MOVE_NORMAL) ? 1 : 0;
+	}
+}
+
+static bool SV_StepDirection(edict_t* ent, float yaw, float dist)
+{
+	yaw = yaw * M_PI * 2 / 360;
+
+	const Vector move(cos(yaw) * dist, sin(yaw) * dist, 0);
+
+	const bool moved = SV_MoveStep(ent, move, false, MOVE_NORMAL);
+
+	SV_LinkEdict(ent, true);
+
+	return moved;
+}
+
+static float SV_AngleMod(float angle)
+{
+	return (360.0f / 65536) * (static_cast<int>(angle * (65536 / 360.0f)) & 65535);
+}
+
+//=========================================================
+// SV_NewChaseDir - tries the directions towards the goal,
+// then every other direction, before turning around.
+//=========================================================
+static void SV_NewChaseDir(edict_t* actor, const Vector& goal, float dist)
+{
+	const float oldDir = SV_AngleMod(static_cast<int>(actor->v.ideal_yaw / 45) * 45);
+	const float turnAround = SV_AngleMod(oldDir - 180);
+
+	const float deltaX = goal[0] - actor->v.origin[0];
+	const float deltaY = goal[1] - actor->v.origin[1];
+
+	float d[3];
+
+	if (deltaX > 10)
+		d[1] = 0;
+	else if (deltaX < -10)
+		d[1] = 180;
+	else
+		d[1] = DI_NODIR;
+
+	if (deltaY < -10)
+		d[2] = 270;
+	else if (deltaY > 10)
+		d[2] = 90;
+	else
+		d[2] = DI_NODIR;
+
+	// try direct route
+	if (d[1] != DI_NODIR && d[2] != DI_NODIR)
+	{
+		float tdir;
+
+		if (d[1] == 0)
+			tdir = d[2] == 90 ? 45 : 315;
+		else
+			tdir = d[2] == 90 ? 135 : 215;
+
+		if (tdir != turnAround && SV_StepDirection(actor, tdir, dist))
+			return;
+	}
+
+	// try other directions
+	if (0 != Engine_RandomLong(0, 1) || fabs(deltaY) > fabs(deltaX))
+	{
+		const float tdir = d[1];
+		d[1] = d[2];
+		d[2] = tdir;
+	}
+
+	if (d[1] != DI_NODIR && d[1] != turnAround && SV_StepDirection(actor, d[1], dist))
+		return;
+
+	if (d[2] != DI_NODIR && d[2] != turnAround && SV_StepDirection(actor, d[2], dist))
+		return;
+
+	// there is no direct path to the player, so pick another direction
+	if (oldDir != DI_NODIR && SV_StepDirection(actor, oldDir, dist))
+		return;
+
+	// randomly determine direction of search
+	if (0 != Engine_RandomLong(0, 1))
+	{
+		for (float tdir = 0; tdir <= 315; tdir += 45)
+		{
+			if (tdir != turnAround && SV_StepDirection(actor, tdir, dist))
+				return;
+		}
+	}
+	else
+	{
+		for (float tdir = 315; tdir >= 0; tdir -= 45)
+		{
+			if (tdir != turnAround && SV_StepDirection(actor, tdir, dist))
+				return;
+		}
+	}
+
+	if (turnAround != DI_NODIR && SV_StepDirection(actor, turnAround, dist))
+		return;
+
+	actor->v.ideal_yaw = oldDir; // can't move
+
+	// if a bridge was pulled out from underneath a monster, it may not have
+	// a valid standing position at all
+	if (!SV_CheckBottom(actor))
+		actor->v.flags |= FL_PARTIALGROUND;
+}
+
+void SV_MoveToOrigin(edict_t* ent, const float* goal, float dist, int moveType)
+{
+	if ((ent->v.flags & (FL_ONGROUND | FL_FLY | FL_SWIM)) == 0)
+		return;
+
+	if (0 != moveType)
+	{
+		// strafe towards the goal
+		Vector direction = Vector(goal) - ent->v.origin;
+
+		if ((ent->v.flags & (FL_FLY | FL_SWIM)) == 0)
+			direction[2] = 0;
+
+		direction = direction.Normalize() * dist;
+
+		SV_MoveStep(ent, direction, false, MOVE_NORMAL);
+		SV_LinkEdict(ent, true);
+		return;
+	}
+
+	if (!SV_StepDirection(ent, ent->v.ideal_yaw, dist))
+		SV_NewChaseDir(ent, goal, dist);
+}
+
+int SV_DropToFloor(edict_t* ent)
+{
+	Vector end = ent->v.origin;
+	end[2] -= 256;
+
+	const trace_t trace = SV_Move(ent->v.origin, ent->v.mins, ent->v.maxs, end, MOVE_NORMAL, ent);
+
+	if (0 != trace.allsolid)
+		return -1;
+
+	if (trace.fraction == 1)
+		return 0;
+
+	ent->v.origin = trace.endpos;
+	SV_LinkEdict(ent, false);
+	ent->v.flags |= FL_ONGROUND;
+	ent->v.groundentity = trace.ent;
+
+	return 1;
+}
+
+//=========================================================
+// Visibility
+//=========================================================
+static std::vector<unsigned char> g_FatPVS;
+static std::vector<unsigned char> g_FatPAS;
+static std::vector<unsigned char> g_LeafPVS;
+
+//=========================================================
+// SV_AddToFatPVS - ORs in the PVS of every leaf within 8
+// units of the origin, so the view doesn't flicker when it
+// is right on a leaf boundary.
+//=========================================================
+static void SV_AddToFatPVS(const Vector& origin, std::vector<unsigned char>& pvs)
+{
+	short leafs[128];
+
+	const int count = std::min(Bsp_BoxLeafs(origin - Vector(8, 8, 8), origin + Vector(8, 8, 8), leafs, 128), 128);
+
+	g_LeafPVS.resize(Bsp_PVSBytes());
+
+	for (int i = 0; i < count; i++)
+	{
+		Bsp_LeafPVS(leafs[i] + 1, g_LeafPVS.data());
+
+		for (std::size_t j = 0; j < pvs.size(); j++)
+			pvs[j] |= g_LeafPVS[j];
+	}
+}
+
+unsigned char* SV_SetFatPVS(float* origin)
+{
+	g_FatPVS.assign(Bsp_PVSBytes(), 0);
+
+	SV_AddToFatPVS(origin, g_FatPVS);
+
+	return g_FatPVS.data();
+}
+
+unsigned char* SV_SetFatPAS(float* origin)
+{
+	// There's no PAS in the map, the PVS is close enough.
+	g_FatPAS.assign(Bsp_PVSBytes(), 0);
+
+	SV_AddToFatPVS(origin, g_FatPAS);
+
+	return g_FatPAS.data();
+}
+
+int SV_CheckVisibility(const edict_t* ent, unsigned char* pset)
+{
+	if (!pset)
+		return 1;
+
+	if (ent->headnode >= 0)
+		return 1; // touches too many leafs to list
+
+	for (int i = 0; i < ent->num_leafs; i++)
+	{
+		const int leaf = ent->leafnums[i];
+
+		if ((pset[leaf >> 3] & (1 << (leaf & 7))) != 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static const unsigned char* SV_PVSForEntity(const edict_t* ed)
+{
+	const Vector view = ed->v.origin + ed->v.view_ofs;
+
+	g_LeafPVS.resize(Bsp_PVSBytes());
+	Bsp_LeafPVS(Bsp_PointLeaf(view), g_LeafPVS.data());
+
+	return g_LeafPVS.data();
+}
+
+edict_t* SV_FindClientInPVS(edict_t* ed)
+{
+	const unsigned char* pvs = SV_PVSForEntity(ed);
+
+	for (int i = 1; i <= g_Globals.maxClients; i++)
+	{
+		edict_t* client = &g_Edicts[i];
+
+		if (0 != client->free || !client->pvPrivateData || client->v.health <= 0 || (client->v.flags & FL_NOTARGET) != 0)
+			continue;
+
+		const int leaf = Bsp_PointLeaf(client->v.origin + client->v.view_ofs) - 1;
+
+		if (leaf >= 0 && (pvs[leaf >> 3] & (1 << (leaf & 7))) != 0)
+			return client;
+	}
+
+	return g_Edicts;
+}
+
+edict_t* SV_EntitiesInPVS(edict_t* player)
+{
+	const unsigned char* pvs = SV_PVSForEntity(player);
+
+	edict_t* chain = g_Edicts;
+
+	for (int i = 1; i < g_NumEdicts; i++)
+	{
+		edict_t* ent = &g_Edicts[i];
+
+		if (0 != ent->free || !ent->pvPrivateData)
+			continue;
+
+		const int leaf = Bsp_PointLeaf(ent->v.origin) - 1;
+
+		if (leaf < 0 || (pvs[leaf >> 3] & (1 << (leaf & 7))) == 0)
+			continue;
+
+		ent->v.chain = chain;
+		chain = ent;
+	}
+
+	return chain;
+}
+
+//=========================================================
+// Player movement
+//=========================================================
+static playermove_t g_PlayerMove;
+
+//=========================================================
+// PM_HullForPhysent - gets the hull to trace against and
+// the offset to apply to the trace, for the player's
+// current hull.
+//=========================================================
+static void* PM_HullForPhysent(physent_t* pe, Vector& offset)
+{
+	playermove_t* pmove = &g_PlayerMove;
+
+	const model_s* model = reinterpret_cast<const model_s*>(pe->model);
+
+	if (model && model->Type == BENCH_MOD_BRUSH)
+	{
+		int hullNumber;
+
+		switch (pmove->usehull)
+		{
+		case 1:
+			hullNumber = 3;
+			break;
+		case 2:
+			hullNumber = 0;
+			break;
+		case 3:
+			hullNumber = 2;
+			break;
+		default:
+			hullNumber = 1;
+			break;
+		}
+
+		Vector clipMins, clipMaxs;
+		Bsp_HullSize(hullNumber, clipMins, clipMaxs);
+
+		offset = clipMins - pmove->player_mins[pmove->usehull] + pe->origin;
+
+		return Bsp_ModelHull(model->BspModel, hullNumber);
+	}
+
+	offset = pe->origin;
+
+	return Bsp_BoxHull(pe->mins - pmove->player_maxs[pmove->usehull], pe->maxs - pmove->player_mins[pmove->usehull]);
+}
+
+static void* PM_HullForBsp(physent_t* pe, float* offset)
+{
+	Vector hullOffset;
+	void* hull = PM_HullForPhysent(pe, hullOffset);
+
+	VectorCopy(hullOffset, offset);
+
+	return hull;
+}
+
+static bool PM_IsWaterBrush(const physent_t* pe)
+{
+	return pe->model && pe->solid == SOLID_NOT && pe->skin != 0;
+}
+
+static pmtrace_t PM_PlayerTraceImpl(const float* start, const float* end, int traceFlags, int ignorePe, int (*pfnIgnore)(physent_t* pe))
+{
+	playermove_t* pmove = &g_PlayerMove;
+
+	pmtrace_t total{};
+	total.fraction = 1;
+	total.ent = -1;
+	total.endpos = end;
+
+	for (int i = 0; i < pmove->numphysent; i++)
+	{
+		physent_t* pe = &pmove->physents[i];
+
+		if (i > 0 && (traceFlags & PM_WORLD_ONLY) != 0)
+			break;
+
+		if (pfnIgnore ? 0 != pfnIgnore(pe) : i == ignorePe)
+			continue;
+
+		if (PM_IsWaterBrush(pe))
+			continue;
+
+		if ((traceFlags & PM_GLASS_IGNORE) != 0 && pe->rendermode != kRenderNormal)
+			continue;
+
+		Vector offset;
+		void* hull = PM_HullForPhysent(pe, offset);
+
+		Vector startLocal = Vector(start) - offset;
+		Vector endLocal = Vector(end) - offset;
+
+		const bool rotated = pe->solid == SOLID_BSP && pe->angles != g_vecZero;
+		Vector forward, right, up;
+
+		if (rotated)
+		{
+			Engine_AngleVectors(pe->angles, forward, right, up);
+
+			startLocal = SV_RotateIntoEntity(startLocal, forward, right, up);
+			endLocal = SV_RotateIntoEntity(endLocal, forward, right, up);
+		}
+
+		BspTrace result;
+		Bsp_InitTrace(result, endLocal);
+		Bsp_ClipToHull(hull, startLocal, endLocal, result);
+
+		pmtrace_t trace{};
+		trace.allsolid = result.AllSolid ? 1 : 0;
+		trace.startsolid = result.StartSolid ? 1 : 0;
+		trace.inopen = result.InOpen ? 1 : 0;
+		trace.inwater = result.InWater ? 1 : 0;
+		trace.fraction = result.Fraction;
+		trace.plane.normal = result.PlaneNormal;
+		trace.plane.dist = result.PlaneDist;
+		trace.ent = i;
+
+		if (0 != trace.allsolid)
+			trace.startsolid = 1;
+
+		if (0 != trace.startsolid)
+			trace.fraction = 0;
+
+		if (trace.fraction != 1)
+		{
+			if (rotated)
+			{
+				Engine_AngleVectors(-pe->angles, forward, right, up);
+				trace.plane.normal = SV_RotateIntoEntity(trace.plane.normal, forward, right, up);
+			}
+
+			trace.endpos = Vector(start) + trace.fraction * (Vector(end) - Vector(start));
+		}
+		else
+		{
+			trace.endpos = end;
+		}
+
+		if (trace.fraction < total.fraction)
+		{
+			total = trace;
+		}
+		else if (0 != trace.startsolid)
+		{
+			total.startsolid = 1;
+		}
+
+		if (0 != total.allsolid)
+			break;
+	}
+
+	return total;
+}
+
+static pmtrace_t PM_PlayerTrace(float* start, float* end, int traceFlags, int ignorePe)
+{
+	return PM_PlayerTraceImpl(start, end, traceFlags, ignorePe, nullptr);
+}
+
+static pmtrace_t PM_PlayerTraceEx(float* start, float* end, int traceFlags, int (*pfnIgnore)(physent_t* pe))
+{
+	return PM_PlayerTraceImpl(start, end, traceFlags, -1, pfnIgnore);
+}
+
+static pmtrace_t* PM_TraceLineImpl(float* start, float* end, int flags, int useHull, int ignorePe, int (*pfnIgnore)(physent_t* pe))
+{
+	static pmtrace_t trace;
+
+	const int oldHull = g_PlayerMove.usehull;
+
+	g_PlayerMove.usehull = useHull;
+	trace = PM_PlayerTraceImpl(start, end, PM_NORMAL, ignorePe, pfnIgnore);
+	g_PlayerMove.usehull = oldHull;
+
+	return &trace;
+}
+
+static pmtrace_t* PM_TraceLine(float* start, float* end, int flags, int useHull, int ignorePe)
+{
+	return PM_TraceLineImpl(start, end, flags, useHull, ignorePe, nullptr);
+}
+
+static pmtrace_t* PM_TraceLineEx(float* start, float* end, int flags, int useHull, int (*pfnIgnore)(physent_t* pe))
+{
+	return PM_TraceLineImpl(start, end, flags, useHull, -1, pfnIgnore);
+}
+
+static int PM_TestPlayerPositionImpl(float* pos, pmtrace_t* ptrace, int (*pfnIgnore)(physent_t* pe))
+{
+	playermove_t* pmove = &g_PlayerMove;
+
+	const pmtrace_t trace = PM_PlayerTraceImpl(pos, pos, PM_NORMAL, -1, pfnIgnore);
+
+	if (ptrace)
+		*ptrace = trace;
+
+	for (int i = 0; i < pmove->numphysent; i++)
+	{
+		physent_t* pe = &pmove->physents[i];
+
+		if (pfnIgnore && 0 != pfnIgnore(pe))
+			continue;
+
+		if (PM_IsWaterBrush(pe))
+			continue;
+
+		Vector offset;
+		void* hull = PM_HullForPhysent(pe, offset);
+
+		Vector test = Vector(pos) - offset;
+
+		if (pe->solid == SOLID_BSP && pe->angles != g_vecZero)
+		{
+			Vector forward, right, up;
+			Engine_AngleVectors(pe->angles, forward, right, up);
+			test = SV_RotateIntoEntity(test, forward, right, up);
+		}
+
+		if (Bsp_HullPointContents(hull, Bsp_HullFirstClipNode(hull), test) == CONTENTS_SOLID)
+			return i;
+	}
+
+	return -1; // didn't hit anything
+}
+
+static int PM_TestPlayerPosition(float* pos, pmtrace_t* ptrace)
+{
+	return PM_TestPlayerPositionImpl(pos, ptrace, nullptr);
+}
+
+static int PM_TestPlayerPositionEx(float* pos, pmtrace_t* ptrace, int (*pfnIgnore)(physent_t* pe))
+{
+	return PM_TestPlayerPositionImpl(pos, ptrace, pfnIgnore);
+}
+
+static int PM_PointContents(float* point, int* trueContents)
+{
+	playermove_t* pmove = &g_PlayerMove;
+
+	int contents = SV_TruePointContents(point);
+
+	if (trueContents)
+		*trueContents = contents;
+
+	if (contents <= CONTENTS_CURRENT_0 && contents >= CONTENTS_CURRENT_DOWN)
+		contents = CONTENTS_WATER;
+
+	if (contents == CONTENTS_SOLID)
+		return contents;
+
+	for (int i = 1; i < pmove->numphysent; i++)
+	{
+		physent_t* pe = &pmove->physents[i];
+
+		if (!PM_IsWaterBrush(pe))
+			continue;
+
+		const model_s* model = reinterpret_cast<const model_s*>(pe->model);
+		void* hull = Bsp_ModelHull(model->BspModel, 0);
+
+		const Vector test = Vector(point) - pe->origin;
+
+		if (Bsp_HullPointContents(hull, Bsp_HullFirstClipNode(hull), test) != CONTENTS_EMPTY)
+			return pe->skin;
+	}
+
+	return contents;
+}
+
+static int PM_TruePointContents(float* point)
+{
+	return SV_TruePointContents(point);
+}
+
+static int PM_HullPointContents(struct hull_s* hull, int num, float* point)
+{
+	return Bsp_HullPointContents(hull, num, point);
+}
+
+static float PM_TraceModel(physent_t* pe, const float* start, const float* end, trace_t* trace)
+{
+	playermove_t* pmove = &g_PlayerMove;
+
+	const int oldHull = pmove->usehull;
+	pmove->usehull = 2;
+
+	Vector offset;
+	void* hull = PM_HullForPhysent(pe, offset);
+
+	pmove->usehull = oldHull;
+
+	const Vector startLocal = Vector(start) - offset;
+	const Vector endLocal = Vector(end) - offset;
+
+	BspTrace result;
+	Bsp_InitTrace(result, endLocal);
+	Bsp_ClipToHull(hull, startLocal, endLocal, result);
+
+	*trace = SV_ToTrace(result);
+	trace->endpos = trace->endpos + offset;
+
+	return trace->fraction;
+}
+
+static const char* PM_TraceTexture(int ground, float* start, float* end)
+{
+	if (ground < 0 || ground >= g_PlayerMove.numphysent)
+		return nullptr;
+
+	const physent_t* pe = &g_PlayerMove.physents[ground];
+	const model_s* model = reinterpret_cast<const model_s*>(pe->model);
+
+	if (!model || model->Type != BENCH_MOD_BRUSH)
+		return nullptr;
+
+	return Bsp_TraceTexture(model->BspModel, Vector(start) - pe->origin, Vector(end) - pe->origin);
+}
+
+static int PM_GetModelType(model_t* model)
+{
+	return reinterpret_cast<model_s*>(model)->Type;
+}
+
+static void PM_GetModelBounds(model_t* model, float* mins, float* maxs)
+{
+	const model_s* benchModel = reinterpret_cast<model_s*>(model);
+
+	VectorCopy(benchModel->Mins, mins);
+	VectorCopy(benchModel->Maxs, maxs);
+}
+
+static void PM_StuckTouch(int hitEnt, pmtrace_t* traceResult)
+{
+	playermove_t* pmove = &g_PlayerMove;
+
+	if (pmove->numtouch >= MAX_PHYSENTS)
+		return;
+
+	for (int i = 0; i < pmove->numtouch; i++)
+	{
+		if (pmove->touchindex[i].ent == hitEnt)
+			return;
+	}
+
+	pmove->touchindex[pmove->numtouch] = *traceResult;
+	pmove->touchindex[pmove->numtouch].ent = hitEnt;
+	++pmove->numtouch;
+}
+
+static void PM_Particle(float* origin, int color, float life, int zpos, int zvel)
+{
+}
+
+static void PM_PlaySound(int channel, const char* sample, float volume, float attenuation, int flags, int pitch)
+{
+}
+
+static void PM_PlaybackEventFull(int flags, int clientIndex, unsigned short eventIndex, float delay, float* origin, float* angles,
+	float fparam1, float fparam2, int iparam1, int iparam2, int bparam1, int bparam2)
+{
+}
+
+static void PM_Con_NPrintf(int idx, const char* format, ...)
+{
+}
+
+static void PM_Con_Printf(const char* format, ...)
+{
+	if (Cvar_Value("developer") < 1)
+		return;
+
+	va_list list;
+	va_start(list, format);
+	vprintf(format, list);
+	va_end(list);
+}
+
+static double PM_Sys_FloatTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int PM_COM_FileSize(const char* fileName)
+{
+	int length = 0;
+	byte* data = Engine_LoadFile(fileName, &length);
+
+	if (!data)
+		return -1;
+
+	Engine_FreeFile(data);
+
+	return length;
+}
+
+static byte* PM_COM_LoadFile(const char* path, int useHunk, int* length)
+{
+	return Engine_LoadFile(path, length);
+}
+
+static char* PM_memfgets(byte* memFile, int fileSize, int* filePos, char* buffer, int bufferSize)
+{
+	if (!memFile || !buffer || !filePos || *filePos >= fileSize)
+		return nullptr;
+
+	int i = *filePos;
+	const int last = std::min(fileSize, *filePos + bufferSize - 1);
+
+	// Stop at the end of the line
+	while (i < last)
+	{
+		if (memFile[i++] == '\n')
+			break;
+	}
+
+	const int size = i - *filePos;
+
+	memcpy(buffer, memFile + *filePos, size);
+	buffer[size] = '\0';
+
+	*filePos = i;
+
+	return buffer;
+}
+
+void SV_InitPlayerMove()
+{
+	playermove_t* pmove = &g_PlayerMove;
+
+	memset(pmove, 0, sizeof(*pmove));
+
+	pmove->server = 1;
+	pmove->movevars = &g_MoveVars;
+
+	for (int i = 0; i < 4; i++)
+	{
+		if (0 == g_GameFuncs.pfnGetHullBounds(i, pmove->player_mins[i], pmove->player_maxs[i]))
+			Bsp_HullSize(i, pmove->player_mins[i], pmove->player_maxs[i]);
+	}
+
+	pmove->PM_Info_ValueForKey = &Info_ValueForKey;
+	pmove->PM_Particle = &PM_Particle;
+	pmove->PM_TestPlayerPosition = &PM_TestPlayerPosition;
+	pmove->Con_NPrintf = &PM_Con_NPrintf;
+	pmove->Con_DPrintf = &PM_Con_Printf;
+	pmove->Con_Printf = &PM_Con_Printf;
+	pmove->Sys_FloatTime = &PM_Sys_FloatTime;
+	pmove->PM_StuckTouch = &PM_StuckTouch;
+	pmove->PM_PointContents = &PM_PointContents;
+	pmove->PM_TruePointContents = &PM_TruePointContents;
+	pmove->PM_HullPointContents = &PM_HullPointContents;
+	pmove->PM_PlayerTrace = &PM_PlayerTrace;
+	pmove->PM_TraceLine = &PM_TraceLine;
+	pmove->RandomLong = &Engine_RandomLong;
+	pmove->RandomFloat = &Engine_RandomFloat;
+	pmove->PM_GetModelType = &PM_GetModelType;
+	pmove->PM_GetModelBounds = &PM_GetModelBounds;
+	pmove->PM_HullForBsp = &PM_HullForBsp;
+	pmove->PM_TraceModel = &PM_TraceModel;
+	pmove->COM_FileSize = &PM_COM_FileSize;
+	pmove->COM_LoadFile = &PM_COM_LoadFile;
+	pmove->COM_FreeFile = &Engine_FreeFile;
+	pmove->memfgets = &PM_memfgets;
+	pmove->PM_PlaySound = &PM_PlaySound;
+	pmove->PM_TraceTexture = &PM_TraceTexture;
+	pmove->PM_PlaybackEventFull = &PM_PlaybackEventFull;
+	pmove->PM_PlayerTraceEx = &PM_PlayerTraceEx;
+	pmove->PM_TestPlayerPositionEx = &PM_TestPlayerPositionEx;
+	pmove->PM_TraceLineEx = &PM_TraceLineEx;
+
+	g_GameFuncs.pfnPM_Init(pmove);
+}
+
+static void SV_SetupPhysent(physent_t* pe, edict_t* ent)
+{
+	memset(pe, 0, sizeof(*pe));
+
+	const model_s* model = Mod_ForIndex(ent->v.modelindex);
+
+	if ((ent->v.flags & FL_CLIENT) != 0)
+	{
+		strcpy(pe->name, "player");
+		pe->player = ED_Index(ent);
+	}
+	else if (model)
+	{
+		strncpy(pe->name, model->Name.c_str(), sizeof(pe->name) - 1);
+	}
+
+	pe->origin = ent->v.origin;
+	pe->model = model && model->Type == BENCH_MOD_BRUSH && (ent->v.solid == SOLID_BSP || ent->v.solid == SOLID_NOT) ? reinterpret_cast<model_t*>(const_cast<model_s*>(model)) : nullptr;
+	pe->mins = ent->v.mins;
+	pe->maxs = ent->v.maxs;
+	pe->info = ED_Index(ent);
+	pe->angles = ent->v.angles;
+	pe->solid = ent->v.solid;
+	pe->skin = ent->v.skin;
+	pe->rendermode = ent->v.rendermode;
+	pe->frame = ent->v.frame;
+	pe->sequence = ent->v.sequence;
+	memcpy(pe->controller, ent->v.controller, sizeof(pe->controller));
+	memcpy(pe->blending, ent->v.blending, sizeof(pe->blending));
+	pe->movetype = ent->v.movetype;
+	pe->takedamage = static_cast<int>(ent->v.takedamage);
+	pe->team = ent->v.team;
+	pe->classnumber = ent->v.playerclass;
+	pe->iuser1 = ent->v.iuser1;
+	pe->iuser2 = ent->v.iuser2;
+	pe->iuser3 = ent->v.iuser3;
+	pe->iuser4 = ent->v.iuser4;
+	pe->fuser1 = ent->v.fuser1;
+	pe->fuser2 = ent->v.fuser2;
+	pe->fuser3 = ent->v.fuser3;
+	pe->fuser4 = ent->v.fuser4;
+	pe->vuser1 = ent->v.vuser1;
+	pe->vuser2 = ent->v.vuser2;
+	pe->vuser3 = ent->v.vuser3;
+	pe->vuser4 = ent->v.vuser4;
+}
+
+//=========================================================
+// SV_AddLinksToPmove - adds the world and every entity
+// near the player that it can collide with to physents,
+// and ladders to moveents.
+//=========================================================
+static void SV_AddLinksToPmove(edict_t* player)
+{
+	playermove_t* pmove = &g_PlayerMove;
+
+	SV_SetupPhysent(&pmove->physents[0], g_Edicts);
+	strcpy(pmove->physents[0].name, "world");
+
+	pmove->numphysent = 1;
+	pmove->nummoveent = 0;
+	pmove->numvisent = 0;
+
+	const Vector mins = player->v.origin - Vector(256, 256, 256);
+	const Vector maxs = player->v.origin + Vector(256, 256, 256);
+
+	for (int i = 1; i < g_NumEdicts; i++)
+	{
+		edict_t* check = &g_Edicts[i];
+
+		if (0 != check->free || check == player || check->v.owner == player)
+			continue;
+
+		if (check->v.solid == SOLID_TRIGGER)
+			continue;
+
+		// water brushes and ladders are the only non-solid entities the player interacts with
+		if (check->v.solid == SOLID_NOT && check->v.skin == 0)
+			continue;
+
+		if ((check->v.flags & FL_CLIENT) != 0 && check->v.health <= 0)
+			continue;
+
+		if (!SV_BoxesOverlap(check->v.absmin, check->v.absmax, mins, maxs))
+			continue;
+
+		const model_s* model = Mod_ForIndex(check->v.modelindex);
+
+		if (check->v.skin == CONTENTS_LADDER && model && model->Type == BENCH_MOD_BRUSH)
+		{
+			if (pmove->nummoveent < MAX_MOVEENTS)
+				SV_SetupPhysent(&pmove->moveents[pmove->nummoveent++], check);
+
+			continue;
+		}
+
+		if (pmove->numphysent < MAX_PHYSENTS)
+			SV_SetupPhysent(&pmove->physents[pmove->numphysent++], check);
+	}
+}
+
+void SV_RunCmd(edict_t* player, const usercmd_t& cmd, unsigned int randomSeed)
+{
+	playermove_t* pmove = &g_PlayerMove;
+
+	const float frameTime = cmd.msec * 0.001f;
+
+	g_GameFuncs.pfnCmdStart(player, &cmd, randomSeed);
+
+	player->v.button = cmd.buttons;
+
+	if (0 != cmd.impulse)
+		player->v.impulse = cmd.impulse;
+
+	player->v.v_angle = cmd.viewangles;
+
+	if (0 == player->v.fixangle)
+	{
+		player->v.angles[PITCH] = -player->v.v_angle[PITCH] / 3;
+		player->v.angles[YAW] = player->v.v_angle[YAW];
+	}
+
+	player->v.clbasevelocity = g_vecZero;
+
+	const float frameTimeSaved = g_Globals.frametime;
+	g_Globals.frametime = frameTime;
+
+	g_GameFuncs.pfnPlayerPreThink(player);
+
+	SV_RunThink(player);
+
+	if (0 != player->free)
+		return;
+
+	SV_AddLinksToPmove(player);
+
+	pmove->player_index = ED_Index(player) - 1;
+	pmove->multiplayer = g_Globals.maxClients > 1 ? 1 : 0;
+	pmove->time = g_Globals.time * 1000;
+	pmove->frametime = frameTime;
+	pmove->origin = player->v.origin;
+	pmove->oldangles = pmove->angles;
+	pmove->angles = cmd.viewangles;
+	pmove->velocity = player->v.velocity;
+	pmove->movedir = player->v.movedir;
+	pmove->basevelocity = player->v.basevelocity;
+	pmove->view_ofs = player->v.view_ofs;
+	pmove->flDuckTime = player->v.flDuckTime;
+	pmove->bInDuck = player->v.bInDuck;
+	pmove->flTimeStepSound = player->v.flTimeStepSound;
+	pmove->iStepLeft = player->v.iStepLeft;
+	pmove->flFallVelocity = player->v.flFallVelocity;
+	pmove->punchangle = player->v.punchangle;
+	pmove->flSwimTime = player->v.flSwimTime;
+	pmove->flNextPrimaryAttack = 0;
+	pmove->effects = player->v.effects;
+	pmove->flags = player->v.flags;
+	pmove->usehull = (player->v.flags & FL_DUCKING) != 0 ? 1 : 0;
+	pmove->gravity = player->v.gravity;
+	pmove->friction = player->v.friction;
+	pmove->oldbuttons = player->v.oldbuttons;
+	pmove->waterjumptime = player->v.teleport_time;
+	pmove->dead = player->v.health <= 0 ? 1 : 0;
+	pmove->deadflag = player->v.deadflag;
+	pmove->spectator = 0;
+	pmove->movetype = player->v.movetype;
+	pmove->onground = -1;
+	pmove->waterlevel = player->v.waterlevel;
+	pmove->watertype = player->v.watertype;
+	pmove->maxspeed = g_MoveVars.maxspeed;
+	pmove->clientmaxspeed = player->v.maxspeed;
+	pmove->iuser1 = player->v.iuser1;
+	pmove->iuser2 = player->v.iuser2;
+	pmove->iuser3 = player->v.iuser3;
+	pmove->iuser4 = player->v.iuser4;
+	pmove->fuser1 = player->v.fuser1;
+	pmove->fuser2 = player->v.fuser2;
+	pmove->fuser3 = player->v.fuser3;
+	pmove->fuser4 = player->v.fuser4;
+	pmove->vuser1 = player->v.vuser1;
+	pmove->vuser2 = player->v.vuser2;
+	pmove->vuser3 = player->v.vuser3;
+	pmove->vuser4 = player->v.vuser4;
+	pmove->cmd = cmd;
+	pmove->numtouch = 0;
+	pmove->runfuncs = 1;
+	strncpy(pmove->physinfo, Engine_GetPhysicsInfoString(player), MAX_PHYSINFO_STRING - 1);
+
+	g_GameFuncs.pfnPM_Move(pmove, 1);
+
+	player->v.origin = pmove->origin;
+	player->v.velocity = pmove->velocity;
+	player->v.basevelocity = pmove->basevelocity;
+	player->v.view_ofs = pmove->view_ofs;
+	player->v.movedir = pmove->movedir;
+	player->v.flDuckTime = pmove->flDuckTime;
+	player->v.bInDuck = pmove->bInDuck;
+	player->v.flTimeStepSound = pmove->flTimeStepSound;
+	player->v.iStepLeft = pmove->iStepLeft;
+	player->v.flFallVelocity = pmove->flFallVelocity;
+	player->v.punchangle = pmove->punchangle;
+	player->v.flSwimTime = pmove->flSwimTime;
+	player->v.effects = pmove->effects;
+	player->v.flags = pmove->flags;
+	player->v.friction = pmove->friction;
+	player->v.oldbuttons = pmove->cmd.buttons;
+	player->v.teleport_time = pmove->waterjumptime;
+	player->v.movetype = pmove->movetype;
+	player->v.waterlevel = pmove->waterlevel;
+	player->v.watertype = pmove->watertype;
+	player->v.iuser1 = pmove->iuser1;
+	player->v.iuser2 = pmove->iuser2;
+	player->v.iuser3 = pmove->iuser3;
+	player->v.iuser4 = pmove->iuser4;
+	player->v.fuser1 = pmove->fuser1;
+	player->v.fuser2 = pmove->fuser2;
+	player->v.fuser3 = pmove->fuser3;
+	player->v.fuser4 = pmove->fuser4;
+	player->v.vuser1 = pmove->vuser1;
+	player->v.vuser2 = pmove->vuser2;
+	player->v.vuser3 = pmove->vuser3;
+	player->v.vuser4 = pmove->vuser4;
+
+	if (pmove->onground >= 0 && pmove->onground < pmove->numphysent)
+	{
+		player->v.groundentity = &g_Edicts[pmove->physents[pmove->onground].info];
+		player->v.flags |= FL_ONGROUND;
+	}
+	else
+	{
+		player->v.groundentity = nullptr;
+		player->v.flags &= ~FL_ONGROUND;
+	}
+
+	SV_LinkEdict(player, true);
+
+	// touch the entities the movement ran into
+	for (int i = 0; i < pmove->numtouch; i++)
+	{
+		const pmtrace_t& touch = pmove->touchindex[i];
+
+		if (touch.ent < 0 || touch.ent >= pmove->numphysent)
+			continue;
+
+		edict_t* ent = &g_Edicts[pmove->physents[touch.ent].info];
+
+		if (ent == g_Edicts || 0 != ent->free || 0 != player->free)
+			continue;
+
+		trace_t trace{};
+		trace.allsolid = touch.allsolid;
+		trace.startsolid = touch.startsolid;
+		trace.inopen = touch.inopen;
+		trace.inwater = touch.inwater;
+		trace.fraction = touch.fraction;
+		trace.endpos = touch.endpos;
+		trace.plane.normal = touch.plane.normal;
+		trace.plane.dist = touch.plane.dist;
+		trace.ent = ent;
+
+		SV_Impact(ent, player, trace);
+	}
+
+	g_GameFuncs.pfnPlayerPostThink(player);
+	g_GameFuncs.pfnCmdEnd(player);
+
+	g_Globals.frametime = frameTimeSaved;
+}